@@ -24,6 +24,8 @@
 
 #include <boost/shared_ptr.hpp>
 
+#include "Common/Serialization.h"
+
 #include "Event.h"
 
 namespace Hypertable {
@@ -63,6 +65,21 @@ namespace Hypertable {
      */
     uint64_t get_thread_group() { return (m_event_ptr) ? m_event_ptr->thread_group : 0; }
 
+    /** Returns the type of this request, which the ApplicationQueue keys its
+     * statistics by.  By convention, request messages start with a 16-bit
+     * command code, which is returned here.  Handlers not created from a
+     * message get REQUEST_TYPE_NONE.
+     */
+    virtual uint16_t get_request_type() {
+      if (!m_event_ptr || m_event_ptr->message_len < 2)
+        return REQUEST_TYPE_NONE;
+      const uint8_t *ptr = m_event_ptr->message;
+      size_t remaining = m_event_ptr->message_len;
+      return Serialization::decode_i16(&ptr, &remaining);
+    }
+
+    static const uint16_t REQUEST_TYPE_NONE = 0xffff;
+
   protected:
     EventPtr m_event_ptr;
   };
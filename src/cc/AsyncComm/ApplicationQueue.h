@@ -23,7 +23,14 @@
 #define HYPERTABLE_APPLICATIONQUEUE_H
 
 #include <cassert>
-#include <list>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <vector>
+
+extern "C" {
+#include <sys/time.h>
+}
 
 #include <boost/thread/condition.hpp>
 #include <boost/thread/mutex.hpp>
@@ -41,99 +48,358 @@ namespace Hypertable {
   /**
    * Provides application work queue and worker threads.  It maintains a queue of requests and a pool
    * of threads that pull requests off the queue and carry them out.
+   *
+   * Each worker has its own queue of runnable requests, with its own mutex
+   * and condition variable.  New requests are dealt out to the worker
+   * queues round-robin, and a worker whose queue is empty takes the oldest
+   * request from another worker's queue.  A worker that finds no request
+   * anywhere goes to sleep on its own condition variable; adding a request
+   * wakes the owner of the queue it was put on if that one is asleep, and
+   * otherwise one sleeping worker, if there is any, to take it.  While all
+   * workers are busy, adding and taking a request only locks one worker
+   * queue.  Requests of the same thread group are chained: only the oldest
+   * one of a group is ever in a worker queue, and when it finishes the
+   * worker that ran it queues the next one of the group for itself.  A
+   * backed up thread group therefore only occupies one worker and does not
+   * slow down the rest.
    */
   class ApplicationQueue : public ReferenceCount {
 
-    class UsageRec {
+  public:
+
+    /**
+     * Histogram with power of two buckets.  Bucket i counts values in
+     * [2^(i-1), 2^i), bucket 0 counts zeros.
+     */
+    class Histogram {
     public:
-      UsageRec() : thread_group(0), running(false), outstanding(1) { return; }
-      uint64_t thread_group;
-      bool     running;
-      int      outstanding;
+      enum { BUCKETS = 40 };
+
+      Histogram() : count(0), sum(0), max(0) {
+        memset(buckets, 0, sizeof(buckets));
+      }
+
+      void add(uint64_t value) {
+        int bucket = value ? 64 - __builtin_clzll(value) : 0;
+        if (bucket >= BUCKETS)
+          bucket = BUCKETS - 1;
+        buckets[bucket]++;
+        count++;
+        sum += value;
+        if (value > max)
+          max = value;
+      }
+
+      void merge(const Histogram &other) {
+        for (int i=0; i<BUCKETS; i++)
+          buckets[i] += other.buckets[i];
+        count += other.count;
+        sum += other.sum;
+        if (other.max > max)
+          max = other.max;
+      }
+
+      uint64_t mean() const { return count ? sum / count : 0; }
+
+      /**
+       * Returns an upper bound of the given percentile, that is, the top
+       * of the bucket it falls in (or the maximum, if that is lower)
+       *
+       * @param pct percentile, between 0 and 100
+       */
+      uint64_t percentile(double pct) const {
+        if (count == 0)
+          return 0;
+        uint64_t target = (uint64_t)(count * pct / 100.0);
+        uint64_t seen = 0;
+        if (target >= count)
+          target = count - 1;
+        for (int i=0; i<BUCKETS; i++) {
+          seen += buckets[i];
+          if (seen > target) {
+            uint64_t upper = i ? ((uint64_t)1 << i) - 1 : 0;
+            return upper < max ? upper : max;
+          }
+        }
+        return max;
+      }
+
+      uint64_t buckets[BUCKETS];
+      uint64_t count;
+      uint64_t sum;
+      uint64_t max;
+    };
+
+    /**
+     * Queue statistics for one request type
+     */
+    class RequestStatistics {
+    public:
+      /** requests ahead of this one in the worker queue or thread group
+       * chain it was added to */
+      Histogram queue_depth;
+      /** microseconds from being added to being started */
+      Histogram wait_micros;
+      /** microseconds spent in ApplicationHandler::run */
+      Histogram service_micros;
     };
 
-    typedef hash_map<uint64_t, UsageRec *> UsageRecMap;
+    /** Statistics keyed by ApplicationHandler::get_request_type() */
+    typedef std::map<uint16_t, RequestStatistics> StatisticsMap;
+
+  private:
+
+    class GroupRec;
 
     class WorkRec {
     public:
-      WorkRec(ApplicationHandler *ah) : handler(ah), usage(0) { return; }
+      WorkRec(ApplicationHandler *ah) : handler(ah), group(0), request_type(0),
+                                        queue_depth(0), added_micros(0) { return; }
       ~WorkRec() { delete handler; }
       ApplicationHandler   *handler;
-      UsageRec             *usage;
+      GroupRec             *group;
+      uint16_t              request_type;
+      uint32_t              queue_depth;
+      uint64_t              added_micros;
     };
 
-    class ApplicationQueueState {
+    /**
+     * A thread group with a request queued or running.  Requests that
+     * arrive for it in the meantime wait, in order, in the pending chain.
+     */
+    class GroupRec {
     public:
-      ApplicationQueueState() : queue(), usage_map(), queue_mutex(), usage_mutex(), cond(), shutdown(false) { return; }
-      std::list<WorkRec *> queue;
-      UsageRecMap         usage_map;
-      boost::mutex        queue_mutex;
-      boost::mutex        usage_mutex;
-      boost::condition    cond;
-      bool                shutdown;
+      GroupRec(uint64_t group) : thread_group(group) { return; }
+      uint64_t             thread_group;
+      std::deque<WorkRec *> pending;
     };
 
-    class Worker {
+    typedef hash_map<uint64_t, GroupRec *> GroupRecMap;
+
+    /**
+     * Part of the thread groups, by group id modulo the number of shards
+     */
+    class GroupShard {
+    public:
+      boost::mutex  mutex;
+      GroupRecMap   group_map;
+    };
+
+    /**
+     * Runnable requests of one worker.  The sleeping flag is set while the
+     * worker has found no request and waits, or is about to wait, on cond.
+     */
+    class WorkerQueue {
+    public:
+      WorkerQueue() : sleeping(false) { return; }
+      boost::mutex          mutex;
+      boost::condition      cond;
+      std::deque<WorkRec *> queue;
+      bool                  sleeping;
+    };
 
+    class WorkerStatistics {
     public:
+      boost::mutex   mutex;
+      StatisticsMap  stats;
+    };
 
-      Worker(ApplicationQueueState &qstate) : m_state(qstate) {
+    class ApplicationQueueState {
+    public:
+      ApplicationQueueState() : sleeping(0), next_queue(0), shutdown(false) {
         return;
       }
+      ~ApplicationQueueState() {
+        for (size_t i=0; i<queues.size(); i++) {
+          delete queues[i];
+          delete stats[i];
+          delete groups[i];
+        }
+      }
 
-      void operator()() {
-        WorkRec *rec = 0;
-        std::list<WorkRec *>::iterator iter;
+      GroupShard *group_shard(uint64_t thread_group) {
+        return groups[thread_group % groups.size()];
+      }
 
-        while (true) {
+      /**
+       * Puts a request on the given worker queue.  Wakes up the worker of
+       * that queue if it is sleeping, or else one sleeping worker to take
+       * the request from there.
+       *
+       * @param rec request to queue
+       * @param qi index of the worker queue
+       * @param added true if the request is being added, as opposed to
+       *        being the next one of its thread group
+       */
+      void push_runnable(WorkRec *rec, size_t qi, bool added) {
+        WorkerQueue *wq = queues[qi];
+        {
+          boost::mutex::scoped_lock lock(wq->mutex);
+          if (added)
+            rec->queue_depth = wq->queue.size();
+          wq->queue.push_back(rec);
+          if (wq->sleeping) {
+            wake(wq);
+            return;
+          }
+        }
+        // pairs with the increment of sleeping in Worker::next_request: if
+        // the worker did not see the request, it is seen sleeping here
+        if (__sync_fetch_and_add(&sleeping, 0) == 0)
+          return;
+        for (size_t i=1; i<queues.size(); i++) {
+          wq = queues[(qi + i) % queues.size()];
+          boost::mutex::scoped_lock lock(wq->mutex);
+          if (wq->sleeping) {
+            wake(wq);
+            return;
+          }
+        }
+      }
 
-          {  // !!! maybe ditch this block specifier
-            boost::mutex::scoped_lock lock(m_state.queue_mutex);
+      /**
+       * Wakes up the worker of a queue, whose mutex the caller holds
+       */
+      void wake(WorkerQueue *wq) {
+        wq->sleeping = false;
+        __sync_fetch_and_sub(&sleeping, 1);
+        wq->cond.notify_one();
+      }
 
-            while (m_state.queue.empty()) {
-              if (m_state.shutdown) {
-                HT_INFO("shutdown!");
-                return;
-              }
-              m_state.cond.wait(lock);
-            }
+      std::vector<WorkerQueue *> queues;
+      std::vector<WorkerStatistics *> stats;
+      std::vector<GroupShard *> groups;
+      uint32_t            sleeping;
+      uint32_t            next_queue;
+      volatile bool       shutdown;
+    };
 
-            {
-              boost::mutex::scoped_lock ulock(m_state.usage_mutex);
-
-              for (iter = m_state.queue.begin(); iter != m_state.queue.end(); iter++) {
-                rec = (*iter);
-                if (rec->usage == 0 || !rec->usage->running) {
-                  if (rec->usage)
-                    rec->usage->running = true;
-                  m_state.queue.erase(iter);
-                  break;
-                }
-                rec = 0;
-              }
-            }
+    static uint64_t get_micros() {
+      struct timeval tv;
+      gettimeofday(&tv, 0);
+      return (uint64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+    }
+
+    class Worker {
+
+    public:
+
+      Worker(ApplicationQueueState &qstate, size_t index)
+        : m_state(qstate), m_index(index) {
+        return;
+      }
+
+      void operator()() {
+        WorkRec *rec;
+        uint64_t start_micros, end_micros;
+
+        while ((rec = next_request()) != 0) {
+
+          start_micros = get_micros();
+          rec->handler->run();
+          end_micros = get_micros();
+
+          {
+            WorkerStatistics *ws = m_state.stats[m_index];
+            boost::mutex::scoped_lock lock(ws->mutex);
+            RequestStatistics &rs = ws->stats[rec->request_type];
+            rs.queue_depth.add(rec->queue_depth);
+            rs.wait_micros.add(start_micros - rec->added_micros);
+            rs.service_micros.add(end_micros - start_micros);
           }
 
-          if (rec) {
-            rec->handler->run();
-            if (rec->usage) {
-              boost::mutex::scoped_lock ulock(m_state.usage_mutex);
-              rec->usage->running = false;
-              rec->usage->outstanding--;
-              if (rec->usage->outstanding == 0) {
-                m_state.usage_map.erase(rec->usage->thread_group);
-                delete rec->usage;
+          if (rec->group) {
+            GroupRec *group = rec->group;
+            WorkRec *next = 0;
+            {
+              GroupShard *shard = m_state.group_shard(group->thread_group);
+              boost::mutex::scoped_lock lock(shard->mutex);
+              if (group->pending.empty()) {
+                shard->group_map.erase(group->thread_group);
+                delete group;
+              }
+              else {
+                next = group->pending.front();
+                group->pending.pop_front();
               }
             }
-            delete rec;
+            if (next)
+              m_state.push_runnable(next, m_index, false);
           }
+          delete rec;
         }
 
         HT_INFO("thread exit");
       }
 
     private:
+
+      /**
+       * Takes the next request from this worker's queue or, failing that,
+       * from the front of another worker's queue, sleeping until there is
+       * one.  Returns 0 on shutdown, once no request is left.
+       */
+      WorkRec *next_request() {
+        WorkerQueue *wq = m_state.queues[m_index];
+        WorkRec *rec;
+
+        while (true) {
+          {
+            boost::mutex::scoped_lock lock(wq->mutex);
+            if (!wq->queue.empty()) {
+              rec = wq->queue.front();
+              wq->queue.pop_front();
+              return rec;
+            }
+            // counted as sleeping before looking at the other queues, so
+            // that a request added to one of them meanwhile wakes us up
+            wq->sleeping = true;
+            __sync_fetch_and_add(&m_state.sleeping, 1);
+          }
+
+          rec = steal();
+
+          boost::mutex::scoped_lock lock(wq->mutex);
+          if (rec == 0) {
+            while (wq->sleeping && wq->queue.empty() && !m_state.shutdown)
+              wq->cond.wait(lock);
+          }
+          if (wq->sleeping) {
+            wq->sleeping = false;
+            __sync_fetch_and_sub(&m_state.sleeping, 1);
+          }
+          if (rec)
+            return rec;
+          if (m_state.shutdown && wq->queue.empty()) {
+            lock.unlock();
+            if ((rec = steal()) != 0)
+              return rec;
+            HT_INFO("shutdown!");
+            return 0;
+          }
+        }
+      }
+
+      /**
+       * Takes the oldest request of the first other worker queue that has
+       * one, or returns 0
+       */
+      WorkRec *steal() {
+        size_t count = m_state.queues.size();
+        for (size_t i=1; i<count; i++) {
+          WorkerQueue *wq = m_state.queues[(m_index + i) % count];
+          boost::mutex::scoped_lock lock(wq->mutex);
+          if (!wq->queue.empty()) {
+            WorkRec *rec = wq->queue.front();
+            wq->queue.pop_front();
+            return rec;
+          }
+        }
+        return 0;
+      }
+
       ApplicationQueueState &m_state;
+      size_t m_index;
     };
 
     boost::mutex           m_mutex;
@@ -150,11 +416,14 @@ namespace Hypertable {
      * @param worker_count number of worker threads to create
      */
     ApplicationQueue(int worker_count) : joined(false) {
-      Worker Worker(m_state);
       assert (worker_count > 0);
+      for (int i=0; i<worker_count; ++i) {
+        m_state.queues.push_back(new WorkerQueue());
+        m_state.stats.push_back(new WorkerStatistics());
+        m_state.groups.push_back(new GroupShard());
+      }
       for (int i=0; i<worker_count; ++i)
-        m_threads.create_thread(Worker);
-      //threads
+        m_threads.create_thread(Worker(m_state, i));
     }
 
     /**
@@ -163,8 +432,12 @@ namespace Hypertable {
      * of the shutdown.
      */
     void shutdown() {
-      m_state.shutdown = true;
-      m_state.cond.notify_all();
+      for (size_t i=0; i<m_state.queues.size(); i++) {
+        WorkerQueue *wq = m_state.queues[i];
+        boost::mutex::scoped_lock lock(wq->mutex);
+        m_state.shutdown = true;
+        wq->cond.notify_all();
+      }
     }
 
     /**
@@ -186,28 +459,48 @@ namespace Hypertable {
      * group ID is constructed in the Event object
      */
     void add(ApplicationHandler *app_handler) {
-      UsageRecMap::iterator uiter;
+      GroupRecMap::iterator iter;
       uint64_t thread_group = app_handler->get_thread_group();
       WorkRec *rec = new WorkRec(app_handler);
-      rec->usage = 0;
+
+      rec->request_type = app_handler->get_request_type();
+      rec->added_micros = get_micros();
 
       if (thread_group != 0) {
-        boost::mutex::scoped_lock ulock(m_state.usage_mutex);
-        if ((uiter = m_state.usage_map.find(thread_group)) != m_state.usage_map.end()) {
-          rec->usage = (*uiter).second;
-          rec->usage->outstanding++;
-        }
-        else {
-          rec->usage = new UsageRec();
-          rec->usage->thread_group = thread_group;
-          m_state.usage_map[thread_group] = rec->usage;
+        GroupShard *shard = m_state.group_shard(thread_group);
+        boost::mutex::scoped_lock lock(shard->mutex);
+        if ((iter = shard->group_map.find(thread_group)) != shard->group_map.end()) {
+          rec->group = (*iter).second;
+          rec->queue_depth = rec->group->pending.size() + 1;
+          rec->group->pending.push_back(rec);
+          return;
         }
+        rec->group = new GroupRec(thread_group);
+        shard->group_map[thread_group] = rec->group;
       }
 
-      {
-        boost::mutex::scoped_lock lock(m_state.queue_mutex);
-        m_state.queue.push_back(rec);
-        m_state.cond.notify_one();
+      m_state.push_runnable(rec, __sync_fetch_and_add(&m_state.next_queue, 1)
+                            % m_state.queues.size(), true);
+    }
+
+    /**
+     * Returns queue depth, wait time and service time histograms for each
+     * type of request carried out so far
+     *
+     * @param stats reference to map to fill in
+     */
+    void get_statistics(StatisticsMap &stats) {
+      stats.clear();
+      for (size_t i=0; i<m_state.stats.size(); i++) {
+        WorkerStatistics *ws = m_state.stats[i];
+        boost::mutex::scoped_lock lock(ws->mutex);
+        for (StatisticsMap::iterator iter = ws->stats.begin();
+             iter != ws->stats.end(); ++iter) {
+          RequestStatistics &rs = stats[(*iter).first];
+          rs.queue_depth.merge((*iter).second.queue_depth);
+          rs.wait_micros.merge((*iter).second.wait_micros);
+          rs.service_micros.merge((*iter).second.service_micros);
+        }
       }
     }
   };
@@ -366,6 +366,47 @@ int Comm::get_local_address(struct sockaddr_in addr, struct sockaddr_in *local_a
 }
 
 
+/**
+ *
+ */
+int Comm::set_nodelay(struct sockaddr_in &addr, bool nodelay) {
+  IOHandlerDataPtr data_handler;
+
+  if (!m_handler_map_ptr->lookup_data_handler(addr, data_handler))
+    return Error::COMM_NOT_CONNECTED;
+
+  return data_handler->set_nodelay(nodelay);
+}
+
+
+/**
+ *
+ */
+int Comm::set_cork(struct sockaddr_in &addr, bool cork) {
+  IOHandlerDataPtr data_handler;
+
+  if (!m_handler_map_ptr->lookup_data_handler(addr, data_handler))
+    return Error::COMM_NOT_CONNECTED;
+
+  return data_handler->set_cork(cork);
+}
+
+
+/**
+ *
+ */
+int Comm::get_send_statistics(struct sockaddr_in &addr, SendStatistics &stats) {
+  IOHandlerDataPtr data_handler;
+
+  if (!m_handler_map_ptr->lookup_data_handler(addr, data_handler))
+    return Error::COMM_NOT_CONNECTED;
+
+  data_handler->get_send_statistics(stats);
+
+  return Error::OK;
+}
+
+
 /**
  *
  */
@@ -180,6 +180,40 @@ namespace Hypertable {
      */
     int get_local_address(struct sockaddr_in addr, struct sockaddr_in *local_addr);
 
+    /**
+     * Enables or disables Nagle's algorithm on a connection.  Connections
+     * are created with TCP_NODELAY set, which favors latency; turning
+     * Nagle back on lets the kernel batch small writes to peers that
+     * receive a high rate of small messages.
+     *
+     * @param addr connection identifier (remote address)
+     * @param nodelay true to disable Nagle's algorithm
+     * @return Error::OK on success or error code on failure
+     */
+    int set_nodelay(struct sockaddr_in &addr, bool nodelay);
+
+    /**
+     * Corks or uncorks a connection (TCP_CORK on Linux, TCP_NOPUSH on
+     * BSD).  A sender about to issue a burst of messages to one peer can
+     * cork the connection, send them, then uncork it so that they leave
+     * in full-sized segments.
+     *
+     * @param addr connection identifier (remote address)
+     * @param cork true to cork, false to uncork and push pending data
+     * @return Error::OK on success or error code on failure
+     */
+    int set_cork(struct sockaddr_in &addr, bool cork);
+
+    /**
+     * Returns the number of bytes, messages and writev calls sent so far
+     * on a connection.
+     *
+     * @param addr connection identifier (remote address)
+     * @param stats reference to statistics structure to fill in
+     * @return Error::OK on success or error code on failure
+     */
+    int get_send_statistics(struct sockaddr_in &addr, SendStatistics &stats);
+
     /**
      * Creates a local socket for receiving datagrams and assigns a default dispatch
      * handler to handle events on this socket.  This socket can also be used for
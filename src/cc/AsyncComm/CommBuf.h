@@ -74,14 +74,14 @@ namespace Hypertable {
      * extended buffer to _ex and takes ownership of it.  The total
      * length written into the header is len plus _exLen.  The internal
      * pointer into the primary buffer is positioned to just after the
-     * header.
+     * header.  The primary buffer comes from the BufferPool.
      *
      * @param hbuilder the Header builder object used to write the header
      * @param len the length of the primary buffer to allocate
      */
     CommBuf(HeaderBuilder &hbuilder, uint32_t len) : ext_ptr(0) {
       len += hbuilder.header_length();
-      data.set(new uint8_t [len], len, true);
+      data.set_pooled(len);
       data_ptr = data.base;
       hbuilder.set_total_len(len);
       hbuilder.encode(&data_ptr);
@@ -102,7 +102,7 @@ namespace Hypertable {
      */
     CommBuf(HeaderBuilder &hbuilder, uint32_t len, StaticBuffer &buffer) : ext(buffer) {
       len += hbuilder.header_length();
-      data.set(new uint8_t [len], len, true);
+      data.set_pooled(len);
       data_ptr = data.base;
       hbuilder.set_total_len(len+buffer.size);
       hbuilder.encode(&data_ptr);
@@ -28,6 +28,7 @@ extern "C" {
 #include <netinet/in.h>
 }
 
+#include "Common/BufferPool.h"
 #include "Common/String.h"
 #include "Common/ReferenceCount.h"
 
@@ -58,7 +59,8 @@ namespace Hypertable {
      * @param a remote address of connection on which this event was generated
      * @param err error code associated with this event
      * @param h pointer to message data for MESSAGE events (<b>NOTE:</b> this object
-     * takes ownership of this data and deallocates it when it gets destroyed)
+     * takes ownership of this data and returns it to the BufferPool when it gets
+     * destroyed, so it must have been allocated with BufferPool::allocate(h->total_len))
      */
     Event(Type ct, int cid, struct sockaddr_in &a, int err=0,
           Header::Common *h=0)
@@ -94,7 +96,16 @@ namespace Hypertable {
     /** Destroys event.  Deallocates message data
      */
     ~Event() {
-      delete [] header;
+      if (header)
+        BufferPool::release((uint8_t *)header, header->total_len);
+    }
+
+    /** Events are allocated and freed at message rate, so they come from
+     * the BufferPool as well
+     */
+    static void *operator new(size_t size) { return BufferPool::allocate(size); }
+    static void operator delete(void *ptr, size_t size) {
+      BufferPool::release((uint8_t *)ptr, size);
     }
 
     /** Type of event.  Can take one of values CONNECTION_ESTABLISHED,
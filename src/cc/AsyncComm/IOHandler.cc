@@ -45,6 +45,10 @@ void IOHandler::add_poll_interest(int mode) {
 
   m_poll_interest |= mode;
 
+  // edge-triggered handlers are registered for everything up front
+  if (m_edge_triggered)
+    return;
+
   memset(&event, 0, sizeof(struct epoll_event));
   event.data.ptr = this;
   event.events = EPOLLERR | EPOLLHUP;
@@ -70,6 +74,9 @@ void IOHandler::remove_poll_interest(int mode) {
 
   m_poll_interest &= ~mode;
 
+  if (m_edge_triggered)
+    return;
+
   memset(&event, 0, sizeof(struct epoll_event));
   event.data.ptr = this;
   event.events = EPOLLERR | EPOLLHUP;
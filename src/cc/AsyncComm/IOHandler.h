@@ -32,6 +32,9 @@ extern "C" {
 #endif
 #if defined(__linux__)
 #include <sys/epoll.h>
+#ifndef EPOLLRDHUP
+#define EPOLLRDHUP 0x2000
+#endif
 #endif
 }
 
@@ -54,6 +57,7 @@ namespace Hypertable {
     IOHandler(int sd, struct sockaddr_in &addr, DispatchHandlerPtr &dhp) : m_addr(addr), m_sd(sd), m_dispatch_handler_ptr(dhp) {
       ReactorFactory::get_reactor(m_reactor_ptr);
       m_poll_interest = 0;
+      m_edge_triggered = false;
       socklen_t namelen = sizeof(m_local_addr);
       getsockname(m_sd, (sockaddr *)&m_local_addr, &namelen);
       memset(&m_alias, 0, sizeof(m_alias));
@@ -107,9 +111,11 @@ namespace Hypertable {
       memset(&event, 0, sizeof(struct epoll_event));
       event.data.ptr = this;
       event.events = EPOLLIN | EPOLLERR | EPOLLHUP;
+      if (m_edge_triggered)
+        event.events |= EPOLLOUT | EPOLLRDHUP | EPOLLET;
       if (epoll_ctl(m_reactor_ptr->poll_fd, EPOLL_CTL_ADD, m_sd, &event) < 0) {
-        HT_ERRORF("epoll_ctl(%d, EPOLL_CTL_ADD, %d, EPOLLIN|EPOLLERR|EPOLLHUP) failed : %s",
-                     m_reactor_ptr->poll_fd, m_sd, strerror(errno));
+        HT_ERRORF("epoll_ctl(%d, EPOLL_CTL_ADD, %d, 0x%x) failed : %s",
+                     m_reactor_ptr->poll_fd, m_sd, event.events, strerror(errno));
         exit(1);
       }
       m_poll_interest |= Reactor::READ_READY;
@@ -172,6 +178,7 @@ namespace Hypertable {
     DispatchHandlerPtr  m_dispatch_handler_ptr;
     ReactorPtr          m_reactor_ptr;
     int                 m_poll_interest;
+    bool                m_edge_triggered;
 
 #if defined(__APPLE__)
     void display_event(struct kevent *event);
@@ -28,7 +28,9 @@ using namespace std;
 extern "C" {
 #include <arpa/inet.h>
 #include <errno.h>
+#include <limits.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #if defined(__APPLE__)
@@ -38,6 +40,7 @@ extern "C" {
 
 #define HT_DISABLE_LOG_DEBUG 1
 
+#include "Common/BufferPool.h"
 #include "Common/Error.h"
 #include "Common/FileUtils.h"
 #include "Common/InetAddr.h"
@@ -47,6 +50,14 @@ using namespace Hypertable;
 
 atomic_t IOHandlerData::ms_next_connection_id = ATOMIC_INIT(1);
 
+namespace {
+#if defined(IOV_MAX)
+  const int SEND_IOV_MAX = IOV_MAX;
+#else
+  const int SEND_IOV_MAX = 1024;
+#endif
+}
+
 #if defined(__linux__)
 
 bool IOHandlerData::handle_event(struct epoll_event *event) {
@@ -60,11 +71,19 @@ bool IOHandlerData::handle_event(struct epoll_event *event) {
     }
   }
 
+  /**
+   * Read until the socket runs dry.  A short read means EAGAIN (or EOF),
+   * which is also what edge-triggered polling requires before going back
+   * to epoll_wait.  errno is cleared first so that an empty read caused by
+   * EAGAIN, e.g. for data already consumed on the previous event, is not
+   * mistaken for EOF.
+   */
   if (event->events & EPOLLIN) {
     size_t nread, total_read = 0;
     while (true) {
       if (!m_got_header) {
         uint8_t *ptr = ((uint8_t *)&m_message_header) + (sizeof(Header::Common) - m_message_header_remaining);
+        errno = 0;
         nread = FileUtils::read(m_sd, ptr, m_message_header_remaining);
         if (nread == (size_t)-1) {
           if (errno != ECONNREFUSED) {
@@ -74,19 +93,19 @@ bool IOHandlerData::handle_event(struct epoll_event *event) {
           deliver_event(new Event(Event::DISCONNECT, m_id, m_addr, error));
           return true;
         }
-        else if (nread == 0 && total_read == 0) {
+        else if (nread == 0 && total_read == 0 && errno != EAGAIN) {
           // eof
           deliver_event(new Event(Event::DISCONNECT, m_id, m_addr, Error::OK));
           return true;
         }
         else if (nread < m_message_header_remaining) {
           m_message_header_remaining -= nread;
-          return false;
+          break;
         }
         else {
           m_got_header = true;
           m_message_header_remaining = 0;
-          m_message = new uint8_t [m_message_header.total_len];
+          m_message = BufferPool::allocate(m_message_header.total_len);
           memcpy(m_message, &m_message_header, sizeof(Header::Common));
           m_message_ptr = m_message + sizeof(Header::Common);
           m_message_remaining = (m_message_header.total_len) - sizeof(Header::Common);
@@ -94,13 +113,14 @@ bool IOHandlerData::handle_event(struct epoll_event *event) {
         }
       }
       if (m_got_header) {
+        errno = 0;
         nread = FileUtils::read(m_sd, m_message_ptr, m_message_remaining);
-        if (nread < 0) {
-          HT_ERRORF("FileUtils::read(%d, len=%d) failure : %s", m_sd, m_message_header_remaining, strerror(errno));
+        if (nread == (size_t)-1) {
+          HT_ERRORF("FileUtils::read(%d, len=%d) failure : %s", m_sd, m_message_remaining, strerror(errno));
           deliver_event(new Event(Event::DISCONNECT, m_id, m_addr, Error::OK));
           return true;
         }
-        else if (nread == 0 && total_read == 0) {
+        else if (nread == 0 && total_read == 0 && errno != EAGAIN) {
           // eof
           deliver_event(new Event(Event::DISCONNECT, m_id, m_addr, Error::OK));
           return true;
@@ -108,6 +128,7 @@ bool IOHandlerData::handle_event(struct epoll_event *event) {
         else if (nread < m_message_remaining) {
           m_message_ptr += nread;
           m_message_remaining -= nread;
+          break;
         }
         else {
           DispatchHandler *dh = 0;
@@ -118,7 +139,7 @@ bool IOHandlerData::handle_event(struct epoll_event *event) {
               HT_WARNF("Received response for non-pending event (id=%d,version=%d,total_len=%d)",
                           id, ((Header::Common *)m_message)->version, ((Header::Common *)m_message)->total_len);
             }
-            delete [] m_message;
+            BufferPool::release(m_message, ((Header::Common *)m_message)->total_len);
           }
           else
             deliver_event(new Event(Event::MESSAGE, m_id, m_addr, Error::OK, (Header::Common *)m_message), dh);
@@ -141,6 +162,12 @@ bool IOHandlerData::handle_event(struct epoll_event *event) {
     return true;
   }
 
+  // peer closed; with edge-triggered polling there won't be another EPOLLIN
+  if (event->events & EPOLLRDHUP) {
+    deliver_event(new Event(Event::DISCONNECT, m_id, m_addr, Error::OK));
+    return true;
+  }
+
   return false;
 }
 
@@ -187,7 +214,7 @@ bool IOHandlerData::handle_event(struct kevent *event) {
           m_got_header = true;
           available -= nread;
           m_message_header_remaining = 0;
-          m_message = new uint8_t [m_message_header.total_len];
+          m_message = BufferPool::allocate(m_message_header.total_len);
           memcpy(m_message, &m_message_header, sizeof(Header::Common));
           m_message_ptr = m_message + sizeof(Header::Common);
           m_message_remaining = (m_message_header.total_len) - sizeof(Header::Common);
@@ -222,7 +249,7 @@ bool IOHandlerData::handle_event(struct kevent *event) {
             if ((((Header::Common *)m_message)->flags & Header::FLAGS_BIT_IGNORE_RESPONSE) == 0) {
               HT_WARNF("Received response for non-pending event (id=%d)", id);
             }
-            delete [] m_message;
+            BufferPool::release(m_message, ((Header::Common *)m_message)->total_len);
           }
           else
             deliver_event(new Event(Event::MESSAGE, m_id, m_addr, Error::OK, (Header::Common *)m_message), dh);
@@ -331,61 +358,120 @@ int IOHandlerData::send_message(CommBufPtr &cbp, time_t timeout, DispatchHandler
 
 
 int IOHandlerData::flush_send_queue() {
+  struct iovec vec[SEND_IOV_MAX];
   ssize_t nwritten, towrite, remaining;
-  struct iovec vec[2];
   int count;
 
   while (!m_send_queue.empty()) {
 
-    CommBufPtr &cbp = m_send_queue.front();
-
+    // gather everything pending, front to back, into one iovec array
     count = 0;
     towrite = 0;
-    remaining = cbp->data.size - (cbp->data_ptr - cbp->data.base);
-    if (remaining > 0) {
-      vec[0].iov_base = (void *)cbp->data_ptr;
-      vec[0].iov_len = remaining;
-      towrite = remaining;
-      ++count;
-    }
-    if (cbp->ext.base != 0) {
-      remaining = cbp->ext.size - (cbp->ext_ptr - cbp->ext.base);
+    for (std::list<CommBufPtr>::iterator iter = m_send_queue.begin();
+         iter != m_send_queue.end() && count + 2 <= SEND_IOV_MAX; ++iter) {
+      CommBuf *cbuf = (*iter).get();
+      remaining = cbuf->data.size - (cbuf->data_ptr - cbuf->data.base);
       if (remaining > 0) {
-        vec[count].iov_base = (void *)cbp->ext_ptr;
+        vec[count].iov_base = (void *)cbuf->data_ptr;
         vec[count].iov_len = remaining;
         towrite += remaining;
         ++count;
       }
+      if (cbuf->ext.base != 0) {
+        remaining = cbuf->ext.size - (cbuf->ext_ptr - cbuf->ext.base);
+        if (remaining > 0) {
+          vec[count].iov_base = (void *)cbuf->ext_ptr;
+          vec[count].iov_len = remaining;
+          towrite += remaining;
+          ++count;
+        }
+      }
     }
 
-    nwritten = FileUtils::writev(m_sd, vec, count);
-    if (nwritten == (ssize_t)-1) {
-      HT_WARNF("FileUtils::writev(%d, len=%d) failed : %s", m_sd, towrite, strerror(errno));
-      return Error::COMM_BROKEN_CONNECTION;
+    if (count == 0)
+      nwritten = 0;
+    else {
+      nwritten = FileUtils::writev(m_sd, vec, count);
+      m_send_stats.syscalls++;
+      if (nwritten == (ssize_t)-1) {
+        HT_WARNF("FileUtils::writev(%d, len=%d, iovcnt=%d) failed : %s", m_sd,
+                 (int)towrite, count, strerror(errno));
+        return Error::COMM_BROKEN_CONNECTION;
+      }
+      m_send_stats.bytes += nwritten;
     }
-    else if (nwritten < towrite) {
-      if (nwritten == 0)
-        break;
+
+    bool partial = nwritten < towrite;
+
+    // advance past what was written, removing (and thereby destroying)
+    // the buffers that went out completely
+    while (!m_send_queue.empty()) {
+      CommBufPtr &cbp = m_send_queue.front();
       remaining = cbp->data.size - (cbp->data_ptr - cbp->data.base);
       if (remaining > 0) {
         if (nwritten < remaining) {
           cbp->data_ptr += nwritten;
           break;
         }
-        else {
-          nwritten -= remaining;
-          cbp->data_ptr += remaining;
-        }
+        cbp->data_ptr += remaining;
+        nwritten -= remaining;
       }
       if (cbp->ext.base != 0) {
-        cbp->ext_ptr += nwritten;
-        break;
+        remaining = cbp->ext.size - (cbp->ext_ptr - cbp->ext.base);
+        if (remaining > 0) {
+          if (nwritten < remaining) {
+            cbp->ext_ptr += nwritten;
+            break;
+          }
+          cbp->ext_ptr += remaining;
+          nwritten -= remaining;
+        }
       }
+      m_send_queue.pop_front();
+      m_send_stats.messages++;
     }
 
-    // buffer written successfully, now remove from queue (which will destroy buffer)
-    m_send_queue.pop_front();
+    // socket buffer is full, wait for write readiness
+    if (partial)
+      break;
   }
 
   return Error::OK;
 }
+
+
+
+int IOHandlerData::set_nodelay(bool nodelay) {
+  int flag = nodelay ? 1 : 0;
+#if defined(__linux__) || defined(__APPLE__)
+  if (setsockopt(m_sd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag)) < 0) {
+    HT_WARNF("setsockopt(TCP_NODELAY) failure: %s", strerror(errno));
+    return Error::COMM_SOCKET_ERROR;
+  }
+#endif
+  return Error::OK;
+}
+
+
+
+int IOHandlerData::set_cork(bool cork) {
+  boost::mutex::scoped_lock lock(m_mutex);
+  int flag = cork ? 1 : 0;
+
+  if (cork == m_corked)
+    return Error::OK;
+
+#if defined(__linux__)
+  if (setsockopt(m_sd, IPPROTO_TCP, TCP_CORK, &flag, sizeof(flag)) < 0) {
+    HT_WARNF("setsockopt(TCP_CORK) failure: %s", strerror(errno));
+    return Error::COMM_SOCKET_ERROR;
+  }
+#elif defined(__APPLE__)
+  if (setsockopt(m_sd, IPPROTO_TCP, TCP_NOPUSH, &flag, sizeof(flag)) < 0) {
+    HT_WARNF("setsockopt(TCP_NOPUSH) failure: %s", strerror(errno));
+    return Error::COMM_SOCKET_ERROR;
+  }
+#endif
+  m_corked = cork;
+  return Error::OK;
+}
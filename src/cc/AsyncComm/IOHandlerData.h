@@ -34,11 +34,20 @@ extern "C" {
 
 #include "CommBuf.h"
 #include "IOHandler.h"
-#include "RequestCache.h"
 
 
 namespace Hypertable {
 
+  /**
+   * Running totals of what has been written to a connection
+   */
+  struct SendStatistics {
+    SendStatistics() : bytes(0), messages(0), syscalls(0) { }
+    uint64_t bytes;     //!< bytes handed to the kernel
+    uint64_t messages;  //!< messages written out completely
+    uint64_t syscalls;  //!< writev calls issued
+  };
+
   /**
    */
   class IOHandlerData : public IOHandler {
@@ -46,8 +55,10 @@ namespace Hypertable {
   public:
 
     IOHandlerData(int sd, struct sockaddr_in &addr, DispatchHandlerPtr &dhp)
-      : IOHandler(sd, addr, dhp), m_request_cache(), m_send_queue() {
+      : IOHandler(sd, addr, dhp), m_send_queue() {
       m_connected = false;
+      m_corked = false;
+      m_edge_triggered = m_reactor_ptr->edge_triggered();
       reset_incoming_message_state();
       m_id = atomic_inc_return(&ms_next_connection_id);
     }
@@ -62,8 +73,32 @@ namespace Hypertable {
 
     int send_message(CommBufPtr &cbp, time_t timeout=0, DispatchHandler *disp_handler=0);
 
+    /**
+     * Writes as much of the send queue as the socket will take.  Pending
+     * buffers are gathered, up to IOV_MAX iovecs at a time, into a single
+     * writev so that a backlog of small messages costs one system call
+     * instead of one per message.  Must be called with m_mutex held.
+     */
     int flush_send_queue();
 
+    /**
+     * Enables or disables Nagle's algorithm (TCP_NODELAY) on the connection.
+     * Connections are created with Nagle disabled.
+     */
+    int set_nodelay(bool nodelay);
+
+    /**
+     * Corks (or uncorks) the connection.  While corked, the kernel only
+     * sends full segments, so a burst of messages goes out in as few
+     * packets as possible; uncorking pushes out whatever is left.
+     */
+    int set_cork(bool cork);
+
+    void get_send_statistics(SendStatistics &stats) {
+      boost::mutex::scoped_lock lock(m_mutex);
+      stats = m_send_stats;
+    }
+
 #if defined(__APPLE__)
     virtual bool handle_event(struct kevent *event);
 #elif defined(__linux__)
@@ -88,8 +123,9 @@ namespace Hypertable {
     uint8_t            *m_message;
     uint8_t            *m_message_ptr;
     size_t              m_message_remaining;
-    RequestCache        m_request_cache;
     std::list<CommBufPtr> m_send_queue;
+    SendStatistics      m_send_stats;
+    bool                m_corked;
     int                 m_id;
   };
 
@@ -38,6 +38,7 @@ extern "C" {
 
 #define HT_DISABLE_LOG_DEBUG 1
 
+#include "Common/BufferPool.h"
 #include "Common/Error.h"
 #include "Common/FileUtils.h"
 
@@ -71,7 +72,14 @@ bool IOHandlerDatagram::handle_event(struct epoll_event *event) {
       return true;
     }
 
-    rmsg = new uint8_t [nread];
+    if ((size_t)nread < sizeof(Header::Common) ||
+        ((Header::Common *)m_message)->total_len != (size_t)nread) {
+      HT_WARNF("Dropping malformed datagram (len=%d) from %s:%d", (int)nread,
+               inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+      return false;
+    }
+
+    rmsg = BufferPool::allocate(nread);
     memcpy(rmsg, m_message, nread);
 
     deliver_event(new Event(Event::MESSAGE, 0, addr, Error::OK, (Header::Common *)rmsg));
@@ -122,7 +130,14 @@ bool IOHandlerDatagram::handle_event(struct kevent *event) {
       return true;
     }
 
-    rmsg = new uint8_t [nread];
+    if ((size_t)nread < sizeof(Header::Common) ||
+        ((Header::Common *)m_message)->total_len != (size_t)nread) {
+      HT_WARNF("Dropping malformed datagram (len=%d) from %s:%d", (int)nread,
+               inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+      return false;
+    }
+
+    rmsg = BufferPool::allocate(nread);
     memcpy(rmsg, m_message, nread);
 
     deliver_event(new Event(Event::MESSAGE, 0, addr, Error::OK, (Header::Common *)rmsg));
@@ -56,7 +56,7 @@ const int Reactor::WRITE_READY  = 0x02;
 /**
  *
  */
-Reactor::Reactor() : m_mutex(), m_interrupt_in_progress(false) {
+Reactor::Reactor() : m_mutex(), m_interrupt_in_progress(false), m_edge_triggered(false) {
   struct sockaddr_in addr;
 
 #if defined(__linux__)
@@ -109,71 +109,67 @@ Reactor::Reactor() : m_mutex(), m_interrupt_in_progress(false) {
 
 
 void Reactor::handle_timeouts(PollTimeout &next_timeout) {
-  vector<ExpireTimer> expired_timers;
+  RequestCache::ExpiredList expired_requests;
+  TimerWheel::EntryList expired_timers;
   EventPtr event_ptr;
-  boost::xtime     now, next_req_timeout;
-  ExpireTimer timer;
+  boost::xtime now, next_wakeup, next_timer;
+  bool have_wakeup, have_timer;
 
+  /**
+   * Clear a pending interrupt before looking at the timeouts, so that an
+   * interrupt for a timeout added from here on is not lost
+   */
   {
     boost::mutex::scoped_lock lock(m_mutex);
-    IOHandler       *handler;
-    DispatchHandler *dh;
-
-    boost::xtime_get(&now, boost::TIME_UTC);
-
-    while ((dh = m_request_cache.get_next_timeout(now, handler, &next_req_timeout)) != 0) {
-      handler->deliver_event(new Event(Event::ERROR, 0, ((IOHandlerData *)handler)->get_address(), Error::COMM_REQUEST_TIMEOUT), dh);
-    }
+    poll_loop_continue();
+  }
 
-    if (next_req_timeout.sec != 0) {
-      next_timeout.set(now, next_req_timeout);
-      memcpy(&m_next_wakeup, &next_req_timeout, sizeof(m_next_wakeup));
-    }
-    else {
-      next_timeout.set_indefinite();
-      memset(&m_next_wakeup, 0, sizeof(m_next_wakeup));
-    }
+  boost::xtime_get(&now, boost::TIME_UTC);
 
-    if (!m_timer_heap.empty()) {
-      ExpireTimer timer;
-
-      while (!m_timer_heap.empty()) {
-        timer = m_timer_heap.top();
-        if (xtime_cmp(timer.expire_time, now) > 0) {
-          if (next_req_timeout.sec == 0 || xtime_cmp(timer.expire_time, next_req_timeout) < 0) {
-            next_timeout.set(now, timer.expire_time);
-            memcpy(&m_next_wakeup, &timer.expire_time, sizeof(m_next_wakeup));
-          }
-          break;
-        }
-        expired_timers.push_back(timer);
-        m_timer_heap.pop();
-      }
+  {
+    boost::mutex::scoped_lock lock(m_timer_mutex);
+    m_request_cache.get_expired(now, expired_requests);
+    m_timer_wheel.advance(now, expired_timers);
+  }
 
-    }
+  for (size_t i=0; i<expired_requests.size(); i++) {
+    IOHandler *handler = expired_requests[i].handler;
+    handler->deliver_event(new Event(Event::ERROR, 0, ((IOHandlerData *)handler)->get_address(), Error::COMM_REQUEST_TIMEOUT), expired_requests[i].dh);
   }
 
   /**
    * Deliver timer events
    */
   for (size_t i=0; i<expired_timers.size(); i++) {
-    event_ptr = new Event(Event::TIMER, Error::OK);
-    if (expired_timers[i].handler)
-      expired_timers[i].handler->handle(event_ptr);
+    TimerRec *rec = static_cast<TimerRec *>(expired_timers[i]);
+    if (rec->handler) {
+      event_ptr = new Event(Event::TIMER, Error::OK);
+      rec->handler->handle(event_ptr);
+    }
+    delete rec;
   }
 
   {
-    boost::mutex::scoped_lock lock(m_mutex);
+    boost::mutex::scoped_lock lock(m_timer_mutex);
 
-    if (!m_timer_heap.empty()) {
-      timer = m_timer_heap.top();
-      if (next_req_timeout.sec == 0 || xtime_cmp(timer.expire_time, next_req_timeout) < 0) {
-        next_timeout.set(now, timer.expire_time);
-        memcpy(&m_next_wakeup, &timer.expire_time, sizeof(m_next_wakeup));
-      }
+    have_wakeup = m_request_cache.next_wakeup(next_wakeup);
+    have_timer = m_timer_wheel.next_wakeup(next_timer);
+    if (have_timer && (!have_wakeup || xtime_cmp(next_timer, next_wakeup) < 0)) {
+      memcpy(&next_wakeup, &next_timer, sizeof(next_wakeup));
+      have_wakeup = true;
     }
 
-    poll_loop_continue();
+    if (have_wakeup) {
+      boost::xtime_get(&now, boost::TIME_UTC);
+      if (xtime_cmp(next_wakeup, now) < 0)
+        memcpy(&next_wakeup, &now, sizeof(next_wakeup));
+      next_timeout.set(now, next_wakeup);
+      memcpy(&m_next_wakeup, &next_wakeup, sizeof(m_next_wakeup));
+    }
+    else {
+      next_timeout.set_indefinite();
+      memset(&m_next_wakeup, 0, sizeof(m_next_wakeup));
+    }
   }
 
 }
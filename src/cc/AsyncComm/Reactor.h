@@ -22,7 +22,6 @@
 #ifndef HYPERTABLE_REACTOR_H
 #define HYPERTABLE_REACTOR_H
 
-#include <queue>
 #include <set>
 
 #include <boost/thread/thread.hpp>
@@ -32,6 +31,7 @@
 #include "PollTimeout.h"
 #include "RequestCache.h"
 #include "ExpireTimer.h"
+#include "TimerWheel.h"
 
 namespace Hypertable {
 
@@ -51,29 +51,48 @@ namespace Hypertable {
 
     void operator()();
 
+    /**
+     * Registers an outstanding request so that its dispatch handler gets
+     * an ERROR event with COMM_REQUEST_TIMEOUT if no response arrives by
+     * the expiration time.  The poll loop is only interrupted if the
+     * request expires before the reactor would wake up anyway.
+     */
     void add_request(uint32_t id, IOHandler *handler, DispatchHandler *dh, boost::xtime &expire) {
-      boost::mutex::scoped_lock lock(m_mutex);
-      boost::xtime now;
-      m_request_cache.insert(id, handler, dh, expire);
-      boost::xtime_get(&now, boost::TIME_UTC);
-      if (m_next_wakeup.sec == 0 || xtime_cmp(expire, m_next_wakeup) < 0)
+      bool interrupt;
+      {
+        boost::mutex::scoped_lock lock(m_timer_mutex);
+        m_request_cache.insert(id, handler, dh, expire);
+        interrupt = wakeup_needed(expire);
+      }
+      if (interrupt) {
+        boost::mutex::scoped_lock lock(m_mutex);
         poll_loop_interrupt();
+      }
     }
 
     DispatchHandler *remove_request(uint32_t id) {
-      boost::mutex::scoped_lock lock(m_mutex);
+      boost::mutex::scoped_lock lock(m_timer_mutex);
       return m_request_cache.remove(id);
     }
 
     void cancel_requests(IOHandler *handler) {
-      boost::mutex::scoped_lock lock(m_mutex);
+      boost::mutex::scoped_lock lock(m_timer_mutex);
       m_request_cache.purge_requests(handler);
     }
 
     void add_timer(ExpireTimer &timer) {
-      boost::mutex::scoped_lock lock(m_mutex);
-      m_timer_heap.push(timer);
-      poll_loop_interrupt();
+      bool interrupt;
+      {
+        boost::mutex::scoped_lock lock(m_timer_mutex);
+        TimerRec *rec = new TimerRec;
+        rec->handler = timer.handler;
+        m_timer_wheel.insert(rec, timer.expire_time);
+        interrupt = wakeup_needed(timer.expire_time);
+      }
+      if (interrupt) {
+        boost::mutex::scoped_lock lock(m_mutex);
+        poll_loop_interrupt();
+      }
     }
 
     void schedule_removal(IOHandler *handler) {
@@ -89,6 +108,14 @@ namespace Hypertable {
 
     void handle_timeouts(PollTimeout &next_timeout);
 
+    /**
+     * Returns true if data connections on this reactor are registered
+     * edge-triggered (EPOLLET).  Such connections are added to the poll set
+     * once with both read and write interest and never modified, so send
+     * queue transitions don't cost an epoll_ctl each.
+     */
+    bool edge_triggered() { return m_edge_triggered; }
+
 #if defined(__linux__)
     int poll_fd;
 #elif defined (__APPLE__)
@@ -99,13 +126,30 @@ namespace Hypertable {
     void poll_loop_continue();
 
   protected:
+
+    class TimerRec : public TimerWheel::Entry {
+    public:
+      DispatchHandler *handler;
+    };
+
+    /**
+     * Returns true if something expiring at the given time needs the poll
+     * loop to wake up earlier than it is going to.  Called with
+     * m_timer_mutex locked.
+     */
+    bool wakeup_needed(boost::xtime &expire) {
+      return m_next_wakeup.sec == 0 || xtime_cmp(expire, m_next_wakeup) < 0;
+    }
+
     boost::mutex    m_mutex;
+    boost::mutex    m_timer_mutex;
     RequestCache    m_request_cache;
-    std::priority_queue<ExpireTimer, std::vector<ExpireTimer>, LtTimer> m_timer_heap;
+    TimerWheel      m_timer_wheel;
     int             m_interrupt_sd;
     bool            m_interrupt_in_progress;
     boost::xtime    m_next_wakeup;
     std::set<IOHandler *> m_removed_handlers;
+    bool            m_edge_triggered;
   };
   typedef boost::intrusive_ptr<Reactor> ReactorPtr;
 
@@ -20,6 +20,7 @@
  */
 
 #include "Common/Compat.h"
+#include "Common/System.h"
 
 #include "HandlerMap.h"
 #include "ReactorFactory.h"
@@ -40,7 +41,7 @@ atomic_t ReactorFactory::ms_next_reactor = ATOMIC_INIT(0);
 
 /**
  */
-void ReactorFactory::initialize(uint16_t reactor_count) {
+void ReactorFactory::initialize(uint16_t reactor_count, int flags) {
   boost::mutex::scoped_lock lock(ms_mutex);
   if (!ms_reactors.empty())
     return;
@@ -51,6 +52,11 @@ void ReactorFactory::initialize(uint16_t reactor_count) {
   assert(reactor_count > 0);
   for (uint16_t i=0; i<reactor_count; i++) {
     reactor_ptr = new Reactor();
+#if defined(__linux__)
+    reactor_ptr->m_edge_triggered = (flags & EDGE_TRIGGERED) != 0;
+    if (flags & PIN_THREADS)
+      rrunner.set_cpu(i % System::get_processor_count());
+#endif
     ms_reactors.push_back(reactor_ptr);
     rrunner.set_reactor(reactor_ptr);
     ms_threads.create_thread(rrunner);
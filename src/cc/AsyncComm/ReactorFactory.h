@@ -43,12 +43,21 @@ namespace Hypertable {
 
   public:
 
+    /** Reactor flags */
+    enum {
+      /** register data connections edge-triggered (Linux only) */
+      EDGE_TRIGGERED = 0x01,
+      /** pin reactor thread i to CPU i modulo the number of CPUs (Linux only) */
+      PIN_THREADS    = 0x02
+    };
+
     /** This method creates and initializes the I/O reactor threads and must be
      * called once by an application prior to creating the Comm object.
      *
      * @param reactor_count number of reactor threads to create
+     * @param flags bitwise OR of reactor flags (EDGE_TRIGGERED, PIN_THREADS)
      */
-    static void initialize(uint16_t reactor_count);
+    static void initialize(uint16_t reactor_count, int flags=0);
 
     /** This method shuts down the reactors
      */
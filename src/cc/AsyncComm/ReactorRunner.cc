@@ -23,6 +23,8 @@
 
 extern "C" {
 #include <errno.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <sys/types.h>
@@ -46,6 +48,15 @@ using namespace Hypertable;
 bool Hypertable::ReactorRunner::ms_shutdown = false;
 HandlerMapPtr Hypertable::ReactorRunner::ms_handler_map_ptr;
 
+namespace {
+  /**
+   * Maximum number of events collected by one epoll_wait.  Servers with
+   * thousands of connections see large batches under load; a short array
+   * would just turn one wakeup into several.
+   */
+  const int EVENT_BATCH_SIZE = 1024;
+}
+
 /**
  *
  */
@@ -56,9 +67,18 @@ void ReactorRunner::operator()() {
   PollTimeout timeout;
 
 #if defined(__linux__)
-  struct epoll_event events[256];
+  struct epoll_event events[EVENT_BATCH_SIZE];
+
+  if (m_cpu >= 0) {
+    cpu_set_t cpus;
+    int error;
+    CPU_ZERO(&cpus);
+    CPU_SET(m_cpu, &cpus);
+    if ((error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus)) != 0)
+      HT_WARNF("Unable to pin reactor thread to CPU %d : %s", m_cpu, strerror(error));
+  }
 
-  while ((n = epoll_wait(m_reactor_ptr->poll_fd, events, 256, timeout.get_millis())) >= 0 || errno == EINTR) {
+  while ((n = epoll_wait(m_reactor_ptr->poll_fd, events, EVENT_BATCH_SIZE, timeout.get_millis())) >= 0 || errno == EINTR) {
     m_reactor_ptr->get_removed_handlers(removed_handlers);
     HT_DEBUGF("epoll_wait returned %d events", n);
     for (int i=0; i<n; i++) {
@@ -34,13 +34,16 @@ namespace Hypertable {
    */
   class ReactorRunner {
   public:
+    ReactorRunner() : m_cpu(-1) { }
     void operator()();
     void set_reactor(ReactorPtr &reactor_ptr) { m_reactor_ptr = reactor_ptr; }
+    void set_cpu(int cpu) { m_cpu = cpu; }
     static bool ms_shutdown;
     static HandlerMapPtr ms_handler_map_ptr;
   private:
     void cleanup_and_remove_handlers(std::set<IOHandler *> &handlers);
     ReactorPtr m_reactor_ptr;
+    int m_cpu;
   };
 
 }
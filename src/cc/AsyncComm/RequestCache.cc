@@ -31,6 +31,12 @@ using namespace std;
 #include "RequestCache.h"
 using namespace Hypertable;
 
+RequestCache::~RequestCache() {
+  for (IdHandlerMap::iterator iter = m_id_map.begin(); iter != m_id_map.end(); ++iter)
+    delete (*iter).second;
+}
+
+
 void RequestCache::insert(uint32_t id, IOHandler *handler, DispatchHandler *dh, boost::xtime &expire) {
   CacheNode *node = new CacheNode;
 
@@ -43,18 +49,8 @@ void RequestCache::insert(uint32_t id, IOHandler *handler, DispatchHandler *dh,
   node->id = id;
   node->handler = handler;
   node->dh = dh;
-  memcpy(&node->expire, &expire, sizeof(expire));
 
-  if (m_head == 0) {
-    node->next = node->prev = 0;
-    m_head = m_tail = node;
-  }
-  else {
-    node->next = m_tail;
-    node->next->prev = node;
-    node->prev = 0;
-    m_tail = node;
-  }
+  m_wheel.insert(node, expire);
 
   m_id_map[id] = node;
 }
@@ -73,16 +69,7 @@ DispatchHandler *RequestCache::remove(uint32_t id) {
 
   CacheNode *node = (*iter).second;
 
-  if (node->prev == 0)
-    m_tail = node->next;
-  else
-    node->prev->next = node->next;
-
-  if (node->next == 0)
-    m_head = node->prev;
-  else
-    node->next->prev = node->prev;
-
+  m_wheel.remove(node);
   m_id_map.erase(iter);
 
   DispatchHandler *dh = node->dh;
@@ -92,47 +79,36 @@ DispatchHandler *RequestCache::remove(uint32_t id) {
 
 
 
-DispatchHandler *RequestCache::get_next_timeout(boost::xtime &now, IOHandler *&handlerp, boost::xtime *next_timeout) {
-
-  while (m_head && xtime_cmp(m_head->expire, now) <= 0) {
+void RequestCache::get_expired(boost::xtime &now, ExpiredList &expired) {
+  Expired request;
 
-    IdHandlerMap::iterator iter = m_id_map.find(m_head->id);
-    assert (iter != m_id_map.end());
-    CacheNode *node = m_head;
-    if (m_head->prev) {
-      m_head = m_head->prev;
-      m_head->next = 0;
-    }
-    else
-      m_head = m_tail = 0;
+  m_expired.clear();
+  m_wheel.advance(now, m_expired);
 
-    m_id_map.erase(iter);
-
-    if (node->handler != 0) {
-      handlerp = node->handler;
-      DispatchHandler *dh = node->dh;
-      delete node;
-      return dh;
-    }
+  for (size_t i=0; i<m_expired.size(); i++) {
+    CacheNode *node = static_cast<CacheNode *>(m_expired[i]);
+    m_id_map.erase(node->id);
+    request.handler = node->handler;
+    request.dh = node->dh;
+    expired.push_back(request);
     delete node;
   }
-
-  if (m_head)
-    memcpy(next_timeout, &m_head->expire, sizeof(boost::xtime));
-  else
-    memset(next_timeout, 0, sizeof(boost::xtime));
-
-  return 0;
 }
 
 
 
 void RequestCache::purge_requests(IOHandler *handler) {
-  for (CacheNode *node = m_tail; node != 0; node = node->next) {
+  IdHandlerMap::iterator iter = m_id_map.begin();
+
+  while (iter != m_id_map.end()) {
+    CacheNode *node = (*iter).second;
     if (node->handler == handler) {
       HT_DEBUGF("Purging request id %d", node->id);
-      node->handler = 0;  // mark for deletion
+      m_wheel.remove(node);
+      m_id_map.erase(iter++);
+      delete node;
     }
+    else
+      ++iter;
   }
 }
-
@@ -23,22 +23,28 @@
 #ifndef HYPERTABLE_REQUESTCACHE_H
 #define HYPERTABLE_REQUESTCACHE_H
 
-#include <boost/thread/mutex.hpp>
+#include <vector>
+
 #include <boost/thread/xtime.hpp>
 
 #include "Common/HashMap.h"
 
 #include "DispatchHandler.h"
+#include "TimerWheel.h"
 
 namespace Hypertable {
 
   class IOHandler;
 
+  /**
+   * Outstanding requests of a reactor, by request id and by expiration
+   * time.  Timeouts are kept in a TimerWheel, so insert, remove and expiry
+   * are O(1) per request.  Not thread safe; the Reactor locks around it.
+   */
   class RequestCache {
 
-    struct CacheNode {
-      struct CacheNode  *prev, *next;
-      boost::xtime       expire;
+    class CacheNode : public TimerWheel::Entry {
+    public:
       uint32_t           id;
       IOHandler         *handler;
       DispatchHandler   *dh;
@@ -48,19 +54,43 @@ namespace Hypertable {
 
   public:
 
-    RequestCache() : m_id_map(), m_head(0), m_tail(0) { return; }
+    /** A timed out request */
+    struct Expired {
+      IOHandler         *handler;
+      DispatchHandler   *dh;
+    };
+
+    typedef std::vector<Expired> ExpiredList;
+
+    RequestCache() : m_id_map(), m_wheel() { return; }
+    ~RequestCache();
 
     void insert(uint32_t id, IOHandler *handler, DispatchHandler *dh, boost::xtime &expire);
 
     DispatchHandler *remove(uint32_t id);
 
-    DispatchHandler *get_next_timeout(boost::xtime &now, IOHandler *&handlerp, boost::xtime *next_timeout);
+    /**
+     * Removes the requests that have timed out by the given time
+     *
+     * @param now current time
+     * @param expired list to append the timed out requests to
+     */
+    void get_expired(boost::xtime &now, ExpiredList &expired);
+
+    /**
+     * Returns the time at which #get_expired needs to be called next
+     *
+     * @param next set to the next wakeup time
+     * @return false if there are no outstanding requests
+     */
+    bool next_wakeup(boost::xtime &next) { return m_wheel.next_wakeup(next); }
 
     void purge_requests(IOHandler *handler);
 
   private:
     IdHandlerMap  m_id_map;
-    CacheNode    *m_head, *m_tail;
+    TimerWheel    m_wheel;
+    TimerWheel::EntryList m_expired;
   };
 }
 
@@ -0,0 +1,177 @@
+/**
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or any later version.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "Common/Compat.h"
+
+#include "TimerWheel.h"
+using namespace Hypertable;
+
+namespace {
+  const uint64_t TICK_NANOS = TimerWheel::TICK_MILLIS * 1000000ULL;
+}
+
+
+TimerWheel::TimerWheel() : m_count(0) {
+  boost::xtime now;
+
+  for (size_t i=0; i<ROOT_SIZE; i++)
+    m_root[i].prev = m_root[i].next = &m_root[i];
+  for (size_t level=0; level<LEVELS-1; level++)
+    for (size_t i=0; i<LEVEL_SIZE; i++)
+      m_levels[level][i].prev = m_levels[level][i].next = &m_levels[level][i];
+
+  boost::xtime_get(&now, boost::TIME_UTC);
+  m_current_tick = to_tick(now, false);
+}
+
+
+void TimerWheel::insert(Entry *entry, const boost::xtime &expire) {
+
+  // An empty wheel is not advanced, so bring it up to date first to keep
+  // the next advance from stepping through all of the idle time
+  if (m_count == 0) {
+    boost::xtime now;
+    boost::xtime_get(&now, boost::TIME_UTC);
+    uint64_t now_tick = to_tick(now, false);
+    if (now_tick > m_current_tick)
+      m_current_tick = now_tick;
+  }
+
+  entry->expire_tick = to_tick(expire, true);
+  link(entry);
+  m_count++;
+}
+
+
+void TimerWheel::remove(Entry *entry) {
+  if (!entry->is_linked())
+    return;
+  entry->prev->next = entry->next;
+  entry->next->prev = entry->prev;
+  entry->prev = entry->next = 0;
+  m_count--;
+}
+
+
+void TimerWheel::advance(const boost::xtime &now, EntryList &expired) {
+  uint64_t now_tick = to_tick(now, false);
+
+  while (m_count > 0 && m_current_tick <= now_tick) {
+    size_t index = m_current_tick & (ROOT_SIZE-1);
+
+    if (index == 0) {
+      for (int level=0; level<LEVELS-1; level++)
+        if (cascade(level))
+          break;
+    }
+    m_current_tick++;
+
+    Entry *head = &m_root[index];
+    while (head->next != head) {
+      Entry *entry = head->next;
+      head->next = entry->next;
+      entry->prev = entry->next = 0;
+      expired.push_back(entry);
+      m_count--;
+    }
+    head->prev = head;
+  }
+
+  if (m_count == 0 && m_current_tick <= now_tick)
+    m_current_tick = now_tick + 1;
+}
+
+
+bool TimerWheel::next_wakeup(boost::xtime &next) {
+  uint64_t tick = m_current_tick;
+
+  if (m_count == 0)
+    return false;
+
+  // stop at the end of the turn, the outer wheels are cascaded there
+  if (tick & (ROOT_SIZE-1)) {
+    while ((tick & (ROOT_SIZE-1)) != 0 &&
+           m_root[tick & (ROOT_SIZE-1)].next == &m_root[tick & (ROOT_SIZE-1)])
+      tick++;
+  }
+
+  uint64_t nanos = tick * TICK_NANOS;
+  next.sec = nanos / 1000000000ULL;
+  next.nsec = nanos % 1000000000ULL;
+  return true;
+}
+
+
+uint64_t TimerWheel::to_tick(const boost::xtime &xt, bool round_up) {
+  uint64_t nanos = (uint64_t)xt.sec * 1000000000ULL + xt.nsec;
+  if (round_up)
+    nanos += TICK_NANOS - 1;
+  return nanos / TICK_NANOS;
+}
+
+
+void TimerWheel::link(Entry *entry) {
+  uint64_t expires = entry->expire_tick;
+  Entry *head = 0;
+
+  if (expires < m_current_tick)
+    head = &m_root[m_current_tick & (ROOT_SIZE-1)];
+  else if (expires - m_current_tick < ROOT_SIZE)
+    head = &m_root[expires & (ROOT_SIZE-1)];
+  else {
+    for (int level=0; level<LEVELS-1; level++) {
+      int shift = ROOT_BITS + level*LEVEL_BITS;
+      uint64_t span = 1ULL << (shift + LEVEL_BITS);
+      if (expires - m_current_tick < span || level == LEVELS-2) {
+        if (expires - m_current_tick >= span)
+          entry->expire_tick = expires = m_current_tick + span - 1;
+        head = &m_levels[level][(expires >> shift) & (LEVEL_SIZE-1)];
+        break;
+      }
+    }
+  }
+
+  entry->next = head;
+  entry->prev = head->prev;
+  head->prev->next = entry;
+  head->prev = entry;
+}
+
+
+/**
+ * Re-inserts the entries of the current slot of an outer wheel.  Returns
+ * true if the slot index is not zero, i.e. the next wheel out does not turn
+ * over as well.
+ */
+bool TimerWheel::cascade(int level) {
+  size_t index = (m_current_tick >> (ROOT_BITS + level*LEVEL_BITS)) & (LEVEL_SIZE-1);
+  Entry *head = &m_levels[level][index];
+  Entry *entry = head->next;
+
+  head->prev = head->next = head;
+
+  while (entry != head) {
+    Entry *next = entry->next;
+    link(entry);
+    entry = next;
+  }
+  return index != 0;
+}
@@ -0,0 +1,118 @@
+/**
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or any later version.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef HYPERTABLE_TIMERWHEEL_H
+#define HYPERTABLE_TIMERWHEEL_H
+
+#include <vector>
+
+#include <boost/thread/xtime.hpp>
+
+namespace Hypertable {
+
+  /**
+   * Hierarchical timer wheel.  Insert and remove are O(1) and expiring
+   * costs O(1) per tick elapsed plus O(1) per entry, independent of the
+   * number of entries.  Time is kept in ticks of TICK_MILLIS milliseconds;
+   * entries fire on the first tick at or after their expiration time.
+   *
+   * The root wheel has a slot per tick for the next 256 ticks.  Each of the
+   * three outer wheels has 64 slots, each covering a whole turn of the
+   * wheel inside it; when the root wheel wraps, the next slot of the outer
+   * wheel is emptied and its entries are re-inserted ("cascaded") closer
+   * in.  Expirations more than 2^26 ticks (about a week) out are clamped.
+   *
+   * Entries are intrusive; callers derive their records from
+   * TimerWheel::Entry.  The wheel does no locking.
+   */
+  class TimerWheel {
+
+  public:
+
+    class Entry {
+    public:
+      Entry() : prev(0), next(0), expire_tick(0) { return; }
+      bool is_linked() const { return next != 0; }
+      Entry    *prev;
+      Entry    *next;
+      uint64_t  expire_tick;
+    };
+
+    typedef std::vector<Entry *> EntryList;
+
+    enum {
+      TICK_MILLIS = 10,
+      ROOT_BITS = 8,
+      LEVEL_BITS = 6,
+      LEVELS = 4,
+      ROOT_SIZE = 1 << ROOT_BITS,
+      LEVEL_SIZE = 1 << LEVEL_BITS
+    };
+
+    TimerWheel();
+
+    /**
+     * Schedules an entry to expire at the given time.  The entry must not
+     * be linked already.
+     */
+    void insert(Entry *entry, const boost::xtime &expire);
+
+    /**
+     * Removes an entry.  Does nothing if it is not linked (for example
+     * because it has expired).
+     */
+    void remove(Entry *entry);
+
+    /**
+     * Advances the wheel up to the given time and appends the expired
+     * entries to the list, unlinked
+     *
+     * @param now current time
+     * @param expired list to append the expired entries to
+     */
+    void advance(const boost::xtime &now, EntryList &expired);
+
+    /**
+     * Returns the time by which #advance needs to be called next, which is
+     * either the next expiration or, if nothing expires during the current
+     * turn of the root wheel, the end of the turn.
+     *
+     * @param next set to the next wakeup time
+     * @return false if the wheel is empty
+     */
+    bool next_wakeup(boost::xtime &next);
+
+    size_t size() { return m_count; }
+
+  private:
+    static uint64_t to_tick(const boost::xtime &xt, bool round_up);
+    void link(Entry *entry);
+    bool cascade(int level);
+
+    Entry     m_root[ROOT_SIZE];
+    Entry     m_levels[LEVELS-1][LEVEL_SIZE];
+    uint64_t  m_current_tick;   // next tick to process
+    size_t    m_count;
+  };
+
+}
+
+#endif // HYPERTABLE_TIMERWHEEL_H
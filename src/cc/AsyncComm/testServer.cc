@@ -69,6 +69,7 @@ namespace {
     "  --port=<n>      Specifies the port to listen on (default=11255)",
     "  --app-queue     Use an application queue for handling requests",
     "  --reactors=<n>  Specifies the number of reactors (default=1)",
+    "  --edge-triggered  Poll connections edge-triggered",
     "  --delay=<ms>    Specifies milliseconds to wait before echoing message (default=0)",
     "  --udp           Operate in UDP mode instead of TCP",
     "  --verbose,-v    Generate verbose output",
@@ -213,6 +214,7 @@ int main(int argc, char **argv) {
   int rval, error;
   uint16_t port = DEFAULT_PORT;
   int reactor_count = 2;
+  int reactor_flags = 0;
   ConnectionHandlerFactoryPtr chfp;
   ApplicationQueue *app_queue = 0;
   bool udp = false;
@@ -242,6 +244,8 @@ int main(int argc, char **argv) {
     }
     else if (!strncmp(argv[i], "--reactors=", 11))
       reactor_count = atoi(&argv[i][11]);
+    else if (!strcmp(argv[i], "--edge-triggered"))
+      reactor_flags |= ReactorFactory::EDGE_TRIGGERED;
     else if (!strncmp(argv[i], "--delay=", 8))
       g_delay = atoi(&argv[i][8]);
     else if (!strcmp(argv[i], "--udp"))
@@ -253,7 +257,7 @@ int main(int argc, char **argv) {
   }
 
   System::initialize(argv[0]);
-  ReactorFactory::initialize(reactor_count);
+  ReactorFactory::initialize(reactor_count, reactor_flags);
 
   comm = new Comm();
 
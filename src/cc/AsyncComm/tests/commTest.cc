@@ -20,20 +20,26 @@
  */
 
 #include "Common/Compat.h"
+#include <algorithm>
 #include <cstdlib>
+#include <vector>
 
 extern "C" {
 #include <poll.h>
 #include <signal.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
 }
 
+#include <boost/thread/condition.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/thread/thread.hpp>
 
 #include "Common/Error.h"
 #include "Common/FileUtils.h"
 #include "Common/InetAddr.h"
+#include "Common/Serialization.h"
 #include "Common/TestHarness.h"
 #include "Common/StringExt.h"
 #include "Common/System.h"
@@ -42,6 +48,7 @@ extern "C" {
 #include "AsyncComm/Comm.h"
 #include "AsyncComm/ConnectionManager.h"
 #include "AsyncComm/Event.h"
+#include "AsyncComm/HeaderBuilder.h"
 #include "AsyncComm/ReactorFactory.h"
 
 #include "CommTestThreadFunction.h"
@@ -50,20 +57,36 @@ using namespace Hypertable;
 
 namespace {
   const char *usage[] = {
-    "usage: commTest",
+    "usage: commTest [OPTIONS]",
     "",
-    "This program ...",
+    "OPTIONS:",
+    "  --edge-triggered  Run client and server reactors edge-triggered",
+    "  --benchmark       Also time a stream of echo requests and report",
+    "                    messages/sec and latency percentiles",
+    "",
+    "This program sends the words file to a testServer from two threads",
+    "and checks that every word is echoed back in order.",
     0
   };
 
   const int DEFAULT_PORT = 32998;
   const char *DEFAULT_PORT_ARG = "--port=32998";
+  const int EDGE_TRIGGERED_PORT = 32999;
+  const char *EDGE_TRIGGERED_PORT_ARG = "--port=32999";
+
+  const int BENCHMARK_MESSAGES = 200000;
+  const int BENCHMARK_MAX_OUTSTANDING = 100;
 
   class ServerLauncher {
   public:
-    ServerLauncher() {
+    ServerLauncher(bool edge_triggered) {
       if ((m_child_pid = fork()) == 0) {
-        execl("./testServer", "./testServer", DEFAULT_PORT_ARG, "--app-queue", (char *)0);
+        if (edge_triggered)
+          execl("./testServer", "./testServer", EDGE_TRIGGERED_PORT_ARG,
+                "--app-queue", "--edge-triggered", (char *)0);
+        else
+          execl("./testServer", "./testServer", DEFAULT_PORT_ARG,
+                "--app-queue", (char *)0);
       }
       poll(0,0,2000);
     }
@@ -75,25 +98,132 @@ namespace {
       pid_t m_child_pid;
   };
 
+  uint64_t get_micros() {
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return (uint64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+  }
+
+  /**
+   * Collects echoed benchmark messages.  Each message carries the time it
+   * was sent, so the round trip latency is known on arrival.
+   */
+  class BenchmarkHandler : public DispatchHandler {
+  public:
+    BenchmarkHandler() : m_outstanding(0), m_failed(false) { }
+
+    virtual void handle(EventPtr &event_ptr) {
+      boost::mutex::scoped_lock lock(m_mutex);
+      if (event_ptr->type == Event::MESSAGE) {
+        const uint8_t *ptr = event_ptr->message;
+        size_t remaining = event_ptr->message_len;
+        uint64_t sent = Serialization::decode_i64(&ptr, &remaining);
+        m_latencies.push_back(get_micros() - sent);
+      }
+      else {
+        HT_ERRORF("%s", event_ptr->to_str().c_str());
+        m_failed = true;
+      }
+      m_outstanding--;
+      m_cond.notify_one();
+    }
+
+    void wait_for_outstanding(int max_outstanding) {
+      boost::mutex::scoped_lock lock(m_mutex);
+      while (m_outstanding > max_outstanding)
+        m_cond.wait(lock);
+    }
+
+    void increment_outstanding() {
+      boost::mutex::scoped_lock lock(m_mutex);
+      m_outstanding++;
+    }
+
+    bool failed() {
+      boost::mutex::scoped_lock lock(m_mutex);
+      return m_failed;
+    }
+
+    std::vector<uint64_t> &latencies() { return m_latencies; }
+
+  private:
+    boost::mutex      m_mutex;
+    boost::condition  m_cond;
+    int               m_outstanding;
+    bool              m_failed;
+    std::vector<uint64_t> m_latencies;
+  };
+
+  /**
+   * Sends BENCHMARK_MESSAGES small requests, keeping up to
+   * BENCHMARK_MAX_OUTSTANDING of them in flight, and reports throughput
+   * and round trip latency
+   */
+  bool run_benchmark(Comm *comm, struct sockaddr_in &addr) {
+    HeaderBuilder hbuilder(Header::PROTOCOL_NONE, rand());
+    BenchmarkHandler *handler = new BenchmarkHandler();
+    DispatchHandlerPtr dhp(handler);
+    uint64_t start_time, elapsed;
+    int error;
+
+    start_time = get_micros();
+    for (int i=0; i<BENCHMARK_MESSAGES; i++) {
+      handler->wait_for_outstanding(BENCHMARK_MAX_OUTSTANDING - 1);
+      CommBufPtr cbp(new CommBuf(hbuilder, 8));
+      cbp->append_i64(get_micros());
+      handler->increment_outstanding();
+      if ((error = comm->send_request(addr, 30, cbp, handler)) != Error::OK) {
+        HT_ERRORF("Comm::send_request returned '%s'", Error::get_text(error));
+        return false;
+      }
+    }
+    handler->wait_for_outstanding(0);
+    elapsed = get_micros() - start_time;
+
+    if (handler->failed())
+      return false;
+
+    std::vector<uint64_t> &latencies = handler->latencies();
+    std::sort(latencies.begin(), latencies.end());
+    size_t count = latencies.size();
+
+    printf("%d messages in %.3f seconds, %.0f messages/sec\n", (int)count,
+           (double)elapsed / 1000000.0, (double)count * 1000000.0 / elapsed);
+    printf("latency (usec): p50=%llu p90=%llu p99=%llu max=%llu\n",
+           (Llu)latencies[count / 2], (Llu)latencies[(count * 9) / 10],
+           (Llu)latencies[(count * 99) / 100], (Llu)latencies[count - 1]);
+    return true;
+  }
+
 }
 
 
 int main(int argc, char **argv) {
   boost::thread  *thread1, *thread2;
   struct sockaddr_in addr;
-  ServerLauncher slauncher;
   Comm *comm;
   ConnectionManagerPtr conn_mgr;
+  bool edge_triggered = false;
+  bool benchmark = false;
+
+  for (int i=1; i<argc; i++) {
+    if (!strcmp(argv[i], "--edge-triggered"))
+      edge_triggered = true;
+    else if (!strcmp(argv[i], "--benchmark"))
+      benchmark = true;
+    else
+      Usage::dump_and_exit(usage);
+  }
 
-  if (argc != 1)
-    Usage::dump_and_exit(usage);
+  ServerLauncher slauncher(edge_triggered);
 
   srand(8876);
 
   System::initialize(argv[0]);
-  ReactorFactory::initialize(1);
+  ReactorFactory::initialize(1, edge_triggered ? ReactorFactory::EDGE_TRIGGERED : 0);
 
-  InetAddr::initialize(&addr, "localhost", DEFAULT_PORT);
+  InetAddr::initialize(&addr, "localhost",
+                       edge_triggered ? EDGE_TRIGGERED_PORT : DEFAULT_PORT);
 
   comm = new Comm();
 
@@ -105,18 +235,20 @@ int main(int argc, char **argv) {
   }
 
   CommTestThreadFunction thread_func(comm, addr, "./words");
+  const char *output1 = edge_triggered ? "commTest-et.output.1" : "commTest.output.1";
+  const char *output2 = edge_triggered ? "commTest-et.output.2" : "commTest.output.2";
 
-  thread_func.set_output_file("commTest.output.1");
+  thread_func.set_output_file(output1);
   thread1 = new boost::thread(thread_func);
 
-  thread_func.set_output_file("commTest.output.2");
+  thread_func.set_output_file(output2);
   thread2 = new boost::thread(thread_func);
 
   thread1->join();
   thread2->join();
 
   std::string tmp_file = (std::string)"/tmp/commTest" + (int)getpid();
-  std::string cmd_str = (std::string)"head -" + (int)MAX_MESSAGES + " ./words > " + tmp_file  + " ; diff " + tmp_file + " commTest.output.1";
+  std::string cmd_str = (std::string)"head -" + (int)MAX_MESSAGES + " ./words > " + tmp_file  + " ; diff " + tmp_file + " " + output1;
 
   if (system(cmd_str.c_str()))
     return 1;
@@ -125,7 +257,11 @@ int main(int argc, char **argv) {
   if (system(cmd_str.c_str()))
     return 1;
 
-  if (system("diff commTest.output.1 commTest.output.2"))
+  cmd_str = (std::string)"diff " + output1 + " " + output2;
+  if (system(cmd_str.c_str()))
+    return 1;
+
+  if (benchmark && !run_benchmark(comm, addr))
     return 1;
 
   ReactorFactory::destroy();
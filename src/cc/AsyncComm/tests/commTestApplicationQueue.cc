@@ -0,0 +1,281 @@
+/**
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or any later version.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "Common/Compat.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+extern "C" {
+#include <unistd.h>
+}
+
+#include <boost/thread/condition.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/xtime.hpp>
+
+#include "Common/Usage.h"
+
+#include "AsyncComm/ApplicationHandler.h"
+#include "AsyncComm/ApplicationQueue.h"
+#include "AsyncComm/Event.h"
+
+using namespace std;
+using namespace Hypertable;
+
+namespace {
+  const char *usage[] = {
+    "usage: commTestApplicationQueue [--seed=<n>]",
+    "",
+    "This program tests the application queue.  Requests of several thread",
+    "groups are added from several threads and must run one at a time per",
+    "group, in the order they were added.  Requests dealt to the queue of a",
+    "worker that is held up by a long request must be taken and run by the",
+    "other workers, also when those are asleep when the requests arrive.",
+    0
+  };
+
+  const int WORKERS = 4;
+
+  /**
+   * State shared by the test and its requests
+   */
+  class TestState {
+  public:
+    TestState(size_t groups) : running(groups, 0), order(groups), completed(0),
+                               gate_open(false), blocked(false), errors(0) { }
+
+    void error(const char *msg) {
+      if (errors++ < 10)
+        cout << msg << endl;
+    }
+
+    boost::mutex      mutex;
+    boost::condition  cond;
+    vector<int>       running;
+    vector< vector<int> > order;
+    size_t            completed;
+    bool              gate_open;
+    bool              blocked;
+    size_t            errors;
+  };
+
+  /**
+   * Records that it ran, checking that no other request of its group runs
+   * at the same time.  A request with sequence number -1 holds its worker
+   * until the gate opens.
+   */
+  class TestHandler : public ApplicationHandler {
+  public:
+    TestHandler(EventPtr &event_ptr, TestState &state, int group, int seq,
+                int micros)
+      : ApplicationHandler(event_ptr), m_state(state), m_group(group),
+        m_seq(seq), m_micros(micros) { }
+
+    virtual void run() {
+      if (m_seq == -1) {
+        boost::mutex::scoped_lock lock(m_state.mutex);
+        m_state.blocked = true;
+        m_state.cond.notify_all();
+        while (!m_state.gate_open)
+          m_state.cond.wait(lock);
+        return;
+      }
+
+      if (m_group >= 0) {
+        boost::mutex::scoped_lock lock(m_state.mutex);
+        if (m_state.running[m_group]++ > 0)
+          m_state.error("two requests of one group running at once");
+        m_state.order[m_group].push_back(m_seq);
+      }
+
+      if (m_micros)
+        usleep(m_micros);
+
+      boost::mutex::scoped_lock lock(m_state.mutex);
+      if (m_group >= 0)
+        m_state.running[m_group]--;
+      m_state.completed++;
+      m_state.cond.notify_all();
+    }
+
+  private:
+    TestState &m_state;
+    int m_group;
+    int m_seq;
+    int m_micros;
+  };
+
+  ApplicationHandler *make_handler(TestState &state, int group, int seq,
+                                   int micros) {
+    EventPtr event_ptr = new Event(Event::MESSAGE);
+    if (group >= 0)
+      event_ptr->thread_group = ((uint64_t)(group + 1) << 32) | 1;
+    return new TestHandler(event_ptr, state, group, seq, micros);
+  }
+
+  /**
+   * Adds the requests of a range of thread groups, in sequence, with the
+   * groups interleaved
+   */
+  class Adder {
+  public:
+    Adder(ApplicationQueuePtr &queue_ptr, TestState &state, int first_group,
+          int groups, int requests)
+      : m_queue_ptr(queue_ptr), m_state(state), m_first_group(first_group),
+        m_groups(groups), m_requests(requests) { }
+
+    void operator()() {
+      for (int seq=0; seq<m_requests; seq++)
+        for (int g=m_first_group; g<m_first_group+m_groups; g++)
+          m_queue_ptr->add(make_handler(m_state, g, seq, random() % 50));
+    }
+
+  private:
+    ApplicationQueuePtr m_queue_ptr;
+    TestState &m_state;
+    int m_first_group;
+    int m_groups;
+    int m_requests;
+  };
+
+  bool wait_completed(TestState &state, size_t count, int seconds) {
+    boost::mutex::scoped_lock lock(state.mutex);
+    boost::xtime deadline;
+    boost::xtime_get(&deadline, boost::TIME_UTC);
+    deadline.sec += seconds;
+    while (state.completed < count)
+      if (!state.cond.timed_wait(lock, deadline))
+        return state.completed >= count;
+    return true;
+  }
+
+  bool test_group_order() {
+    const int ADDERS = 4, GROUPS_PER_ADDER = 8, REQUESTS = 100;
+    ApplicationQueuePtr queue_ptr = new ApplicationQueue(WORKERS);
+    TestState state(ADDERS * GROUPS_PER_ADDER);
+    boost::thread_group adders;
+
+    for (int i=0; i<ADDERS; i++)
+      adders.create_thread(Adder(queue_ptr, state, i * GROUPS_PER_ADDER,
+                                 GROUPS_PER_ADDER, REQUESTS));
+    adders.join_all();
+
+    queue_ptr->shutdown();
+    queue_ptr->join();
+
+    for (size_t g=0; g<state.order.size(); g++) {
+      if (state.order[g].size() != (size_t)REQUESTS) {
+        cout << "group " << g << " ran " << state.order[g].size() << " of "
+             << REQUESTS << " requests" << endl;
+        return false;
+      }
+      for (int i=0; i<REQUESTS; i++) {
+        if (state.order[g][i] != i) {
+          cout << "request " << state.order[g][i] << " of group " << g
+               << " ran in place " << i << endl;
+          return false;
+        }
+      }
+    }
+
+    ApplicationQueue::StatisticsMap stats;
+    uint16_t request_type = ApplicationHandler::REQUEST_TYPE_NONE;
+    queue_ptr->get_statistics(stats);
+    if (stats[request_type].service_micros.count !=
+        (uint64_t)(ADDERS * GROUPS_PER_ADDER * REQUESTS)) {
+      cout << "statistics count " << stats[request_type].service_micros.count
+           << " requests" << endl;
+      return false;
+    }
+
+    return state.errors == 0;
+  }
+
+  /**
+   * Holds up one worker and adds ungrouped requests, which are dealt to
+   * all worker queues.  They must all run while the worker is held up.
+   * With a delay between them, the other workers are asleep whenever a
+   * request arrives.
+   */
+  bool test_steal(int delay_micros) {
+    const size_t REQUESTS = 200;
+    ApplicationQueuePtr queue_ptr = new ApplicationQueue(WORKERS);
+    TestState state(0);
+    bool ok;
+
+    queue_ptr->add(make_handler(state, -1, -1, 0));
+    {
+      boost::mutex::scoped_lock lock(state.mutex);
+      while (!state.blocked)
+        state.cond.wait(lock);
+    }
+
+    for (size_t i=0; i<REQUESTS; i++) {
+      queue_ptr->add(make_handler(state, -1, i, random() % 50));
+      if (delay_micros)
+        usleep(delay_micros);
+    }
+
+    ok = wait_completed(state, REQUESTS, 20);
+    if (!ok)
+      cout << state.completed << " of " << REQUESTS << " requests ran "
+           << "while a worker was held up" << endl;
+
+    {
+      boost::mutex::scoped_lock lock(state.mutex);
+      state.gate_open = true;
+      state.cond.notify_all();
+    }
+
+    queue_ptr->shutdown();
+    queue_ptr->join();
+    return ok && state.errors == 0;
+  }
+
+}
+
+
+int main(int argc, char **argv) {
+  uint32_t seed = 1;
+
+  for (int i=1; i<argc; i++) {
+    if (!strncmp(argv[i], "--seed=", 7))
+      seed = atoi(&argv[i][7]);
+    else
+      Usage::dump_and_exit(usage);
+  }
+
+  cout << "commTestApplicationQueue SEED = " << seed << endl;
+  srandom(seed);
+
+  if (!test_group_order())
+    return 1;
+
+  if (!test_steal(0))
+    return 1;
+
+  if (!test_steal(500))
+    return 1;
+
+  return 0;
+}
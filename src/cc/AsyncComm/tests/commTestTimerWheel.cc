@@ -0,0 +1,347 @@
+/**
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or any later version.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "Common/Compat.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "Common/String.h"
+#include "Common/Usage.h"
+
+#include "AsyncComm/TimerWheel.h"
+
+using namespace std;
+using namespace Hypertable;
+
+namespace {
+  const char *usage[] = {
+    "usage: commTestTimerWheel [--seed=<n>]",
+    "",
+    "This program tests the timer wheel used for request timeouts and",
+    "timers.  Entries are scheduled at random times on every level of the",
+    "wheel, across cascade boundaries, in the past and beyond the clamp,",
+    "and some are removed, partly after having been cascaded.  The wheel",
+    "is driven with a simulated clock to check that every entry that is",
+    "not removed expires exactly once, on the first tick at or after its",
+    "expiration time.",
+    0
+  };
+
+  const uint64_t TICK = TimerWheel::TICK_MILLIS;
+  const uint64_t MAX_TICKS = 1ULL << (TimerWheel::ROOT_BITS +
+      (TimerWheel::LEVELS - 1) * TimerWheel::LEVEL_BITS);
+
+  enum { LIVE, EXPIRED, REMOVED };
+
+  class TestEntry : public TimerWheel::Entry {
+  public:
+    uint64_t expire_ms;    // requested expiration time
+    uint64_t expect_tick;  // tick on which it should expire
+    uint64_t insert_tick;  // next tick to process at insertion
+    int state;
+  };
+
+  boost::xtime to_xtime(uint64_t ms) {
+    boost::xtime xt;
+    xt.sec = ms / 1000;
+    xt.nsec = (ms % 1000) * 1000000;
+    return xt;
+  }
+
+  uint64_t random64() {
+    return ((uint64_t)random() << 31) ^ (uint64_t)random();
+  }
+
+  class WheelTest {
+  public:
+    WheelTest() : m_live(0), m_expired(0), m_removed(0),
+                  m_removed_cascaded(0), m_errors(0) {
+      boost::xtime now;
+
+      // run the simulated clock ahead of the real one, so that inserts
+      // into an empty wheel don't pull it back to the real time
+      boost::xtime_get(&now, boost::TIME_UTC);
+      m_now = ((uint64_t)now.sec + 86400) * 1000;
+      advance(m_now);
+    }
+
+    ~WheelTest() {
+      for (size_t i=0; i<m_entries.size(); i++)
+        delete m_entries[i];
+    }
+
+    /**
+     * Schedules an entry the given number of milliseconds from now
+     * (negative for the past)
+     */
+    void insert(int64_t delta) {
+      TestEntry *entry = new TestEntry();
+      uint64_t tick;
+
+      entry->expire_ms = m_now + delta;
+      entry->insert_tick = m_now / TICK + 1;
+      entry->state = LIVE;
+
+      tick = (entry->expire_ms + TICK - 1) / TICK;
+      if (tick < entry->insert_tick)
+        tick = entry->insert_tick;
+      else if (tick - entry->insert_tick >= MAX_TICKS)
+        tick = entry->insert_tick + MAX_TICKS - 1;
+      entry->expect_tick = tick;
+
+      m_wheel.insert(entry, to_xtime(entry->expire_ms));
+      m_entries.push_back(entry);
+      m_live++;
+    }
+
+    /**
+     * Schedules entries on every level of the wheel, around the next
+     * cascade boundaries, in the past and beyond the clamp
+     */
+    void insert_random(size_t count) {
+      uint64_t now_tick = m_now / TICK + 1;
+
+      for (size_t i=0; i<count; i++) {
+        int level = random() % TimerWheel::LEVELS;
+        int bits = TimerWheel::ROOT_BITS + level * TimerWheel::LEVEL_BITS;
+        int64_t delta;
+
+        switch (random() % 6) {
+        case 0:
+        case 1:
+          delta = random64() % ((1ULL << bits) * TICK);
+          break;
+        case 2: {
+          // within a few ticks of the next boundary of that level
+          uint64_t span = 1ULL << bits;
+          uint64_t boundary = (now_tick / span + 1 + random() % 2) * span;
+          delta = (int64_t)(boundary * TICK) - (int64_t)m_now
+                  + (int64_t)(random() % (4 * TICK)) - (int64_t)(2 * TICK);
+          break;
+        }
+        case 3:
+          delta = -(int64_t)(random() % (1000 * TICK));
+          break;
+        case 4:
+          delta = (MAX_TICKS + random64() % MAX_TICKS) * TICK;
+          break;
+        default:
+          delta = random() % (3 * TICK);
+          break;
+        }
+        insert(delta);
+      }
+    }
+
+    /**
+     * Removes some of the live entries at random, counting the ones that
+     * were placed beyond the root wheel and have been cascaded since
+     */
+    void remove_random(size_t count) {
+      uint64_t now_tick = m_now / TICK + 1;
+
+      for (size_t i=0; i<count && m_live > 0; i++) {
+        TestEntry *entry = m_entries[random() % m_entries.size()];
+        if (entry->state != LIVE)
+          continue;
+        if (entry->expect_tick - entry->insert_tick >= TimerWheel::ROOT_SIZE &&
+            now_tick / TimerWheel::ROOT_SIZE >
+            entry->insert_tick / TimerWheel::ROOT_SIZE)
+          m_removed_cascaded++;
+        m_wheel.remove(entry);
+        entry->state = REMOVED;
+        m_removed++;
+        m_live--;
+        // removing twice is a no-op
+        m_wheel.remove(entry);
+      }
+    }
+
+    /**
+     * Advances the simulated clock and checks the entries that expire.
+     * An entry must not expire before its tick nor after an earlier
+     * advance; when <i>exact</i> is set the clock was stepped to the
+     * wakeup time, so each entry must expire on its tick exactly.
+     */
+    void advance(uint64_t now, bool exact=false) {
+      TimerWheel::EntryList expired;
+      uint64_t prev_tick = m_now / TICK;
+      uint64_t now_tick = now / TICK;
+
+      m_now = now;
+      m_wheel.advance(to_xtime(now), expired);
+
+      for (size_t i=0; i<expired.size(); i++) {
+        TestEntry *entry = (TestEntry *)expired[i];
+        if (entry->state != LIVE) {
+          error(entry, (entry->state == REMOVED) ? "removed entry expired"
+                : "entry expired twice");
+          continue;
+        }
+        entry->state = EXPIRED;
+        m_expired++;
+        m_live--;
+        if (now_tick < entry->expect_tick)
+          error(entry, "entry expired early");
+        else if (entry->expect_tick <= prev_tick ||
+                 (exact && now_tick != entry->expect_tick))
+          error(entry, "entry expired late");
+        else if (exact && entry->expire_ms > entry->insert_tick * TICK &&
+                 entry->expect_tick < entry->insert_tick + MAX_TICKS - 1 &&
+                 now >= entry->expire_ms + TICK)
+          error(entry, "entry expired more than a tick after its time");
+      }
+
+      if (m_wheel.size() != m_live) {
+        cout << "wheel holds " << m_wheel.size() << " entries, expected "
+             << m_live << endl;
+        m_errors++;
+      }
+    }
+
+    /**
+     * Runs the clock from wakeup to wakeup until the wheel is empty,
+     * inserting and removing entries along the way
+     */
+    void run(size_t churn) {
+      boost::xtime next;
+      size_t steps = 0;
+
+      while (m_wheel.next_wakeup(next) && m_errors < 10) {
+        uint64_t next_ms = (uint64_t)next.sec * 1000 + next.nsec / 1000000;
+        if (next_ms <= m_now) {
+          cout << "wakeup " << next_ms << " is not after " << m_now << endl;
+          m_errors++;
+          break;
+        }
+        advance(next_ms, true);
+        if (churn && (++steps % 64) == 0) {
+          insert_random(churn);
+          remove_random(churn / 2);
+          churn--;
+        }
+      }
+
+      for (size_t i=0; i<m_entries.size(); i++)
+        if (m_entries[i]->state == LIVE)
+          error(m_entries[i], "entry never expired");
+    }
+
+    void error(TestEntry *entry, const char *msg) {
+      if (m_errors++ < 10)
+        cout << msg << ": expire=" << entry->expire_ms << " expected tick="
+             << entry->expect_tick << " inserted at tick="
+             << entry->insert_tick << " now=" << m_now << endl;
+    }
+
+    TimerWheel           m_wheel;
+    vector<TestEntry *>  m_entries;
+    uint64_t             m_now;
+    size_t               m_live;
+    size_t               m_expired;
+    size_t               m_removed;
+    size_t               m_removed_cascaded;
+    size_t               m_errors;
+  };
+
+  /**
+   * Removes entries that have been cascaded from each outer wheel into
+   * the root wheel, and checks that the rest still expire on time
+   */
+  bool test_remove_after_cascade() {
+    WheelTest test;
+    uint64_t now_tick = test.m_now / TICK + 1;
+
+    for (int level=0; level<TimerWheel::LEVELS-1; level++) {
+      int bits = TimerWheel::ROOT_BITS + level * TimerWheel::LEVEL_BITS;
+      uint64_t boundary = (now_tick / (1ULL << bits) + 2) << bits;
+      for (uint64_t i=0; i<8; i++)
+        test.insert((boundary + TimerWheel::ROOT_SIZE / 2 + i) * TICK
+                    - test.m_now);
+    }
+
+    // step to each boundary, which cascades that group into the root
+    // wheel, and remove every other entry of the group
+    for (int level=0; level<TimerWheel::LEVELS-1; level++) {
+      TestEntry *first = test.m_entries[level * 8];
+      uint64_t boundary = first->expect_tick - TimerWheel::ROOT_SIZE / 2;
+      test.advance(boundary * TICK);
+      for (size_t i=level*8; i<(size_t)level*8+8; i+=2) {
+        test.m_wheel.remove(test.m_entries[i]);
+        test.m_entries[i]->state = REMOVED;
+        test.m_live--;
+      }
+      test.advance(boundary * TICK + TICK);
+    }
+    test.run(0);
+
+    if (test.m_expired != test.m_entries.size() / 2 || test.m_errors) {
+      cout << "remove after cascade: " << test.m_expired << " of "
+           << test.m_entries.size() / 2 << " entries expired" << endl;
+      return false;
+    }
+    return true;
+  }
+
+  bool test_random(size_t count, size_t churn) {
+    WheelTest test;
+
+    test.insert_random(count);
+    test.remove_random(count / 10);
+    test.run(churn);
+
+    cout << "expired=" << test.m_expired << " removed=" << test.m_removed
+         << " removed after cascade=" << test.m_removed_cascaded << endl;
+
+    if (test.m_removed_cascaded == 0) {
+      cout << "no entry was removed after being cascaded" << endl;
+      return false;
+    }
+    return test.m_errors == 0 && test.m_wheel.size() == 0;
+  }
+
+}
+
+
+int main(int argc, char **argv) {
+  uint32_t seed = 1;
+
+  for (int i=1; i<argc; i++) {
+    if (!strncmp(argv[i], "--seed=", 7))
+      seed = atoi(&argv[i][7]);
+    else
+      Usage::dump_and_exit(usage);
+  }
+
+  cout << "commTestTimerWheel SEED = " << seed << endl;
+  srandom(seed);
+
+  if (!test_remove_after_cascade())
+    return 1;
+
+  for (int round=0; round<3; round++)
+    if (!test_random(5000, 40))
+      return 1;
+
+  return 0;
+}
@@ -0,0 +1,191 @@
+/** -*- c++ -*-
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or any later version.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hypertable. If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef HYPERTABLE_BLOOMFILTER_H
+#define HYPERTABLE_BLOOMFILTER_H
+
+#include <cmath>
+#include <cstring>
+
+#include <boost/noncopyable.hpp>
+
+#include "Serialization.h"
+
+namespace Hypertable {
+
+  /**
+   * Bloom filter over arbitrary byte strings.  Keys are reduced to a
+   * pair of 32-bit murmur hashes which are combined (Kirsch-Mitzenmacher
+   * double hashing) to produce the bit positions.  The reduced hash can
+   * be computed up front with hash() so that callers that do not know the
+   * number of items until the end (e.g. a CellStore being written) can
+   * collect hashes and size the filter afterwards.
+   */
+  class BloomFilter : boost::noncopyable {
+  public:
+
+    /**
+     * Constructs a filter sized for the given number of items and target
+     * false positive probability.
+     *
+     * @param items_estimate number of items that will be inserted
+     * @param false_positive_prob desired false positive probability
+     */
+    BloomFilter(size_t items_estimate, float false_positive_prob)
+      : m_num_hashes(0), m_num_bits(0), m_num_bytes(0), m_bits(0) {
+      double items = (double)(items_estimate ? items_estimate : 1);
+      double ln2 = log(2.0);
+      if (false_positive_prob <= 0.0 || false_positive_prob >= 1.0)
+        false_positive_prob = 0.01;
+      m_num_bits = (uint32_t)ceil(-(items * log(false_positive_prob))
+                                  / (ln2 * ln2));
+      if (m_num_bits < 64)
+        m_num_bits = 64;
+      // optimal count for the target, (bits / items) * ln2 before rounding
+      // the size up; more hashes on a small filter only add collisions
+      m_num_hashes = (uint32_t)floor(-log(false_positive_prob) / ln2 + 0.5);
+      if (m_num_hashes == 0)
+        m_num_hashes = 1;
+      allocate();
+    }
+
+    /**
+     * Constructs a filter by decoding a serialized representation
+     * produced by encode().
+     *
+     * @param bufp address of pointer to serialized filter (advanced)
+     * @param remainp address of remaining byte count (decremented)
+     */
+    BloomFilter(const uint8_t **bufp, size_t *remainp)
+      : m_num_hashes(0), m_num_bits(0), m_num_bytes(0), m_bits(0) {
+      decode(bufp, remainp);
+    }
+
+    ~BloomFilter() { delete [] m_bits; }
+
+    /**
+     * Reduces a key to the 64-bit value used for insertion and lookup.
+     */
+    static uint64_t hash(const void *key, size_t len) {
+      return ((uint64_t)murmur_hash2(key, len, 0x9747b28c) << 32)
+             | (uint64_t)murmur_hash2(key, len, 0x5bd1e995);
+    }
+
+    void insert(uint64_t hashval) {
+      uint32_t h1 = (uint32_t)(hashval >> 32);
+      uint32_t h2 = (uint32_t)hashval;
+      for (uint32_t i=0; i<m_num_hashes; i++) {
+        uint32_t bit = (h1 + i*h2) % m_num_bits;
+        m_bits[bit >> 3] |= (uint8_t)(1 << (bit & 7));
+      }
+    }
+
+    void insert(const void *key, size_t len) { insert(hash(key, len)); }
+
+    bool may_contain(uint64_t hashval) const {
+      uint32_t h1 = (uint32_t)(hashval >> 32);
+      uint32_t h2 = (uint32_t)hashval;
+      for (uint32_t i=0; i<m_num_hashes; i++) {
+        uint32_t bit = (h1 + i*h2) % m_num_bits;
+        if ((m_bits[bit >> 3] & (1 << (bit & 7))) == 0)
+          return false;
+      }
+      return true;
+    }
+
+    bool may_contain(const void *key, size_t len) const {
+      return may_contain(hash(key, len));
+    }
+
+    uint32_t get_num_hashes() const { return m_num_hashes; }
+    uint32_t get_num_bits() const { return m_num_bits; }
+    size_t size() const { return m_num_bytes; }
+
+    size_t encoded_length() const { return 8 + m_num_bytes; }
+
+    void encode(uint8_t **bufp) const {
+      Serialization::encode_i32(bufp, m_num_hashes);
+      Serialization::encode_i32(bufp, m_num_bits);
+      memcpy(*bufp, m_bits, m_num_bytes);
+      *bufp += m_num_bytes;
+    }
+
+    void decode(const uint8_t **bufp, size_t *remainp) {
+      m_num_hashes = Serialization::decode_i32(bufp, remainp);
+      m_num_bits = Serialization::decode_i32(bufp, remainp);
+      if (m_num_hashes == 0 || m_num_bits == 0)
+        HT_THROW(Error::SERIALIZATION_INPUT_OVERRUN, "Bad bloom filter header");
+      delete [] m_bits;
+      allocate();
+      HT_DECODE_NEED(*remainp, m_num_bytes);
+      memcpy(m_bits, *bufp, m_num_bytes);
+      *bufp += m_num_bytes;
+    }
+
+  private:
+
+    void allocate() {
+      m_num_bytes = (m_num_bits + 7) / 8;
+      m_bits = new uint8_t [m_num_bytes];
+      memset(m_bits, 0, m_num_bytes);
+    }
+
+    /**
+     * MurmurHash2, by Austin Appleby (public domain)
+     */
+    static uint32_t murmur_hash2(const void *key, size_t len, uint32_t seed) {
+      const uint32_t m = 0x5bd1e995;
+      const int r = 24;
+      uint32_t h = seed ^ (uint32_t)len;
+      const uint8_t *data = (const uint8_t *)key;
+
+      while (len >= 4) {
+        uint32_t k;
+        memcpy(&k, data, 4);
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h *= m;
+        h ^= k;
+        data += 4;
+        len -= 4;
+      }
+
+      switch (len) {
+      case 3: h ^= data[2] << 16;
+      case 2: h ^= data[1] << 8;
+      case 1: h ^= data[0];
+        h *= m;
+      };
+
+      h ^= h >> 13;
+      h *= m;
+      h ^= h >> 15;
+      return h;
+    }
+
+    uint32_t m_num_hashes;
+    uint32_t m_num_bits;
+    size_t   m_num_bytes;
+    uint8_t *m_bits;
+  };
+
+} // namespace Hypertable
+
+#endif // HYPERTABLE_BLOOMFILTER_H
@@ -0,0 +1,226 @@
+/**
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or any later version.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "Common/Compat.h"
+
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+
+#include "BufferPool.h"
+
+using namespace Hypertable;
+
+namespace {
+
+  /** Bytes of each size class a thread keeps to itself */
+  const size_t THREAD_CACHE_BYTES = 512 * 1024;
+
+  /** Most buffers of one class a thread cache holds */
+  const size_t THREAD_CACHE_MAX_SLOTS = 64;
+
+  /** Bytes of each size class the shared depot holds on to */
+  const size_t DEPOT_BYTES = 16 * 1024 * 1024;
+
+  /** Operations a thread counts before folding them into the totals */
+  const uint32_t FOLD_INTERVAL = 256;
+
+  inline int size_class(size_t len) {
+    if (len <= ((size_t)1 << BufferPool::MIN_CLASS_SHIFT))
+      return 0;
+    int shift = 64 - __builtin_clzll((unsigned long long)(len - 1));
+    return shift - BufferPool::MIN_CLASS_SHIFT;
+  }
+
+  inline size_t class_size(int sc) {
+    return (size_t)1 << (sc + BufferPool::MIN_CLASS_SHIFT);
+  }
+
+  inline size_t thread_cache_slots(int sc) {
+    size_t slots = THREAD_CACHE_BYTES / class_size(sc);
+    if (slots < 1)
+      return 1;
+    return slots < THREAD_CACHE_MAX_SLOTS ? slots : THREAD_CACHE_MAX_SLOTS;
+  }
+
+  /**
+   * Buffers shared by all threads, one locked free list per size class,
+   * plus the running totals
+   */
+  struct Depot {
+    struct FreeList {
+      boost::mutex mutex;
+      std::vector<uint8_t *> buffers;
+    };
+    FreeList lists[BufferPool::CLASS_COUNT];
+    BufferPool::Statistics totals;
+  };
+
+  Depot *depot() {
+    // never destroyed: threads may still release buffers during exit
+    static Depot *d = new Depot();
+    return d;
+  }
+
+  struct ThreadCache {
+    ThreadCache() : allocations(0), hits(0), releases(0), discards(0) {
+      for (int i=0; i<BufferPool::CLASS_COUNT; i++)
+        counts[i] = 0;
+    }
+
+    ~ThreadCache() {
+      for (int i=0; i<BufferPool::CLASS_COUNT; i++)
+        flush(i, 0);
+      fold();
+    }
+
+    /** Takes up to half a cache worth of buffers from the depot */
+    void refill(int sc) {
+      Depot::FreeList &list = depot()->lists[sc];
+      size_t want = (thread_cache_slots(sc) + 1) / 2;
+      size_t moved = 0;
+      {
+        boost::mutex::scoped_lock lock(list.mutex);
+        while (counts[sc] < want && !list.buffers.empty()) {
+          slots[sc][counts[sc]++] = list.buffers.back();
+          list.buffers.pop_back();
+          moved++;
+        }
+      }
+      __sync_fetch_and_sub(&depot()->totals.depot_bytes,
+                           (uint64_t)moved * class_size(sc));
+    }
+
+    /** Hands buffers to the depot until keep are left */
+    void flush(int sc, size_t keep) {
+      Depot::FreeList &list = depot()->lists[sc];
+      size_t depot_max = DEPOT_BYTES / class_size(sc);
+      size_t moved = 0;
+      {
+        boost::mutex::scoped_lock lock(list.mutex);
+        while (counts[sc] > keep && list.buffers.size() < depot_max) {
+          list.buffers.push_back(slots[sc][--counts[sc]]);
+          moved++;
+        }
+      }
+      __sync_fetch_and_add(&depot()->totals.depot_bytes,
+                           (uint64_t)moved * class_size(sc));
+      while (counts[sc] > keep) {
+        delete [] slots[sc][--counts[sc]];
+        discards++;
+      }
+    }
+
+    void fold() {
+      BufferPool::Statistics &totals = depot()->totals;
+      __sync_fetch_and_add(&totals.allocations, allocations);
+      __sync_fetch_and_add(&totals.hits, hits);
+      __sync_fetch_and_add(&totals.releases, releases);
+      __sync_fetch_and_add(&totals.discards, discards);
+      allocations = hits = releases = discards = 0;
+    }
+
+    void maybe_fold() {
+      if (allocations + releases >= FOLD_INTERVAL)
+        fold();
+    }
+
+    uint8_t *slots[BufferPool::CLASS_COUNT][THREAD_CACHE_MAX_SLOTS];
+    size_t counts[BufferPool::CLASS_COUNT];
+    uint32_t allocations;
+    uint32_t hits;
+    uint32_t releases;
+    uint32_t discards;
+  };
+
+  boost::thread_specific_ptr<ThreadCache> g_thread_cache;
+
+  inline ThreadCache *thread_cache() {
+    ThreadCache *cache = g_thread_cache.get();
+    if (cache == 0) {
+      cache = new ThreadCache();
+      g_thread_cache.reset(cache);
+    }
+    return cache;
+  }
+
+} // local namespace
+
+
+uint8_t *BufferPool::allocate(size_t len) {
+  int sc = size_class(len);
+
+  if (sc >= CLASS_COUNT) {
+    __sync_fetch_and_add(&depot()->totals.allocations, 1);
+    __sync_fetch_and_add(&depot()->totals.oversized, 1);
+    return new uint8_t [len];
+  }
+
+  ThreadCache *cache = thread_cache();
+  uint8_t *buf;
+
+  cache->allocations++;
+  if (cache->counts[sc] == 0)
+    cache->refill(sc);
+  if (cache->counts[sc] > 0) {
+    buf = cache->slots[sc][--cache->counts[sc]];
+    cache->hits++;
+  }
+  else
+    buf = new uint8_t [class_size(sc)];
+  cache->maybe_fold();
+  return buf;
+}
+
+
+void BufferPool::release(uint8_t *buf, size_t len) {
+  if (buf == 0)
+    return;
+
+  int sc = size_class(len);
+
+  if (sc >= CLASS_COUNT) {
+    __sync_fetch_and_add(&depot()->totals.releases, 1);
+    delete [] buf;
+    return;
+  }
+
+  ThreadCache *cache = thread_cache();
+  size_t slots = thread_cache_slots(sc);
+
+  if (cache->counts[sc] == slots)
+    cache->flush(sc, slots / 2);
+  cache->slots[sc][cache->counts[sc]++] = buf;
+  cache->releases++;
+  cache->maybe_fold();
+}
+
+
+void BufferPool::get_statistics(Statistics &stats) {
+  Statistics &totals = depot()->totals;
+  stats.allocations = __sync_fetch_and_add(&totals.allocations, 0);
+  stats.hits = __sync_fetch_and_add(&totals.hits, 0);
+  stats.oversized = __sync_fetch_and_add(&totals.oversized, 0);
+  stats.releases = __sync_fetch_and_add(&totals.releases, 0);
+  stats.discards = __sync_fetch_and_add(&totals.discards, 0);
+  stats.depot_bytes = __sync_fetch_and_add(&totals.depot_bytes, 0);
+}
@@ -0,0 +1,93 @@
+/**
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or any later version.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef HYPERTABLE_BUFFERPOOL_H
+#define HYPERTABLE_BUFFERPOOL_H
+
+#include <cstddef>
+#include <stdint.h>
+
+namespace Hypertable {
+
+  /**
+   * Process-wide pool of message buffers.  Requests are rounded up to a
+   * power of two size class, from 64 bytes up to 2MB (a maximum size scan
+   * block plus its header), and freed buffers are kept for reuse instead
+   * of going back to the heap.  Each thread has a small cache per size
+   * class that it allocates from and releases to without locking; caches
+   * exchange buffers in batches with a shared depot, which is what lets a
+   * buffer allocated by a reactor thread be released by a worker thread.
+   * Larger requests are passed straight through to new[] and delete[].
+   *
+   * A buffer must be released with the length it was allocated with (or
+   * any smaller length, which only costs it a trip to a smaller class).
+   */
+  class BufferPool {
+  public:
+
+    enum {
+      MIN_CLASS_SHIFT = 6,
+      MAX_CLASS_SHIFT = 21,
+      CLASS_COUNT = MAX_CLASS_SHIFT - MIN_CLASS_SHIFT + 1
+    };
+
+    /**
+     * Pool activity.  Threads fold their counts into these totals every
+     * few hundred operations, so they trail the true values slightly.
+     */
+    struct Statistics {
+      Statistics() : allocations(0), hits(0), oversized(0), releases(0),
+                     discards(0), depot_bytes(0) { }
+      uint64_t allocations;  //!< allocate() calls
+      uint64_t hits;         //!< allocations served from a cached buffer
+      uint64_t oversized;    //!< allocations too large to pool
+      uint64_t releases;     //!< release() calls
+      uint64_t discards;     //!< releases freed because the depot was full
+      uint64_t depot_bytes;  //!< bytes held in the shared depot
+    };
+
+    /**
+     * Returns a buffer of at least len bytes
+     *
+     * @param len number of bytes needed
+     * @return pointer to the buffer
+     */
+    static uint8_t *allocate(size_t len);
+
+    /**
+     * Returns a buffer obtained from allocate() to the pool
+     *
+     * @param buf buffer to release (may be 0)
+     * @param len length passed to allocate() for this buffer
+     */
+    static void release(uint8_t *buf, size_t len);
+
+    /**
+     * Fills in the current pool statistics
+     *
+     * @param stats reference to statistics structure to fill in
+     */
+    static void get_statistics(Statistics &stats);
+  };
+
+}
+
+#endif // HYPERTABLE_BUFFERPOOL_H
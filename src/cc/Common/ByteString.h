@@ -28,6 +28,7 @@
 #include <boost/shared_ptr.hpp>
 
 #include "DynamicBuffer.h"
+#include "KeyCompare.h"
 #include "Serialization.h"
 
 namespace Hypertable {
@@ -107,9 +108,7 @@ namespace Hypertable {
     const uint8_t *ptr1, *ptr2;
     size_t len1 = bs1.decode_length(&ptr1);
     size_t len2 = bs2.decode_length(&ptr2);
-    size_t len = (len1 < len2) ? len1 : len2;
-    int cmp = memcmp(ptr1, ptr2, len);
-    return (cmp==0) ? len1 < len2 : cmp < 0;
+    return key_compare(ptr1, len1, ptr2, len2) < 0;
   }
 
   /**
@@ -121,7 +120,7 @@ namespace Hypertable {
     size_t len2 = bs2.decode_length(&ptr2);
     if (len1 != len2)
       return false;
-    return memcmp(ptr1, ptr2, len1) == 0;
+    return key_memcmp(ptr1, ptr2, len1) == 0;
   }
 
   /**
@@ -131,6 +130,16 @@ namespace Hypertable {
     return !(bs1 == bs2);
   }
 
+  /**
+   * Compares the row of a serialized key against a row of row_len bytes.
+   * Same sign as strcmp(key.str(), row).
+   */
+  inline int compare_row(const ByteString key, const char *row, size_t row_len) {
+    const uint8_t *ptr;
+    size_t len = key.decode_length(&ptr);
+    return key_row_compare(ptr, len, row, row_len);
+  }
+
   struct LtByteString {
     bool operator()(const ByteString bs1, const ByteString bs2) const {
       return bs1 < bs2;
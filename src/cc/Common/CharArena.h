@@ -117,6 +117,30 @@ public: // API
     return m_cur_page->alloc(sz);
   }
 
+  /**
+   * Allocates memory suitably aligned for holding pointers (and other
+   * word sized data), e.g. for node structures of arena backed containers
+   */
+  char *
+  alloc_aligned(size_t sz) {
+    const size_t align = sizeof(void *);
+
+    if (m_cur_page && sz <= m_page_limit) {
+      size_t pad = (align - ((size_t)m_cur_page->alloc_end & (align - 1)))
+                   & (align - 1);
+
+      if (pad + sz <= m_cur_page->remain()) {
+        m_cur_page->alloc(pad);
+        m_alloced += pad;
+        return alloc(sz);
+      }
+    }
+    // new pages (and dedicated big pages) start out aligned
+    if (sz <= m_page_limit)
+      m_cur_page = alloc_page(m_page_sz);
+    return alloc(sz);
+  }
+
   char *
   dup(const char *s) {
     if (!s)
@@ -140,6 +164,14 @@ public: // API
     m_pages = m_total = m_alloced = 0;
   }
 
+  /** Total bytes obtained from malloc, including page slack */
+  size_t
+  total() const { return m_total; }
+
+  /** Total bytes handed out by alloc() and friends */
+  size_t
+  used() const { return m_alloced; }
+
   std::ostream&
   dump_stat(std::ostream& out) const {
     out <<"pages="<< m_pages
@@ -19,6 +19,7 @@
 
 #include "Compat.h"
 #include <arpa/inet.h>
+#include <cstring>
 #include <zlib.h>
 #include "Checksum.h"
 
@@ -207,6 +208,102 @@ crc32_update(uint32_t crc, const void *data, size_t len) {
   return ::crc32(crc, (Bytef *)data, len);
 }
 
+/* CRC32C (Castagnoli, reflected polynomial 0x82F63B78).  Uses the SSE4.2
+ * crc32 instruction when the CPU has it, otherwise slicing-by-8 tables.
+ */
+namespace {
+
+struct Crc32cTables {
+  Crc32cTables() {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t crc = i;
+      for (int j = 0; j < 8; j++)
+        crc = (crc >> 1) ^ (0x82F63B78 & (0 - (crc & 1)));
+      table[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++)
+      for (int k = 1; k < 8; k++)
+        table[k][i] = (table[k-1][i] >> 8) ^ table[0][table[k-1][i] & 0xff];
+#if defined(__x86_64__) && defined(__GNUC__)
+    __builtin_cpu_init();
+    have_sse42 = __builtin_cpu_supports("sse4.2");
+#else
+    have_sse42 = false;
+#endif
+  }
+  uint32_t table[8][256];
+  bool have_sse42;
+};
+
+const Crc32cTables crc32c_tables;
+
+uint32_t
+crc32c_sw(uint32_t crc, const uint8_t *data, size_t len) {
+  const uint32_t (*t)[256] = crc32c_tables.table;
+
+  while (len && ((size_t)data & 7)) {
+    crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xff];
+    len--;
+  }
+  while (len >= 8) {
+    uint32_t lo, hi;
+    memcpy(&lo, data, 4);
+    memcpy(&hi, data + 4, 4);
+    lo ^= crc;   // little endian
+    crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff]
+        ^ t[4][lo >> 24] ^ t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff]
+        ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+    data += 8;
+    len -= 8;
+  }
+  while (len--)
+    crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xff];
+  return crc;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+__attribute__((target("sse4.2"))) uint32_t
+crc32c_hw(uint32_t crc, const uint8_t *data, size_t len) {
+  uint64_t crc64 = crc;
+
+  while (len && ((size_t)data & 7)) {
+    crc64 = __builtin_ia32_crc32qi((uint32_t)crc64, *data++);
+    len--;
+  }
+  while (len >= 8) {
+    uint64_t word;
+    memcpy(&word, data, 8);
+    crc64 = __builtin_ia32_crc32di(crc64, word);
+    data += 8;
+    len -= 8;
+  }
+  while (len--)
+    crc64 = __builtin_ia32_crc32qi((uint32_t)crc64, *data++);
+  return (uint32_t)crc64;
+}
+#endif
+
+} // local namespace
+
+uint32_t
+crc32c(const void *data, size_t len) {
+  return crc32c_update(0, data, len);
+}
+
+uint32_t
+crc32c_update(uint32_t crc, const void *data, size_t len) {
+#if defined(__x86_64__) && defined(__GNUC__)
+  if (crc32c_tables.have_sse42)
+    return ~crc32c_hw(~crc, (const uint8_t *)data, len);
+#endif
+  return ~crc32c_sw(~crc, (const uint8_t *)data, len);
+}
+
+uint32_t
+crc32c_software(const void *data, size_t len) {
+  return ~crc32c_sw(~0u, (const uint8_t *)data, len);
+}
+
 } // namespace Hypertable
 
 /* vim: et sw=2
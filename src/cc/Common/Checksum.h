@@ -73,6 +73,32 @@ crc32(const void *data, size_t len);
 extern uint32_t
 crc32_update(uint32_t crc, const void *data, size_t len);
 
+/** Compute crc32c (Castagnoli) checksum, using the SSE4.2 crc32
+ *  instruction when the CPU supports it
+ *
+ * @param data - input data
+ * @param len - input data length in bytes
+ */
+extern uint32_t
+crc32c(const void *data, size_t len);
+
+/** Update crc32c checksum incrementally
+ *
+ * @param crc - current crc32c checksum
+ * @param data - input data
+ * @param len - input data length in bytes
+ */
+extern uint32_t
+crc32c_update(uint32_t crc, const void *data, size_t len);
+
+/** Compute crc32c checksum without the SSE4.2 instruction (for testing)
+ *
+ * @param data - input data
+ * @param len - input data length in bytes
+ */
+extern uint32_t
+crc32c_software(const void *data, size_t len);
+
 } // namespace Hypertable
 
 #endif /* HYPERTABLE_CHECKSUM_H */
@@ -69,6 +69,7 @@ namespace {
     { Error::COMM_RECEIVE_ERROR,          "COMM receive error" },
     { Error::COMM_POLL_ERROR,             "COMM poll error" },
     { Error::COMM_CONFLICTING_ADDRESS,    "COMM conflicting address" },
+    { Error::COMM_SOCKET_ERROR,           "COMM socket error" },
     { Error::DFSBROKER_BAD_FILE_HANDLE,   "DFS BROKER bad file handle" },
     { Error::DFSBROKER_IO_ERROR,          "DFS BROKER i/o error" },
     { Error::DFSBROKER_FILE_NOT_FOUND,    "DFS BROKER file not found" },
@@ -116,6 +117,7 @@ namespace {
     { Error::RANGESERVER_TIMESTAMP_ORDER_ERROR,"RANGE SERVER supplied timestamp is not strictly increasing" },
     { Error::RANGESERVER_ROW_OVERFLOW,         "RANGE SERVER row overflow" },
     { Error::RANGESERVER_TABLE_NOT_FOUND,      "RANGE SERVER table not found" },
+    { Error::RANGESERVER_BAD_SCAN_SPEC,        "RANGE SERVER bad scan specification" },
     { Error::HQL_BAD_LOAD_FILE_FORMAT,         "HQL bad load file format" },
     { Error::METALOG_BAD_RS_HEADER, "METALOG bad range server metalog header" },
     { Error::METALOG_BAD_M_HEADER,  "METALOG bad master metalog header" },
@@ -67,6 +67,7 @@ namespace Hypertable {
       COMM_RECEIVE_ERROR       = 0x00010007,
       COMM_POLL_ERROR          = 0x00010008,
       COMM_CONFLICTING_ADDRESS = 0x00010009,
+      COMM_SOCKET_ERROR        = 0x0001000A,
 
       DFSBROKER_BAD_FILE_HANDLE   = 0x00020001,
       DFSBROKER_IO_ERROR          = 0x00020002,
@@ -118,6 +119,7 @@ namespace Hypertable {
       RANGESERVER_TIMESTAMP_ORDER_ERROR  = 0x00050010,
       RANGESERVER_ROW_OVERFLOW           = 0x00050011,
       RANGESERVER_TABLE_NOT_FOUND        = 0x00050012,
+      RANGESERVER_BAD_SCAN_SPEC          = 0x00050013,
 
       HQL_BAD_LOAD_FILE_FORMAT  = 0x00060001,
 
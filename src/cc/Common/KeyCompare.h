@@ -0,0 +1,164 @@
+/** -*- c++ -*-
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or any later version.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hypertable. If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef HYPERTABLE_KEYCOMPARE_H
+#define HYPERTABLE_KEYCOMPARE_H
+
+#include <cstddef>
+#include <cstring>
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace Hypertable {
+
+  /**
+   * Inline kernels for comparing keys and finding the NUL terminators of
+   * the row and qualifier inside a key.  Keys are short (tens to a couple
+   * hundred bytes), so these avoid the call into libc and use SSE2, or
+   * AVX2 when the build targets it, with a scalar fallback.
+   *
+   * key_memcmp() only loads bytes inside [0, len) of each buffer.
+   * key_find_nul() uses aligned loads, which may read bytes before ptr or
+   * past end within the same aligned block (never across a page).
+   */
+
+  /**
+   * Compares len bytes like memcmp(), returning <0, 0 or >0
+   */
+  inline int key_memcmp(const void *s1, const void *s2, size_t len) {
+    const uint8_t *p1 = (const uint8_t *)s1;
+    const uint8_t *p2 = (const uint8_t *)s2;
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    for (; i + 32 <= len; i += 32) {
+      __m256i v1 = _mm256_loadu_si256((const __m256i *)(p1 + i));
+      __m256i v2 = _mm256_loadu_si256((const __m256i *)(p2 + i));
+      uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v1, v2));
+      if (mask) {
+        size_t off = i + __builtin_ctz(mask);
+        return (int)p1[off] - (int)p2[off];
+      }
+    }
+#endif
+#if defined(__SSE2__)
+    for (; i + 16 <= len; i += 16) {
+      __m128i v1 = _mm_loadu_si128((const __m128i *)(p1 + i));
+      __m128i v2 = _mm_loadu_si128((const __m128i *)(p2 + i));
+      uint32_t mask = 0xFFFF ^ (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v1, v2));
+      if (mask) {
+        size_t off = i + __builtin_ctz(mask);
+        return (int)p1[off] - (int)p2[off];
+      }
+    }
+    if (i < len && len >= 16) {
+      // overlapping load for the tail
+      i = len - 16;
+      __m128i v1 = _mm_loadu_si128((const __m128i *)(p1 + i));
+      __m128i v2 = _mm_loadu_si128((const __m128i *)(p2 + i));
+      uint32_t mask = 0xFFFF ^ (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v1, v2));
+      if (mask) {
+        size_t off = i + __builtin_ctz(mask);
+        return (int)p1[off] - (int)p2[off];
+      }
+      return 0;
+    }
+#else
+    for (; i + 8 <= len; i += 8) {
+      uint64_t w1, w2;
+      memcpy(&w1, p1 + i, 8);
+      memcpy(&w2, p2 + i, 8);
+      if (w1 != w2)
+        break;
+    }
+#endif
+    for (; i < len; i++) {
+      if (p1[i] != p2[i])
+        return (int)p1[i] - (int)p2[i];
+    }
+    return 0;
+  }
+
+  /**
+   * Compares two byte strings of the given lengths in lexicographic order,
+   * a proper prefix sorting first
+   */
+  inline int key_compare(const void *s1, size_t len1, const void *s2, size_t len2) {
+    int cmp = key_memcmp(s1, s2, (len1 < len2) ? len1 : len2);
+    if (cmp == 0)
+      return (len1 < len2) ? -1 : ((len1 > len2) ? 1 : 0);
+    return cmp;
+  }
+
+  /**
+   * Compares the NUL terminated row at the start of a key of key_len
+   * bytes against a row of row_len bytes (which must not contain NUL).
+   * Gives the same sign as strcmp() without scanning for the terminators:
+   * comparing row_len+1 bytes includes the terminator of row, which
+   * differs from the key byte unless the rows are equal.
+   */
+  inline int key_row_compare(const void *key, size_t key_len, const char *row,
+                             size_t row_len) {
+    if (key_len > row_len)
+      return key_memcmp(key, row, row_len + 1);
+    int cmp = key_memcmp(key, row, key_len);
+    return cmp ? cmp : -1;
+  }
+
+  /**
+   * Returns a pointer to the first NUL byte in [ptr, end), or end
+   */
+  inline const uint8_t *key_find_nul(const uint8_t *ptr, const uint8_t *end) {
+#if defined(__SSE2__)
+    if (ptr >= end)
+      return end;
+    const __m128i zero = _mm_setzero_si128();
+    size_t skew = (size_t)ptr & 15;
+    const uint8_t *base = ptr - skew;
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(
+        _mm_cmpeq_epi8(_mm_load_si128((const __m128i *)base), zero)) >> skew;
+    if (mask) {
+      ptr += __builtin_ctz(mask);
+      return (ptr < end) ? ptr : end;
+    }
+    for (base += 16; base < end; base += 16) {
+      mask = (uint32_t)_mm_movemask_epi8(
+          _mm_cmpeq_epi8(_mm_load_si128((const __m128i *)base), zero));
+      if (mask) {
+        ptr = base + __builtin_ctz(mask);
+        return (ptr < end) ? ptr : end;
+      }
+    }
+    return end;
+#else
+    while (ptr < end && *ptr != 0)
+      ptr++;
+    return ptr;
+#endif
+  }
+
+} // namespace Hypertable
+
+#endif // HYPERTABLE_KEYCOMPARE_H
@@ -0,0 +1,203 @@
+/** -*- c++ -*-
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or any later version.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hypertable. If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef HYPERTABLE_SKIPLIST_H
+#define HYPERTABLE_SKIPLIST_H
+
+#include <cassert>
+#include <new>
+
+#include <boost/noncopyable.hpp>
+
+#include "CharArena.h"
+
+namespace Hypertable {
+
+  /**
+   * Sorted skip list whose nodes are carved out of an arena.  Inserts must
+   * be serialized by the caller (e.g. with a mutex), but any number of
+   * readers may traverse the list concurrently with the writer without
+   * taking a lock.  A node is completely initialized before it is linked
+   * in and each link is published with a memory barrier, so a reader
+   * either sees a fully built node or does not see it at all.  Nodes are
+   * never unlinked; they are released all at once when the arena goes away.
+   */
+  template <typename KeyT, typename ValueT, typename CompareT,
+            typename ArenaT = CharArena>
+  class SkipList : boost::noncopyable {
+  public:
+
+    enum { MAX_HEIGHT = 12, BRANCHING = 4 };
+
+    class Node {
+    public:
+      KeyT   key;
+      ValueT value;
+
+      Node *next(int level) const {
+        Node *node = m_next[level];
+        __asm__ __volatile__("" : : : "memory");
+        return node;
+      }
+
+      void set_next(int level, Node *node) {
+        __sync_synchronize();
+        m_next[level] = node;
+      }
+
+      Node *volatile m_next[1];
+    };
+
+    /**
+     * Forward iterator.  Safe to use concurrently with inserts.
+     */
+    class Iterator {
+    public:
+      Iterator(const SkipList &list) : m_list(&list), m_node(0) { }
+
+      bool valid() const { return m_node != 0; }
+
+      const KeyT &key() const { assert(valid()); return m_node->key; }
+
+      const ValueT &value() const { assert(valid()); return m_node->value; }
+
+      void next() { assert(valid()); m_node = m_node->next(0); }
+
+      /** Positions at the first entry that is not less than target */
+      void seek(const KeyT &target) {
+        m_node = m_list->find_greater_or_equal(target, 0);
+      }
+
+      void seek_to_first() { m_node = m_list->m_head->next(0); }
+
+    private:
+      const SkipList *m_list;
+      Node *m_node;
+    };
+
+    SkipList(ArenaT &arena, CompareT compare = CompareT())
+      : m_arena(arena), m_compare(compare), m_head(0), m_max_height(1),
+        m_size(0), m_random(0xdeadbeef) {
+      m_head = new_node(MAX_HEIGHT, KeyT(), ValueT());
+      for (int i=0; i<MAX_HEIGHT; i++)
+        m_head->set_next(i, 0);
+    }
+
+    /**
+     * Inserts a key/value pair.  Must not be called concurrently with
+     * another insert.
+     *
+     * @param key key to insert (copied by value into the node)
+     * @param value value to associate with the key
+     * @return false if an equal key is already present, true otherwise
+     */
+    bool insert(const KeyT &key, const ValueT &value) {
+      Node *prev[MAX_HEIGHT];
+      Node *node = find_greater_or_equal(key, prev);
+
+      if (node && !m_compare(key, node->key))
+        return false;
+
+      int height = random_height();
+      if (height > m_max_height) {
+        for (int i=m_max_height; i<height; i++)
+          prev[i] = m_head;
+        // readers that see the new height early just find null links at
+        // the new levels and drop down a level
+        m_max_height = height;
+      }
+
+      node = new_node(height, key, value);
+      for (int i=0; i<height; i++) {
+        node->m_next[i] = prev[i]->next(i);
+        prev[i]->set_next(i, node);
+      }
+      ++m_size;
+      return true;
+    }
+
+    bool contains(const KeyT &key) const {
+      Node *node = find_greater_or_equal(key, 0);
+      return node && !m_compare(key, node->key);
+    }
+
+    size_t size() const { return m_size; }
+
+    /**
+     * Returns the average per-entry overhead of the node structure
+     * (excluding whatever the key references)
+     */
+    static size_t node_overhead() {
+      return sizeof(Node) + sizeof(Node *) / (BRANCHING - 1);
+    }
+
+  private:
+
+    Node *new_node(int height, const KeyT &key, const ValueT &value) {
+      char *mem = m_arena.alloc_aligned(sizeof(Node)
+                                        + sizeof(Node *) * (height - 1));
+      Node *node = new (mem) Node();
+      node->key = key;
+      node->value = value;
+      return node;
+    }
+
+    int random_height() {
+      int height = 1;
+      while (height < MAX_HEIGHT && (next_random() % BRANCHING) == 0)
+        height++;
+      return height;
+    }
+
+    uint32_t next_random() {
+      m_random ^= m_random << 13;
+      m_random ^= m_random >> 17;
+      m_random ^= m_random << 5;
+      return m_random;
+    }
+
+    Node *find_greater_or_equal(const KeyT &key, Node **prev) const {
+      Node *node = m_head;
+      int level = m_max_height - 1;
+
+      while (true) {
+        Node *next = node->next(level);
+        if (next && m_compare(next->key, key))
+          node = next;
+        else {
+          if (prev)
+            prev[level] = node;
+          if (level == 0)
+            return next;
+          level--;
+        }
+      }
+    }
+
+    ArenaT          &m_arena;
+    CompareT         m_compare;
+    Node            *m_head;
+    volatile int     m_max_height;
+    volatile size_t  m_size;
+    uint32_t         m_random;
+  };
+
+} // namespace Hypertable
+
+#endif // HYPERTABLE_SKIPLIST_H
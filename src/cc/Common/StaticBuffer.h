@@ -22,6 +22,7 @@
 #ifndef HYPERTABLE_STATICBUFFER_H
 #define HYPERTABLE_STATICBUFFER_H
 
+#include "BufferPool.h"
 #include "DynamicBuffer.h"
 
 namespace Hypertable {
@@ -29,17 +30,18 @@ namespace Hypertable {
   class StaticBuffer {
   public:
     explicit StaticBuffer(size_t len) :
-        base(new uint8_t[len]), size(len), own(true) {}
+        base(new uint8_t[len]), size(len), own(true), pooled(false) {}
 
     StaticBuffer(void *data, uint32_t len, bool take_ownership=true) :
-        base((uint8_t *)data), size(len), own(take_ownership) { }
+        base((uint8_t *)data), size(len), own(take_ownership), pooled(false) { }
 
-    StaticBuffer() : base(0), size(0), own(true) { }
+    StaticBuffer() : base(0), size(0), own(true), pooled(false) { }
 
     StaticBuffer(DynamicBuffer &dbuf) {
       base = dbuf.base;
       size = dbuf.fill();
       own = dbuf.own;
+      pooled = false;
       if (own) {
         dbuf.base = dbuf.ptr = 0;
         dbuf.size = 0;
@@ -47,8 +49,7 @@ namespace Hypertable {
     }
 
     ~StaticBuffer() {
-      if (own)
-        delete [] base;
+      release();
     }
 
     /**
@@ -65,6 +66,7 @@ namespace Hypertable {
       base = other.base;
       size = other.size;
       own = other.own;
+      pooled = other.pooled;
       if (own) {
         other.own = false;
         other.base = 0;
@@ -85,6 +87,7 @@ namespace Hypertable {
       base = other.base;
       size = other.size;
       own = other.own;
+      pooled = other.pooled;
       if (own) {
         other.own = false;
         other.base = 0;
@@ -99,6 +102,7 @@ namespace Hypertable {
       base = dbuf.base;
       size = dbuf.fill();
       own = dbuf.own;
+      pooled = false;
       if (own) {
         dbuf.base = dbuf.ptr = 0;
         dbuf.size = 0;
@@ -107,16 +111,28 @@ namespace Hypertable {
     }
 
     void set(uint8_t *data, uint32_t len, bool take_ownership=true) {
-      if (own)
-        delete [] base;
+      release();
       base = data;
       size = len;
       own = take_ownership;
+      pooled = false;
+    }
+
+    /**
+     * Replaces the buffer with len bytes from the BufferPool, which gets
+     * the memory back when this buffer is freed.  The size must not be
+     * increased afterwards.
+     */
+    void set_pooled(uint32_t len) {
+      release();
+      base = BufferPool::allocate(len);
+      size = len;
+      own = true;
+      pooled = true;
     }
 
     void free() {
-      if (own)
-        delete [] base;
+      release();
       base = 0;
       size = 0;
     }
@@ -124,6 +140,17 @@ namespace Hypertable {
     uint8_t *base;
     uint32_t size;
     bool own;
+    bool pooled;
+
+  private:
+    void release() {
+      if (own) {
+        if (pooled)
+          BufferPool::release(base, size);
+        else
+          delete [] base;
+      }
+    }
   };
 
 } // namespace Hypertable
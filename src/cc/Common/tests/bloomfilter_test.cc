@@ -0,0 +1,177 @@
+/** -*- c++ -*-
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "Common/Compat.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <sys/types.h>
+#include <unistd.h>
+}
+
+#include "Common/BloomFilter.h"
+#include "Common/Error.h"
+#include "Common/System.h"
+
+using namespace Hypertable;
+using namespace std;
+
+namespace {
+
+  /**
+   * Makes n distinct row + column family style keys.  The tag keeps the
+   * key sets of different calls disjoint.
+   */
+  void make_keys(vector<string> &keys, size_t n, char tag) {
+    char buf[64];
+    keys.clear();
+    for (size_t i=0; i<n; i++) {
+      sprintf(buf, "%c-row-%08lx-%lu", tag, (long)random(), (unsigned long)i);
+      keys.push_back(buf);
+      keys.back().push_back((char)0);
+      keys.back().push_back((char)(1 + i % 3));
+    }
+  }
+
+  size_t count_matches(const BloomFilter &filter, const vector<string> &keys) {
+    size_t matches = 0;
+    for (size_t i=0; i<keys.size(); i++)
+      if (filter.may_contain(keys[i].data(), keys[i].length()))
+        matches++;
+    return matches;
+  }
+
+  /**
+   * Checks that every inserted key is found, that the false positive rate
+   * is close to the target and that the encoded filter decodes to one that
+   * gives the same answers
+   */
+  bool test_filter(size_t items, float target) {
+    vector<string> keys, others;
+    BloomFilter filter(items, target);
+
+    make_keys(keys, items, 'k');
+    make_keys(others, 200000, 'x');
+
+    for (size_t i=0; i<keys.size(); i++) {
+      if (i % 2)
+        filter.insert(keys[i].data(), keys[i].length());
+      else
+        filter.insert(BloomFilter::hash(keys[i].data(), keys[i].length()));
+    }
+
+    size_t found = count_matches(filter, keys);
+    if (found != keys.size()) {
+      cout << "false negatives: " << keys.size() - found << " of "
+           << keys.size() << " inserted keys not found" << endl;
+      return false;
+    }
+
+    size_t false_positives = count_matches(filter, others);
+    double rate = (double)false_positives / others.size();
+    printf("items=%lu target=%.4f bits=%u hashes=%u rate=%.4f\n",
+           (unsigned long)items, target, filter.get_num_bits(),
+           filter.get_num_hashes(), rate);
+    if (rate > target * 1.5 + 0.0005) {
+      cout << "false positive rate " << rate << " too far above target "
+           << target << endl;
+      return false;
+    }
+
+    vector<uint8_t> buf(filter.encoded_length());
+    uint8_t *ptr = &buf[0];
+    filter.encode(&ptr);
+    if ((size_t)(ptr - &buf[0]) != buf.size()) {
+      cout << "encode wrote " << (ptr - &buf[0]) << " bytes, encoded_length() "
+           << buf.size() << endl;
+      return false;
+    }
+
+    const uint8_t *cptr = &buf[0];
+    size_t remaining = buf.size();
+    BloomFilter decoded(&cptr, &remaining);
+    if (remaining != 0 || decoded.get_num_bits() != filter.get_num_bits() ||
+        decoded.get_num_hashes() != filter.get_num_hashes()) {
+      cout << "decoded filter differs from the original" << endl;
+      return false;
+    }
+    if (count_matches(decoded, keys) != keys.size()) {
+      cout << "decoded filter has false negatives" << endl;
+      return false;
+    }
+    for (size_t i=0; i<others.size(); i++) {
+      if (decoded.may_contain(others[i].data(), others[i].length()) !=
+          filter.may_contain(others[i].data(), others[i].length())) {
+        cout << "decoded filter answers differently for key " << i << endl;
+        return false;
+      }
+    }
+
+    // a truncated filter must not decode
+    cptr = &buf[0];
+    remaining = buf.size() - 1;
+    try {
+      BloomFilter truncated(&cptr, &remaining);
+      cout << "truncated filter decoded without error" << endl;
+      return false;
+    }
+    catch (Exception &e) {
+      if (e.code() != Error::SERIALIZATION_INPUT_OVERRUN) {
+        cout << "truncated filter: unexpected error " << e.what() << endl;
+        return false;
+      }
+    }
+    return true;
+  }
+
+}
+
+
+/**
+ * Usage: bloomfilter_test [--seed=<n>]
+ */
+int main(int argc, char **argv) {
+  unsigned long seed = (unsigned long)getpid();
+
+  System::initialize(argv[0]);
+
+  for (int i=1; i<argc; i++) {
+    if (!strncmp(argv[i], "--seed=", 7))
+      seed = atoi(&argv[i][7]);
+  }
+
+  cout << "bloomfilter_test SEED = " << seed << endl;
+  srandom(seed);
+
+  if (!test_filter(1, 0.01) ||
+      !test_filter(1000, 0.01) ||
+      !test_filter(100000, 0.01) ||
+      !test_filter(100000, 0.001) ||
+      !test_filter(50000, 0.1))
+    return 1;
+
+  return 0;
+}
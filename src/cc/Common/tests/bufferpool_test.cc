@@ -0,0 +1,274 @@
+/** -*- c++ -*-
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "Common/Compat.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+
+#include <boost/thread/condition.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "Common/BufferPool.h"
+#include "Common/StaticBuffer.h"
+#include "Common/String.h"
+#include "Common/Stopwatch.h"
+
+using namespace Hypertable;
+using namespace std;
+
+namespace {
+
+  /**
+   * Allocates every length around each class boundary, fills the whole
+   * request and checks it reads back intact after more allocations
+   */
+  bool test_sizes() {
+    vector<uint8_t *> bufs;
+    vector<size_t> lens;
+
+    for (int shift=0; shift<=BufferPool::MAX_CLASS_SHIFT + 1; shift++) {
+      size_t base = (size_t)1 << shift;
+      for (size_t len = base - 1; len <= base + 1; len++) {
+        if (len == 0)
+          continue;
+        uint8_t *buf = BufferPool::allocate(len);
+        memset(buf, (int)(len & 0xff), len);
+        bufs.push_back(buf);
+        lens.push_back(len);
+      }
+    }
+    for (size_t i=0; i<bufs.size(); i++) {
+      for (size_t j=0; j<lens[i]; j++) {
+        if (bufs[i][j] != (uint8_t)(lens[i] & 0xff)) {
+          cout << "buffer of length " << lens[i] << " corrupted at " << j
+               << endl;
+          return false;
+        }
+      }
+      BufferPool::release(bufs[i], lens[i]);
+    }
+    return true;
+  }
+
+  /**
+   * Released buffers must be handed out again, and a StaticBuffer from the
+   * pool must go back to it
+   */
+  bool test_reuse() {
+    BufferPool::Statistics before, after;
+
+    uint8_t *buf = BufferPool::allocate(1000);
+    BufferPool::release(buf, 1000);
+    if (BufferPool::allocate(600) != buf) {
+      cout << "released 1024 byte class buffer was not reused" << endl;
+      return false;
+    }
+    BufferPool::release(buf, 600);
+
+    {
+      StaticBuffer sbuf;
+      sbuf.set_pooled(700);
+      if (sbuf.base != buf) {
+        cout << "StaticBuffer did not get the pooled buffer" << endl;
+        return false;
+      }
+    }
+    if (BufferPool::allocate(1024) != buf) {
+      cout << "StaticBuffer did not return its buffer to the pool" << endl;
+      return false;
+    }
+    BufferPool::release(buf, 1024);
+
+    BufferPool::get_statistics(before);
+    for (int i=0; i<10000; i++)
+      BufferPool::release(BufferPool::allocate(256), 256);
+    BufferPool::get_statistics(after);
+    if (after.hits - before.hits < 9000) {
+      cout << "expected at least 9000 hits, got " << after.hits - before.hits
+           << endl;
+      return false;
+    }
+    return true;
+  }
+
+  /**
+   * Buffers allocated on one thread and released on another, the way
+   * reactor threads hand received messages to worker threads
+   */
+  class Handoff {
+  public:
+    Handoff() : m_done(false) { }
+
+    void put(uint8_t *buf) {
+      boost::mutex::scoped_lock lock(m_mutex);
+      m_queue.push_back(buf);
+      m_cond.notify_one();
+    }
+
+    void finish() {
+      boost::mutex::scoped_lock lock(m_mutex);
+      m_done = true;
+      m_cond.notify_all();
+    }
+
+    uint8_t *get() {
+      boost::mutex::scoped_lock lock(m_mutex);
+      while (m_queue.empty() && !m_done)
+        m_cond.wait(lock);
+      if (m_queue.empty())
+        return 0;
+      uint8_t *buf = m_queue.front();
+      m_queue.pop_front();
+      return buf;
+    }
+
+  private:
+    boost::mutex m_mutex;
+    boost::condition m_cond;
+    std::deque<uint8_t *> m_queue;
+    bool m_done;
+  };
+
+  const int HANDOFF_COUNT = 200000;
+  const size_t HANDOFF_LEN = 4000;
+
+  struct Producer {
+    Producer(Handoff *h) : handoff(h) { }
+    void operator()() {
+      for (int i=0; i<HANDOFF_COUNT; i++) {
+        uint8_t *buf = BufferPool::allocate(HANDOFF_LEN);
+        memset(buf, i & 0xff, HANDOFF_LEN);
+        handoff->put(buf);
+      }
+      handoff->finish();
+    }
+    Handoff *handoff;
+  };
+
+  struct Consumer {
+    Consumer(Handoff *h, bool *okp) : handoff(h), ok(okp) { }
+    void operator()() {
+      uint8_t *buf;
+      for (int i=0; (buf = handoff->get()) != 0; i++) {
+        if (buf[0] != (uint8_t)(i & 0xff) ||
+            buf[HANDOFF_LEN - 1] != (uint8_t)(i & 0xff))
+          *ok = false;
+        BufferPool::release(buf, HANDOFF_LEN);
+      }
+    }
+    Handoff *handoff;
+    bool *ok;
+  };
+
+  bool test_handoff() {
+    Handoff handoff;
+    bool ok = true;
+    BufferPool::Statistics stats;
+
+    Consumer consumer_func(&handoff, &ok);
+    Producer producer_func(&handoff);
+    boost::thread consumer(consumer_func);
+    boost::thread producer(producer_func);
+    producer.join();
+    consumer.join();
+
+    if (!ok) {
+      cout << "handed off buffer corrupted" << endl;
+      return false;
+    }
+    BufferPool::get_statistics(stats);
+    printf("handoff: %llu allocations, %.1f%% hits, %llu discards\n",
+           (Llu)stats.allocations, 100.0 * stats.hits / stats.allocations,
+           (Llu)stats.discards);
+    if (stats.hits > stats.allocations || stats.allocations < HANDOFF_COUNT) {
+      cout << "inconsistent pool statistics" << endl;
+      return false;
+    }
+    return true;
+  }
+
+  const int BENCH_ITERATIONS = 2000000;
+
+  struct PoolWorker {
+    void operator()() {
+      uint8_t *bufs[8];
+      for (int i=0; i<BENCH_ITERATIONS; i += 8) {
+        for (int j=0; j<8; j++)
+          bufs[j] = BufferPool::allocate(64 << j);
+        for (int j=0; j<8; j++)
+          BufferPool::release(bufs[j], 64 << j);
+      }
+    }
+  };
+
+  struct HeapWorker {
+    void operator()() {
+      uint8_t *bufs[8];
+      for (int i=0; i<BENCH_ITERATIONS; i += 8) {
+        for (int j=0; j<8; j++)
+          bufs[j] = new uint8_t [64 << j];
+        for (int j=0; j<8; j++)
+          delete [] bufs[j];
+      }
+    }
+  };
+
+  template <typename WorkerT>
+  void time_workers(const char *name, int threads) {
+    boost::thread_group group;
+    Stopwatch stopwatch;
+    for (int i=0; i<threads; i++)
+      group.create_thread(WorkerT());
+    group.join_all();
+    stopwatch.stop();
+    printf("%-12s %d threads  %8.1f M allocations/s\n", name, threads,
+           (double)threads * BENCH_ITERATIONS / stopwatch.elapsed() / 1000000.0);
+  }
+
+}
+
+
+/**
+ * Usage: bufferpool_test [--threads=<n>]
+ *
+ * Checks the pool, then times allocate/release pairs of 64 bytes to 8KB
+ * on --threads threads against new[]/delete[].
+ */
+int main(int argc, char **argv) {
+  int threads = 4;
+
+  for (int i=1; i<argc; i++) {
+    if (!strncmp(argv[i], "--threads=", 10))
+      threads = atoi(&argv[i][10]);
+  }
+
+  if (!test_sizes() || !test_reuse() || !test_handoff())
+    return 1;
+
+  time_workers<PoolWorker>("BufferPool", threads);
+  time_workers<HeapWorker>("new/delete", threads);
+
+  return 0;
+}
@@ -0,0 +1,147 @@
+/** -*- c++ -*-
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "Common/Compat.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+extern "C" {
+#include <sys/types.h>
+#include <unistd.h>
+}
+
+#include "Common/Checksum.h"
+#include "Common/Stopwatch.h"
+#include "Common/System.h"
+
+using namespace Hypertable;
+using namespace std;
+
+namespace {
+
+  /**
+   * Checks crc32c against published test vectors (RFC 3720 B.4) and the
+   * software implementation against the default one at every alignment
+   */
+  bool test_crc32c() {
+    uint8_t buf[4096 + 8];
+
+    if (crc32c("123456789", 9) != 0xE3069283) {
+      cout << "crc32c(\"123456789\") = " << hex << crc32c("123456789", 9)
+           << ", expected e3069283" << endl;
+      return false;
+    }
+
+    memset(buf, 0, 32);
+    if (crc32c(buf, 32) != 0x8A9136AA) {
+      cout << "crc32c(32 zero bytes) wrong" << endl;
+      return false;
+    }
+
+    memset(buf, 0xff, 32);
+    if (crc32c(buf, 32) != 0x62A8AB43) {
+      cout << "crc32c(32 0xff bytes) wrong" << endl;
+      return false;
+    }
+
+    for (size_t i=0; i<sizeof(buf); i++)
+      buf[i] = (uint8_t)random();
+
+    for (size_t align=0; align<8; align++) {
+      for (size_t len=0; len<=4096; len += 1 + len / 8) {
+        uint32_t crc = crc32c(buf + align, len);
+        if (crc != crc32c_software(buf + align, len)) {
+          cout << "crc32c: hardware and software differ at alignment "
+               << align << " length " << len << endl;
+          return false;
+        }
+        if (crc != crc32c_update(crc32c(buf + align, len / 3),
+                                 buf + align + len / 3, len - len / 3)) {
+          cout << "crc32c_update: wrong result for length " << len << endl;
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  typedef uint32_t (*ChecksumFunc)(const void *data, size_t len);
+
+  void time_checksum(const char *name, ChecksumFunc func,
+                     vector<uint8_t> &data, size_t block_size, int iterations) {
+    uint32_t sum = 0;
+    Stopwatch stopwatch;
+
+    for (int it=0; it<iterations; it++)
+      for (size_t off=0; off + block_size <= data.size(); off += block_size)
+        sum += func(&data[off], block_size);
+    stopwatch.stop();
+
+    double bytes = (double)iterations * (data.size() - data.size() % block_size);
+    printf("%-16s %8.1f MB/s  (%08x)\n", name,
+           bytes / stopwatch.elapsed() / 1000000.0, sum);
+  }
+
+}
+
+
+/**
+ * Usage: checksum_test [--seed=<n>] [--block-size=<n>] [--iterations=<n>]
+ *
+ * Checks crc32c, then reports the throughput of the block checksums over
+ * 16MB of random data in blocks of --block-size bytes.
+ */
+int main(int argc, char **argv) {
+  unsigned long seed = (unsigned long)getpid();
+  size_t block_size = 65536;
+  int iterations = 4;
+
+  System::initialize(argv[0]);
+
+  for (int i=1; i<argc; i++) {
+    if (!strncmp(argv[i], "--seed=", 7))
+      seed = atoi(&argv[i][7]);
+    else if (!strncmp(argv[i], "--block-size=", 13))
+      block_size = strtoll(&argv[i][13], 0, 0);
+    else if (!strncmp(argv[i], "--iterations=", 13))
+      iterations = atoi(&argv[i][13]);
+  }
+
+  cout << "checksum_test SEED = " << seed << endl;
+  srandom(seed);
+
+  if (!test_crc32c())
+    return 1;
+
+  vector<uint8_t> data(16 * 1024 * 1024);
+  for (size_t i=0; i<data.size(); i++)
+    data[i] = (uint8_t)random();
+
+  time_checksum("fletcher32", fletcher32, data, block_size, iterations);
+  time_checksum("adler32", adler32, data, block_size, iterations);
+  time_checksum("crc32c", crc32c, data, block_size, iterations);
+  time_checksum("crc32c software", crc32c_software, data, block_size, iterations);
+
+  return 0;
+}
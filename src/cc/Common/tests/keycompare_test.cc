@@ -0,0 +1,308 @@
+/** -*- c++ -*-
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "Common/Compat.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <sys/types.h>
+#include <unistd.h>
+}
+
+#include "Common/ByteString.h"
+#include "Common/DynamicBuffer.h"
+#include "Common/KeyCompare.h"
+#include "Common/Serialization.h"
+#include "Common/Stopwatch.h"
+#include "Common/System.h"
+
+using namespace Hypertable;
+using namespace std;
+
+namespace {
+
+  const char *domains[] = { "com.example.www", "com.zvents.www",
+    "org.hypertable.code", "net.sourceforge.downloads",
+    "com.example.images", "edu.stanford.cs.infolab" };
+
+  const char *segments[] = { "events", "search", "venues", "2008", "08",
+    "san-francisco-ca", "performers", "index.html", "tickets",
+    "?category=music&sort=date", "page", "details", "users" };
+
+  /**
+   * Makes a URL style row of 60 to 120 bytes.  Rows share long prefixes,
+   * as rows from the same site do.
+   */
+  string make_row() {
+    string row = domains[random() % (sizeof(domains)/sizeof(char *))];
+    size_t target = 60 + random() % 61;
+
+    while (row.length() < target) {
+      row += "/";
+      row += segments[random() % (sizeof(segments)/sizeof(char *))];
+    }
+    row.resize(target);
+    return row;
+  }
+
+  /**
+   * Appends a serialized key (row, family, qualifier, flag, timestamp)
+   */
+  void append_key(DynamicBuffer &buf, const string &row, uint8_t family,
+                  const char *qualifier, uint64_t timestamp) {
+    size_t len = row.length() + 1 + 1 + strlen(qualifier) + 1 + 9;
+    buf.ensure(len + 6);
+    Serialization::encode_vi32(&buf.ptr, len);
+    buf.add_unchecked(row.c_str(), row.length() + 1);
+    *buf.ptr++ = family;
+    buf.add_unchecked(qualifier, strlen(qualifier) + 1);
+    *buf.ptr++ = 0xff;
+    for (int i=7; i>=0; i--)
+      *buf.ptr++ = (uint8_t)(~timestamp >> (8*i));
+  }
+
+  /** ByteString less than, as it was before KeyCompare.h */
+  struct LtByteStringMemcmp {
+    bool operator()(const ByteString bs1, const ByteString bs2) const {
+      const uint8_t *ptr1, *ptr2;
+      size_t len1 = bs1.decode_length(&ptr1);
+      size_t len2 = bs2.decode_length(&ptr2);
+      size_t len = (len1 < len2) ? len1 : len2;
+      int cmp = memcmp(ptr1, ptr2, len);
+      return (cmp==0) ? len1 < len2 : cmp < 0;
+    }
+  };
+
+  int sign(int x) { return (x > 0) - (x < 0); }
+
+  /** Best time so far, 0.0 meaning none yet */
+  double min_time(double best, double elapsed) {
+    return (best == 0.0 || elapsed < best) ? elapsed : best;
+  }
+
+  /**
+   * Checks the kernels against libc on every length and mismatch position
+   * up to 200 bytes, at every alignment within 32 bytes
+   */
+  bool test_kernels() {
+    uint8_t buf1[300], buf2[300];
+
+    for (size_t align=0; align<32; align++) {
+      for (size_t len=0; len<=200; len++) {
+        uint8_t *p1 = buf1 + align, *p2 = buf2 + (31 - align);
+        for (size_t i=0; i<len; i++)
+          p1[i] = p2[i] = (uint8_t)('a' + (i % 26));
+        if (key_memcmp(p1, p2, len) != 0) {
+          cout << "key_memcmp: equal buffers of length " << len
+               << " compared unequal" << endl;
+          return false;
+        }
+        for (size_t pos=0; pos<len; pos++) {
+          uint8_t save = p2[pos];
+          p2[pos] = (pos & 1) ? 0x01 : 0xf0;
+          if (sign(key_memcmp(p1, p2, len)) != sign(memcmp(p1, p2, len))) {
+            cout << "key_memcmp: mismatch at " << pos << " of " << len
+                 << " gave the wrong sign" << endl;
+            return false;
+          }
+          p2[pos] = save;
+        }
+        for (size_t pos=0; pos<=len; pos++) {
+          p1[len] = 'x';
+          if (pos < len)
+            p1[pos] = 0;
+          const uint8_t *expected = (pos < len) ? p1 + pos : p1 + len;
+          if (key_find_nul(p1, p1 + len) != expected) {
+            cout << "key_find_nul: wrong result for NUL at " << pos << " of "
+                 << len << endl;
+            return false;
+          }
+          if (pos < len)
+            p1[pos] = (uint8_t)('a' + (pos % 26));
+        }
+      }
+    }
+    return true;
+  }
+
+  /**
+   * Checks compare_row() against strcmp() on rows that are equal, are
+   * prefixes of each other or differ
+   */
+  bool test_compare_row(vector<ByteString> &keys) {
+    for (size_t i=1; i<keys.size(); i++) {
+      const char *row = keys[i-1].str();
+      string rows[3] = { row, string(row, strlen(row) / 2), string(row) + "/" };
+      for (int j=0; j<3; j++) {
+        int expected = sign(strcmp(keys[i].str(), rows[j].c_str()));
+        if (sign(compare_row(keys[i], rows[j].c_str(), rows[j].length()))
+            != expected) {
+          cout << "compare_row: '" << keys[i].str() << "' vs '" << rows[j]
+               << "' expected " << expected << endl;
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+}
+
+
+/**
+ * Usage: keycompare_test [--seed=<n>] [--keys=<n>] [--iterations=<n>]
+ *
+ * Checks the KeyCompare.h kernels against libc, then compares them with
+ * the code they replaced on --keys URL style keys: sorting the keys,
+ * finding the row terminator and checking rows against an end row.
+ * Reports the best time of --iterations runs.
+ */
+int main(int argc, char **argv) {
+  unsigned long seed = (unsigned long)getpid();
+  size_t key_count = 200000;
+  int iterations = 3;
+
+  System::initialize(argv[0]);
+
+  for (int i=1; i<argc; i++) {
+    if (!strncmp(argv[i], "--seed=", 7))
+      seed = atoi(&argv[i][7]);
+    else if (!strncmp(argv[i], "--keys=", 7))
+      key_count = strtoll(&argv[i][7], 0, 0);
+    else if (!strncmp(argv[i], "--iterations=", 13))
+      iterations = atoi(&argv[i][13]);
+  }
+
+  cout << "keycompare_test SEED = " << seed << endl;
+  srandom(seed);
+
+  if (!test_kernels())
+    return 1;
+
+  DynamicBuffer buf(key_count * 160);
+  vector<size_t> offsets;
+  char qualifier[16];
+
+  for (size_t i=0; i<key_count; i++) {
+    sprintf(qualifier, "q%u", (unsigned)(random() % 8));
+    offsets.push_back(buf.fill());
+    append_key(buf, make_row(), (uint8_t)(1 + random() % 3), qualifier,
+               random());
+  }
+
+  vector<ByteString> keys;
+  for (size_t i=0; i<offsets.size(); i++)
+    keys.push_back(ByteString(buf.base + offsets[i]));
+
+  if (!test_compare_row(keys))
+    return 1;
+
+  double old_time = 0.0, new_time = 0.0;
+  size_t found_old = 0, found_new = 0;
+  const char *end_row = keys[keys.size() / 2].str();
+  size_t end_row_len = strlen(end_row);
+
+  /**
+   * Sort
+   */
+  for (int it=0; it<iterations; it++) {
+    vector<ByteString> sorted_old(keys), sorted_new(keys);
+    Stopwatch old_watch;
+    sort(sorted_old.begin(), sorted_old.end(), LtByteStringMemcmp());
+    old_watch.stop();
+    Stopwatch new_watch;
+    sort(sorted_new.begin(), sorted_new.end(), LtByteString());
+    new_watch.stop();
+    old_time = min_time(old_time, old_watch.elapsed());
+    new_time = min_time(new_time, new_watch.elapsed());
+    for (size_t i=0; i<sorted_old.size(); i++) {
+      if (sorted_old[i].ptr != sorted_new[i].ptr &&
+          !(sorted_old[i] == sorted_new[i])) {
+        cout << "sort: orders differ at " << i << endl;
+        return 1;
+      }
+    }
+  }
+  printf("sort         memcmp %.4fs  key_compare %.4fs\n", old_time, new_time);
+
+  /**
+   * Row terminator
+   */
+  old_time = new_time = 0.0;
+  for (int it=0; it<iterations; it++) {
+    Stopwatch old_watch;
+    for (size_t i=0; i<keys.size(); i++) {
+      const uint8_t *ptr;
+      size_t len = keys[i].decode_length(&ptr);
+      const uint8_t *end = ptr + len;
+      while (ptr < end && *ptr != 0)
+        ptr++;
+      found_old += ptr - keys[i].ptr;
+    }
+    old_watch.stop();
+    Stopwatch new_watch;
+    for (size_t i=0; i<keys.size(); i++) {
+      const uint8_t *ptr;
+      size_t len = keys[i].decode_length(&ptr);
+      const uint8_t *end = ptr + len;
+      found_new += key_find_nul(ptr, end) - keys[i].ptr;
+    }
+    new_watch.stop();
+    old_time = min_time(old_time, old_watch.elapsed());
+    new_time = min_time(new_time, new_watch.elapsed());
+  }
+  if (found_old != found_new) {
+    cout << "find nul: results differ" << endl;
+    return 1;
+  }
+  printf("find nul     loop   %.4fs  key_find_nul %.4fs\n", old_time, new_time);
+
+  /**
+   * End row check
+   */
+  old_time = new_time = 0.0;
+  found_old = found_new = 0;
+  for (int it=0; it<iterations; it++) {
+    Stopwatch old_watch;
+    for (size_t i=0; i<keys.size(); i++)
+      found_old += strcmp(keys[i].str(), end_row) >= 0;
+    old_watch.stop();
+    Stopwatch new_watch;
+    for (size_t i=0; i<keys.size(); i++)
+      found_new += compare_row(keys[i], end_row, end_row_len) >= 0;
+    new_watch.stop();
+    old_time = min_time(old_time, old_watch.elapsed());
+    new_time = min_time(new_time, new_watch.elapsed());
+  }
+  if (found_old != found_new) {
+    cout << "end row: results differ" << endl;
+    return 1;
+  }
+  printf("end row      strcmp %.4fs  compare_row %.4fs\n", old_time, new_time);
+
+  return 0;
+}
@@ -44,7 +44,9 @@ namespace Hypertable {
 
     static const char *get_compressor_name(uint16_t algo);
 
-    BlockCompressionCodec() { HT_THREAD_ID_SET(m_creator_thread); }
+    BlockCompressionCodec() : m_checksum_type(BlockCompressionHeader::CHECKSUM_FLETCHER32) {
+      HT_THREAD_ID_SET(m_creator_thread);
+    }
     virtual ~BlockCompressionCodec() { return; }
 
     virtual void deflate(const DynamicBuffer &input, DynamicBuffer &output,
@@ -57,7 +59,17 @@ namespace Hypertable {
 
     virtual int get_type() = 0;
 
+    /**
+     * Sets the checksum type that deflate() records in block headers.
+     * inflate() verifies with whichever type the block was written with.
+     */
+    void set_checksum_type(int type) { m_checksum_type = type; }
+    int get_checksum_type() { return m_checksum_type; }
+
     HT_THREAD_ID_DECL(m_creator_thread);
+
+  protected:
+    int m_checksum_type;
   };
   typedef boost::intrusive_ptr<BlockCompressionCodec> BlockCompressionCodecPtr;
 
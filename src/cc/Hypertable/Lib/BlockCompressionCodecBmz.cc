@@ -88,8 +88,9 @@ BlockCompressionCodecBmz::deflate(const DynamicBuffer &input,
     header.set_data_length(inlen);
     header.set_data_zlength(outlen);
   }
-  header.set_data_checksum(fletcher32(output.base + headerlen,
-                                      header.get_data_zlength()));
+  header.set_checksum_type(m_checksum_type);
+  header.set_data_checksum(header.compute_data_checksum(output.base + headerlen,
+                                                        header.get_data_zlength()));
   output.ptr = output.base;
   header.encode(&output.ptr);
   output.ptr += header.get_data_zlength();
@@ -105,7 +106,7 @@ BlockCompressionCodecBmz::inflate(const DynamicBuffer &input,
   header.decode(&ip, &remain);
   HT_EXPECT(header.get_data_zlength() == remain,
             Error::BLOCK_COMPRESSOR_BAD_HEADER);
-  HT_EXPECT(header.get_data_checksum() == fletcher32(ip, remain),
+  HT_EXPECT(header.get_data_checksum() == header.compute_data_checksum(ip, remain),
             Error::BLOCK_COMPRESSOR_CHECKSUM_MISMATCH);
 
   size_t outlen = header.get_data_length();
@@ -40,6 +40,9 @@ namespace {
  *
  */
 BlockCompressionCodecLzo::BlockCompressionCodecLzo(const Args &args) {
+  if (!args.empty())
+    HT_THROWF(Error::BLOCK_COMPRESSOR_INVALID_ARG, "Unrecognized argument "
+              "to Lzo codec: '%s'", args[0].c_str());
   if (lzo_init() != LZO_E_OK)
     HT_THROW(Error::BLOCK_COMPRESSOR_INIT_ERROR, "Problem initializing lzo library");
   m_workmem = new uint8_t [LZO1X_1_MEM_COMPRESS + 4];
@@ -86,7 +89,8 @@ void BlockCompressionCodecLzo::deflate(const DynamicBuffer &input, DynamicBuffer
     header.set_data_length(input.fill());
     header.set_data_zlength(out_len);
   }
-  header.set_data_checksum(fletcher32(output.base + header.length(), header.get_data_zlength()));
+  header.set_checksum_type(m_checksum_type);
+  header.set_data_checksum(header.compute_data_checksum(output.base + header.length(), header.get_data_zlength()));
 
   output.ptr = output.base;
   header.encode(&output.ptr);
@@ -113,7 +117,7 @@ void BlockCompressionCodecLzo::inflate(const DynamicBuffer &input, DynamicBuffer
     HT_THROW(Error::BLOCK_COMPRESSOR_BAD_HEADER, "");
   }
 
-  uint32_t checksum = fletcher32(msg_ptr, remaining);
+  uint32_t checksum = header.compute_data_checksum(msg_ptr, remaining);
   if (checksum != header.get_data_checksum()) {
     HT_ERRORF("Compressed block checksum mismatch header=%d, computed=%d", header.get_data_checksum(), checksum);
     HT_THROW(Error::BLOCK_COMPRESSOR_CHECKSUM_MISMATCH, "");
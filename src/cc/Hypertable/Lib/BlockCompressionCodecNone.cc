@@ -34,7 +34,10 @@ using namespace Hypertable;
 /**
  *
  */
-BlockCompressionCodecNone::BlockCompressionCodecNone(const Args &) {
+BlockCompressionCodecNone::BlockCompressionCodecNone(const Args &args) {
+  if (!args.empty())
+    HT_THROWF(Error::BLOCK_COMPRESSOR_INVALID_ARG, "Unrecognized argument "
+              "to None codec: '%s'", args[0].c_str());
 }
 
 
@@ -50,7 +53,8 @@ BlockCompressionCodecNone::deflate(const DynamicBuffer &input, DynamicBuffer &ou
   memcpy(output.base+header.length(), input.base, input.fill());
   header.set_data_length(input.fill());
   header.set_data_zlength(input.fill());
-  header.set_data_checksum(fletcher32(output.base + header.length(), header.get_data_zlength()));
+  header.set_checksum_type(m_checksum_type);
+  header.set_data_checksum(header.compute_data_checksum(output.base + header.length(), header.get_data_zlength()));
 
   output.ptr = output.base;
   header.encode(&output.ptr);
@@ -74,7 +78,7 @@ BlockCompressionCodecNone::inflate(const DynamicBuffer &input, DynamicBuffer &ou
               "header zlength = %lu, actual = %lu",
               (Lu)header.get_data_zlength(), (Lu)remaining);
 
-  uint32_t checksum = fletcher32(msg_ptr, remaining);
+  uint32_t checksum = header.compute_data_checksum(msg_ptr, remaining);
   if (checksum != header.get_data_checksum())
     HT_THROWF(Error::BLOCK_COMPRESSOR_CHECKSUM_MISMATCH, "Compressed block "
               "checksum mismatch header=%lx, computed=%lx",
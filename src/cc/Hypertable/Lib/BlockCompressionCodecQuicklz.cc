@@ -38,6 +38,9 @@ using namespace Hypertable;
  *
  */
 BlockCompressionCodecQuicklz::BlockCompressionCodecQuicklz(const Args &args) {
+  if (!args.empty())
+    HT_THROWF(Error::BLOCK_COMPRESSOR_INVALID_ARG, "Unrecognized argument "
+              "to Quicklz codec: '%s'", args[0].c_str());
   size_t amount = ((SCRATCH_DECOMPRESS) < (SCRATCH_COMPRESS)) ? (SCRATCH_COMPRESS) : (SCRATCH_DECOMPRESS);
   m_workmem = new uint8_t [amount];
 }
@@ -77,7 +80,8 @@ void BlockCompressionCodecQuicklz::deflate(const DynamicBuffer &input, DynamicBu
     header.set_data_length(input.fill());
     header.set_data_zlength(len);
   }
-  header.set_data_checksum(fletcher32(output.base + header.length(), header.get_data_zlength()));
+  header.set_checksum_type(m_checksum_type);
+  header.set_data_checksum(header.compute_data_checksum(output.base + header.length(), header.get_data_zlength()));
 
   output.ptr = output.base;
   header.encode(&output.ptr);
@@ -99,7 +103,7 @@ void BlockCompressionCodecQuicklz::inflate(const DynamicBuffer &input, DynamicBu
               "header zlength = %lu, actual = %lu",
               (Lu)header.get_data_zlength(), (Lu)remaining);
 
-  uint32_t checksum = fletcher32(msg_ptr, remaining);
+  uint32_t checksum = header.compute_data_checksum(msg_ptr, remaining);
 
   if (checksum != header.get_data_checksum())
     HT_THROWF(Error::BLOCK_COMPRESSOR_CHECKSUM_MISMATCH, "Compressed block "
@@ -124,7 +124,8 @@ void BlockCompressionCodecZlib::deflate(const DynamicBuffer &input, DynamicBuffe
     header.set_data_zlength(zlen);
   }
 
-  header.set_data_checksum(fletcher32(output.base + header.length(), header.get_data_zlength()));
+  header.set_checksum_type(m_checksum_type);
+  header.set_data_checksum(header.compute_data_checksum(output.base + header.length(), header.get_data_zlength()));
 
   deflateReset(&m_stream_deflate);
 
@@ -162,7 +163,7 @@ void BlockCompressionCodecZlib::inflate(const DynamicBuffer &input, DynamicBuffe
               "header zlength = %lu, actual = %lu",
               (Lu)header.get_data_zlength(), (Lu)remaining);
 
-  uint32_t checksum = fletcher32(msg_ptr, remaining);
+  uint32_t checksum = header.compute_data_checksum(msg_ptr, remaining);
 
   if (checksum != header.get_data_checksum())
     HT_THROWF(Error::BLOCK_COMPRESSOR_CHECKSUM_MISMATCH, "Compressed block "
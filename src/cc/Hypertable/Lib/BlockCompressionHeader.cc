@@ -34,6 +34,38 @@ using namespace Serialization;
 
 const size_t BlockCompressionHeader::LENGTH;
 
+namespace {
+  const uint8_t CRC32C_FLAG = 0x80;
+}
+
+
+uint32_t BlockCompressionHeader::compute_data_checksum(const void *data, size_t len) {
+  if (m_checksum_type == CHECKSUM_CRC32C)
+    return crc32c(data, len);
+  return fletcher32(data, len);
+}
+
+
+const char *BlockCompressionHeader::get_checksum_name(int type) {
+  if (type == CHECKSUM_CRC32C)
+    return "crc32c";
+  if (type == CHECKSUM_FLETCHER32)
+    return "fletcher32";
+  return "invalid";
+}
+
+
+/**
+ * Returns the checksum type with the given name, or -1 if unknown
+ */
+int BlockCompressionHeader::parse_checksum_name(const std::string &name) {
+  if (name == "crc32c")
+    return CHECKSUM_CRC32C;
+  if (name == "fletcher32")
+    return CHECKSUM_FLETCHER32;
+  return -1;
+}
+
 
 /**
  */
@@ -42,7 +74,8 @@ void BlockCompressionHeader::encode(uint8_t **bufp) {
   memcpy(*bufp, m_magic, 10);
   (*bufp) += 10;
   *(*bufp)++ = (uint8_t)length();
-  *(*bufp)++ = (uint8_t)m_compression_type;
+  *(*bufp)++ = (uint8_t)m_compression_type |
+      ((m_checksum_type == CHECKSUM_CRC32C) ? CRC32C_FLAG : 0);
   encode_i32(bufp, m_data_checksum);
   encode_i32(bufp, m_data_length);
   encode_i32(bufp, m_data_zlength);
@@ -88,6 +121,13 @@ void BlockCompressionHeader::decode(const uint8_t **bufp, size_t *remainp) {
 
   m_compression_type = decode_byte(bufp, remainp);
 
+  if (m_compression_type & CRC32C_FLAG) {
+    m_checksum_type = CHECKSUM_CRC32C;
+    m_compression_type &= ~CRC32C_FLAG;
+  }
+  else
+    m_checksum_type = CHECKSUM_FLETCHER32;
+
   if (m_compression_type >= BlockCompressionCodec::COMPRESSION_TYPE_LIMIT)
     HT_THROWF(Error::BLOCK_COMPRESSOR_BAD_HEADER, "Bad compression type: %d",
               (int)m_compression_type);
@@ -22,21 +22,28 @@
 #ifndef HYPERTABLE_BLOCKCOMPRESSIONHEADER_H
 #define HYPERTABLE_BLOCKCOMPRESSIONHEADER_H
 
+#include <string>
+
 namespace Hypertable {
 
   /**
-   * Base class for compressed block header.
+   * Base class for compressed block header.  The data checksum is either
+   * fletcher32 or crc32c; crc32c is recorded by setting the high bit of
+   * the compression type byte, so headers written with fletcher32 are
+   * unchanged.
    */
   class BlockCompressionHeader {
   public:
 
     static const size_t LENGTH = 26;
 
-    BlockCompressionHeader() : m_data_length(0), m_data_zlength(0), m_data_checksum(0), m_compression_type(-1)
-    { return; }
+    enum ChecksumType { CHECKSUM_FLETCHER32=0, CHECKSUM_CRC32C=1 };
+
+    BlockCompressionHeader() : m_data_length(0), m_data_zlength(0), m_data_checksum(0), m_compression_type(-1),
+      m_checksum_type(CHECKSUM_FLETCHER32) { return; }
 
-    BlockCompressionHeader(const char *magic) : m_data_length(0), m_data_zlength(0), m_data_checksum(0), m_compression_type(-1)
-      { memcpy(m_magic, magic, 10); }
+    BlockCompressionHeader(const char *magic) : m_data_length(0), m_data_zlength(0), m_data_checksum(0), m_compression_type(-1),
+      m_checksum_type(CHECKSUM_FLETCHER32) { memcpy(m_magic, magic, 10); }
 
     virtual ~BlockCompressionHeader() { return; }
 
@@ -56,6 +63,17 @@ namespace Hypertable {
     void     set_compression_type(uint16_t type) { m_compression_type = type; }
     uint16_t get_compression_type() { return m_compression_type; }
 
+    void     set_checksum_type(int type) { m_checksum_type = type; }
+    int      get_checksum_type() { return m_checksum_type; }
+
+    /**
+     * Computes the checksum of block data with this header's checksum type
+     */
+    uint32_t compute_data_checksum(const void *data, size_t len);
+
+    static const char *get_checksum_name(int type);
+    static int parse_checksum_name(const std::string &name);
+
     virtual size_t length() { return LENGTH; }
     virtual void   encode(uint8_t **bufp);
     virtual void   write_header_checksum(uint8_t *base, uint8_t **bufp);
@@ -67,6 +85,7 @@ namespace Hypertable {
     uint32_t m_data_zlength;
     uint32_t m_data_checksum;
     uint16_t m_compression_type;
+    int      m_checksum_type;
   };
 
 }
@@ -76,6 +76,30 @@ Table *Client::open_table(const String &name) {
 }
 
 
+/**
+ *
+ */
+MultiTableMutator *Client::create_multi_table_mutator(const std::vector<String> &names, int timeout) {
+  std::vector<TablePtr> table_ptrs;
+  std::vector<Table *> tables;
+
+  for (size_t i=0; i<names.size(); i++) {
+    table_ptrs.push_back(open_table(names[i]));
+    tables.push_back(table_ptrs.back().get());
+  }
+
+  return new MultiTableMutator(m_props_ptr, m_comm, tables, timeout);
+}
+
+
+/**
+ *
+ */
+MultiTableMutator *Client::create_multi_table_mutator(std::vector<Table *> &tables, int timeout) {
+  return new MultiTableMutator(m_props_ptr, m_comm, tables, timeout);
+}
+
+
 /**
  *
  */
@@ -33,6 +33,7 @@
 #include "Hyperspace/Session.h"
 
 #include "MasterClient.h"
+#include "MultiTableMutator.h"
 #include "Table.h"
 
 
@@ -76,6 +77,28 @@ namespace Hypertable {
      */
     Table *open_table(const String &name);
 
+    /**
+     * Creates a mutator that writes to several tables at once.  Updates
+     * for tables that share a range server are sent in a single request.
+     *
+     * @param names names of the tables; the position of each name is the
+     *        table index passed to the mutator methods
+     * @param timeout maximum time in seconds to allow mutator methods to execute before throwing an exception
+     * @return newly constructed mutator object
+     */
+    MultiTableMutator *create_multi_table_mutator(const std::vector<String> &names, int timeout=0);
+
+    /**
+     * Creates a mutator that writes to several tables that are already
+     * open.  The mutator shares the range locators of the tables.
+     *
+     * @param tables open tables; the position of each table is the table
+     *        index passed to the mutator methods
+     * @param timeout maximum time in seconds to allow mutator methods to execute before throwing an exception
+     * @return newly constructed mutator object
+     */
+    MultiTableMutator *create_multi_table_mutator(std::vector<Table *> &tables, int timeout=0);
+
     /**
      * Returns the table identifier for a table
      *
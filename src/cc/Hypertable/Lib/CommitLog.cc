@@ -20,6 +20,7 @@
  */
 
 #include "Common/Compat.h"
+#include <algorithm>
 #include <cassert>
 
 #include "Common/Checksum.h"
@@ -55,17 +56,26 @@ void CommitLog::initialize(Filesystem *fs, const String &log_dir, PropertiesPtr
   m_log_dir = log_dir;
   m_cur_fragment_length = 0;
   m_cur_fragment_num = 0;
+  m_last_issued_timestamp = 0;
+  m_queue_bytes = 0;
+  m_leader_active = false;
 
   if (props_ptr) {
     m_max_fragment_size = props_ptr->get_int64("Hypertable.RangeServer.CommitLog.RollLimit", 100000000LL);
     compressor = props_ptr->get("Hypertable.RangeServer.CommitLog.Compressor", "lzo");
+    m_max_batch_bytes = (size_t)props_ptr->get_int64("Hypertable.RangeServer.CommitLog.GroupCommit.MaxBatchBytes", 8388608LL);
+    m_max_delay = (uint32_t)props_ptr->get_int("Hypertable.RangeServer.CommitLog.GroupCommit.MaxDelay", 0);
   }
   else {
     m_max_fragment_size = 268435456LL;
     compressor = "lzo";
+    m_max_batch_bytes = 8388608;
+    m_max_delay = 0;
   }
 
   HT_INFOF("RollLimit = %lld", m_max_fragment_size);
+  HT_INFOF("GroupCommit.MaxBatchBytes = %llu", (Llu)m_max_batch_bytes);
+  HT_INFOF("GroupCommit.MaxDelay = %u", m_max_delay);
 
   m_compressor = CompressorFactory::create_block_codec(compressor);
 
@@ -90,39 +100,99 @@ void CommitLog::initialize(Filesystem *fs, const String &log_dir, PropertiesPtr
  *
  */
 uint64_t CommitLog::get_timestamp() {
-  boost::mutex::scoped_lock lock(m_mutex);
+  boost::mutex::scoped_lock lock(m_timestamp_mutex);
   boost::xtime now;
+  uint64_t timestamp;
   boost::xtime_get(&now, boost::TIME_UTC);
-  return ((uint64_t)now.sec * 1000000000LL) + (uint64_t)now.nsec;
+  timestamp = ((uint64_t)now.sec * 1000000000LL) + (uint64_t)now.nsec;
+  if (timestamp <= m_last_issued_timestamp)
+    timestamp = m_last_issued_timestamp + 1;
+  m_last_issued_timestamp = timestamp;
+  return timestamp;
 }
 
 
 
 
 /**
- *
+ * Queues the block and waits for it to be written.  If no other caller
+ * is currently writing a batch, this caller becomes the leader: it
+ * optionally waits up to m_max_delay milliseconds for more blocks to
+ * arrive, pulls up to m_max_batch_bytes worth of blocks off the queue
+ * and writes them with #write_batch.  The queue lock is released while
+ * the batch is being written so that new blocks can accumulate for the
+ * next leader.
  */
 int CommitLog::write(DynamicBuffer &buffer, uint64_t timestamp) {
-  int error;
-  BlockCompressionHeaderCommitLog header(MAGIC_DATA, timestamp);
-
-  /**
-   * Compress and write the commit block
-   */
-  if ((error = compress_and_write(buffer, &header, timestamp)) != Error::OK)
-    return error;
-
-  /**
-   * Roll the log
-   */
-  if (m_cur_fragment_length > m_max_fragment_size) {
-    boost::mutex::scoped_lock lock(m_mutex);
-    error = roll();
+  std::vector<DynamicBuffer *> buffers(1, &buffer);
+  return write(buffers, timestamp);
+}
+
+
+
+/**
+ */
+int CommitLog::write(std::vector<DynamicBuffer *> &buffers, uint64_t timestamp) {
+  CommitRequest request(buffers, timestamp);
+  std::vector<CommitRequest *> batch;
+  boost::mutex::scoped_lock lock(m_queue_mutex);
+
+  m_queue.push_back(&request);
+  m_queue_bytes += request.size;
+
+  if (m_leader_active && m_queue_bytes >= m_max_batch_bytes)
+    m_queue_cond.notify_all();
+
+  while (!request.done) {
+
+    if (m_leader_active) {
+      m_queue_cond.wait(lock);
+      continue;
+    }
+
+    m_leader_active = true;
+
+    if (m_max_delay && m_queue_bytes < m_max_batch_bytes) {
+      boost::xtime deadline;
+      boost::xtime_get(&deadline, boost::TIME_UTC);
+      deadline.sec += m_max_delay / 1000;
+      deadline.nsec += (m_max_delay % 1000) * 1000000;
+      if (deadline.nsec >= 1000000000) {
+        deadline.sec++;
+        deadline.nsec -= 1000000000;
+      }
+      while (m_queue_bytes < m_max_batch_bytes)
+        if (!m_queue_cond.timed_wait(lock, deadline))
+          break;
+    }
+
+    // always take at least one block, even if it exceeds the limit
+    size_t batch_bytes = 0;
+    batch.clear();
+    while (!m_queue.empty() &&
+           (batch.empty() || batch_bytes + m_queue.front()->size <= m_max_batch_bytes)) {
+      batch.push_back(m_queue.front());
+      batch_bytes += m_queue.front()->size;
+      m_queue.pop_front();
+    }
+    m_queue_bytes -= batch_bytes;
+
+    // updates are applied concurrently, so restore commit order
+    std::stable_sort(batch.begin(), batch.end(), LtCommitRequest());
+
+    lock.unlock();
+    int error = write_batch(batch);
+    lock.lock();
+
+    for (size_t i=0; i<batch.size(); i++) {
+      batch[i]->error = error;
+      batch[i]->done = true;
+    }
+    m_leader_active = false;
+    m_queue_cond.notify_all();
   }
-  else
-    error = Error::OK;
 
-  return error;
+  return request.error;
 }
 
 
@@ -140,7 +210,7 @@ int CommitLog::link_log(CommitLogBase *log_base, uint64_t timestamp) {
   header.set_compression_type(BlockCompressionCodec::NONE);
   header.set_data_length(log_dir.length() + 1);
   header.set_data_zlength(log_dir.length() + 1);
-  header.set_data_checksum(fletcher32(log_dir.c_str(), log_dir.length()+1));
+  header.set_data_checksum(header.compute_data_checksum(log_dir.c_str(), log_dir.length()+1));
 
   header.encode(&input.ptr);
   input.add(log_dir.c_str(), log_dir.length() + 1);
@@ -271,27 +341,50 @@ int CommitLog::roll() {
 
 
 /**
- *
+ * Compresses each block in the batch into its own commit block and writes
+ * them all with a single flushed append, rolling the log afterwards if it
+ * has grown past the roll limit.  Each block keeps its own
+ * BlockCompressionHeaderCommitLog so the on-disk format is unchanged.
+ * Only the current leader calls this, so the compressor is not shared.
  */
-int CommitLog::compress_and_write(DynamicBuffer &input, BlockCompressionHeader *header, uint64_t timestamp) {
+int CommitLog::write_batch(std::vector<CommitRequest *> &batch) {
   int error = Error::OK;
-  EventPtr event_ptr;
+  DynamicBuffer zblocks;
   DynamicBuffer zblock;
+  uint64_t max_timestamp = 0;
 
-  // Compress block and kick off log write (protected by lock)
   try {
-    boost::mutex::scoped_lock lock(m_mutex);
 
-    m_compressor->deflate(input, zblock, *header);
+    for (size_t i=0; i<batch.size(); i++) {
+      std::vector<DynamicBuffer *> &buffers = batch[i]->buffers;
+      for (size_t j=0; j<buffers.size(); j++) {
+        BlockCompressionHeaderCommitLog header(MAGIC_DATA, batch[i]->timestamp);
+        if (batch.size() == 1 && buffers.size() == 1)
+          m_compressor->deflate(*buffers[j], zblocks, header);
+        else {
+          m_compressor->deflate(*buffers[j], zblock, header);
+          zblocks.add(zblock.base, zblock.fill());
+        }
+      }
+      assert(batch[i]->timestamp != 0);
+      if (batch[i]->timestamp > max_timestamp)
+        max_timestamp = batch[i]->timestamp;
+    }
 
-    size_t amount = zblock.fill();
-    StaticBuffer send_buf(zblock);
+    boost::mutex::scoped_lock lock(m_mutex);
+
+    size_t amount = zblocks.fill();
+    StaticBuffer send_buf(zblocks);
 
     m_fs->append(m_fd, send_buf, Filesystem::O_FLUSH);
-    assert(timestamp != 0);
-    assert(timestamp != 0);
-    m_last_timestamp = timestamp;
+
+    // fragments are purged by timestamp, so track the newest one written
+    if (max_timestamp > m_last_timestamp)
+      m_last_timestamp = max_timestamp;
     m_cur_fragment_length += amount;
+
+    if (m_cur_fragment_length > m_max_fragment_size)
+      error = roll();
   }
   catch (Exception &e) {
     HT_ERRORF("Problem writing commit log: %s: %s",
@@ -25,6 +25,7 @@
 #include <deque>
 #include <map>
 #include <stack>
+#include <vector>
 
 #include <boost/thread/xtime.hpp>
 
@@ -32,9 +33,11 @@ extern "C" {
 #include <sys/time.h>
 }
 
+#include <boost/thread/condition.hpp>
 #include <boost/thread/mutex.hpp>
 
 #include "Common/DynamicBuffer.h"
+#include "Common/Error.h"
 #include "Common/Properties.h"
 #include "Common/ReferenceCount.h"
 #include "Common/String.h"
@@ -66,6 +69,17 @@ namespace Hypertable {
    *<pre>
    * Hypertable.RangeServer.CommitLog.RollLimit
    *</pre>
+   * Concurrent calls to #write are group committed.  Each caller queues
+   * its block and waits; one of the waiting callers becomes the leader,
+   * compresses every queued block and appends them to the log with a
+   * single flushed append, and then wakes up the others.  A call to
+   * #write does not return until its block has been flushed.  The size
+   * of each batch and the amount of time the leader waits for more
+   * blocks to arrive are controlled by the following properties:
+   *<pre>
+   * Hypertable.RangeServer.CommitLog.GroupCommit.MaxBatchBytes
+   * Hypertable.RangeServer.CommitLog.GroupCommit.MaxDelay (milliseconds)
+   *</pre>
    */
   class CommitLog : public CommitLogBase {
   public:
@@ -95,13 +109,17 @@ namespace Hypertable {
     virtual ~CommitLog();
 
     /**
-     * Atomically obtains a timestamp
+     * Atomically obtains a timestamp.  Timestamps are strictly increasing,
+     * so they also serve as commit sequence numbers: blocks handed to
+     * #write in the same group commit are written in timestamp order.
      *
-     * @return microseconds since the epoch
+     * @return nanoseconds since the epoch
      */
     uint64_t get_timestamp();
 
-    /** Writes a block of updates to the commit log.
+    /** Writes a block of updates to the commit log.  Blocks until
+     * the block (and any others in the same group commit batch) has
+     * been flushed.
      *
      * @param buffer block of updates to commit
      * @param timestamp current commit log time obtained with a call to #get_timestamp
@@ -109,6 +127,18 @@ namespace Hypertable {
      */
     int write(DynamicBuffer &buffer, uint64_t timestamp);
 
+    /** Writes several blocks of updates to the commit log as one
+     * request.  The blocks are always placed in the same group commit
+     * batch and flushed with a single append, so a caller committing
+     * updates for several tables pays for one log write.  Each block
+     * keeps its own header, so readers see ordinary commit blocks.
+     *
+     * @param buffers blocks of updates to commit
+     * @param timestamp current commit log time obtained with a call to #get_timestamp
+     * @return Error::OK on success or error code on failure
+     */
+    int write(std::vector<DynamicBuffer *> &buffers, uint64_t timestamp);
+
     /** Links an external log into this log.
      *
      * @param log_base pointer to commit log object to link in
@@ -151,11 +181,40 @@ namespace Hypertable {
 
   private:
 
+    struct CommitRequest {
+      CommitRequest(std::vector<DynamicBuffer *> &bufs, uint64_t ts)
+        : buffers(bufs), size(0), timestamp(ts), error(Error::OK),
+          done(false) {
+        for (size_t i=0; i<buffers.size(); i++)
+          size += buffers[i]->fill();
+      }
+      std::vector<DynamicBuffer *> &buffers;
+      size_t size;
+      uint64_t timestamp;
+      int error;
+      bool done;
+    };
+
+    struct LtCommitRequest {
+      bool operator()(const CommitRequest *r1, const CommitRequest *r2) const {
+        return r1->timestamp < r2->timestamp;
+      }
+    };
+
     void initialize(Filesystem *fs, const String &log_dir, PropertiesPtr &props_ptr);
     int roll();
-    int compress_and_write(DynamicBuffer &input, BlockCompressionHeader *header, uint64_t timestamp);
+    int write_batch(std::vector<CommitRequest *> &batch);
 
     boost::mutex            m_mutex;
+    boost::mutex            m_timestamp_mutex;
+    uint64_t                m_last_issued_timestamp;
+    boost::mutex            m_queue_mutex;
+    boost::condition        m_queue_cond;
+    std::deque<CommitRequest *> m_queue;
+    size_t                  m_queue_bytes;
+    bool                    m_leader_active;
+    size_t                  m_max_batch_bytes;
+    uint32_t                m_max_delay;
     Filesystem             *m_fs;
     BlockCompressionCodec  *m_compressor;
     String                  m_cur_fragment_fname;
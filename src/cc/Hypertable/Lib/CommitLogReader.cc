@@ -138,6 +138,17 @@ bool CommitLogReader::next(const uint8_t **blockp, size_t *lenp, BlockCompressio
 
 
 
+void CommitLogReader::get_fragments(std::vector<CommitLogFileInfo> &fragments) {
+  LogFragmentStack stack(m_fragment_stack);
+
+  while (!stack.empty()) {
+    fragments.push_back(stack.top());
+    stack.pop();
+  }
+}
+
+
+
 void CommitLogReader::load_fragments(String &log_dir) {
   vector<string> listing;
   CommitLogFileInfo file_info;
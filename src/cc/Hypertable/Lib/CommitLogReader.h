@@ -54,6 +54,15 @@ namespace Hypertable {
 
     LogFragmentQueue &get_fragment_queue() { return m_fragment_queue; }
 
+    /**
+     * Returns the fragments that have not been read yet, in the order in
+     * which #next would read them.  This allows the fragments to be read
+     * independently (e.g. concurrently) with a CommitLogBlockStream each.
+     *
+     * @param fragments reference to vector to receive the fragment info
+     */
+    void get_fragments(std::vector<CommitLogFileInfo> &fragments);
+
   private:
 
     void load_fragments(String &log_dir);
@@ -63,21 +63,49 @@ CompressorFactory::parse_block_codec_spec(const string &spec,
   return BlockCompressionCodec::UNKNOWN;
 }
 
+/**
+ * Creates a block codec.  A "--checksum=<type>" argument (fletcher32 or
+ * crc32c) selects the checksum recorded in the blocks it writes and is
+ * not passed on to the codec.
+ */
 BlockCompressionCodec *
 CompressorFactory::create_block_codec(BlockCompressionCodec::Type type,
                                       const BlockCompressionCodec::Args &args) {
+  BlockCompressionCodec::Args codec_args;
+  BlockCompressionCodec *codec;
+  int checksum_type = BlockCompressionHeader::CHECKSUM_FLETCHER32;
+
+  for (size_t i=0; i<args.size(); i++) {
+    if (starts_with(args[i], "--checksum=")) {
+      checksum_type = BlockCompressionHeader::parse_checksum_name(args[i].substr(11));
+      if (checksum_type < 0)
+        HT_THROWF(Error::BLOCK_COMPRESSOR_INVALID_ARG, "Unrecognized "
+                  "checksum type: '%s'", args[i].c_str());
+    }
+    else
+      codec_args.push_back(args[i]);
+  }
+
   switch (type) {
   case BlockCompressionCodec::BMZ:
-    return new BlockCompressionCodecBmz(args);
+    codec = new BlockCompressionCodecBmz(codec_args);
+    break;
   case BlockCompressionCodec::NONE:
-    return new BlockCompressionCodecNone(args);
+    codec = new BlockCompressionCodecNone(codec_args);
+    break;
   case BlockCompressionCodec::ZLIB:
-    return new BlockCompressionCodecZlib(args);
+    codec = new BlockCompressionCodecZlib(codec_args);
+    break;
   case BlockCompressionCodec::LZO:
-    return new BlockCompressionCodecLzo(args);
+    codec = new BlockCompressionCodecLzo(codec_args);
+    break;
   case BlockCompressionCodec::QUICKLZ:
-    return new BlockCompressionCodecQuicklz(args);
+    codec = new BlockCompressionCodecQuicklz(codec_args);
+    break;
   default:
     return NULL;
   }
+
+  codec->set_checksum_type(checksum_type);
+  return codec;
 }
@@ -166,6 +166,10 @@ void HqlCommandInterpreter::execute_line(const String &line) {
       scan_spec.interval.first  = state.scan.start_time;
       scan_spec.interval.second = state.scan.end_time;
       scan_spec.return_deletes = state.scan.return_deletes;
+      for (size_t i=0; i<state.scan.predicates.size(); i++)
+        scan_spec.predicates.push_back(CellPredicate(
+            state.scan.predicates[i].target, state.scan.predicates[i].match,
+            state.scan.predicates[i].pattern.c_str()));
 
       table_ptr = m_client->open_table(state.table_name);
 
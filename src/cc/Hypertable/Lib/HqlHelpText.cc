@@ -90,6 +90,12 @@ namespace {
     "    | TIMESTAMP >= timestamp",
     "    | TIMESTAMP <  timestamp",
     "    | TIMESTAMP <= timestamp",
+    "    | QUALIFIER = qualifier",
+    "    | QUALIFIER STARTS WITH substr",
+    "    | QUALIFIER =~ regex",
+    "    | VALUE = value",
+    "    | VALUE STARTS WITH substr",
+    "    | VALUE =~ regex",
     "",
     "options_spec:",
     "    (MAX_VERSIONS = version_count",
@@ -254,6 +260,10 @@ namespace {
     "    IN_MEMORY",
     "    | BLOCKSIZE '=' value",
     "    | COMPRESSOR '=' string_literal",
+    "    | BLOOMFILTER '=' string_literal",
+    "",
+    "bloom filter string_literal:",
+    "    ('none' | 'rows' | 'rows+cols') [--false-positive probability]",
     "",
     (const char *)0
   };
@@ -279,6 +289,12 @@ namespace {
     "    | TIMESTAMP >= timestamp",
     "    | TIMESTAMP <  timestamp",
     "    | TIMESTAMP <= timestamp",
+    "    | QUALIFIER = qualifier",
+    "    | QUALIFIER STARTS WITH substr",
+    "    | QUALIFIER =~ regex",
+    "    | VALUE = value",
+    "    | VALUE STARTS WITH substr",
+    "    | VALUE =~ regex",
     "",
     "options_spec:",
     "    (MAX_VERSIONS = version_count",
@@ -291,6 +307,11 @@ namespace {
     "timestamp:",
     "    'YYYY-MM-DD HH:MM:SS[.nanoseconds]'",
     "",
+    "NOTES:  QUALIFIER and VALUE predicates are evaluated by the range",
+    "servers, so cells that do not match are never sent to the client.",
+    "Regular expressions are POSIX extended regular expressions.  LIMIT and",
+    "MAX_VERSIONS count matching cells only.",
+    "",
     (const char *)0
   };
 
@@ -49,6 +49,7 @@ extern "C" {
 #include "Common/FileUtils.h"
 
 #include "Schema.h"
+#include "Types.h"
 
 
 namespace Hypertable {
@@ -96,6 +97,16 @@ namespace Hypertable {
       std::string value;
     };
 
+    class hql_interpreter_scan_predicate {
+    public:
+      hql_interpreter_scan_predicate(uint8_t target_, uint8_t match_,
+                                     const std::string &pattern_)
+        : target(target_), match(match_), pattern(pattern_) { }
+      uint8_t target;
+      uint8_t match;
+      std::string pattern;
+    };
+
     class hql_interpreter_scan_state {
     public:
       hql_interpreter_scan_state() : start_row_inclusive(true), end_row_inclusive(true), limit(0), max_versions(0), start_time(0), end_time(0), display_timestamps(false), return_deletes(false), keys_only(false) { }
@@ -113,6 +124,7 @@ namespace Hypertable {
       bool display_timestamps;
       bool return_deletes;
       bool keys_only;
+      std::vector<hql_interpreter_scan_predicate> predicates;
     };
 
     class hql_interpreter_state {
@@ -292,6 +304,20 @@ namespace Hypertable {
       hql_interpreter_state &state;
     };
 
+    struct set_access_group_bloom_filter {
+      set_access_group_bloom_filter(hql_interpreter_state &state_) : state(state_) {  }
+      void operator()(char const *str, char const *end) const {
+        display_string("set_access_group_bloom_filter");
+        Schema::BloomFilterMode mode;
+        float false_positive;
+        state.ag->bloom_filter = std::string(str, end-str);
+        boost::trim_if(state.ag->bloom_filter, boost::is_any_of("'\""));
+        if (!Schema::parse_bloom_filter_spec(state.ag->bloom_filter, mode, false_positive))
+          HT_THROW(Error::HQL_PARSE_ERROR, std::string("invalid bloom filter specification '") + state.ag->bloom_filter + "'");
+      }
+      hql_interpreter_state &state;
+    };
+
     struct set_access_group_blocksize {
       set_access_group_blocksize(hql_interpreter_state &state_) : state(state_) { }
       void operator()(const unsigned int &blocksize) const {
@@ -479,6 +505,22 @@ namespace Hypertable {
       hql_interpreter_state &state;
     };
 
+    struct scan_add_predicate {
+      scan_add_predicate(hql_interpreter_state &state_, uint8_t target_,
+                         uint8_t match_)
+        : state(state_), target(target_), match(match_) { }
+      void operator()(char const *str, char const *end) const {
+        display_string("scan_add_predicate");
+        // strip the enclosing quotes only, they may be part of the pattern
+        std::string pattern = std::string(str+1, end-str-2);
+        state.scan.predicates.push_back(
+            hql_interpreter_scan_predicate(target, match, pattern));
+      }
+      hql_interpreter_state &state;
+      uint8_t target;
+      uint8_t match;
+    };
+
     struct scan_set_start_row {
       scan_set_start_row(hql_interpreter_state &state_, bool inclusive_) : state(state_), inclusive(inclusive_) { }
       void operator()(char const *str, char const *end) const {
@@ -797,6 +839,7 @@ namespace Hypertable {
           chlit<>     COLON(':');
           chlit<>     EQUAL('=');
           strlit<>    DOUBLEEQUAL("==");
+          strlit<>    REGEXMATCH("=~");
           chlit<>     LT('<');
           strlit<>    LE("<=");
           strlit<>    GE(">=");
@@ -866,6 +909,7 @@ namespace Hypertable {
           token_t DELETE       = as_lower_d["delete"];
           token_t VALUES       = as_lower_d["values"];
           token_t COMPRESSOR   = as_lower_d["compressor"];
+          token_t BLOOMFILTER  = as_lower_d["bloomfilter"];
           token_t STARTS       = as_lower_d["starts"];
           token_t WITH         = as_lower_d["with"];
           token_t IF           = as_lower_d["if"];
@@ -885,6 +929,8 @@ namespace Hypertable {
           token_t START        = as_lower_d["start"];
           token_t COMMIT       = as_lower_d["commit"];
           token_t LOG          = as_lower_d["log"];
+          token_t QUALIFIER    = as_lower_d["qualifier"];
+          token_t VALUE        = as_lower_d["value"];
 
           /**
            * Start grammar definition
@@ -1091,6 +1137,7 @@ namespace Hypertable {
             = in_memory_option[set_access_group_in_memory(self.state)]
             | blocksize_option
             | COMPRESSOR >> EQUAL >> string_literal[set_access_group_compressor(self.state)]
+            | BLOOMFILTER >> EQUAL >> string_literal[set_access_group_bloom_filter(self.state)]
             ;
 
           in_memory_option
@@ -1125,6 +1172,14 @@ namespace Hypertable {
             | TIMESTAMP >> GE >> date_expression[scan_set_start_time(self.state, true)]
             | TIMESTAMP >> LT >> date_expression[scan_set_end_time(self.state, false)]
             | TIMESTAMP >> LE >> date_expression[scan_set_end_time(self.state, true)]
+            | QUALIFIER >> REGEXMATCH >> string_literal[scan_add_predicate(self.state, CellPredicate::QUALIFIER, CellPredicate::REGEX)]
+            | QUALIFIER >> EQUAL >> string_literal[scan_add_predicate(self.state, CellPredicate::QUALIFIER, CellPredicate::EXACT)]
+            | QUALIFIER >> DOUBLEEQUAL >> string_literal[scan_add_predicate(self.state, CellPredicate::QUALIFIER, CellPredicate::EXACT)]
+            | QUALIFIER >> STARTS >> WITH >> string_literal[scan_add_predicate(self.state, CellPredicate::QUALIFIER, CellPredicate::PREFIX)]
+            | VALUE >> REGEXMATCH >> string_literal[scan_add_predicate(self.state, CellPredicate::VALUE, CellPredicate::REGEX)]
+            | VALUE >> EQUAL >> string_literal[scan_add_predicate(self.state, CellPredicate::VALUE, CellPredicate::EXACT)]
+            | VALUE >> DOUBLEEQUAL >> string_literal[scan_add_predicate(self.state, CellPredicate::VALUE, CellPredicate::EXACT)]
+            | VALUE >> STARTS >> WITH >> string_literal[scan_add_predicate(self.state, CellPredicate::VALUE, CellPredicate::PREFIX)]
             ;
 
           option_spec
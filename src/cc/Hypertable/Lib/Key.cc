@@ -100,8 +100,7 @@ namespace Hypertable {
     size_t len = key.decode_length((const uint8_t **)&row);
     const uint8_t *endptr = (const uint8_t *)row + len;
 
-    while (key.ptr < endptr && *key.ptr != 0)
-      key.ptr++;
+    key.ptr = key_find_nul(key.ptr, endptr);
     key.ptr++;
     if (key.ptr >= endptr) {
       cerr << "row decode overrun" << endl;
@@ -111,8 +110,7 @@ namespace Hypertable {
     column_family_code = *key.ptr++;
     column_qualifier = (const char *)key.ptr;
 
-    while (key.ptr < endptr && *key.ptr != 0)
-      key.ptr++;
+    key.ptr = key_find_nul(key.ptr, endptr);
     key.ptr++;
     if (key.ptr >= endptr) {
       cerr << "qualifier decode overrun" << endl;
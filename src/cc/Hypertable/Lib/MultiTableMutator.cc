@@ -0,0 +1,323 @@
+/** -*- c++ -*-
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "Common/Compat.h"
+#include <cstring>
+#include <map>
+
+extern "C" {
+#include <poll.h>
+}
+
+#include "Defaults.h"
+#include "Key.h"
+#include "MultiTableMutator.h"
+#include "MultiTableMutatorDispatchHandler.h"
+#include "TableMutator.h"
+
+using namespace Hypertable;
+using namespace Serialization;
+
+namespace {
+  const uint64_t DEFAULT_MAX_MEMORY = 20000000LL;
+}
+
+
+/**
+ *
+ */
+MultiTableMutator::MultiTableMutator(PropertiesPtr &props_ptr, Comm *comm,
+    std::vector<Table *> &tables, int timeout)
+    : m_props_ptr(props_ptr), m_comm(comm),
+      m_range_server(comm, HYPERTABLE_CLIENT_TIMEOUT), m_memory_used(0),
+      m_max_memory(DEFAULT_MAX_MEMORY), m_resends(0), m_timeout(timeout) {
+  TableIdentifier identifier;
+  SchemaPtr schema_ptr;
+  RangeLocatorPtr range_locator_ptr;
+  TableState *state;
+
+  if (m_timeout == 0 ||
+      (m_timeout = props_ptr->get_int("Hypertable.Client.Timeout", 0)) == 0 ||
+      (m_timeout = props_ptr->get_int("Hypertable.Request.Timeout", 0)) == 0)
+    m_timeout = HYPERTABLE_CLIENT_TIMEOUT;
+
+  for (size_t i=0; i<tables.size(); i++) {
+    tables[i]->get_identifier(&identifier);
+    tables[i]->get_schema(schema_ptr);
+    tables[i]->get_range_locator(range_locator_ptr);
+    state = new TableState(identifier, schema_ptr, range_locator_ptr);
+    state->buffer_ptr = new TableMutatorScatterBuffer(props_ptr, m_comm, &state->table_identifier, state->schema_ptr, state->range_locator_ptr);
+    m_tables.push_back(state);
+  }
+}
+
+
+MultiTableMutator::~MultiTableMutator() {
+  for (size_t i=0; i<m_tables.size(); i++)
+    delete m_tables[i];
+}
+
+
+/**
+ *
+ */
+void MultiTableMutator::set(size_t table, uint64_t timestamp, KeySpec &key, const void *value, uint32_t value_len) {
+  Timer timer(m_timeout);
+  TableState *state = get_table(table);
+  Key full_key;
+
+  TableMutator::sanity_check_key(key);
+
+  if (key.column_family == 0)
+    HT_THROW(Error::BAD_KEY, "Invalid key - column family not specified");
+
+  Schema::ColumnFamily *cf = state->schema_ptr->get_column_family(key.column_family);
+  if (cf == 0)
+    HT_THROW(Error::BAD_KEY, (std::string)"Invalid key - bad column family '" + key.column_family + "'");
+  full_key.row = (const char *)key.row;
+  full_key.column_qualifier = (const char *)key.column_qualifier;
+  full_key.column_family_code = (uint8_t)cf->id;
+  full_key.timestamp = timestamp;
+
+  state->buffer_ptr->set(full_key, value, value_len, timer);
+
+  m_memory_used += 20 + key.row_len + key.column_qualifier_len + value_len;
+
+  if (state->buffer_ptr->full() || m_memory_used > m_max_memory)
+    send_and_swap(timer);
+}
+
+
+
+void MultiTableMutator::set_delete(size_t table, uint64_t timestamp, KeySpec &key) {
+  Timer timer(m_timeout);
+  TableState *state = get_table(table);
+  Key full_key;
+
+  TableMutator::sanity_check_key(key);
+
+  if (key.column_family == 0) {
+    full_key.row = (const char *)key.row;
+    full_key.column_family_code = 0;
+    full_key.column_qualifier = 0;
+    full_key.timestamp = timestamp;
+  }
+  else  {
+    Schema::ColumnFamily *cf = state->schema_ptr->get_column_family(key.column_family);
+    if (cf == 0)
+      HT_THROW(Error::BAD_KEY, (std::string)"Invalid key - bad column family '" + key.column_family + "'");
+    full_key.row = (const char *)key.row;
+    full_key.column_qualifier = (const char *)key.column_qualifier;
+    full_key.column_family_code = (uint8_t)cf->id;
+    full_key.timestamp = timestamp;
+  }
+
+  state->buffer_ptr->set_delete(full_key, timer);
+
+  m_memory_used += 20 + key.row_len + key.column_qualifier_len;
+
+  if (state->buffer_ptr->full() || m_memory_used > m_max_memory)
+    send_and_swap(timer);
+}
+
+
+
+void MultiTableMutator::flush() {
+  Timer timer(m_timeout, true);
+  std::vector<TableMutatorScatterBuffer *> buffers;
+
+  wait_for_previous_buffers(timer);
+
+  /**
+   * If there are buffered updates, send them and wait for completion
+   */
+  if (m_memory_used > 0) {
+    for (size_t i=0; i<m_tables.size(); i++) {
+      buffers.push_back(m_tables[i]->buffer_ptr.get());
+      m_tables[i]->prev_buffer_ptr = m_tables[i]->buffer_ptr;
+    }
+    send(buffers);
+    wait_for_previous_buffers(timer);
+  }
+
+  for (size_t i=0; i<m_tables.size(); i++) {
+    m_tables[i]->buffer_ptr->reset();
+    m_tables[i]->prev_buffer_ptr = 0;
+  }
+  m_memory_used = 0;
+}
+
+
+
+void MultiTableMutator::get_failed(size_t table, std::vector<std::pair<Cell, int> > &failed_mutations) {
+  TableState *state = get_table(table);
+  if (state->prev_buffer_ptr)
+    state->prev_buffer_ptr->get_failed_mutations(failed_mutations);
+}
+
+
+
+MultiTableMutator::TableState *MultiTableMutator::get_table(size_t table) {
+  if (table >= m_tables.size())
+    HT_THROWF(Error::TABLE_DOES_NOT_EXIST, "Invalid table index %d (mutator has %d tables)", (int)table, (int)m_tables.size());
+  return m_tables[table];
+}
+
+
+
+/**
+ * Waits for the previous round of sends, sends the current buffers of all
+ * of the tables and starts a new round.
+ */
+void MultiTableMutator::send_and_swap(Timer &timer) {
+  std::vector<TableMutatorScatterBuffer *> buffers;
+
+  timer.start();
+
+  wait_for_previous_buffers(timer);
+
+  for (size_t i=0; i<m_tables.size(); i++)
+    buffers.push_back(m_tables[i]->buffer_ptr.get());
+
+  send(buffers);
+
+  for (size_t i=0; i<m_tables.size(); i++) {
+    TableState *state = m_tables[i];
+    state->prev_buffer_ptr = state->buffer_ptr;
+    state->buffer_ptr = new TableMutatorScatterBuffer(m_props_ptr, m_comm, &state->table_identifier, state->schema_ptr, state->range_locator_ptr);
+  }
+  m_memory_used = 0;
+}
+
+
+
+/**
+ * Sends the given scatter buffers, combining the send buffers of all of
+ * the tables bound for the same range server into one "update multi"
+ * request.
+ */
+void MultiTableMutator::send(std::vector<TableMutatorScatterBuffer *> &buffers) {
+  typedef std::map<uint64_t, std::vector<TableMutatorSendBuffer *> > ServerMap;
+  std::vector<TableMutatorSendBufferPtr> send_buffers;
+  ServerMap server_map;
+  uint64_t server_key;
+
+  for (size_t i=0; i<buffers.size(); i++)
+    buffers[i]->prepare_send(send_buffers);
+
+  for (size_t i=0; i<send_buffers.size(); i++) {
+    struct sockaddr_in &addr = send_buffers[i]->addr;
+    server_key = ((uint64_t)addr.sin_addr.s_addr << 16) | addr.sin_port;
+    server_map[server_key].push_back(send_buffers[i].get());
+  }
+
+  for (ServerMap::iterator iter = server_map.begin(); iter != server_map.end(); ++iter) {
+    std::vector<TableMutatorSendBuffer *> &group = (*iter).second;
+    TableMutatorSendBuffer *send_buffer = group[0];
+
+    /**
+     * A lone send buffer goes out as an ordinary update
+     */
+    if (group.size() == 1) {
+      try {
+        send_buffer->pending_updates.own = false;
+        m_range_server.update(send_buffer->addr, *send_buffer->get_table_identifier(), send_buffer->pending_updates, send_buffer->dispatch_handler_ptr.get());
+      }
+      catch (Exception &e) {
+        send_buffer->add_retries(0, send_buffer->pending_updates.size);
+        send_buffer->counterp->decrement();
+      }
+      send_buffer->pending_updates.own = true;
+      continue;
+    }
+
+    size_t len = 0;
+    for (size_t i=0; i<group.size(); i++)
+      len += group[i]->get_table_identifier()->encoded_length() + 4 + group[i]->pending_updates.size;
+
+    StaticBuffer buffer(len);
+    uint8_t *ptr = buffer.base;
+
+    for (size_t i=0; i<group.size(); i++) {
+      group[i]->get_table_identifier()->encode(&ptr);
+      encode_i32(&ptr, group[i]->pending_updates.size);
+      memcpy(ptr, group[i]->pending_updates.base, group[i]->pending_updates.size);
+      ptr += group[i]->pending_updates.size;
+    }
+
+    DispatchHandlerPtr dispatch_handler_ptr = new MultiTableMutatorDispatchHandler(group);
+    for (size_t i=0; i<group.size(); i++)
+      group[i]->dispatch_handler_ptr = dispatch_handler_ptr;
+
+    try {
+      m_range_server.update_multi(send_buffer->addr, group.size(), buffer, dispatch_handler_ptr.get());
+    }
+    catch (Exception &e) {
+      for (size_t i=0; i<group.size(); i++) {
+        group[i]->add_retries(0, group[i]->pending_updates.size);
+        group[i]->counterp->decrement();
+      }
+    }
+  }
+}
+
+
+
+void MultiTableMutator::wait_for_previous_buffers(Timer &timer) {
+  std::vector<TableState *> pending;
+  std::vector<TableMutatorScatterBuffer *> redo_buffers;
+  TableMutatorScatterBuffer *redo_buffer;
+  int wait_time = 1;
+
+  while (true) {
+
+    pending.clear();
+    for (size_t i=0; i<m_tables.size(); i++) {
+      if (m_tables[i]->prev_buffer_ptr &&
+          !m_tables[i]->prev_buffer_ptr->wait_for_completion(timer))
+        pending.push_back(m_tables[i]);
+    }
+
+    if (pending.empty())
+      return;
+
+    if (timer.remaining() < wait_time)
+      HT_THROW(Error::REQUEST_TIMEOUT, "");
+
+    // wait a bit
+    poll(0, 0, wait_time*1000);
+    wait_time += 2;
+
+    /**
+     * Re-send failed sends, again combined per range server
+     */
+    redo_buffers.clear();
+    for (size_t i=0; i<pending.size(); i++) {
+      redo_buffer = pending[i]->prev_buffer_ptr->create_redo_buffer(timer);
+      m_resends += pending[i]->prev_buffer_ptr->get_resend_count();
+      pending[i]->prev_buffer_ptr = redo_buffer;
+      redo_buffers.push_back(redo_buffer);
+    }
+
+    send(redo_buffers);
+  }
+
+}
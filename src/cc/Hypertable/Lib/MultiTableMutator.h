@@ -0,0 +1,177 @@
+/** -*- c++ -*-
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef HYPERTABLE_MULTITABLEMUTATOR_H
+#define HYPERTABLE_MULTITABLEMUTATOR_H
+
+#include <vector>
+
+#include "Common/Properties.h"
+#include "Common/ReferenceCount.h"
+#include "Common/Timer.h"
+
+#include "Cell.h"
+#include "KeySpec.h"
+#include "RangeServerClient.h"
+#include "Table.h"
+#include "TableMutatorScatterBuffer.h"
+
+namespace Hypertable {
+
+  /**
+   * Mutates several tables through a single set of buffers.  Mutations are
+   * collected per table exactly as in TableMutator, but when the buffers are
+   * flushed the updates for all of the tables that live on the same range
+   * server are sent together in one "update multi" request, which the range
+   * server commits with a single commit log write.  Tables are referred to
+   * by their position in the vector passed to the constructor.
+   */
+  class MultiTableMutator : public ReferenceCount {
+
+  public:
+
+    /**
+     * Constructs the MultiTableMutator object
+     *
+     * @param props_ptr smart pointer to configuration properties object
+     * @param comm pointer to the Comm layer
+     * @param tables tables to be mutated
+     * @param timeout maximum time in seconds to allow methods to execute before throwing an exception
+     */
+    MultiTableMutator(PropertiesPtr &props_ptr, Comm *comm, std::vector<Table *> &tables, int timeout);
+
+    virtual ~MultiTableMutator();
+
+    /**
+     * Inserts a cell into one of the tables.  See TableMutator::set for
+     * the caveats regarding explicit timestamps.
+     *
+     * @param table index of the table
+     * @param timestamp timestamp (nanoseconds) of cell
+     * @param key key of the cell being inserted
+     * @param value pointer to the value to store in the cell
+     * @param value_len length of data pointed to by value
+     */
+    void set(size_t table, uint64_t timestamp, KeySpec &key, const void *value, uint32_t value_len);
+
+    /**
+     * Inserts a cell into one of the tables.
+     *
+     * @param table index of the table
+     * @param key key of the cell being inserted
+     * @param value pointer to the value to store in the cell
+     * @param value_len length of data pointed to by value
+     */
+    void set(size_t table, KeySpec &key, const void *value, uint32_t value_len) {
+      set(table, 0, key, value, value_len);
+    }
+
+    /**
+     * Inserts a cell into one of the tables.
+     *
+     * @param table index of the table
+     * @param key key of the cell being inserted
+     * @param value null-terminated c-string value
+     */
+    void set(size_t table, KeySpec &key, const char *value) {
+      if (value)
+        set(table, 0, key, value, strlen(value));
+      else
+        set(table, 0, key, 0, 0);
+    }
+
+    /**
+     * Deletes an entire row, a column family in a particular row, or a
+     * specific cell within a row of one of the tables.
+     *
+     * @param table index of the table
+     * @param timestamp timestamp (nanoseconds) of cell
+     * @param key key of the row or cell(s) being deleted
+     */
+    void set_delete(size_t table, uint64_t timestamp, KeySpec &key);
+
+    /**
+     * Deletes an entire row, a column family in a particular row, or a
+     * specific cell within a row of one of the tables.
+     *
+     * @param table index of the table
+     * @param key key of the row or cell(s) being deleted
+     */
+    void set_delete(size_t table, KeySpec &key) {
+      set_delete(table, 0, key);
+    }
+
+    /**
+     * Flushes the accumulated mutations of all tables to their respective
+     * range servers.
+     */
+    void flush();
+
+    /**
+     * Returns the number of mutations that were resent because of stale
+     * range location information (see TableMutator::get_resend_count)
+     *
+     * @return number of mutations that were resent
+     */
+    uint64_t get_resend_count() { return m_resends; }
+
+    /**
+     * Returns the failed mutations of one of the tables
+     *
+     * @param table index of the table
+     * @param failed_mutations reference to vector of Cell/error pairs
+     */
+    void get_failed(size_t table, std::vector<std::pair<Cell, int> > &failed_mutations);
+
+  private:
+
+    class TableState {
+    public:
+      TableState(TableIdentifier &identifier, SchemaPtr &schema,
+                 RangeLocatorPtr &range_locator)
+        : table_identifier(identifier), schema_ptr(schema),
+          range_locator_ptr(range_locator) { }
+      TableIdentifierManaged table_identifier;
+      SchemaPtr schema_ptr;
+      RangeLocatorPtr range_locator_ptr;
+      TableMutatorScatterBufferPtr buffer_ptr;
+      TableMutatorScatterBufferPtr prev_buffer_ptr;
+    };
+
+    TableState *get_table(size_t table);
+    void send_and_swap(Timer &timer);
+    void send(std::vector<TableMutatorScatterBuffer *> &buffers);
+    void wait_for_previous_buffers(Timer &timer);
+
+    PropertiesPtr        m_props_ptr;
+    Comm                *m_comm;
+    RangeServerClient    m_range_server;
+    std::vector<TableState *> m_tables;
+    uint64_t             m_memory_used;
+    uint64_t             m_max_memory;
+    uint64_t             m_resends;
+    int                  m_timeout;
+  };
+  typedef boost::intrusive_ptr<MultiTableMutator> MultiTableMutatorPtr;
+
+}
+
+#endif // HYPERTABLE_MULTITABLEMUTATOR_H
@@ -0,0 +1,68 @@
+/** -*- c++ -*-
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef HYPERTABLE_MULTITABLEMUTATORDISPATCHHANDLER_H
+#define HYPERTABLE_MULTITABLEMUTATORDISPATCHHANDLER_H
+
+#include <vector>
+
+#include "AsyncComm/DispatchHandler.h"
+#include "AsyncComm/Event.h"
+
+#include "TableMutatorScatterBuffer.h"
+#include "TableMutatorSendBuffer.h"
+
+namespace Hypertable {
+
+  /**
+   * DispatchHandler for an "update multi" request that carries the send
+   * buffers of several tables bound for the same range server.  The
+   * response is split into its per-table sections and each section is
+   * handled the way TableMutatorDispatchHandler handles the response to
+   * an ordinary "update" request.
+   */
+  class MultiTableMutatorDispatchHandler : public DispatchHandler {
+
+  public:
+    /**
+     * Constructor.  Initializes state.
+     *
+     * @param send_buffers send buffers in the order their sections
+     *        appear in the request
+     */
+    MultiTableMutatorDispatchHandler(std::vector<TableMutatorSendBuffer *> &send_buffers);
+
+    /**
+     * Dispatch method.  This gets called by the AsyncComm layer
+     * when an event occurs in response to a previously sent
+     * request that was supplied with this dispatch handler.
+     *
+     * @param event_ptr shared pointer to event object
+     */
+    virtual void handle(EventPtr &event_ptr);
+
+  private:
+    std::vector<TableMutatorSendBuffer *> m_send_buffers;
+  };
+}
+
+
+#endif // HYPERTABLE_MULTITABLEMUTATORDISPATCHHANDLER_H
@@ -72,6 +72,13 @@ void RangeServerClient::update(struct sockaddr_in &addr, TableIdentifier &table,
 
 
 
+void RangeServerClient::update_multi(struct sockaddr_in &addr, uint32_t count, StaticBuffer &buffer, DispatchHandler *handler) {
+  CommBufPtr cbp(RangeServerProtocol::create_request_update_multi(count, buffer));
+  send_message(addr, cbp, handler);
+}
+
+
+
 void RangeServerClient::create_scanner(struct sockaddr_in &addr, TableIdentifier &table, RangeSpec &range, ScanSpec &scan_spec, DispatchHandler *handler) {
   CommBufPtr cbp(RangeServerProtocol::create_request_create_scanner(table, range, scan_spec));
   send_message(addr, cbp, handler);
@@ -104,6 +104,19 @@ namespace Hypertable {
      */
     void update(struct sockaddr_in &addr, TableIdentifier &table, StaticBuffer &buffer);
 
+    /** Issues an "update multi" request asynchronously.  The data argument holds
+     * one section per table, each consisting of an encoded TableIdentifier, a
+     * 32-bit length and that many bytes of key/value pairs (see
+     * RangeServerProtocol::create_request_update_multi).  This method takes
+     * ownership of the data buffer.
+     *
+     * @param addr remote address of RangeServer connection
+     * @param count number of table sections in buffer
+     * @param buffer buffer holding the table sections
+     * @param handler response handler
+     */
+    void update_multi(struct sockaddr_in &addr, uint32_t count, StaticBuffer &buffer, DispatchHandler *handler);
+
     /** Issues a "create scanner" request asynchronously.
      *
      * @param addr remote address of RangeServer connection
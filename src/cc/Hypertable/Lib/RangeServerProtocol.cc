@@ -44,6 +44,7 @@ namespace Hypertable {
     "replay update",
     "replay commit",
     "drop range",
+    "update multi",
     (const char *)0
   };
 
@@ -73,6 +74,14 @@ namespace Hypertable {
     return cbuf;
   }
 
+  CommBuf *RangeServerProtocol::create_request_update_multi(uint32_t count, StaticBuffer &buffer) {
+    HeaderBuilder hbuilder(Header::PROTOCOL_HYPERTABLE_RANGESERVER);
+    CommBuf *cbuf = new CommBuf(hbuilder, 6, buffer);
+    cbuf->append_i16(COMMAND_UPDATE_MULTI);
+    cbuf->append_i32(count);
+    return cbuf;
+  }
+
   CommBuf *RangeServerProtocol::create_request_create_scanner(TableIdentifier &table, RangeSpec &range, ScanSpec &scan_spec) {
     HeaderBuilder hbuilder(Header::PROTOCOL_HYPERTABLE_RANGESERVER);
     CommBuf *cbuf = new CommBuf(hbuilder, 2 + table.encoded_length() + range.encoded_length() + scan_spec.encoded_length());
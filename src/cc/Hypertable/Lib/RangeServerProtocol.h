@@ -47,7 +47,8 @@ namespace Hypertable {
     static const short COMMAND_REPLAY_UPDATE    = 11;
     static const short COMMAND_REPLAY_COMMIT    = 12;
     static const short COMMAND_DROP_RANGE       = 13;
-    static const short COMMAND_MAX              = 14;
+    static const short COMMAND_UPDATE_MULTI     = 14;
+    static const short COMMAND_MAX              = 15;
 
     static const uint16_t LOAD_RANGE_FLAG_REPLAY = 0x0001;
 
@@ -75,6 +76,22 @@ namespace Hypertable {
      */
     static CommBuf *create_request_update(TableIdentifier &table, StaticBuffer &buffer);
 
+    /** Creates an "update multi" request message, which carries updates for
+     * several tables in one request.  The data argument holds one section per
+     * table.  Each section is an encoded TableIdentifier, followed by a 32-bit
+     * length, followed by that many bytes of key/value pairs encoded as in an
+     * "update" request.  The response holds, for each section in order, a
+     * 32-bit count followed by that many (error, offset, length) triples
+     * describing updates that were not applied; offsets are relative to the
+     * start of the section's key/value pairs.  This method transfers ownership
+     * of the data buffer to the CommBuf that gets returned.
+     *
+     * @param count number of table sections in buffer
+     * @param buffer buffer holding the table sections
+     * @return protocol message
+     */
+    static CommBuf *create_request_update_multi(uint32_t count, StaticBuffer &buffer);
+
     /** Creates a "create scanner" request message.
      *
      * @param table table identifier
@@ -89,6 +89,12 @@ namespace Hypertable {
      */
     int get_scanner_id() { return m_scanner_id; }
 
+    /** Returns the number of bytes held by this scanblock.
+     *
+     * @return size of the response message backing the key/value pairs
+     */
+    size_t memory_used() { return m_event_ptr ? m_event_ptr->message_len : 0; }
+
   private:
     int m_error;
     uint16_t m_flags;
@@ -23,6 +23,7 @@
 #include <cctype>
 #include <iostream>
 #include <string>
+#include <vector>
 
 #include <boost/algorithm/string.hpp>
 
@@ -255,6 +256,14 @@ void Schema::set_access_group_parameter(const char *param, const char *value) {
       m_open_access_group->compressor = value;
       boost::trim(m_open_access_group->compressor);
     }
+    else if (!strcasecmp(param, "bloomFilter")) {
+      BloomFilterMode mode;
+      float false_positive;
+      m_open_access_group->bloom_filter = value;
+      boost::trim(m_open_access_group->bloom_filter);
+      if (!parse_bloom_filter_spec(m_open_access_group->bloom_filter, mode, false_positive))
+        set_error_string((string)"Invalid value (" + value + ") for AccessGroup attribute '" + param + "'");
+    }
     else
       set_error_string((string)"Invalid AccessGroup attribute '" + param + "'");
   }
@@ -325,6 +334,8 @@ void Schema::render(String &output) {
       output += (String)" blksz=\"" + (*iter)->blocksize + "\"";
     if ((*iter)->compressor != "")
       output += (String)" compressor=\"" + (*iter)->compressor + "\"";
+    if ((*iter)->bloom_filter != "")
+      output += (String)" bloomFilter=\"" + (*iter)->bloom_filter + "\"";
     output += ">\n";
     for (list<ColumnFamily *>::iterator cfiter = (*iter)->columns.begin(); cfiter != (*iter)->columns.end(); cfiter++) {
       output += (string)"    <ColumnFamily";
@@ -412,6 +423,8 @@ void Schema::render_hql_create_table(const String &table_name, String &output) {
       output += (String)" BLOCKSIZE=" + (*ag_iter)->blocksize;
     if ((*ag_iter)->compressor != "")
       output += (String)" COMPRESSOR=\"" + (*ag_iter)->compressor + "\"";
+    if ((*ag_iter)->bloom_filter != "")
+      output += (String)" BLOOMFILTER=\"" + (*ag_iter)->bloom_filter + "\"";
     if (!(*ag_iter)->columns.empty()) {
       bool display_comma = false;
       output += (String)" (";
@@ -459,6 +472,39 @@ void Schema::render_hql_create_table(const String &table_name, String &output) {
  * Protected methods
  */
 
+bool Schema::parse_bloom_filter_spec(const String &spec, BloomFilterMode &mode,
+                                     float &false_positive) {
+  std::vector<String> args;
+
+  mode = BLOOM_FILTER_DISABLED;
+  false_positive = 0.01;
+
+  boost::split(args, spec, boost::is_any_of(" \t"), boost::token_compress_on);
+  if (args.empty() || args[0] == "")
+    return true;
+
+  if (!strcasecmp(args[0].c_str(), "none"))
+    mode = BLOOM_FILTER_DISABLED;
+  else if (!strcasecmp(args[0].c_str(), "rows"))
+    mode = BLOOM_FILTER_ROWS;
+  else if (!strcasecmp(args[0].c_str(), "rows+cols"))
+    mode = BLOOM_FILTER_ROWS_COLS;
+  else
+    return false;
+
+  for (size_t i=1; i<args.size(); i++) {
+    if (args[i] == "--false-positive" && i+1 < args.size()) {
+      false_positive = (float)strtod(args[++i].c_str(), 0);
+      if (false_positive <= 0.0 || false_positive >= 1.0)
+        return false;
+    }
+    else
+      return false;
+  }
+  return true;
+}
+
+
 bool Schema::is_valid() {
   if (get_error_string() != 0)
     return false;
@@ -55,9 +55,16 @@ namespace Hypertable {
       bool     in_memory;
       uint32_t blocksize;
       String compressor;
+      String bloom_filter;
       std::list<ColumnFamily *> columns;
     };
 
+    enum BloomFilterMode {
+      BLOOM_FILTER_DISABLED,
+      BLOOM_FILTER_ROWS,
+      BLOOM_FILTER_ROWS_COLS
+    };
+
     Schema(bool read_ids=false);
     ~Schema();
 
@@ -103,6 +110,19 @@ namespace Hypertable {
 
     void add_column_family(ColumnFamily *cf);
 
+    /**
+     * Parses an access group bloom filter specification of the form
+     * "none | rows | rows+cols [--false-positive <probability>]".  An
+     * empty specification is the same as "none".
+     *
+     * @param spec bloom filter specification string
+     * @param mode reference to returned filter mode
+     * @param false_positive reference to returned false positive probability
+     * @return true if the specification is valid, false otherwise
+     */
+    static bool parse_bloom_filter_spec(const String &spec,
+        BloomFilterMode &mode, float &false_positive);
+
     void set_compressor(String compressor) { m_compressor = compressor; }
     String &get_compressor() { return m_compressor; }
 
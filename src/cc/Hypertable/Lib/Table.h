@@ -70,6 +70,12 @@ namespace Hypertable {
       memcpy(table_id_p, &m_table, sizeof(TableIdentifier));
     }
 
+    void get_schema(SchemaPtr &schema_ptr) { schema_ptr = m_schema_ptr; }
+
+    void get_range_locator(RangeLocatorPtr &range_locator_ptr) {
+      range_locator_ptr = m_range_locator_ptr;
+    }
+
   private:
 
     void initialize(const String &name);
@@ -169,6 +169,14 @@ namespace Hypertable {
         m_prev_buffer_ptr->get_failed_mutations(failed_mutations);
     }
 
+    /**
+     * Checks that the row key and column qualifier of a key are well
+     * formed, throwing Error::BAD_KEY if they are not.
+     *
+     * @param key key to check
+     */
+    static void sanity_check_key(KeySpec &key);
+
   private:
 
     enum Operation {
@@ -179,8 +187,6 @@ namespace Hypertable {
 
     void wait_for_previous_buffer(Timer &timer);
 
-    void sanity_check_key(KeySpec &key);
-
     PropertiesPtr        m_props_ptr;
     Comm                *m_comm;
     SchemaPtr            m_schema_ptr;
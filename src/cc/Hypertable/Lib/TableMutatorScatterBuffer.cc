@@ -174,9 +174,12 @@ namespace {
 
 
 /**
- *
+ * Sorts the accumulated updates of each send buffer into its pending
+ * updates buffer and arms the completion counter, without sending
+ * anything.  Send buffers that have nothing to send are counted as
+ * complete right away; the others are appended to send_buffers.
  */
-void TableMutatorScatterBuffer::send() {
+void TableMutatorScatterBuffer::prepare_send(std::vector<TableMutatorSendBufferPtr> &send_buffers) {
   TableMutatorSendBufferPtr send_buffer_ptr;
   struct LtByteStringChronological swo_bs;
   std::vector<ByteString> kvec;
@@ -222,6 +225,24 @@ void TableMutatorScatterBuffer::send() {
     send_buffer_ptr->accum.free();
     send_buffer_ptr->key_offsets.clear();
 
+    send_buffers.push_back(send_buffer_ptr);
+  }
+}
+
+
+
+/**
+ *
+ */
+void TableMutatorScatterBuffer::send() {
+  std::vector<TableMutatorSendBufferPtr> send_buffers;
+  TableMutatorSendBufferPtr send_buffer_ptr;
+
+  prepare_send(send_buffers);
+
+  for (size_t i=0; i<send_buffers.size(); i++) {
+    send_buffer_ptr = send_buffers[i];
+
     /**
      * Send update
      */
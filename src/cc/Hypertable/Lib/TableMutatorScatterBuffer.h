@@ -56,11 +56,13 @@ namespace Hypertable {
     void set(ByteString key, ByteString value, Timer &timer);
     bool full() { return m_full; }
     void send();
+    void prepare_send(std::vector<TableMutatorSendBufferPtr> &send_buffers);
     bool completed();
     bool wait_for_completion(Timer &timer);
     void reset();
     TableMutatorScatterBuffer *create_redo_buffer(Timer &timer);
     uint64_t get_resend_count() { return m_resends; }
+    TableIdentifier *get_table_identifier() { return &m_table_identifier; }
     void get_failed_mutations(std::vector<std::pair<Cell, int> > &failed_mutations) {
       failed_mutations = m_failed_mutations;
     }
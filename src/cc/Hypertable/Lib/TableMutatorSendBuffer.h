@@ -90,6 +90,8 @@ namespace Hypertable {
 
     bool resend() { return m_resend; }
 
+    TableIdentifier *get_table_identifier() { return m_table_identifier; }
+
     std::vector<uint64_t> key_offsets;
     DynamicBuffer accum;
     StaticBuffer pending_updates;
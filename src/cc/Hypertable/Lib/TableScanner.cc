@@ -31,12 +31,9 @@ using namespace Hypertable;
 
 namespace {
   const char end_row_key[2] = { (char)0xff, (char)0xff };
+  const int64_t DEFAULT_SCANNER_BUFFER_SIZE = 8 * 1024 * 1024;
 }
 
-/**
- * TODO: Asynchronously destroy dangling scanners on EOS
- */
-
 /**
  */
 TableScanner::TableScanner(PropertiesPtr &props_ptr, Comm *comm,
@@ -47,9 +44,9 @@ TableScanner::TableScanner(PropertiesPtr &props_ptr, Comm *comm,
     : m_comm(comm), m_schema_ptr(schema_ptr),
       m_range_locator_ptr(range_locator_ptr),
       m_range_server(comm, HYPERTABLE_CLIENT_TIMEOUT),
-      m_table_identifier(*table_identifier), m_started(false),
-      m_eos(false), m_readahead(true), m_fetch_outstanding(false),
-      m_rows_seen(0), m_timeout(timeout) {
+      m_table_identifier(*table_identifier), m_eos(false), m_all_scheduled(false), m_readahead(true),
+      m_max_ranges(1), m_buffer_limit(0), m_buffered(0), m_rows_seen(0),
+      m_timeout(timeout) {
   char *str;
 
   if (m_timeout == 0 ||
@@ -61,6 +58,12 @@ TableScanner::TableScanner(PropertiesPtr &props_ptr, Comm *comm,
 
   m_range_server.set_default_timeout(m_timeout);
 
+  m_max_ranges = props_ptr->get_int("Hypertable.Client.Scanner.Ranges", 1);
+  if (m_max_ranges == 0)
+    m_max_ranges = 1;
+  m_buffer_limit = props_ptr->get_int64("Hypertable.Client.Scanner.BufferSize",
+                                        DEFAULT_SCANNER_BUFFER_SIZE);
+
   m_scan_spec.row_limit = scan_spec.row_limit;
   m_scan_spec.max_versions = scan_spec.max_versions;
 
@@ -95,10 +98,25 @@ TableScanner::TableScanner(PropertiesPtr &props_ptr, Comm *comm,
       ((m_scan_spec.start_row && m_scan_spec.end_row) && !strcmp(m_scan_spec.start_row, m_scan_spec.end_row)))
     m_readahead = false;
 
+  // a limited scan will most likely be satisfied by the first range
+  if (!m_readahead || m_scan_spec.row_limit > 0)
+    m_max_ranges = 1;
+
+  m_next_row = m_scan_spec.start_row ? m_scan_spec.start_row : "";
+
   memcpy(&m_scan_spec.interval, &scan_spec.interval, sizeof(m_scan_spec.interval));
 
   m_scan_spec.return_deletes = scan_spec.return_deletes;
 
+  // deep copy predicates
+  for (size_t i=0; i<scan_spec.predicates.size(); i++) {
+    const CellPredicate &predicate = scan_spec.predicates[i];
+    str = new char [strlen(predicate.pattern) + 1];
+    strcpy(str, predicate.pattern);
+    m_scan_spec.predicates.push_back(CellPredicate(predicate.target,
+                                                   predicate.match, str));
+  }
+
 }
 
 
@@ -106,69 +124,74 @@ TableScanner::TableScanner(PropertiesPtr &props_ptr, Comm *comm,
  *
  */
 TableScanner::~TableScanner() {
+
+  // wait for outstanding requests to come back (or time out) and destroy
+  // the scanners that are still open
+  finish();
+
   for (size_t i=0; i<m_scan_spec.columns.size(); i++)
     delete [] m_scan_spec.columns[i];
   delete [] m_scan_spec.start_row;
   delete [] m_scan_spec.end_row;
+  for (size_t i=0; i<m_scan_spec.predicates.size(); i++)
+    delete [] m_scan_spec.predicates[i].pattern;
+}
 
-  // if there is an outstanding fetch, wait for it to come back or timeout
-  if (m_fetch_outstanding)
-    m_sync_handler.wait_for_reply(m_event_ptr);
+
+TableScanner::RangeScan::~RangeScan() {
+  for (size_t i=0; i<blocks.size(); i++)
+    delete blocks[i];
 }
 
 
 
 bool TableScanner::next(Cell &cell) {
-  int error;
   ByteString bskey, value;
   Key key;
   Timer timer(m_timeout);
+  RangeScan *scan;
 
   if (m_eos)
     return false;
 
-  if (!m_started)
-    find_range_and_start_scan(m_scan_spec.start_row, timer);
+  // first call, or the previous call failed before a range was located
+  if (m_scans.empty()) {
+    schedule(timer);
+    if (m_scans.empty()) {
+      m_eos = true;
+      return false;
+    }
+  }
 
-  while (!m_scanblock.more()) {
-    if (m_scanblock.eos()) {
-      if (!strcmp(m_range_info.end_row.c_str(), Key::END_ROW_MARKER) ||
-          (m_scan_spec.end_row && (strcmp(m_scan_spec.end_row, m_range_info.end_row.c_str()) <= 0))) {
-        m_range_server.destroy_scanner(m_cur_addr, m_scanblock.get_scanner_id(), 0);
+  while (true) {
+    scan = m_scans.front();
+
+    if (!scan->blocks.empty()) {
+      if (scan->blocks.front()->more())
+        break;
+      m_buffered -= scan->blocks.front()->memory_used();
+      delete scan->blocks.front();
+      scan->blocks.pop_front();
+      schedule(timer);
+      continue;
+    }
+
+    if (scan->eos) {
+      m_scans.pop_front();
+      delete scan;
+      schedule(timer);
+      if (m_scans.empty()) {
         m_eos = true;
         return false;
       }
-      String next_row = m_range_info.end_row;
-      next_row.append(1,1);  // construct row key in next range
-      find_range_and_start_scan(next_row.c_str(), timer);
+      continue;
     }
-    else {
-      if (m_fetch_outstanding) {
-        if (!m_sync_handler.wait_for_reply(m_event_ptr)) {
-          m_fetch_outstanding = false;
-          HT_ERRORF("RangeServer 'fetch scanblock' error : %s", Protocol::string_format_message(m_event_ptr).c_str());
-          HT_THROW((int)Protocol::response_code(m_event_ptr), "");
-        }
-        else {
-          error = m_scanblock.load(m_event_ptr);
-          if (m_readahead && !m_scanblock.eos()) {
-            m_range_server.fetch_scanblock(m_cur_addr, m_scanblock.get_scanner_id(), &m_sync_handler);
-            m_fetch_outstanding = true;
-          }
-          else
-            m_fetch_outstanding = false;
-        }
-      }
-      else {
-        timer.start();
-        m_range_server.set_timeout((time_t)(timer.remaining() + 0.5));
-        m_range_server.fetch_scanblock(m_cur_addr, m_scanblock.get_scanner_id(), m_scanblock);
-      }
 
-    }
+    wait_for_block(scan, timer);
+    schedule(timer);
   }
 
-  if (m_scanblock.next(bskey, value)) {
+  if (scan->blocks.front()->next(bskey, value)) {
     Schema::ColumnFamily *cf;
     if (!key.load(bskey))
       HT_THROW(Error::BAD_KEY, "");
@@ -177,22 +200,19 @@ bool TableScanner::next(Cell &cell) {
     if (m_scan_spec.end_row) {
       if (m_scan_spec.end_row_inclusive) {
         if (strcmp(key.row, m_scan_spec.end_row) > 0) {
-          m_range_server.destroy_scanner(m_cur_addr, m_scanblock.get_scanner_id(), 0);
-          m_eos = true;
+          finish();
           return false;
         }
       }
       else {
         if (strcmp(key.row, m_scan_spec.end_row) >= 0) {
-          m_range_server.destroy_scanner(m_cur_addr, m_scanblock.get_scanner_id(), 0);
-          m_eos = true;
+          finish();
           return false;
         }
       }
     }
     else if (!strcmp(key.row, end_row_key)) {
-      m_range_server.destroy_scanner(m_cur_addr, m_scanblock.get_scanner_id(), 0);
-      m_eos = true;
+      finish();
       return false;
     }
 
@@ -201,8 +221,7 @@ bool TableScanner::next(Cell &cell) {
       m_rows_seen++;
       m_cur_row = key.row;
       if (m_scan_spec.row_limit > 0 && m_rows_seen > m_scan_spec.row_limit) {
-        m_range_server.destroy_scanner(m_cur_addr, m_scanblock.get_scanner_id(), 0);
-        m_eos = true;
+        finish();
         return false;
       }
     }
@@ -224,68 +243,248 @@ bool TableScanner::next(Cell &cell) {
 
   HT_ERROR("No end marker found at end of table.");
 
-  m_range_server.destroy_scanner(m_cur_addr, m_scanblock.get_scanner_id(), 0);
-  m_eos = true;
+  finish();
   return false;
 }
 
 
 
-void TableScanner::find_range_and_start_scan(const char *row_key, Timer &timer) {
-  RangeSpec  range;
-  DynamicBuffer dbuf(0);
+/**
+ * Tops up the pipeline: locates the next ranges and sends them "create
+ * scanner" requests until m_max_ranges ranges are being scanned, and sends
+ * a "fetch scanblock" request to every open scanner that has received its
+ * last reply and does not have one in flight.  Requests other than the one
+ * for the next block of the front range are only sent while the buffered
+ * blocks are within m_buffer_limit.
+ */
+void TableScanner::schedule(Timer &timer) {
 
-  timer.start();
+  while (!m_all_scheduled && m_scans.size() < m_max_ranges &&
+         (m_scans.empty() || m_buffered < m_buffer_limit)) {
+    RangeScan *scan = new RangeScan();
+    scan->row_key = m_next_row;
+    try {
+      locate(scan, timer, false);
+    }
+    catch (...) {
+      delete scan;
+      throw;
+    }
+    m_scans.push_back(scan);
+    set_next_row(scan);
 
-  if (!m_cache_ptr->lookup(m_table_identifier.id, row_key, &m_range_info))
-    m_range_locator_ptr->find_loop(&m_table_identifier, row_key, &m_range_info, timer, false);
+    RangeSpec range(scan->range_info.start_row.c_str(),
+                    scan->range_info.end_row.c_str());
+    try {
+      m_range_server.create_scanner(scan->addr, m_table_identifier, range,
+                                    m_scan_spec, &scan->sync_handler);
+      scan->outstanding = true;
+    }
+    catch (Exception &e) {
+      // start_scan() will retry once this range gets to the front
+      HT_WARNF("Unable to start scan of %s[%s..%s] - %s",
+               m_table_identifier.name, range.start_row, range.end_row,
+               e.what());
+    }
+  }
 
-  m_started = true;
+  if (!m_readahead)
+    return;
+
+  for (size_t i=0; i<m_scans.size(); i++) {
+    RangeScan *scan = m_scans[i];
+    if (!scan->created || scan->outstanding || scan->eos)
+      continue;
+    if (m_buffered >= m_buffer_limit && (i > 0 || scan->blocks.size() > 1))
+      continue;
+    m_range_server.fetch_scanblock(scan->addr, scan->scanner_id,
+                                   &scan->sync_handler);
+    scan->outstanding = true;
+  }
+}
 
-  dbuf.ensure(m_range_info.start_row.length() + m_range_info.end_row.length() + 2);
-  range.start_row = (const char *)dbuf.add_unchecked(m_range_info.start_row.c_str(), m_range_info.start_row.length()+1);
-  range.end_row   = (const char *)dbuf.add_unchecked(m_range_info.end_row.c_str(), m_range_info.end_row.length()+1);
-  if (!LocationCache::location_to_addr(m_range_info.location.c_str(), m_cur_addr)) {
+
+
+void TableScanner::locate(RangeScan *scan, Timer &timer, bool hard) {
+
+  timer.start();
+
+  if (hard || !m_cache_ptr->lookup(m_table_identifier.id, scan->row_key.c_str(),
+                                   &scan->range_info))
+    m_range_locator_ptr->find_loop(&m_table_identifier, scan->row_key.c_str(),
+                                   &scan->range_info, timer, hard);
+
+  if (!LocationCache::location_to_addr(scan->range_info.location.c_str(),
+                                       scan->addr)) {
     HT_ERRORF("Invalid location found in METADATA entry range [%s..%s] - %s",
-                 range.start_row, range.end_row, m_range_info.location.c_str());
+              scan->range_info.start_row.c_str(),
+              scan->range_info.end_row.c_str(),
+              scan->range_info.location.c_str());
     HT_THROW(Error::INVALID_METADATA, "");
   }
+}
+
+
+
+/**
+ * Synchronously creates the scanner for a range whose asynchronous
+ * "create scanner" request could not be sent or failed.  If that fails
+ * as well, the range is located again, bypassing the location cache,
+ * since it may have moved or split.  If it split, the ranges queued
+ * behind it were located with stale boundaries and are re-scheduled.
+ */
+void TableScanner::start_scan(RangeScan *scan, Timer &timer) {
+  ScanBlock *block = new ScanBlock();
+
+  timer.start();
 
   try {
+    RangeSpec range(scan->range_info.start_row.c_str(),
+                    scan->range_info.end_row.c_str());
     m_range_server.set_timeout((time_t)(timer.remaining() + 0.5));
-    m_range_server.create_scanner(m_cur_addr, m_table_identifier, range, m_scan_spec, m_scanblock);
+    m_range_server.create_scanner(scan->addr, m_table_identifier, range,
+                                  m_scan_spec, *block);
   }
   catch (Exception &e) {
+    String end_row = scan->range_info.end_row;
 
     // try again, the hard way
-    m_range_locator_ptr->find_loop(&m_table_identifier, row_key, &m_range_info, timer, true);
-
-    // reset the range information
-    dbuf.ensure(m_range_info.start_row.length() + m_range_info.end_row.length() + 2);
-    range.start_row = (const char *)dbuf.add_unchecked(m_range_info.start_row.c_str(), m_range_info.start_row.length()+1);
-    range.end_row   = (const char *)dbuf.add_unchecked(m_range_info.end_row.c_str(), m_range_info.end_row.length()+1);
-    if (!LocationCache::location_to_addr(m_range_info.location.c_str(), m_cur_addr)) {
-      HT_ERRORF("Invalid location found in METADATA entry range [%s..%s] - %s",
-                   range.start_row, range.end_row, m_range_info.location.c_str());
-      HT_THROW(Error::INVALID_METADATA, "");
+    try {
+      locate(scan, timer, true);
+    }
+    catch (...) {
+      delete block;
+      throw;
     }
 
-    // create the scanner
+    if (scan->range_info.end_row != end_row) {
+      while (m_scans.back() != scan) {
+        cancel(m_scans.back());
+        m_scans.pop_back();
+      }
+      set_next_row(scan);
+    }
+
+    RangeSpec range(scan->range_info.start_row.c_str(),
+                    scan->range_info.end_row.c_str());
     try {
       m_range_server.set_timeout((time_t)(timer.remaining() + 0.5));
-      m_range_server.create_scanner(m_cur_addr, m_table_identifier, range, m_scan_spec, m_scanblock);
+      m_range_server.create_scanner(scan->addr, m_table_identifier, range,
+                                    m_scan_spec, *block);
     }
     catch (Exception &e) {
+      delete block;
       HT_ERRORF("%s", e.what());
       HT_THROW(e.code(), String("Problem creating scanner on ") + m_table_identifier.name + "[" + range.start_row + ".." + range.end_row + "]");
     }
   }
 
-  // maybe kick off readahead
-  if (m_readahead && !m_scanblock.eos()) {
-    m_range_server.fetch_scanblock(m_cur_addr, m_scanblock.get_scanner_id(), &m_sync_handler);
-    m_fetch_outstanding = true;
+  add_block(scan, block);
+}
+
+
+
+void TableScanner::wait_for_block(RangeScan *scan, Timer &timer) {
+  EventPtr event_ptr;
+  int error;
+
+  if (!scan->outstanding) {
+    if (!scan->created) {
+      start_scan(scan, timer);
+      return;
+    }
+    timer.start();
+    m_range_server.set_timeout((time_t)(timer.remaining() + 0.5));
+    m_range_server.fetch_scanblock(scan->addr, scan->scanner_id,
+                                   &scan->sync_handler);
+    scan->outstanding = true;
+  }
+
+  scan->outstanding = false;
+
+  if (!scan->sync_handler.wait_for_reply(event_ptr)) {
+    if (!scan->created) {
+      start_scan(scan, timer);
+      return;
+    }
+    HT_ERRORF("RangeServer 'fetch scanblock' error : %s", Protocol::string_format_message(event_ptr).c_str());
+    HT_THROW((int)Protocol::response_code(event_ptr), "");
+  }
+
+  ScanBlock *block = new ScanBlock();
+  if ((error = block->load(event_ptr)) != Error::OK) {
+    delete block;
+    HT_THROW(error, "Problem loading scan block");
+  }
+  add_block(scan, block);
+}
+
+
+
+void TableScanner::add_block(RangeScan *scan, ScanBlock *block) {
+  scan->created = true;
+  scan->scanner_id = block->get_scanner_id();
+  scan->eos = block->eos();
+  scan->blocks.push_back(block);
+  m_buffered += block->memory_used();
+}
+
+
+
+void TableScanner::set_next_row(const RangeScan *scan) {
+  const String &end_row = scan->range_info.end_row;
+
+  if (end_row == Key::END_ROW_MARKER ||
+      (m_scan_spec.end_row && strcmp(m_scan_spec.end_row, end_row.c_str()) <= 0))
+    m_all_scheduled = true;
+  else {
+    m_next_row = end_row;
+    m_next_row.append(1,1);  // construct row key in next range
+    m_all_scheduled = false;
+  }
+}
+
+
+
+/**
+ * Waits for the request in flight for the given range scan (if any),
+ * destroys its scanner if it is still open and frees it.
+ */
+void TableScanner::cancel(RangeScan *scan) {
+  EventPtr event_ptr;
+
+  if (scan->outstanding) {
+    scan->outstanding = false;
+    if (scan->sync_handler.wait_for_reply(event_ptr)) {
+      ScanBlock block;
+      if (block.load(event_ptr) == Error::OK) {
+        scan->created = true;
+        scan->scanner_id = block.get_scanner_id();
+        scan->eos = block.eos();
+      }
+    }
+  }
+
+  if (scan->created && !scan->eos) {
+    try {
+      m_range_server.destroy_scanner(scan->addr, scan->scanner_id, 0);
+    }
+    catch (Exception &e) {
+      HT_ERROR_OUT << e << HT_END;
+    }
+  }
+
+  for (size_t i=0; i<scan->blocks.size(); i++)
+    m_buffered -= scan->blocks[i]->memory_used();
+  delete scan;
+}
+
+
+
+void TableScanner::finish() {
+  m_eos = true;
+  while (!m_scans.empty()) {
+    cancel(m_scans.back());
+    m_scans.pop_back();
   }
-  else
-    m_fetch_outstanding = false;
 }
@@ -22,6 +22,8 @@
 #ifndef HYPERTABLE_TABLESCANNER_H
 #define HYPERTABLE_TABLESCANNER_H
 
+#include <deque>
+
 #include "Common/Properties.h"
 #include "Common/ReferenceCount.h"
 
@@ -36,6 +38,19 @@
 
 namespace Hypertable {
 
+  /**
+   * Scans a table across all of the ranges that intersect the scan
+   * specification, returning cells in key order.  Up to
+   * Hypertable.Client.Scanner.Ranges consecutive ranges are located ahead
+   * of time and have their scanners created concurrently (possibly on
+   * different range servers), so that by the time a range is reached its
+   * first block is usually already here.  The range being read keeps one
+   * "fetch scanblock" request in flight (readahead).  Blocks received
+   * ahead of time are buffered until the ranges in front of them have been
+   * consumed; no new ranges are started and no readahead is issued while
+   * the buffered blocks exceed Hypertable.Client.Scanner.BufferSize bytes,
+   * except to keep the range currently being read moving.
+   */
   class TableScanner : public ReferenceCount {
 
   public:
@@ -58,7 +73,35 @@ namespace Hypertable {
 
   private:
 
-    void find_range_and_start_scan(const char *row_key, Timer &timer);
+    /**
+     * Scan of one range.  Blocks that have been received but not yet
+     * consumed are queued on blocks, oldest first.
+     */
+    class RangeScan {
+    public:
+      RangeScan() : scanner_id(-1), created(false), outstanding(false),
+                    eos(false) { }
+      ~RangeScan();
+
+      String             row_key;  // row used to locate the range
+      RangeLocationInfo  range_info;
+      struct sockaddr_in addr;
+      int                scanner_id;
+      bool               created;
+      bool               outstanding;  // create or fetch request in flight
+      bool               eos;          // final block received
+      std::deque<ScanBlock *> blocks;
+      DispatchHandlerSynchronizer sync_handler;
+    };
+
+    void schedule(Timer &timer);
+    void locate(RangeScan *scan, Timer &timer, bool hard);
+    void start_scan(RangeScan *scan, Timer &timer);
+    void wait_for_block(RangeScan *scan, Timer &timer);
+    void add_block(RangeScan *scan, ScanBlock *block);
+    void set_next_row(const RangeScan *scan);
+    void cancel(RangeScan *scan);
+    void finish();
 
     Comm               *m_comm;
     SchemaPtr           m_schema_ptr;
@@ -67,16 +110,15 @@ namespace Hypertable {
     ScanSpec            m_scan_spec;
     RangeServerClient   m_range_server;
     TableIdentifierManaged m_table_identifier;
-    bool                m_started;
     bool                m_eos;
-    ScanBlock           m_scanblock;
+    std::deque<RangeScan *> m_scans;  // front is the range being read
+    String              m_next_row;   // row locating the next range to scan
+    bool                m_all_scheduled;
     std::string         m_cur_row;
-    RangeLocationInfo   m_range_info;
-    struct sockaddr_in  m_cur_addr;
     bool                m_readahead;
-    bool                m_fetch_outstanding;
-    DispatchHandlerSynchronizer  m_sync_handler;
-    EventPtr            m_event_ptr;
+    size_t              m_max_ranges;
+    size_t              m_buffer_limit;
+    size_t              m_buffered;
     uint32_t            m_rows_seen;
     int                 m_timeout;
   };
@@ -67,6 +67,23 @@ void RangeSpec::decode(const uint8_t **bufp, size_t *remainp) {
 }
 
 
+size_t CellPredicate::encoded_length() const {
+  return 2 + encoded_length_vstr(pattern);
+}
+
+void CellPredicate::encode(uint8_t **bufp) const {
+  encode_i8(bufp, target);
+  encode_i8(bufp, match);
+  encode_vstr(bufp, pattern);
+}
+
+void CellPredicate::decode(const uint8_t **bufp, size_t *remainp) {
+  HT_TRY("decoding cell predicate",
+    target = decode_i8(bufp, remainp);
+    match = decode_i8(bufp, remainp);
+    pattern = decode_vstr(bufp, remainp));
+}
+
 ScanSpec::ScanSpec() : row_limit(0), max_versions(0), start_row(0),
     start_row_inclusive(true), end_row(0), end_row_inclusive(true),
     interval(0, END_OF_TIME), return_deletes(false) {
@@ -79,6 +96,8 @@ size_t ScanSpec::encoded_length() const {
                encoded_length_vstr(end_row) + 1 +
                encoded_length_vi32(columns.size());
   foreach(const char *c, columns) len += encoded_length_vstr(c);
+  len += encoded_length_vi32(predicates.size());
+  foreach(const CellPredicate &p, predicates) len += p.encoded_length();
   return len + 8 + 8 + 1;
 }
 
@@ -94,6 +113,8 @@ void ScanSpec::encode(uint8_t **bufp) const {
   encode_i64(bufp, interval.first);
   encode_i64(bufp, interval.second);
   encode_bool(bufp, return_deletes);
+  encode_vi32(bufp, predicates.size());
+  foreach(const CellPredicate &p, predicates) p.encode(bufp);
 }
 
 void ScanSpec::decode(const uint8_t **bufp, size_t *remainp) {
@@ -108,7 +129,9 @@ void ScanSpec::decode(const uint8_t **bufp, size_t *remainp) {
       columns.push_back(decode_vstr(bufp, remainp));
     interval.first = decode_i64(bufp, remainp);
     interval.second = decode_i64(bufp, remainp);
-    return_deletes = decode_i8(bufp, remainp));
+    return_deletes = decode_i8(bufp, remainp);
+    for (size_t np = decode_vi32(bufp, remainp); np--;)
+      predicates.push_back(CellPredicate(bufp, remainp)));
 }
 
 
@@ -135,6 +158,18 @@ ostream &Hypertable::operator<<(ostream &os, const RangeSpec &range) {
   return os;
 }
 
+ostream &Hypertable::operator<<(ostream &os, const CellPredicate &predicate) {
+  os << (predicate.target == CellPredicate::VALUE ? "VALUE" : "QUALIFIER");
+  if (predicate.match == CellPredicate::PREFIX)
+    os <<" STARTS WITH ";
+  else if (predicate.match == CellPredicate::REGEX)
+    os <<" =~ ";
+  else
+    os <<" = ";
+  os <<"'"<< (predicate.pattern ? predicate.pattern : "") <<"'";
+  return os;
+}
+
 ostream &Hypertable::operator<<(ostream &os, const ScanSpec &scan_spec) {
   os <<"\n{ScanSpec: row_limit="<< scan_spec.row_limit
      <<" max_versions="<< scan_spec.max_versions
@@ -159,6 +194,14 @@ ostream &Hypertable::operator<<(ostream &os, const ScanSpec &scan_spec) {
 
   os <<"\n end_row_inclusive="<< scan_spec.end_row_inclusive;
   os <<"\n interval=(" << scan_spec.interval.first <<", "
-     << scan_spec.interval.second <<")\n}\n";
+     << scan_spec.interval.second <<")";
+
+  if (!scan_spec.predicates.empty()) {
+    os <<"\n predicates=(";
+    foreach (const CellPredicate &p, scan_spec.predicates)
+      os << p <<" ";
+    os <<')';
+  }
+  os <<"\n}\n";
   return os;
 }
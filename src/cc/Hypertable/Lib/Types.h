@@ -113,7 +113,35 @@ namespace Hypertable {
     String m_start, m_end;
   };
 
-  /** Scan specification */
+  /**
+   * Filter on the column qualifier or value of a cell, evaluated by the
+   * range server so that cells that do not match never leave it
+   */
+  class CellPredicate {
+  public:
+    enum Target { QUALIFIER = 1, VALUE = 2 };
+    enum Match { EXACT = 1, PREFIX = 2, REGEX = 3 };
+
+    CellPredicate() : target(QUALIFIER), match(EXACT), pattern(0) { return; }
+    CellPredicate(uint8_t t, uint8_t m, const char *p)
+        : target(t), match(m), pattern(p) { return; }
+    CellPredicate(const uint8_t **bufp, size_t *remainp) {
+      decode(bufp, remainp);
+    }
+
+    size_t encoded_length() const;
+    void encode(uint8_t **bufp) const;
+    void decode(const uint8_t **bufp, size_t *remainp);
+
+    uint8_t target;
+    uint8_t match;
+    const char *pattern;
+  };
+
+  /**
+   * Scan specification.  A cell is returned only if it satisfies every
+   * one of the predicates.
+   */
   class ScanSpec {
   public:
     ScanSpec();
@@ -132,6 +160,7 @@ namespace Hypertable {
     bool end_row_inclusive;
     std::pair<uint64_t,uint64_t> interval;
     bool return_deletes;
+    std::vector<CellPredicate> predicates;
   };
 
   extern const uint64_t END_OF_TIME;
@@ -140,6 +169,8 @@ namespace Hypertable {
 
   std::ostream &operator<<(std::ostream &os, const RangeSpec &);
 
+  std::ostream &operator<<(std::ostream &os, const CellPredicate &);
+
   std::ostream &operator<<(std::ostream &os, const ScanSpec &);
 
 
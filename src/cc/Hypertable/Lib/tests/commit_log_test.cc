@@ -22,6 +22,9 @@
 #include "Common/Compat.h"
 #include <cassert>
 #include <cstdlib>
+#include <vector>
+
+#include <boost/thread/thread.hpp>
 
 #include "AsyncComm/Comm.h"
 
@@ -44,13 +47,15 @@ namespace {
   const char *usage[] = {
     "usage: commit_log_test",
     "",
-    "Tests the commit log.",
+    "Tests the commit log: writing, reading and linking logs, and group",
+    "commit of blocks written concurrently by several threads.",
     "",
     0
   };
 
   void test1(DfsBroker::Client *dfs_client);
   void test_link(DfsBroker::Client *dfs_client);
+  void test_group_commit(DfsBroker::Client *dfs_client);
   void write_entries(CommitLog *log, int num_entries, uint64_t *sump, CommitLogBase *link_log);
   void read_entries(DfsBroker::Client *dfs_client, CommitLogReader *log_reader, uint64_t *sump);
 }
@@ -92,6 +97,8 @@ int main(int argc, char **argv) {
 
     test_link(dfs_client);
 
+    test_group_commit(dfs_client);
+
   }
   catch (Hypertable::Exception &e) {
     HT_ERRORF("%s - %s", e.what(), Error::get_text(e.code()));
@@ -276,4 +283,110 @@ namespace {
     }
   }
 
+
+  const size_t WRITERS = 8;
+  const size_t BLOCKS_PER_WRITER = 250;
+
+  /**
+   * Writes BLOCKS_PER_WRITER blocks, each tagged with the writer number
+   * and its sequence number, and counts the writes that returned
+   */
+  class GroupCommitWriter {
+  public:
+    GroupCommitWriter(CommitLog *log, uint32_t id, std::vector<int> &errors,
+                      std::vector<size_t> &returned)
+      : m_log(log), m_id(id), m_errors(errors), m_returned(returned) { }
+
+    void operator()() {
+      uint32_t payload[64];
+      DynamicBuffer dbuf;
+      uint32_t limit;
+
+      for (uint32_t seq=0; seq<BLOCKS_PER_WRITER; seq++) {
+        limit = 3 + (random() % 60);
+        payload[0] = m_id;
+        payload[1] = seq;
+        payload[2] = limit;
+        for (size_t j=3; j<limit; j++)
+          payload[j] = m_id ^ (seq * (uint32_t)j);
+
+        dbuf.base = (uint8_t *)payload;
+        dbuf.ptr = dbuf.base + (4*limit);
+        dbuf.own = false;
+
+        int error = m_log->write(dbuf, m_log->get_timestamp());
+        if (error != Error::OK && m_errors[m_id] == Error::OK)
+          m_errors[m_id] = error;
+        m_returned[m_id]++;
+      }
+    }
+
+  private:
+    CommitLog *m_log;
+    uint32_t m_id;
+    std::vector<int> &m_errors;
+    std::vector<size_t> &m_returned;
+  };
+
+  /**
+   * Has several threads write to one log at the same time, so that their
+   * blocks are group committed, then checks that every write returned and
+   * that every block is in the log exactly once.
+   */
+  void test_group_commit(DfsBroker::Client *dfs_client) {
+    PropertiesPtr props_ptr = new Properties();
+    String fname = "/hypertable/test_log/group";
+    std::vector<int> errors(WRITERS, Error::OK);
+    std::vector<size_t> returned(WRITERS, 0);
+    std::vector<std::vector<size_t> > seen(WRITERS,
+        std::vector<size_t>(BLOCKS_PER_WRITER, 0));
+    boost::thread_group threads;
+    CommitLog *log;
+    CommitLogReaderPtr log_reader_ptr;
+    BlockCompressionHeaderCommitLog header;
+    const uint8_t *block;
+    size_t block_len;
+
+    dfs_client->rmdir(fname);
+    dfs_client->mkdirs(fname);
+
+    props_ptr->set("Hypertable.RangeServer.CommitLog.RollLimit", "20000");
+    props_ptr->set("Hypertable.RangeServer.CommitLog.GroupCommit.MaxBatchBytes", "4096");
+    props_ptr->set("Hypertable.RangeServer.CommitLog.GroupCommit.MaxDelay", "1");
+
+    log = new CommitLog(dfs_client, fname, props_ptr);
+
+    for (uint32_t i=0; i<WRITERS; i++)
+      threads.create_thread(GroupCommitWriter(log, i, errors, returned));
+    threads.join_all();
+
+    delete log;
+
+    for (size_t i=0; i<WRITERS; i++) {
+      HT_EXPECT(errors[i] == Error::OK, Error::FAILED_EXPECTATION);
+      HT_EXPECT(returned[i] == BLOCKS_PER_WRITER, Error::FAILED_EXPECTATION);
+    }
+
+    log_reader_ptr = new CommitLogReader(dfs_client, fname);
+    while (log_reader_ptr->next(&block, &block_len, &header)) {
+      const uint32_t *iptr = (const uint32_t *)block;
+      HT_EXPECT(block_len >= 12 && iptr[0] < WRITERS &&
+                iptr[1] < BLOCKS_PER_WRITER && block_len == 4*iptr[2],
+                Error::FAILED_EXPECTATION);
+      for (size_t j=3; j<iptr[2]; j++)
+        HT_EXPECT(iptr[j] == (iptr[0] ^ (iptr[1] * (uint32_t)j)),
+                  Error::FAILED_EXPECTATION);
+      seen[iptr[0]][iptr[1]]++;
+    }
+
+    for (size_t i=0; i<WRITERS; i++) {
+      for (size_t j=0; j<BLOCKS_PER_WRITER; j++) {
+        if (seen[i][j] != 1)
+          HT_ERRORF("block %d of writer %d logged %d times", (int)j, (int)i,
+                    (int)seen[i][j]);
+        HT_EXPECT(seen[i][j] == 1, Error::FAILED_EXPECTATION);
+      }
+    }
+  }
+
 }
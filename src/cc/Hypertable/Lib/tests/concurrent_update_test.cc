@@ -0,0 +1,208 @@
+/** -*- c++ -*-
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "Common/Compat.h"
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include <boost/thread/thread.hpp>
+
+#include "Common/Mutex.h"
+#include "Common/String.h"
+#include "Common/Usage.h"
+
+#include "Hypertable/Lib/Client.h"
+
+using namespace std;
+using namespace Hypertable;
+
+namespace {
+
+  const char *schema =
+  "<Schema>"
+  "  <AccessGroup name=\"default\">"
+  "    <ColumnFamily>"
+  "      <Name>a</Name>"
+  "    </ColumnFamily>"
+  "  </AccessGroup>"
+  "</Schema>";
+
+  const char *table_name = "ConcurrentUpdate";
+
+  const char *usage[] = {
+    "usage: concurrent_update_test [<seed>]",
+    "",
+    "Several writers, each with its own mutator, update the same rows of a",
+    "single range at the same time, one round after another.  Each writer",
+    "owns a column qualifier and flushes after every round, so the rounds",
+    "of different writers arrive at the range server interleaved.  Reading",
+    "the table back, every cell must hold one version per round, newest",
+    "round first, with strictly decreasing timestamps.",
+    0
+  };
+
+  const size_t WRITERS = 4;
+  const size_t ROWS = 200;
+  const size_t ROUNDS = 20;
+
+  class Writer {
+  public:
+    Writer(TablePtr &table_ptr, size_t id, size_t *errors, Mutex *mutex)
+      : m_table_ptr(table_ptr), m_id(id), m_errors(errors), m_mutex(mutex) { }
+
+    void operator()() {
+      String qualifier = format("w%d", (int)m_id);
+      char row[32];
+      KeySpec key;
+
+      key.column_family = "a";
+      key.column_qualifier = qualifier.c_str();
+      key.column_qualifier_len = qualifier.length();
+
+      try {
+        TableMutatorPtr mutator_ptr = m_table_ptr->create_mutator();
+        for (size_t round=0; round<ROUNDS; round++) {
+          for (size_t i=0; i<ROWS; i++) {
+            sprintf(row, "row-%04d", (int)((i + m_id * 17) % ROWS));
+            key.row = row;
+            key.row_len = strlen(row);
+            mutator_ptr->set(key, format("%s-%d", qualifier.c_str(),
+                                         (int)round).c_str());
+          }
+          mutator_ptr->flush();
+        }
+      }
+      catch (Exception &e) {
+        ScopedLock lock(*m_mutex);
+        HT_ERROR_OUT << e << HT_END;
+        (*m_errors)++;
+      }
+    }
+
+  private:
+    TablePtr  m_table_ptr;
+    size_t    m_id;
+    size_t   *m_errors;
+    Mutex    *m_mutex;
+  };
+
+  /**
+   * Reads back all versions of all cells and checks that each cell has
+   * one version per round in reverse round order
+   */
+  bool check_table(TablePtr &table_ptr) {
+    ScanSpec scan_spec;
+    TableScannerPtr scanner_ptr = table_ptr->create_scanner(scan_spec);
+    map<String, vector<String> > values;
+    map<String, vector<uint64_t> > timestamps;
+    Cell cell;
+
+    while (scanner_ptr->next(cell)) {
+      String cell_key = format("%s:%s", cell.row_key, cell.column_qualifier);
+      values[cell_key].push_back(String((const char *)cell.value,
+                                        cell.value_len));
+      timestamps[cell_key].push_back(cell.timestamp);
+    }
+
+    if (values.size() != ROWS * WRITERS) {
+      cout << "read back " << values.size() << " cells, expected "
+           << ROWS * WRITERS << endl;
+      return false;
+    }
+
+    for (map<String, vector<String> >::iterator iter = values.begin();
+         iter != values.end(); ++iter) {
+      const String &cell_key = (*iter).first;
+      vector<String> &versions = (*iter).second;
+      vector<uint64_t> &ts = timestamps[cell_key];
+      String qualifier = cell_key.substr(cell_key.find(':') + 1);
+
+      if (versions.size() != ROUNDS) {
+        cout << cell_key << ": " << versions.size() << " versions, expected "
+             << ROUNDS << endl;
+        return false;
+      }
+      for (size_t i=0; i<ROUNDS; i++) {
+        String expected = format("%s-%d", qualifier.c_str(),
+                                 (int)(ROUNDS - 1 - i));
+        if (versions[i] != expected) {
+          cout << cell_key << ": version " << i << " is '" << versions[i]
+               << "', expected '" << expected << "'" << endl;
+          return false;
+        }
+        if (i > 0 && ts[i] >= ts[i-1]) {
+          cout << cell_key << ": timestamp of version " << i
+               << " is not older than the one of version " << i-1 << endl;
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+}
+
+
+int main(int argc, char **argv) {
+  Client *hypertable;
+  unsigned long seed = 1234;
+  boost::thread_group threads;
+  size_t errors = 0;
+  Mutex mutex;
+
+  if (argc > 2 ||
+      (argc == 2 && (!strcmp(argv[1], "--help") || !strcmp(argv[1], "-?"))))
+    Usage::dump_and_exit(usage);
+
+  if (argc == 2)
+    seed = atoi(argv[1]);
+
+  cout << "SEED: " << seed << endl;
+
+  srandom(seed);
+
+  hypertable = new Client(argv[0], "./hypertable.cfg");
+
+  try {
+    hypertable->drop_table(table_name, true);
+    hypertable->create_table(table_name, schema);
+
+    TablePtr table_ptr = hypertable->open_table(table_name);
+
+    for (size_t i=0; i<WRITERS; i++)
+      threads.create_thread(Writer(table_ptr, i, &errors, &mutex));
+    threads.join_all();
+
+    if (errors)
+      return 1;
+
+    if (!check_table(table_ptr))
+      return 1;
+  }
+  catch (Exception &e) {
+    HT_ERROR_OUT << e << HT_END;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,240 @@
+/** -*- c++ -*-
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "Common/Compat.h"
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include "Common/String.h"
+#include "Common/Usage.h"
+
+#include "Hypertable/Lib/Client.h"
+#include "Hypertable/Lib/Key.h"
+#include "Hypertable/Lib/LocationCache.h"
+#include "Hypertable/Lib/MultiTableMutator.h"
+
+using namespace std;
+using namespace Hypertable;
+
+namespace {
+
+  const char *schema_a =
+  "<Schema>"
+  "  <AccessGroup name=\"default\">"
+  "    <ColumnFamily>"
+  "      <Name>a</Name>"
+  "    </ColumnFamily>"
+  "  </AccessGroup>"
+  "</Schema>";
+
+  const char *schema_b =
+  "<Schema>"
+  "  <AccessGroup name=\"default\">"
+  "    <ColumnFamily>"
+  "      <Name>b1</Name>"
+  "    </ColumnFamily>"
+  "    <ColumnFamily>"
+  "      <Name>b2</Name>"
+  "    </ColumnFamily>"
+  "  </AccessGroup>"
+  "</Schema>";
+
+  const char *table_names[] = { "MultiMutatorA", "MultiMutatorB" };
+
+  const char *usage[] = {
+    "usage: multi_table_mutator_test [<seed>]",
+    "",
+    "Writes to two tables through one MultiTableMutator, so that the",
+    "updates for both tables travel in combined \"update multi\" requests,",
+    "and reads both tables back.  The second pass points the location",
+    "caches of the tables at a server that does not exist, which makes",
+    "the first send fail and the mutator resend the updates.",
+    0
+  };
+
+  typedef map<String, String> CellMap;
+
+  void recreate_tables(Client *hypertable) {
+    hypertable->drop_table(table_names[0], true);
+    hypertable->drop_table(table_names[1], true);
+    hypertable->create_table(table_names[0], schema_a);
+    hypertable->create_table(table_names[1], schema_b);
+  }
+
+  /**
+   * Writes count rows into each of the two tables, interleaving the
+   * tables cell by cell, and records the cells in expected
+   */
+  void write_cells(MultiTableMutator *mutator, size_t count,
+                   CellMap expected[2]) {
+    const char *families[] = { "a", "b1", "b2" };
+    char row[32];
+    KeySpec key;
+    String value;
+
+    key.column_qualifier = 0;
+    key.column_qualifier_len = 0;
+
+    for (size_t i=0; i<count; i++) {
+      sprintf(row, "%05u", (unsigned)i);
+      key.row = row;
+      key.row_len = strlen(row);
+
+      value = format("%s-%u", row, (unsigned)random());
+      key.column_family = families[0];
+      mutator->set(0, key, value.c_str());
+      expected[0][format("%s:%s", row, families[0])] = value;
+
+      value = format("%s-%u", row, (unsigned)random());
+      key.column_family = families[1 + (i & 1)];
+      mutator->set(1, key, value.c_str());
+      expected[1][format("%s:%s", row, key.column_family)] = value;
+    }
+  }
+
+  bool check_table(Client *hypertable, size_t table, CellMap &expected) {
+    TablePtr table_ptr = hypertable->open_table(table_names[table]);
+    ScanSpec scan_spec;
+    TableScannerPtr scanner_ptr = table_ptr->create_scanner(scan_spec);
+    CellMap::iterator iter;
+    size_t found = 0;
+    Cell cell;
+
+    while (scanner_ptr->next(cell)) {
+      String cell_key = format("%s:%s", cell.row_key, cell.column_family);
+      String value((const char *)cell.value, cell.value_len);
+      if ((iter = expected.find(cell_key)) == expected.end()) {
+        cout << table_names[table] << ": unexpected cell " << cell_key
+             << endl;
+        return false;
+      }
+      if ((*iter).second != value) {
+        cout << table_names[table] << ": cell " << cell_key << " is '"
+             << value << "', expected '" << (*iter).second << "'" << endl;
+        return false;
+      }
+      found++;
+    }
+
+    if (found != expected.size()) {
+      cout << table_names[table] << ": read back " << found << " of "
+           << expected.size() << " cells" << endl;
+      return false;
+    }
+    return true;
+  }
+
+  bool test_two_tables(Client *hypertable) {
+    vector<String> names(table_names, table_names + 2);
+    CellMap expected[2];
+    MultiTableMutatorPtr mutator_ptr;
+
+    recreate_tables(hypertable);
+
+    mutator_ptr = hypertable->create_multi_table_mutator(names);
+    write_cells(mutator_ptr.get(), 5000, expected);
+    mutator_ptr->flush();
+    mutator_ptr = 0;
+
+    return check_table(hypertable, 0, expected[0]) &&
+           check_table(hypertable, 1, expected[1]);
+  }
+
+  /**
+   * Caches a location for both tables that covers all of their rows and
+   * points at a port nobody listens on.  The combined request fails, the
+   * stale entries are invalidated and the mutator has to locate the ranges
+   * again and resend the updates of both tables.
+   */
+  bool test_resend(Client *hypertable) {
+    TablePtr table_ptrs[2];
+    vector<Table *> tables;
+    CellMap expected[2];
+    MultiTableMutatorPtr mutator_ptr;
+    RangeLocatorPtr range_locator_ptr;
+    LocationCachePtr cache_ptr;
+    RangeLocationInfo range_loc_info;
+
+    recreate_tables(hypertable);
+
+    range_loc_info.start_row = "";
+    range_loc_info.end_row = Key::END_ROW_MARKER;
+    range_loc_info.location = "127.0.0.1_1";
+
+    for (size_t i=0; i<2; i++) {
+      table_ptrs[i] = hypertable->open_table(table_names[i]);
+      table_ptrs[i]->get_range_locator(range_locator_ptr);
+      range_locator_ptr->get_location_cache(cache_ptr);
+      cache_ptr->insert(hypertable->get_table_id(table_names[i]),
+                        range_loc_info);
+      tables.push_back(table_ptrs[i].get());
+    }
+
+    mutator_ptr = hypertable->create_multi_table_mutator(tables);
+    write_cells(mutator_ptr.get(), 500, expected);
+    mutator_ptr->flush();
+
+    if (mutator_ptr->get_resend_count() == 0) {
+      cout << "updates sent to a stale location were not resent" << endl;
+      return false;
+    }
+    mutator_ptr = 0;
+
+    return check_table(hypertable, 0, expected[0]) &&
+           check_table(hypertable, 1, expected[1]);
+  }
+
+}
+
+
+int main(int argc, char **argv) {
+  Client *hypertable;
+  unsigned long seed = 1234;
+
+  if (argc > 2 ||
+      (argc == 2 && (!strcmp(argv[1], "--help") || !strcmp(argv[1], "-?"))))
+    Usage::dump_and_exit(usage);
+
+  if (argc == 2)
+    seed = atoi(argv[1]);
+
+  cout << "SEED: " << seed << endl;
+
+  srandom(seed);
+
+  hypertable = new Client(argv[0], "./hypertable.cfg");
+
+  try {
+    if (!test_two_tables(hypertable))
+      return 1;
+
+    if (!test_resend(hypertable))
+      return 1;
+  }
+  catch (Exception &e) {
+    HT_ERROR_OUT << e << HT_END;
+    return 1;
+  }
+
+  return 0;
+}
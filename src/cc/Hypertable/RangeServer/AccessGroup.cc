@@ -24,6 +24,8 @@
 #include <iterator>
 #include <vector>
 
+#include <boost/thread/thread.hpp>
+
 #include "Common/Error.h"
 #include "Common/md5.h"
 
@@ -31,7 +33,8 @@
 #include "CellCache.h"
 #include "CellCacheScanner.h"
 #include "CellStoreReleaseCallback.h"
-#include "CellStoreV0.h"
+#include "CellStoreFactory.h"
+#include "CellStoreV1.h"
 #include "Global.h"
 #include "MergeScanner.h"
 #include "MetadataNormal.h"
@@ -41,6 +44,7 @@ using namespace Hypertable;
 
 namespace {
   const uint32_t DEFAULT_BLOCKSIZE = 65536;
+  const uint64_t MIN_PARTITION_BYTES = 64 * 1024 * 1024;
 }
 
 
@@ -65,6 +69,8 @@ AccessGroup::AccessGroup(TableIdentifier *identifier, SchemaPtr &schema_ptr,
 
   m_compressor = (ag->compressor != "") ? ag->compressor : schema_ptr->get_compressor();
 
+  m_bloom_filter = ag->bloom_filter;
+
   m_is_root = (m_identifier.id == 0 && *range->start_row == 0 && !strcmp(range->end_row, Key::END_ROOT_ROW));
 
   m_in_memory = ag->in_memory;
@@ -140,6 +146,8 @@ CellListScanner *AccessGroup::create_scanner(ScanContextPtr &scan_context_ptr) {
   if (!m_in_memory) {
     CellStoreReleaseCallback callback(this);
     for (size_t i=0; i<m_stores.size(); i++) {
+      if (!m_stores[i]->may_contain(scan_context_ptr))
+        continue;
       scanner->add_scanner(m_stores[i]->create_scanner(scan_context_ptr));
       filename = m_stores[i]->get_filename();
       callback.add_file(filename);
@@ -202,6 +210,8 @@ void AccessGroup::get_compaction_priority_data(CompactionPriorityData &priority_
   priority_data.disk_used = m_disk_usage + (uint64_t)(m_compression_ratio * (float)mu);
   priority_data.in_memory = m_in_memory;
   priority_data.deletes = m_cell_cache_ptr->get_delete_count();
+  priority_data.cell_stores = m_stores.size();
+  priority_data.log_space_pinned = 0;
 }
 
 
@@ -249,22 +259,55 @@ namespace {
       return !(x->disk_usage() < y->disk_usage());
     }
   };
+
+  /**
+   * Clears the compaction bit when a compaction returns, however it
+   * returns, so the bit stays set while the compaction is running
+   */
+  class CompactionBitReset {
+  public:
+    CompactionBitReset(bool &bit) : m_bit(bit) { }
+    ~CompactionBitReset() { m_bit = false; }
+  private:
+    bool &m_bit;
+  };
+
+  /**
+   * Removes the files of the CellStores of a failed compaction, which
+   * would otherwise be left behind unreferenced, and drops the CellStores
+   */
+  void remove_cellstore_files(std::vector<CellStorePtr> &cellstores) {
+    std::vector<String> filenames;
+
+    for (size_t i=0; i<cellstores.size(); i++)
+      filenames.push_back(cellstores[i]->get_filename());
+    cellstores.clear();
+
+    for (size_t i=0; i<filenames.size(); i++) {
+      try { Global::dfs->remove(filenames[i]); }
+      catch (Exception &e) {
+        HT_ERRORF("Problem removing CellStore file '%s' - %s",
+                  filenames[i].c_str(), e.what());
+      }
+    }
+  }
 }
 
 
 void AccessGroup::run_compaction(Timestamp timestamp, bool major) {
-  ByteString bskey;
-  ByteString value;
-  Key key;
   CellListScannerPtr scanner_ptr;
+  std::vector<CellListScannerPtr> scanners;
   size_t tableidx = 1;
   CellStorePtr cellstore;
+  std::vector<CellStorePtr> cellstores;
+  std::vector<String> partition_rows;
+  std::vector<MergeScanner::GcStatistics> gc_stats;
   String metadata_key_str;
 
   if (!major && !m_needs_compaction)
     return;
 
-  m_needs_compaction = false;
+  CompactionBitReset bit_reset(m_needs_compaction);
 
   {
     boost::mutex::scoped_lock lock(m_mutex);
@@ -310,53 +353,96 @@ void AccessGroup::run_compaction(Timestamp timestamp, bool major) {
     md5_string(m_end_row.c_str(), hash_str);
 
   hash_str[24] = 0;
-  String cs_file = format("/hypertable/tables/%s/%s/%s/cs%d",
-                          m_table_name.c_str(), m_name.c_str(), hash_str,
-                          m_next_table_id++);
-
-  cellstore = new CellStoreV0(Global::dfs);
-
-  if (cellstore->create(cs_file.c_str(), m_blocksize, m_compressor) != 0) {
-    HT_ERRORF("Problem compacting locality group to file '%s'", cs_file.c_str());
-    return;
-  }
 
   {
     boost::mutex::scoped_lock lock(m_mutex);
-    ScanContextPtr scan_context_ptr = new ScanContext(timestamp.logical+1, m_schema_ptr);
 
-    if (m_in_memory) {
-      MergeScanner *mscanner = new MergeScanner(scan_context_ptr, false);
-      mscanner->add_scanner(m_cell_cache_ptr->create_scanner(scan_context_ptr));
-      scanner_ptr = mscanner;
-    }
-    else if (major || tableidx < m_stores.size()) {
-      MergeScanner *mscanner = new MergeScanner(scan_context_ptr, !major);
-      mscanner->add_scanner(m_cell_cache_ptr->create_scanner(scan_context_ptr));
-      for (size_t i=tableidx; i<m_stores.size(); i++)
-        mscanner->add_scanner(m_stores[i]->create_scanner(scan_context_ptr));
-      scanner_ptr = mscanner;
+    if (!m_in_memory && tableidx < m_stores.size())
+      get_partition_rows(tableidx, partition_rows);
+
+    gc_stats.resize(partition_rows.size() + 1);
+
+    /**
+     * One scanner per partition.  Partition i holds the rows in
+     * [partition_rows[i-1], partition_rows[i]) so deletes stay in the
+     * same partition as the rows they apply to.
+     */
+    for (size_t p=0; p<=partition_rows.size(); p++) {
+      ScanContextPtr scan_context_ptr = new ScanContext(timestamp.logical+1, m_schema_ptr);
+
+      if (p > 0)
+        scan_context_ptr->start_row = partition_rows[p-1];
+      if (p < partition_rows.size())
+        scan_context_ptr->end_row = partition_rows[p];
+
+      if (m_in_memory) {
+        MergeScanner *mscanner = new MergeScanner(scan_context_ptr, false);
+        mscanner->set_gc_statistics(&gc_stats[p]);
+        mscanner->add_scanner(m_cell_cache_ptr->create_scanner(scan_context_ptr));
+        scanner_ptr = mscanner;
+      }
+      else {
+        /**
+         * Minor compactions merge just the CellCache, so that expired
+         * cells are dropped there too.  Deletes can only be dropped if
+         * there are no older CellStores left out of the merge that may
+         * hold cells they cover
+         */
+        MergeScanner *mscanner = new MergeScanner(scan_context_ptr, tableidx > 0);
+        mscanner->set_gc_statistics(&gc_stats[p]);
+        mscanner->add_scanner(m_cell_cache_ptr->create_scanner(scan_context_ptr));
+        for (size_t i=tableidx; i<m_stores.size(); i++)
+          mscanner->add_scanner(m_stores[i]->create_scanner(scan_context_ptr));
+        scanner_ptr = mscanner;
+      }
+
+      scanners.push_back(scanner_ptr);
     }
-    else
-      scanner_ptr = m_cell_cache_ptr->create_scanner(scan_context_ptr);
   }
 
-  while (scanner_ptr->get(bskey, value)) {
+  for (size_t p=0; p<scanners.size(); p++) {
+    String cs_file = format("/hypertable/tables/%s/%s/%s/cs%d",
+                            m_table_name.c_str(), m_name.c_str(), hash_str,
+                            m_next_table_id++);
 
-    if (!key.load(bskey)) {
-      HT_ERROR("Problem deserializing key/value pair");
+    cellstore = new CellStoreV1(Global::dfs);
+
+    if (cellstore->create(cs_file.c_str(), m_blocksize, m_compressor,
+                          m_bloom_filter) != 0) {
+      HT_ERRORF("Problem compacting locality group to file '%s'", cs_file.c_str());
+      remove_cellstore_files(cellstores);
       return;
     }
+    cellstores.push_back(cellstore);
+  }
 
-    if (key.timestamp <= timestamp.logical)
-      cellstore->add(bskey, value, timestamp.real);
-
-    scanner_ptr->forward();
+  if (scanners.size() == 1) {
+    if (!write_compaction(scanners[0], cellstores[0], timestamp)) {
+      remove_cellstore_files(cellstores);
+      return;
+    }
   }
+  else {
+    boost::thread_group threads;
+    bool *ok = new bool [scanners.size()];
+    bool all_ok = true;
 
-  if (cellstore->finalize(timestamp) != 0) {
-    HT_ERRORF("Problem finalizing CellStore '%s'", cs_file.c_str());
-    return;
+    HT_INFOF("Compacting %s(%s) in %d partitions", m_range_name.c_str(),
+             m_name.c_str(), (int)scanners.size());
+
+    for (size_t p=0; p<scanners.size(); p++)
+      threads.create_thread(CompactionWriter(this, scanners[p],
+                            cellstores[p], timestamp, &ok[p]));
+    threads.join_all();
+
+    for (size_t p=0; p<scanners.size(); p++)
+      all_ok = all_ok && ok[p];
+    delete [] ok;
+
+    if (!all_ok) {
+      remove_cellstore_files(cellstores);
+      return;
+    }
   }
 
   /**
@@ -391,9 +477,13 @@ void AccessGroup::run_compaction(Timestamp timestamp, bool major) {
       m_live_files.clear();
     }
 
-    /** Add the new table to the table vector **/
-    m_stores.push_back(cellstore);
-    m_live_files.insert(cellstore->get_filename());
+    /** Add the new tables to the table vector **/
+    for (size_t p=0; p<cellstores.size(); p++) {
+      m_stores.push_back(cellstores[p]);
+      m_live_files.insert(cellstores[p]->get_filename());
+    }
+
+    report_gc_statistics(gc_stats);
 
     /** Determine in-use files to prevent from being GC'd **/
     m_gc_locked_files.clear();
@@ -427,6 +517,124 @@ void AccessGroup::run_compaction(Timestamp timestamp, bool major) {
 }
 
 
+/**
+ * Writes the output of a compaction scanner into a new CellStore,
+ * dropping cells newer than the compaction timestamp, and finalizes it.
+ * Returns false on error.
+ */
+bool AccessGroup::write_compaction(CellListScannerPtr &scanner_ptr,
+    CellStorePtr &cellstore, Timestamp timestamp) {
+  ByteString bskey;
+  ByteString value;
+  Key key;
+
+  while (scanner_ptr->get(bskey, value)) {
+
+    if (!key.load(bskey)) {
+      HT_ERROR("Problem deserializing key/value pair");
+      return false;
+    }
+
+    if (key.timestamp <= timestamp.logical)
+      cellstore->add(bskey, value, timestamp.real);
+
+    scanner_ptr->forward();
+  }
+
+  if (cellstore->finalize(timestamp) != 0) {
+    HT_ERRORF("Problem finalizing CellStore '%s'", cellstore->get_filename().c_str());
+    return false;
+  }
+
+  return true;
+}
+
+
+/**
+ * Logs the cells and bytes that a compaction dropped for good (expired,
+ * beyond the version limit, deleted or deletes), by column family.
+ * Called with m_mutex held.
+ */
+void AccessGroup::report_gc_statistics(std::vector<MergeScanner::GcStatistics> &gc_stats) {
+
+  for (size_t family=0; family<256; family++) {
+    uint64_t cells = 0;
+    uint64_t bytes = 0;
+
+    for (size_t p=0; p<gc_stats.size(); p++) {
+      cells += gc_stats[p].cells[family];
+      bytes += gc_stats[p].bytes[family];
+    }
+
+    if (cells == 0)
+      continue;
+
+    Schema::ColumnFamily *cf = (family == 0) ? 0 : m_schema_ptr->get_column_family((uint32_t)family);
+
+    HT_INFOF("Compaction of %s(%s) reclaimed %llu cells (%llu bytes) from %s%s",
+             m_range_name.c_str(), m_name.c_str(), (Llu)cells, (Llu)bytes,
+             cf ? "column family " : "row deletes", cf ? cf->name.c_str() : "");
+  }
+}
+
+
+/**
+ * Picks the rows at which to partition a compaction of the CellStores
+ * starting at tableidx so that it can be written by several threads.
+ * The rows are evenly spaced samples from the block indexes of those
+ * CellStores.  No rows are returned if the compaction is too small to be
+ * worth partitioning.  Called with m_mutex held.
+ */
+void AccessGroup::get_partition_rows(size_t tableidx, std::vector<String> &partition_rows) {
+  std::vector<String> rows;
+  uint64_t input_bytes = 0;
+  size_t partitions;
+
+  if (Global::access_group_compaction_threads <= 1)
+    return;
+
+  for (size_t i=tableidx; i<m_stores.size(); i++) {
+    input_bytes += m_stores[i]->disk_usage();
+    m_stores[i]->get_index_rows(rows);
+  }
+
+  partitions = std::min((uint64_t)Global::access_group_compaction_threads,
+                        input_bytes / MIN_PARTITION_BYTES);
+
+  select_partition_rows(rows, partitions, m_start_row, m_end_row,
+                        partition_rows);
+}
+
+
+/**
+ * Takes evenly spaced rows out of the sorted samples.  No rows are chosen
+ * if there are fewer distinct samples than partitions, e.g. when the
+ * CellStores provide no index rows.
+ */
+void AccessGroup::select_partition_rows(std::vector<String> &rows,
+    size_t partitions, const String &start_row, const String &end_row,
+    std::vector<String> &partition_rows) {
+
+  if (partitions < 2)
+    return;
+
+  std::sort(rows.begin(), rows.end());
+  rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+
+  if (rows.size() < partitions)
+    return;
+
+  for (size_t p=1; p<partitions; p++) {
+    const String &row = rows[(p * rows.size()) / partitions];
+    if (row <= start_row || (end_row != "" && row >= end_row))
+      continue;
+    if (!partition_rows.empty() && row <= partition_rows.back())
+      continue;
+    partition_rows.push_back(row);
+  }
+}
+
+
 /**
  *
  */
@@ -440,7 +648,7 @@ int AccessGroup::shrink(String &new_start_row) {
   ByteString key;
   ByteString value;
   std::vector<CellStorePtr> new_stores;
-  CellStore *new_cell_store;
+  CellStorePtr new_cell_store;
   uint64_t memory_added = 0;
   uint64_t items_added = 0;
 
@@ -476,17 +684,11 @@ int AccessGroup::shrink(String &new_start_row) {
    */
   for (size_t i=0; i<m_stores.size(); i++) {
     String filename = m_stores[i]->get_filename();
-    new_cell_store = new CellStoreV0(Global::dfs);
-    if ((error = new_cell_store->open(filename.c_str(), m_start_row.c_str(), m_end_row.c_str())) != Error::OK) {
+    if ((error = CellStoreFactory::open(Global::dfs, filename.c_str(), m_start_row.c_str(), m_end_row.c_str(), new_cell_store)) != Error::OK) {
       HT_ERRORF("Problem opening cell store '%s' [%s:%s] - %s",
                    filename.c_str(), m_start_row.c_str(), m_end_row.c_str(), Error::get_text(error));
       return error;
     }
-    if ((error = new_cell_store->load_index()) != Error::OK) {
-      HT_ERRORF("Problem loading index of cell store '%s' [%s:%s] - %s",
-                   filename.c_str(), m_start_row.c_str(), m_end_row.c_str(), Error::get_text(error));
-      return error;
-    }
     new_stores.push_back(new_cell_store);
   }
 
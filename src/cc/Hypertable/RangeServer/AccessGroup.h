@@ -37,6 +37,7 @@
 
 #include "CellCache.h"
 #include "CellStore.h"
+#include "MergeScanner.h"
 #include "Timestamp.h"
 
 
@@ -53,6 +54,7 @@ namespace Hypertable {
       uint64_t disk_used;
       uint64_t log_space_pinned;
       uint32_t deletes;
+      uint32_t cell_stores;
       void *user_data;
       bool in_memory;
     };
@@ -86,6 +88,10 @@ namespace Hypertable {
 
     void set_compaction_bit() { m_needs_compaction = true; }
 
+    /**
+     * Returns true from the time a compaction of this access group is
+     * scheduled until the compaction returns
+     */
     bool needs_compaction() { return m_needs_compaction; }
 
     const char *get_name() { return m_name.c_str(); }
@@ -102,14 +108,58 @@ namespace Hypertable {
       return m_cell_cache_ptr->size();
     }
 
+    uint64_t get_cached_memory_allocated() {
+      boost::mutex::scoped_lock lock(m_mutex);
+      return m_cell_cache_ptr->memory_allocated();
+    }
+
     void drop() { m_drop = true; }
 
     void get_files(String &text);
 
     void release_files(const std::vector<String> &files);
 
+    /**
+     * Chooses the rows at which to split a compaction into the given
+     * number of partitions, from the sample rows of the CellStore block
+     * indexes.  Rows outside of (start_row, end_row) are skipped.
+     *
+     * @param rows sample rows (sorted and de-duplicated in place)
+     * @param partitions number of partitions wanted
+     * @param start_row start row of the range (exclusive)
+     * @param end_row end row of the range, or "" for none
+     * @param partition_rows vector to append the chosen rows to
+     */
+    static void select_partition_rows(std::vector<String> &rows,
+        size_t partitions, const String &start_row, const String &end_row,
+        std::vector<String> &partition_rows);
+
   private:
 
+    /**
+     * Writes one partition of a parallel compaction
+     */
+    class CompactionWriter {
+    public:
+      CompactionWriter(AccessGroup *ag, CellListScannerPtr &scanner_ptr,
+                       CellStorePtr &cellstore, Timestamp timestamp, bool *okp)
+        : m_ag(ag), m_scanner_ptr(scanner_ptr), m_cellstore(cellstore),
+          m_timestamp(timestamp), m_okp(okp) { }
+      void operator()() {
+        *m_okp = m_ag->write_compaction(m_scanner_ptr, m_cellstore, m_timestamp);
+      }
+    private:
+      AccessGroup       *m_ag;
+      CellListScannerPtr m_scanner_ptr;
+      CellStorePtr       m_cellstore;
+      Timestamp          m_timestamp;
+      bool              *m_okp;
+    };
+
+    bool write_compaction(CellListScannerPtr &scanner_ptr, CellStorePtr &cellstore, Timestamp timestamp);
+    void get_partition_rows(size_t tableidx, std::vector<String> &partition_rows);
+    void report_gc_statistics(std::vector<MergeScanner::GcStatistics> &gc_stats);
+
     typedef hash_map<String, uint32_t> FileRefCountMap;
     void increment_file_refcount(const String &filename);
     bool decrement_file_refcount(const String &filename);
@@ -133,6 +183,7 @@ namespace Hypertable {
     uint32_t             m_blocksize;
     float                m_compression_ratio;
     String               m_compressor;
+    String               m_bloom_filter;
     bool                 m_is_root;
     Timestamp            m_compaction_timestamp;
     uint64_t             m_oldest_cached_timestamp;
@@ -35,42 +35,19 @@ using namespace Hypertable;
 using namespace std;
 
 
-const uint32_t CellCache::ALLOC_BIT_MASK  = 0x80000000;
-const uint32_t CellCache::OFFSET_BIT_MASK = 0x7FFFFFFF;
-
-
 //#define STAT
 
 
 CellCache::~CellCache() {
-  uint64_t mem_freed = 0;
-  uint32_t offset;
-  uint8_t *ptr;
-#ifdef STAT
-  uint32_t skipped = 0;
-#endif
-
-  for (CellMap::iterator iter = m_cell_map.begin(); iter != m_cell_map.end(); iter++) {
-    if (((*iter).second & ALLOC_BIT_MASK) == 0) {
-      ptr = (uint8_t *)(*iter).first.ptr;
-      offset = (*iter).second & OFFSET_BIT_MASK;
-      mem_freed += offset + ByteString(ptr + offset).length();
-      delete [] ptr;
-    }
-#ifdef STAT
-    else
-      skipped++;
-#endif
-  }
 
 #ifdef STAT
   cout << flush;
-  cout << "STAT[~CellCache]\tmemory freed\t" << mem_freed << endl;
-  cout << "STAT[~CellCache]\tentries skipped\t" << skipped << endl;
+  cout << "STAT[~CellCache]\tmemory freed\t" << m_memory_used << endl;
+  cout << "STAT[~CellCache]\tarena\t" << m_arena << endl;
   cout << "STAT[~CellCache]\tentries total\t" << m_cell_map.size() << endl;
 #endif
 
-  Global::memory_tracker.remove_memory(mem_freed);
+  Global::memory_tracker.remove_memory(m_memory_used);
   Global::memory_tracker.remove_items(m_cell_map.size());
 
 }
@@ -87,17 +64,17 @@ int CellCache::add(const ByteString key, const ByteString value, uint64_t real_t
 
   (void)real_timestamp;
 
-  new_key.ptr = ptr = new uint8_t [total_len];
+  new_key.ptr = ptr = (uint8_t *)m_arena.alloc(total_len);
 
   memcpy(ptr, key.ptr, key_len);
   ptr += key_len;
 
   value.write(ptr);
 
-  if (! m_cell_map.insert(CellMap::value_type(new_key, key_len)).second) {
+  if (!m_cell_map.insert(new_key, key_len)) {
+    // the copy stays in the arena until the CellCache goes away
     m_collisions++;
     HT_WARNF("Collision detected key insert (row = %s)", new_key.str());
-    delete [] new_key.ptr;
   }
   else {
     m_memory_used += total_len;
@@ -120,11 +97,12 @@ const char *CellCache::get_split_row() {
 void CellCache::get_split_rows(std::vector<std::string> &split_rows) {
   boost::mutex::scoped_lock lock(m_mutex);
   if (m_cell_map.size() > 2) {
-    CellMap::const_iterator iter = m_cell_map.begin();
+    CellMap::Iterator iter(m_cell_map);
     size_t i=0, mid = m_cell_map.size() / 2;
+    iter.seek_to_first();
     for (i=0; i<mid; i++)
-      iter++;
-    split_rows.push_back((*iter).first.str());
+      iter.next();
+    split_rows.push_back(iter.key().str());
   }
 }
 
@@ -133,8 +111,9 @@ void CellCache::get_split_rows(std::vector<std::string> &split_rows) {
 void CellCache::get_rows(std::vector<std::string> &rows) {
   boost::mutex::scoped_lock lock(m_mutex);
   const char *row, *last_row = "";
-  for (CellMap::const_iterator iter = m_cell_map.begin(); iter != m_cell_map.end(); iter++) {
-    row = (*iter).first.str();
+  CellMap::Iterator iter(m_cell_map);
+  for (iter.seek_to_first(); iter.valid(); iter.next()) {
+    row = iter.key().str();
     if (strcmp(row, last_row)) {
       rows.push_back(row);
       last_row = row;
@@ -160,19 +139,18 @@ CellCache *CellCache::slice_copy(uint64_t timestamp) {
   uint64_t dropped = 0;
 #endif
 
-  CellCachePtr child_ptr = new CellCache();
+  CellCache *child = new CellCache();
+  CellMap::Iterator iter(m_cell_map);
 
-  for (CellMap::iterator iter = m_cell_map.begin(); iter != m_cell_map.end(); iter++) {
+  for (iter.seek_to_first(); iter.valid(); iter.next()) {
 
-    if (!key.load((*iter).first)) {
+    if (!key.load(iter.key())) {
       HT_ERROR("Problem deserializing key/value pair");
       continue;
     }
 
-    if (key.timestamp > timestamp) {
-      child_ptr->m_cell_map.insert(CellMap::value_type((*iter).first, (*iter).second));
-      (*iter).second |= ALLOC_BIT_MASK;  // mark this entry in the "old" map so it doesn't get deleted
-    }
+    if (key.timestamp > timestamp)
+      child->add(iter.key(), iter.key().ptr + iter.value(), 0);
 #ifdef STAT
     else
       dropped++;
@@ -184,11 +162,10 @@ CellCache *CellCache::slice_copy(uint64_t timestamp) {
   cout << "STAT[slice_copy]\tdropped\t" << dropped << endl;
 #endif
 
-  Global::memory_tracker.add_items(child_ptr->m_cell_map.size());
-
-  m_children.push_back(child_ptr);
+  Global::memory_tracker.add_memory(child->m_memory_used);
+  Global::memory_tracker.add_items(child->m_cell_map.size());
 
-  return child_ptr.get();
+  return child;
 }
 
 
@@ -205,19 +182,19 @@ CellCache *CellCache::purge_deletes() {
   uint64_t      deleted_column_family_timestamp = 0;
   DynamicBuffer deleted_cell(0);
   uint64_t      deleted_cell_timestamp = 0;
-  CellMap::iterator iter;
+  CellMap::Iterator iter(m_cell_map);
 
   HT_INFO("Purging deletes from CellCache");
 
-  CellCachePtr child_ptr = new CellCache();
+  CellCache *child = new CellCache();
 
-  iter = m_cell_map.begin();
+  iter.seek_to_first();
 
-  while (iter != m_cell_map.end()) {
+  while (iter.valid()) {
 
-    if (!key_comps.load((*iter).first)) {
+    if (!key_comps.load(iter.key())) {
       HT_ERROR("Problem deserializing key/value pair");
-      iter++;
+      iter.next();
       continue;
     }
 
@@ -227,11 +204,9 @@ CellCache *CellCache::purge_deletes() {
         if (deleted_cell.fill() > 0) {
           len = (key_comps.column_qualifier - key_comps.row) + strlen(key_comps.column_qualifier) + 1;
           if (deleted_cell.fill() == len && !memcmp(deleted_cell.base, key_comps.row, len)) {
-            if (key_comps.timestamp > deleted_cell_timestamp) {
-              child_ptr->m_cell_map.insert(CellMap::value_type((*iter).first, (*iter).second));
-              (*iter).second |= ALLOC_BIT_MASK;  // mark this entry in the "old" map so it doesn't get deleted
-            }
-            iter++;
+            if (key_comps.timestamp > deleted_cell_timestamp)
+              child->add(iter.key(), iter.key().ptr + iter.value(), 0);
+            iter.next();
             continue;
           }
           deleted_cell.clear();
@@ -239,11 +214,9 @@ CellCache *CellCache::purge_deletes() {
         if (deleted_column_family.fill() > 0) {
           len = key_comps.column_qualifier - key_comps.row;
           if (deleted_column_family.fill() == len && !memcmp(deleted_column_family.base, key_comps.row, len)) {
-            if (key_comps.timestamp > deleted_column_family_timestamp) {
-              child_ptr->m_cell_map.insert(CellMap::value_type((*iter).first, (*iter).second));
-              (*iter).second |= ALLOC_BIT_MASK;  // mark this entry in the "old" map so it doesn't get deleted
-            }
-            iter++;
+            if (key_comps.timestamp > deleted_column_family_timestamp)
+              child->add(iter.key(), iter.key().ptr + iter.value(), 0);
+            iter.next();
             continue;
           }
           deleted_column_family.clear();
@@ -251,20 +224,17 @@ CellCache *CellCache::purge_deletes() {
         if (deleted_row.fill() > 0) {
           len = strlen(key_comps.row) + 1;
           if (deleted_row.fill() == len && !memcmp(deleted_row.base, key_comps.row, len)) {
-            if (key_comps.timestamp > deleted_row_timestamp) {
-              child_ptr->m_cell_map.insert(CellMap::value_type((*iter).first, (*iter).second));
-              (*iter).second |= ALLOC_BIT_MASK;  // mark this entry in the "old" map so it doesn't get deleted
-            }
-            iter++;
+            if (key_comps.timestamp > deleted_row_timestamp)
+              child->add(iter.key(), iter.key().ptr + iter.value(), 0);
+            iter.next();
             continue;
           }
           deleted_row.clear();
         }
         delete_present = false;
       }
-      child_ptr->m_cell_map.insert(CellMap::value_type((*iter).first, (*iter).second));
-      (*iter).second |= ALLOC_BIT_MASK;  // mark this entry in the "old" map so it doesn't get deleted
-      iter++;
+      child->add(iter.key(), iter.key().ptr + iter.value(), 0);
+      iter.next();
     }
     else {
       if (key_comps.flag == FLAG_DELETE_ROW) {
@@ -303,13 +273,12 @@ CellCache *CellCache::purge_deletes() {
           delete_present = true;
         }
       }
-      iter++;
+      iter.next();
     }
   }
 
-  Global::memory_tracker.add_items(child_ptr->m_cell_map.size());
-
-  m_children.push_back(child_ptr);
+  Global::memory_tracker.add_memory(child->m_memory_used);
+  Global::memory_tracker.add_items(child->m_cell_map.size());
 
-  return child_ptr.get();
+  return child;
 }
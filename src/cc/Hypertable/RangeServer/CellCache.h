@@ -22,9 +22,9 @@
 #ifndef HYPERTABLE_CELLCACHE_H
 #define HYPERTABLE_CELLCACHE_H
 
-#include <map>
-
+#include "Common/CharArena.h"
 #include "Common/Mutex.h"
+#include "Common/SkipList.h"
 
 #include "CellListScanner.h"
 #include "CellList.h"
@@ -34,18 +34,23 @@ namespace Hypertable {
   /**
    * Represents  a sorted list of key/value pairs in memory.
    * All updates get written to the CellCache and later get "compacted"
-   * into a CellStore on disk.
+   * into a CellStore on disk.  Key/value pairs and the skip list nodes that
+   * index them are allocated out of a per-CellCache arena, which is freed
+   * in one shot when the CellCache is destroyed.  Writers serialize on the
+   * CellCache lock; scanners read the skip list without locking.
    */
   class CellCache : public CellList {
 
   public:
-    CellCache() : CellList(), m_memory_used(0), m_deletes(0), m_collisions(0) { return; }
+    CellCache() : CellList(), m_arena(ARENA_PAGE_SIZE), m_cell_map(m_arena),
+                  m_memory_used(0), m_deletes(0), m_collisions(0) { return; }
     virtual ~CellCache();
 
     /**
      * Adds a key/value pair to the CellCache.  This method assumes that
      * the CellCache has been locked by a call to #lock.  Copies of
-     * the key and value are created and inserted into the underlying cell map
+     * the key and value are created in the arena and inserted into the
+     * underlying cell map
      *
      * @param key key to be inserted
      * @param value value to inserted
@@ -71,11 +76,19 @@ namespace Hypertable {
 
     size_t size() { return m_cell_map.size(); }
 
+    /**
+     * Returns the approximate memory overhead per cell beyond the key and
+     * value bytes themselves
+     */
+    static size_t cell_overhead() { return CellMap::node_overhead(); }
+
     /**
      * Makes a copy of this CellCache, but only includes the key/value
      * pairs that have a timestamp greater than the timestamp argument.
      * This method is called after a compaction to drop the key/value
-     * pairs that were compacted to disk.
+     * pairs that were compacted to disk.  The surviving pairs are copied
+     * into the new CellCache's arena so that this CellCache (and its
+     * arena) can be dropped as soon as its last scanner goes away.
      *
      * @param timestamp cutoff timestamp
      * @return The new "sliced" copy of the cell cache
@@ -90,12 +103,23 @@ namespace Hypertable {
     CellCache *purge_deletes();
 
     /**
-     * Returns the amount of memory used by the CellCache.  This is the summation
-     * of the lengths of all the keys and values in the map.
+     * Returns the amount of memory used by the live cells of the CellCache:
+     * their key and value bytes plus the per-cell map overhead.  This is
+     * what the cell cache contributes to MemoryTracker::get_total.
      */
     uint64_t memory_used() {
       ScopedLock lock(m_mutex);
-      return m_memory_used + (m_cell_map.size() * sizeof(CellMap::value_type));
+      return m_memory_used + (m_cell_map.size() * cell_overhead());
+    }
+
+    /**
+     * Returns the total size of the arena, which also counts the copies
+     * of colliding keys and the unused tail of the last page.  This memory
+     * is only released when the CellCache goes away.
+     */
+    uint64_t memory_allocated() {
+      ScopedLock lock(m_mutex);
+      return m_arena.total();
     }
 
     uint32_t get_collision_count() { return m_collisions; }
@@ -105,13 +129,13 @@ namespace Hypertable {
     friend class CellCacheScanner;
 
   protected:
-    typedef std::map<const ByteString, uint32_t, LtByteString> CellMap;
+    /** maps key to the offset of the value (i.e. the key length) */
+    typedef SkipList<ByteString, uint32_t, LtByteString> CellMap;
 
-    static const uint32_t ALLOC_BIT_MASK;
-    static const uint32_t OFFSET_BIT_MASK;
+    enum { ARENA_PAGE_SIZE = 16384 };
 
     Mutex              m_mutex;
-    std::vector<CellListPtr> m_children;
+    CharArena          m_arena;
     CellMap            m_cell_map;
     uint64_t           m_memory_used;
     uint32_t           m_deletes;
@@ -34,47 +34,25 @@ using namespace Hypertable;
 /**
  *
  */
-CellCacheScanner::CellCacheScanner(CellCachePtr &cellcache, ScanContextPtr &scan_ctx) : CellListScanner(scan_ctx), m_cell_cache_ptr(cellcache), m_cell_cache_mutex(cellcache->m_mutex), m_cur_key(0), m_cur_value(0), m_eos(false) {
+CellCacheScanner::CellCacheScanner(CellCachePtr &cellcache, ScanContextPtr &scan_ctx) : CellListScanner(scan_ctx), m_cell_cache_ptr(cellcache), m_iter(cellcache->m_cell_map), m_end_buf(0), m_cur_key(0), m_cur_value(0), m_eos(false) {
   ByteString bs;
   size_t start_row_len = strlen(scan_ctx->start_row.c_str()) + 1;
   size_t end_row_len = strlen(scan_ctx->end_row.c_str()) + 1;
-  DynamicBuffer dbuf(7 + std::max(start_row_len, end_row_len));
-
-  {
-    boost::mutex::scoped_lock lock(m_cell_cache_mutex);
-    Key key;
-
-    assert(scan_ctx->start_row <= scan_ctx->end_row);
-
-    /** set start iterator **/
-    dbuf.clear();
-    append_as_byte_string(dbuf, scan_ctx->start_row.c_str(), start_row_len);
-    bs.ptr = dbuf.base;
-    m_start_iter = m_cell_cache_ptr->m_cell_map.lower_bound(bs);
-
-    /** set end iterator **/
-    dbuf.clear();
-    append_as_byte_string(dbuf, scan_ctx->end_row.c_str(), end_row_len);
-    bs.ptr = dbuf.base;
-    m_end_iter = m_cell_cache_ptr->m_cell_map.lower_bound(bs);
-
-    m_cur_iter = m_start_iter;
-
-    while (m_cur_iter != m_end_iter) {
-      if (!key.load((*m_cur_iter).first)) {
-        HT_ERROR("Problem parsing key!");
-      }
-      else if (key.flag == FLAG_DELETE_ROW || m_scan_context_ptr->family_mask[key.column_family_code]) {
-        m_cur_key = (*m_cur_iter).first;
-        m_cur_value.ptr = m_cur_key.ptr + (CellCache::OFFSET_BIT_MASK & (*m_cur_iter).second);
-        return;
-      }
-      m_cur_iter++;
-    }
-    m_eos = true;
-    return;
-  }
+  DynamicBuffer dbuf(7 + start_row_len);
+
+  assert(scan_ctx->start_row <= scan_ctx->end_row);
+
+  /** set end key **/
+  m_end_buf.reserve(7 + end_row_len);
+  append_as_byte_string(m_end_buf, scan_ctx->end_row.c_str(), end_row_len);
+  m_end_key.ptr = m_end_buf.base;
+
+  /** position at start key **/
+  append_as_byte_string(dbuf, scan_ctx->start_row.c_str(), start_row_len);
+  bs.ptr = dbuf.base;
+  m_iter.seek(bs);
 
+  skip_to_visible();
 }
 
 
@@ -90,20 +68,31 @@ bool CellCacheScanner::get(ByteString &key, ByteString &value) {
 
 
 void CellCacheScanner::forward() {
-  boost::mutex::scoped_lock lock(m_cell_cache_mutex);
+  if (m_eos)
+    return;
+  m_iter.next();
+  skip_to_visible();
+}
+
+
+/**
+ * Advances the iterator to the first entry at or after the current
+ * position that is selected by the scan context, setting m_eos if the
+ * end key is reached.
+ */
+void CellCacheScanner::skip_to_visible() {
   Key key;
 
-  m_cur_iter++;
-  while (m_cur_iter != m_end_iter) {
-    if (!key.load((*m_cur_iter).first)) {
+  while (m_iter.valid() && m_iter.key() < m_end_key) {
+    if (!key.load(m_iter.key())) {
       HT_ERROR("Problem parsing key!");
     }
     else if (key.flag == FLAG_DELETE_ROW || m_scan_context_ptr->family_mask[key.column_family_code]) {
-      m_cur_key = (*m_cur_iter).first;
-      m_cur_value.ptr = m_cur_key.ptr + (CellCache::OFFSET_BIT_MASK & (*m_cur_iter).second);
+      m_cur_key = m_iter.key();
+      m_cur_value.ptr = m_cur_key.ptr + m_iter.value();
       return;
     }
-    m_cur_iter++;
+    m_iter.next();
   }
   m_eos = true;
 }
@@ -22,6 +22,8 @@
 #ifndef HYPERTABLE_CELLCACHESCANNER_H
 #define HYPERTABLE_CELLCACHESCANNER_H
 
+#include "Common/DynamicBuffer.h"
+
 #include "CellCache.h"
 #include "CellListScanner.h"
 #include "ScanContext.h"
@@ -30,7 +32,9 @@
 namespace Hypertable {
 
   /**
-   * Provides a scanning interface to a CellCache.
+   * Provides a scanning interface to a CellCache.  The scanner walks the
+   * CellCache skip list without taking the CellCache lock, so it can run
+   * concurrently with updates.
    */
   class CellCacheScanner : public CellListScanner {
   public:
@@ -40,11 +44,12 @@ namespace Hypertable {
     virtual bool get(ByteString &key, ByteString &value);
 
   private:
-    CellCache::CellMap::iterator   m_start_iter;
-    CellCache::CellMap::iterator   m_end_iter;
-    CellCache::CellMap::iterator   m_cur_iter;
+    void skip_to_visible();
+
     CellCachePtr                   m_cell_cache_ptr;
-    boost::mutex                  &m_cell_cache_mutex;
+    CellCache::CellMap::Iterator   m_iter;
+    DynamicBuffer                  m_end_buf;
+    ByteString                     m_end_key;
     ByteString                     m_cur_key;
     ByteString                     m_cur_value;
     bool                           m_eos;
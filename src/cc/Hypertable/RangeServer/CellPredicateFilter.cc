@@ -0,0 +1,107 @@
+/** -*- c++ -*-
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+
+#include "Common/Compat.h"
+#include <cstring>
+
+#include "Common/Error.h"
+#include "Common/Logger.h"
+
+#include "CellPredicateFilter.h"
+
+using namespace Hypertable;
+
+
+CellPredicateFilter::~CellPredicateFilter() {
+  for (size_t i=0; i<m_predicates.size(); i++) {
+    if (m_predicates[i].regex) {
+      regfree(m_predicates[i].regex);
+      delete m_predicates[i].regex;
+    }
+  }
+}
+
+
+void CellPredicateFilter::add(const CellPredicate &predicate) {
+  Predicate p;
+
+  if (predicate.target != CellPredicate::QUALIFIER &&
+      predicate.target != CellPredicate::VALUE)
+    HT_THROWF(Error::RANGESERVER_BAD_SCAN_SPEC, "Bad predicate target (%d)",
+              (int)predicate.target);
+
+  if (predicate.match != CellPredicate::EXACT &&
+      predicate.match != CellPredicate::PREFIX &&
+      predicate.match != CellPredicate::REGEX)
+    HT_THROWF(Error::RANGESERVER_BAD_SCAN_SPEC, "Bad predicate match type (%d)",
+              (int)predicate.match);
+
+  p.target = predicate.target;
+  p.match = predicate.match;
+  p.pattern = predicate.pattern ? predicate.pattern : "";
+  p.regex = 0;
+
+  if (p.match == CellPredicate::REGEX) {
+    p.regex = new regex_t;
+    int rc = regcomp(p.regex, p.pattern.c_str(), REG_EXTENDED|REG_NOSUB);
+    if (rc != 0) {
+      char errbuf[256];
+      regerror(rc, p.regex, errbuf, sizeof(errbuf));
+      delete p.regex;
+      HT_THROWF(Error::RANGESERVER_BAD_SCAN_SPEC, "Bad regular expression "
+                "'%s' - %s", p.pattern.c_str(), errbuf);
+    }
+  }
+
+  m_predicates.push_back(p);
+}
+
+
+bool
+CellPredicateFilter::matches(const char *qualifier, size_t qualifier_len,
+                             const uint8_t *value, size_t value_len) {
+  for (size_t i=0; i<m_predicates.size(); i++) {
+    Predicate &p = m_predicates[i];
+    bool matched = (p.target == CellPredicate::QUALIFIER)
+        ? matches(p, qualifier, qualifier_len)
+        : matches(p, (const char *)value, value_len);
+    if (!matched)
+      return false;
+  }
+  return true;
+}
+
+
+bool
+CellPredicateFilter::matches(Predicate &p, const char *data, size_t len) {
+  switch (p.match) {
+  case CellPredicate::EXACT:
+    return len == p.pattern.length() && !memcmp(data, p.pattern.data(), len);
+  case CellPredicate::PREFIX:
+    return len >= p.pattern.length() &&
+        !memcmp(data, p.pattern.data(), p.pattern.length());
+  default:
+    // regexec() needs a NUL terminated string
+    m_scratch.assign(data, len);
+    return regexec(p.regex, m_scratch.c_str(), 0, 0, 0) == 0;
+  }
+}
@@ -0,0 +1,90 @@
+/** -*- c++ -*-
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef HYPERTABLE_CELLPREDICATEFILTER_H
+#define HYPERTABLE_CELLPREDICATEFILTER_H
+
+#include <string>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+extern "C" {
+#include <sys/types.h>
+#include <regex.h>
+}
+
+#include "Hypertable/Lib/Types.h"
+
+namespace Hypertable {
+
+  /**
+   * Evaluates the CellPredicates of a scan against individual cells.
+   * Patterns are copied and regular expressions are compiled once, when
+   * the predicate is added, so that matches() does no allocation other
+   * than copying the value of a cell that is tested against a regular
+   * expression.
+   */
+  class CellPredicateFilter : boost::noncopyable {
+  public:
+    CellPredicateFilter() { return; }
+    ~CellPredicateFilter();
+
+    /**
+     * Adds a predicate to the filter.  Throws Exception with error code
+     * RANGESERVER_BAD_SCAN_SPEC if the predicate is malformed or its
+     * regular expression does not compile.
+     *
+     * @param predicate predicate to add
+     */
+    void add(const CellPredicate &predicate);
+
+    bool empty() const { return m_predicates.empty(); }
+
+    /**
+     * Returns true if the cell satisfies every predicate
+     *
+     * @param qualifier column qualifier (not NUL terminated)
+     * @param qualifier_len length of the column qualifier
+     * @param value cell value
+     * @param value_len length of the cell value
+     */
+    bool matches(const char *qualifier, size_t qualifier_len,
+                 const uint8_t *value, size_t value_len);
+
+  private:
+
+    struct Predicate {
+      uint8_t      target;
+      uint8_t      match;
+      std::string  pattern;
+      regex_t     *regex;
+    };
+
+    bool matches(Predicate &predicate, const char *data, size_t len);
+
+    std::vector<Predicate> m_predicates;
+    std::string            m_scratch;
+  };
+
+}
+
+#endif // HYPERTABLE_CELLPREDICATEFILTER_H
@@ -0,0 +1,134 @@
+/** -*- c++ -*-
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "Common/Compat.h"
+#include <cstring>
+
+#include "Common/Error.h"
+#include "Common/Logger.h"
+#include "Common/Serialization.h"
+
+#include "CellStore.h"
+
+using namespace Hypertable;
+
+
+const char *CellStore::get_split_row() {
+  if (m_split_row != "")
+    return m_split_row.c_str();
+  return 0;
+}
+
+
+bool CellStore::may_contain(ScanContextPtr &scan_ctx) {
+
+  if (m_bloom_filter == 0 || !scan_ctx->single_row)
+    return true;
+
+  String key = scan_ctx->spec->start_row;
+  size_t row_len = key.length();
+
+  if (!m_bloom_filter->may_contain(key.c_str(), row_len))
+    return false;
+
+  if (m_bloom_filter_mode == Schema::BLOOM_FILTER_ROWS_COLS &&
+      !scan_ctx->spec->columns.empty()) {
+    key.append(2, (char)0);
+    // row deletes are stored under column family 0
+    for (size_t i=0; i<256; i++) {
+      if (i == 0 || scan_ctx->family_mask[i]) {
+        key[row_len+1] = (char)i;
+        if (m_bloom_filter->may_contain(key.c_str(), row_len + 2))
+          return true;
+      }
+    }
+    return false;
+  }
+
+  return true;
+}
+
+
+
+void CellStore::add_bloom_filter_entry(const ByteString key) {
+  const uint8_t *row;
+  size_t len = key.decode_length(&row);
+  size_t row_len = strlen((const char *)row);
+  uint64_t hashval = BloomFilter::hash(row, row_len);
+
+  if (m_bloom_filter_hashes.empty() || hashval != m_last_row_hash) {
+    m_bloom_filter_hashes.push_back(hashval);
+    m_last_row_hash = hashval;
+  }
+
+  // row + NUL + column family code
+  if (m_bloom_filter_mode == Schema::BLOOM_FILTER_ROWS_COLS && row_len + 2 <= len) {
+    hashval = BloomFilter::hash(row, row_len + 2);
+    if (hashval != m_last_column_hash) {
+      m_bloom_filter_hashes.push_back(hashval);
+      m_last_column_hash = hashval;
+    }
+  }
+}
+
+
+
+void CellStore::create_bloom_filter() {
+  delete m_bloom_filter;
+  m_bloom_filter = new BloomFilter(m_bloom_filter_hashes.size(),
+                                   m_bloom_filter_false_positive);
+  for (size_t i=0; i<m_bloom_filter_hashes.size(); i++)
+    m_bloom_filter->insert(m_bloom_filter_hashes[i]);
+
+  // free the hash vector
+  std::vector<uint64_t> empty_vector;
+  m_bloom_filter_hashes.swap(empty_vector);
+}
+
+
+
+void CellStore::load_bloom_filter(const uint8_t *buf, size_t len) {
+  delete m_bloom_filter;
+  m_bloom_filter = 0;
+  m_bloom_filter_mode = Schema::BLOOM_FILTER_DISABLED;
+
+  try {
+    uint8_t mode = Serialization::decode_i8(&buf, &len);
+    if (mode != Schema::BLOOM_FILTER_ROWS && mode != Schema::BLOOM_FILTER_ROWS_COLS)
+      HT_THROWF(Error::BAD_SCHEMA, "Unknown bloom filter mode %d", (int)mode);
+    m_bloom_filter = new BloomFilter(&buf, &len);
+    m_bloom_filter_mode = (Schema::BloomFilterMode)mode;
+  }
+  catch (Exception &e) {
+    HT_WARN_OUT << "Ignoring bad bloom filter in cellstore '" << get_filename()
+                << "': " << e << HT_END;
+  }
+}
+
+
+
+void CellStore::record_split_row(const ByteString key) {
+  const uint8_t *ptr;
+  key.decode_length(&ptr);
+  std::string split_row = (const char *)ptr;
+  if (split_row > m_start_row && split_row < m_end_row)
+    m_split_row = split_row;
+}
@@ -22,9 +22,16 @@
 #ifndef HYPERTABLE_CELLSTORE_H
 #define HYPERTABLE_CELLSTORE_H
 
+#include <string>
+#include <vector>
+
 #include <boost/intrusive_ptr.hpp>
 
+#include "Common/BloomFilter.h"
 #include "Common/ByteString.h"
+#include "Common/String.h"
+
+#include "Hypertable/Lib/Schema.h"
 
 #include "CellList.h"
 #include "CellStoreTrailer.h"
@@ -38,23 +45,51 @@ namespace Hypertable {
   class CellStore : public CellList {
   public:
 
-    virtual ~CellStore() { return; }
+    CellStore() : m_bloom_filter_mode(Schema::BLOOM_FILTER_DISABLED),
+                  m_bloom_filter_false_positive(0.01), m_bloom_filter(0),
+                  m_last_row_hash(0), m_last_column_hash(0) { }
+
+    virtual ~CellStore() { delete m_bloom_filter; }
 
     virtual int add(const ByteString key, const ByteString value, uint64_t real_timestamp) = 0;
 
-    virtual const char *get_split_row() = 0;
+    /**
+     * Returns the split row recorded while loading the block index, or 0
+     * if there is no row strictly inside the range of this store.
+     */
+    virtual const char *get_split_row();
+
+    /**
+     * Appends sample rows, in sorted order, taken from the part of the
+     * block index that is held in memory.  Used to partition compactions.
+     *
+     * @param rows vector to append the rows to
+     */
+    virtual void get_index_rows(std::vector<String> &rows) { return; }
 
     virtual CellListScanner *create_scanner(ScanContextPtr &scan_ctx) { return 0; }
 
+    /**
+     * Consults the bloom filter (if any) to determine whether or not this
+     * cell store may contain cells for the scan.  Only single row scans can
+     * be ruled out, all others return true.
+     *
+     * @param scan_ctx scan context
+     * @return false if the store definitely has no cells for the scan, true otherwise
+     */
+    virtual bool may_contain(ScanContextPtr &scan_ctx);
+
     /**
      * Creates a new cell store.
      *
      * @param fname name of file to contain the cell store
      * @param blocksize amount of uncompressed data to compress into a block
      * @param compressor string indicating compressor type and arguments (e.g. "zlib --best")
+     * @param bloom_filter string indicating bloom filter mode and arguments (e.g. "rows --false-positive 0.01")
      * @return Error::OK on success, error code on failure
      */
-    virtual int create(const char *fname, uint32_t blocksize, const std::string &compressor) = 0;
+    virtual int create(const char *fname, uint32_t blocksize, const std::string &compressor,
+                       const std::string &bloom_filter) = 0;
 
     /**
      * Finalizes the creation of a cell store, by writing block index and metadata trailer.
@@ -129,6 +164,55 @@ namespace Hypertable {
      */
     virtual CellStoreTrailer *get_trailer() = 0;
 
+    /**
+     * Displays block index information to stdout
+     */
+    virtual void display_block_info() = 0;
+
+  protected:
+
+    /**
+     * Records the hash of the row (and row + column family for rows+cols
+     * filters) of the key.  Keys arrive in sorted order, so repeats of the
+     * same row or column are collapsed by comparing against the previous
+     * hash.  The filter itself is sized and populated by
+     * #create_bloom_filter once the number of distinct entries is known.
+     *
+     * @param key key being added to the store
+     */
+    void add_bloom_filter_entry(const ByteString key);
+
+    /**
+     * Builds the bloom filter from the hashes collected by
+     * #add_bloom_filter_entry and frees the hashes.
+     */
+    void create_bloom_filter();
+
+    /**
+     * Loads an encoded bloom filter section (mode byte followed by the
+     * filter).  A corrupt filter is logged and ignored, since the store is
+     * still perfectly readable without it.
+     *
+     * @param buf pointer to the encoded bloom filter section
+     * @param len length of the section
+     */
+    void load_bloom_filter(const uint8_t *buf, size_t len);
+
+    /**
+     * Remembers the row of the key as the split row, if it lies strictly
+     * inside the range of this store.
+     *
+     * @param key key from the block index
+     */
+    void record_split_row(const ByteString key);
+
+    std::string            m_split_row;
+    Schema::BloomFilterMode m_bloom_filter_mode;
+    float                  m_bloom_filter_false_positive;
+    BloomFilter           *m_bloom_filter;
+    std::vector<uint64_t>  m_bloom_filter_hashes;
+    uint64_t               m_last_row_hash;
+    uint64_t               m_last_column_hash;
   };
 
   typedef boost::intrusive_ptr<CellStore> CellStorePtr;
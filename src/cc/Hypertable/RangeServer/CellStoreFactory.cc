@@ -0,0 +1,98 @@
+/** -*- c++ -*-
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "Common/Compat.h"
+
+#include "Common/Error.h"
+#include "Common/Logger.h"
+#include "Common/Serialization.h"
+
+#include "CellStoreFactory.h"
+#include "CellStoreV0.h"
+#include "CellStoreV1.h"
+
+using namespace Hypertable;
+
+
+int CellStoreFactory::open(Filesystem *filesys, const char *fname, const char *start_row,
+                           const char *end_row, CellStorePtr &cellstore) {
+  uint16_t version;
+  int error;
+
+  cellstore = 0;
+
+  /**
+   * Read the version from the last two bytes of the trailer
+   */
+  try {
+    uint8_t buf[2];
+    const uint8_t *ptr = buf;
+    size_t remaining = 2;
+    int64_t length = filesys->length(fname);
+    int32_t fd;
+
+    if (length < 2) {
+      HT_ERRORF("Bad length of CellStore file '%s' - %llu", fname, (Llu)length);
+      return Error::LOCAL_IO_ERROR;
+    }
+
+    fd = filesys->open(fname);
+    try {
+      if (filesys->pread(fd, buf, 2, length - 2) != 2)
+        HT_THROWF(Error::DFSBROKER_IO_ERROR, "Short read of CellStore "
+                  "version from '%s'", fname);
+    }
+    catch (Exception &e) {
+      filesys->close(fd);
+      throw;
+    }
+    filesys->close(fd);
+
+    version = Serialization::decode_i16(&ptr, &remaining);
+  }
+  catch (Exception &e) {
+    HT_ERROR_OUT << "Problem reading version of cell store '" << fname
+                 << "': " << e << HT_END;
+    return e.code();
+  }
+
+  if (version == 0)
+    cellstore = new CellStoreV0(filesys);
+  else if (version == 1)
+    cellstore = new CellStoreV1(filesys);
+  else {
+    HT_ERRORF("Unsupported CellStore version (%d) for file '%s'",
+              (int)version, fname);
+    return Error::LOCAL_IO_ERROR;
+  }
+
+  if ((error = cellstore->open(fname, start_row, end_row)) != Error::OK) {
+    cellstore = 0;
+    return error;
+  }
+
+  if ((error = cellstore->load_index()) != Error::OK) {
+    cellstore = 0;
+    return error;
+  }
+
+  return Error::OK;
+}
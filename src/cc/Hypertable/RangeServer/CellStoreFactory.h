@@ -0,0 +1,54 @@
+/** -*- c++ -*-
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef HYPERTABLE_CELLSTOREFACTORY_H
+#define HYPERTABLE_CELLSTOREFACTORY_H
+
+#include "Hypertable/Lib/Filesystem.h"
+
+#include "CellStore.h"
+
+namespace Hypertable {
+
+  /**
+   * Opens existing cell stores of any supported version.  Every cell store
+   * trailer ends with a 16-bit version number, which is used to pick the
+   * implementation.
+   */
+  class CellStoreFactory {
+  public:
+    /**
+     * Opens the cell store contained in the given file and loads its index.
+     *
+     * @param filesys filesystem containing the cell store
+     * @param fname pathname of file containing cell store
+     * @param start_row restricts view of the store to rows greater than this value
+     * @param end_row restricts view of the store to rows less than or equal to this value
+     * @param cellstore reference to smart pointer to hold the opened store
+     * @return Error::OK on success, error code on failure
+     */
+    static int open(Filesystem *filesys, const char *fname, const char *start_row,
+                    const char *end_row, CellStorePtr &cellstore);
+  };
+
+}
+
+#endif // HYPERTABLE_CELLSTOREFACTORY_H
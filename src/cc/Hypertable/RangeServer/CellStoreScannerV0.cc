@@ -55,6 +55,12 @@ CellStoreScannerV0::CellStoreScannerV0(CellStorePtr &cellstore,
   m_zcodec = m_cell_store_v0->create_block_compression_codec();
   memset(&m_block, 0, sizeof(m_block));
 
+  // bloom filter rules out this store for the requested row
+  if (!m_cell_store_v0->may_contain(scan_ctx)) {
+    m_iter = m_index.end();
+    return;
+  }
+
   // compute start row
   // this is wrong ...
   m_start_row = m_cell_store_v0->get_start_row();
@@ -142,7 +148,7 @@ CellStoreScannerV0::CellStoreScannerV0(CellStorePtr &cellstore,
   m_cur_value.ptr = m_block.ptr + m_cur_key.length();
 
   if (start_inclusive) {
-    while (strcmp(m_cur_key.str(), m_start_row.c_str()) < 0) {
+    while (compare_row(m_cur_key, m_start_row.c_str(), m_start_row.length()) < 0) {
       m_block.ptr = m_cur_value.ptr + m_cur_value.length();
       if (m_block.ptr >= m_block.end) {
         m_iter = m_index.end();
@@ -154,7 +160,7 @@ CellStoreScannerV0::CellStoreScannerV0(CellStorePtr &cellstore,
     }
   }
   else {
-    while (strcmp(m_cur_key.str(), m_start_row.c_str()) <= 0) {
+    while (compare_row(m_cur_key, m_start_row.c_str(), m_start_row.length()) <= 0) {
       m_block.ptr = m_cur_value.ptr + m_cur_value.length();
       if (m_block.ptr >= m_block.end) {
         if (m_readahead) {
@@ -174,13 +180,13 @@ CellStoreScannerV0::CellStoreScannerV0(CellStorePtr &cellstore,
    * End of range check
    */
   if (m_end_inclusive) {
-    if (strcmp(m_cur_key.str(), m_end_row.c_str()) > 0) {
+    if (compare_row(m_cur_key, m_end_row.c_str(), m_end_row.length()) > 0) {
       m_iter = m_index.end();
       return;
     }
   }
   else {
-    if (strcmp(m_cur_key.str(), m_end_row.c_str()) >= 0) {
+    if (compare_row(m_cur_key, m_end_row.c_str(), m_end_row.length()) >= 0) {
       m_iter = m_index.end();
       return;
     }
@@ -211,11 +217,11 @@ CellStoreScannerV0::~CellStoreScannerV0() {
       }
     }
 
-    if (m_readahead)
-      delete [] m_block.base;
-    else {
-      if (m_block.base != 0)
+    if (m_block.base != 0) {
+      if (m_block.cached)
         Global::block_cache->checkin(m_file_id, m_block.offset);
+      else
+        delete [] m_block.base;
     }
     delete m_zcodec;
 
@@ -275,13 +281,13 @@ void CellStoreScannerV0::forward() {
 
     if (m_check_for_range_end) {
       if (m_end_inclusive) {
-        if (strcmp(m_cur_key.str(), m_end_row.c_str()) > 0) {
+        if (compare_row(m_cur_key, m_end_row.c_str(), m_end_row.length()) > 0) {
           m_iter = m_index.end();
           return;
         }
       }
       else {
-        if (strcmp(m_cur_key.str(), m_end_row.c_str()) >= 0) {
+        if (compare_row(m_cur_key, m_end_row.c_str(), m_end_row.length()) >= 0) {
           m_iter = m_index.end();
           return;
         }
@@ -317,7 +323,10 @@ void CellStoreScannerV0::forward() {
 bool CellStoreScannerV0::fetch_next_block() {
   // If we're at the end of the current block, deallocate and move to next
   if (m_block.base != 0 && m_block.ptr >= m_block.end) {
-    Global::block_cache->checkin(m_file_id, m_block.offset);
+    if (m_block.cached)
+      Global::block_cache->checkin(m_file_id, m_block.offset);
+    else
+      delete [] m_block.base;
     memset(&m_block, 0, sizeof(m_block));
     m_iter++;
   }
@@ -336,7 +345,7 @@ bool CellStoreScannerV0::fetch_next_block() {
         m_check_for_range_end = true;
     }
     else {
-      if (strcmp((*it_next).first.str(), m_end_row.c_str()) >= 0)
+      if (compare_row((*it_next).first, m_end_row.c_str(), m_end_row.length()) >= 0)
         m_check_for_range_end = true;
       m_block.zlength = (*it_next).second - m_block.offset;
     }
@@ -344,8 +353,10 @@ bool CellStoreScannerV0::fetch_next_block() {
     /**
      * Cache lookup / block read
      */
-    if (!Global::block_cache->checkout(m_file_id, (uint32_t)m_block.offset,
-                                      (uint8_t **)&m_block.base, &len)) {
+    if (Global::block_cache->checkout(m_file_id, (uint32_t)m_block.offset,
+                                      (uint8_t **)&m_block.base, &len))
+      m_block.cached = true;
+    else {
       try {
         DynamicBuffer buf(m_block.zlength);
         /** Read compressed block **/
@@ -373,15 +384,23 @@ bool CellStoreScannerV0::fetch_next_block() {
       m_block.base = expand_buf.release(&fill);
       len = fill;
 
-      /** Insert block into cache  **/
-      if (!Global::block_cache->insert_and_checkout(m_file_id, m_block.offset,
-                                         (uint8_t *)m_block.base, len)) {
-        delete [] m_block.base;
-
-        if (!Global::block_cache->checkout(m_file_id, m_block.offset,
-                                          (uint8_t **)&m_block.base, &len)) {
-          HT_FATALF("Problem checking out block from cache file_id=%d, "
-                    "offset=%ld", m_file_id, (uint32_t)m_block.offset);
+      /**
+       * Insert block into cache, or use the copy another scanner inserted
+       * first.  A block too large to be cached stays with the scanner.
+       */
+      if (Global::block_cache->insert_and_checkout(m_file_id, m_block.offset,
+                                         (uint8_t *)m_block.base, len))
+        m_block.cached = true;
+      else {
+        uint8_t *block;
+        uint32_t block_len;
+
+        if (Global::block_cache->checkout(m_file_id, m_block.offset, &block,
+                                          &block_len)) {
+          delete [] m_block.base;
+          m_block.base = block;
+          len = block_len;
+          m_block.cached = true;
         }
       }
     }
@@ -411,7 +430,10 @@ bool CellStoreScannerV0::fetch_next_block() {
 bool CellStoreScannerV0::fetch_next_block_readahead() {
   // If we're at the end of the current block, deallocate and move to next
   if (m_block.base != 0 && m_block.ptr >= m_block.end) {
-    delete [] m_block.base;
+    if (m_block.cached)
+      Global::block_cache->checkin(m_file_id, m_block.offset);
+    else
+      delete [] m_block.base;
     memset(&m_block, 0, sizeof(m_block));
     m_iter++;
   }
@@ -432,7 +454,7 @@ bool CellStoreScannerV0::fetch_next_block_readahead() {
         m_check_for_range_end = true;
     }
     else {
-      if (strcmp((*it_next).first.str(), m_end_row.c_str()) >= 0)
+      if (compare_row((*it_next).first, m_end_row.c_str(), m_end_row.length()) >= 0)
         m_check_for_range_end = true;
       m_block.zlength = (*it_next).second - m_block.offset;
     }
@@ -442,14 +464,24 @@ bool CellStoreScannerV0::fetch_next_block_readahead() {
       /** Read compressed block **/
       nread = m_cell_store_v0->m_filesys->read(m_fd, buf.ptr, m_block.zlength);
       buf.ptr += m_block.zlength;
-      /** inflate compressed block **/
-      BlockCompressionHeader header;
 
-      m_zcodec->inflate(buf, expand_buf, header);
+      /**
+       * Use the cached copy if there is one, but don't promote it; a
+       * readahead scan touches each block once
+       */
+      if (Global::block_cache->checkout(m_file_id, m_block.offset,
+                                        (uint8_t **)&m_block.base, &len, false))
+        m_block.cached = true;
+      else {
+        /** inflate compressed block **/
+        BlockCompressionHeader header;
+
+        m_zcodec->inflate(buf, expand_buf, header);
 
-      if (!header.check_magic(CellStoreV0::DATA_BLOCK_MAGIC))
-        HT_THROW(Error::BLOCK_COMPRESSOR_BAD_MAGIC,
-                 "Error inflating cell store block - magic string mismatch");
+        if (!header.check_magic(CellStoreV0::DATA_BLOCK_MAGIC))
+          HT_THROW(Error::BLOCK_COMPRESSOR_BAD_MAGIC,
+                   "Error inflating cell store block - magic string mismatch");
+      }
     }
     catch (Exception &e) {
       HT_ERROR_OUT <<"Error reading cell store ("
@@ -461,10 +493,17 @@ bool CellStoreScannerV0::fetch_next_block_readahead() {
     HT_EXPECT(nread == m_block.zlength, Error::UNPOSSIBLE);
     m_start_offset += nread;
 
-    /** take ownership of inflate buffer **/
-    size_t fill;
-    m_block.base = expand_buf.release(&fill);
-    len = fill;
+    if (!m_block.cached) {
+      /** take ownership of inflate buffer **/
+      size_t fill;
+      m_block.base = expand_buf.release(&fill);
+      len = fill;
+
+      /** Hand block to the cache at the cold end of the in queue **/
+      if (Global::block_cache->insert_and_checkout(m_file_id, m_block.offset,
+                                   (uint8_t *)m_block.base, len, false))
+        m_block.cached = true;
+    }
 
     m_block.ptr = m_block.base;
     m_block.end = m_block.base + len;
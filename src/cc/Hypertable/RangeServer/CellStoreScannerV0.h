@@ -47,6 +47,7 @@ namespace Hypertable {
       const uint8_t *base;
       const uint8_t *ptr;
       const uint8_t *end;
+      bool cached;
     };
 
     bool fetch_next_block();
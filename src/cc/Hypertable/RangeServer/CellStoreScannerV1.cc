@@ -0,0 +1,593 @@
+/** -*- c++ -*-
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "Common/Compat.h"
+#include <cassert>
+
+#include "Common/Error.h"
+#include "Common/System.h"
+
+#include "Hypertable/Lib/BlockCompressionHeader.h"
+#include "Hypertable/Lib/Key.h"
+
+#include "Global.h"
+#include "CellStoreScannerV1.h"
+
+using namespace Hypertable;
+using namespace Serialization;
+
+namespace {
+  const uint32_t MINIMUM_READAHEAD_AMOUNT = 65536;
+  // room in front of the key buffer for the ByteString length prefix
+  const size_t KEY_PREFIX_SPACE = 5;
+
+  inline uint32_t read_i32(const uint8_t *ptr) {
+    size_t remaining = 4;
+    return decode_i32(&ptr, &remaining);
+  }
+}
+
+//#define STAT 1
+
+
+CellStoreScannerV1::CellStoreScannerV1(CellStorePtr &cellstore,
+                                       ScanContextPtr &scan_ctx) :
+    CellListScanner(scan_ctx), m_cell_store_ptr(cellstore),
+    m_cell_store_v1(dynamic_cast< CellStoreV1*>(m_cell_store_ptr.get())),
+    m_eos(true), m_key_buf(0), m_key_buf_size(256), m_key_len(0),
+    m_check_for_range_end(false), m_end_inclusive(true),
+    m_readahead(true), m_fd(-1), m_start_offset(0), m_end_offset(0),
+    m_end_check_offset(0), m_returned(0) {
+  ByteString bskey;
+  DynamicBuffer dbuf(0);
+  bool start_inclusive = false;
+  CellStoreV1::BlockRef end_ref;
+
+  assert(m_cell_store_v1);
+  m_file_id = m_cell_store_v1->m_file_id;
+  m_zcodec = m_cell_store_v1->create_block_compression_codec();
+  memset(&m_block, 0, sizeof(m_block));
+  memset(&m_ref, 0, sizeof(m_ref));
+  m_key_buf = new uint8_t [m_key_buf_size];
+
+  // bloom filter rules out this store for the requested row
+  if (!m_cell_store_v1->may_contain(scan_ctx))
+    return;
+
+  // compute start row
+  m_start_row = m_cell_store_v1->get_start_row();
+  if (m_start_row < scan_ctx->start_row) {
+    start_inclusive = true;
+    m_start_row = scan_ctx->start_row;
+  }
+
+  // compute end row
+  m_end_row = m_cell_store_v1->get_end_row();
+  if (scan_ctx->end_row < m_end_row) {
+    m_end_inclusive = false;
+    m_end_row = scan_ctx->end_row;
+  }
+
+  /**
+   * Locate the first block
+   */
+  append_as_byte_string(dbuf, m_start_row.c_str());
+  bskey.ptr = dbuf.base;
+
+  if (!m_cell_store_v1->find_block(bskey, !start_inclusive, m_ref, m_zcodec))
+    return;
+
+  /**
+   * Locate the last block, the first one with a key past the range.  A
+   * row can span several blocks, so for an inclusive end row the search
+   * key is bumped past every key of that row (row keys are NUL terminated,
+   * so no row sorts between "row" and "row\001").  Keys in blocks before
+   * the last block are all within the range, so they can skip the end of
+   * range check.
+   */
+  dbuf.clear();
+  if (m_end_inclusive) {
+    String past_end_row = m_end_row;
+    past_end_row.append(1, 1);
+    append_as_byte_string(dbuf, past_end_row.c_str());
+  }
+  else
+    append_as_byte_string(dbuf, m_end_row.c_str());
+  bskey.ptr = dbuf.base;
+
+  if (m_cell_store_v1->find_block(bskey, false, end_ref, m_zcodec)) {
+    m_end_check_offset = end_ref.offset;
+    m_end_offset = end_ref.offset + end_ref.zlength;
+  }
+  else
+    m_end_check_offset = m_end_offset = m_cell_store_v1->m_trailer.leaf_index_offset;
+
+  if (m_ref.offset >= m_end_offset)
+    return;
+
+  /**
+   * If we're just scanning a single row, turn off readahead
+   */
+  if (m_start_row == m_end_row ||
+      (scan_ctx->spec && scan_ctx->spec->row_limit == 1))
+    m_readahead = false;
+  else {
+    uint32_t buf_size = m_cell_store_ptr->get_blocksize();
+
+    if (buf_size < MINIMUM_READAHEAD_AMOUNT)
+      buf_size = MINIMUM_READAHEAD_AMOUNT;
+
+    m_start_offset = m_ref.offset;
+
+    try {
+      m_fd = m_cell_store_v1->m_filesys->open_buffered(
+          m_cell_store_ptr->get_filename(), buf_size, 2,
+          m_start_offset, m_end_offset);
+    }
+    catch (Exception &e) {
+      HT_THROWF(e.code(), "Problem opening cell store in "
+                          "readahead mode: %s", e.what());
+    }
+  }
+
+  if (!fetch_block())
+    return;
+
+  /**
+   * Seek to start of range
+   */
+  if (!seek_row(m_start_row.c_str(), start_inclusive))
+    return;
+
+  m_eos = false;
+
+  /**
+   * End of range check
+   */
+  if (m_end_inclusive) {
+    if (compare_row(m_cur_key, m_end_row.c_str(), m_end_row.length()) > 0) {
+      m_eos = true;
+      return;
+    }
+  }
+  else {
+    if (compare_row(m_cur_key, m_end_row.c_str(), m_end_row.length()) >= 0) {
+      m_eos = true;
+      return;
+    }
+  }
+
+  /**
+   * Column family check
+   */
+  Key key;
+  if (!key.load(m_cur_key)) {
+    HT_ERROR("Problem parsing key!");
+  }
+  else if (key.flag != FLAG_DELETE_ROW &&
+           !m_scan_context_ptr->family_mask[key.column_family_code])
+    forward();
+
+}
+
+
+CellStoreScannerV1::~CellStoreScannerV1() {
+  try {
+    if (m_fd != -1) {
+      try { m_cell_store_v1->m_filesys->close(m_fd, 0); }
+      catch (Exception &e) {
+        HT_THROWF(e.code(), "Problem closing cellstore: %s",
+                  m_cell_store_ptr->get_filename().c_str());
+      }
+    }
+
+    if (m_block.base != 0) {
+      if (m_block.cached)
+        Global::block_cache->checkin(m_file_id, m_block.offset);
+      else
+        delete [] m_block.base;
+    }
+    delete m_zcodec;
+    delete [] m_key_buf;
+
+#ifdef STAT
+    cout << flush;
+    cout << "STAT[~CellStoreScannerV1]\tget\t" << m_returned << "\t";
+    cout << m_cell_store_v1->get_filename() << "[" << m_start_row << ".." << m_end_row << "]" << endl;
+#endif
+  }
+  catch (Exception &e) {
+    HT_ERROR_OUT << e << HT_END;
+  }
+  catch (...) {
+    HT_ERRORF("Unknown exception caught in %s", HT_FUNC);
+  }
+}
+
+
+bool CellStoreScannerV1::get(ByteString &key, ByteString &value) {
+
+  if (m_eos)
+    return false;
+
+#ifdef STAT
+  m_returned++;
+#endif
+
+  key = m_cur_key;
+  value = m_cur_value;
+
+  return true;
+}
+
+
+
+void CellStoreScannerV1::forward() {
+  Key key;
+
+  while (true) {
+
+    if (m_eos)
+      return;
+
+    if (!decode_entry()) {
+      if (m_readahead) {
+        if (!fetch_next_block_readahead()) {
+          m_eos = true;
+          return;
+        }
+      }
+      else if (!fetch_next_block()) {
+        m_eos = true;
+        return;
+      }
+      continue;
+    }
+
+    if (m_check_for_range_end) {
+      if (m_end_inclusive) {
+        if (compare_row(m_cur_key, m_end_row.c_str(), m_end_row.length()) > 0) {
+          m_eos = true;
+          return;
+        }
+      }
+      else {
+        if (compare_row(m_cur_key, m_end_row.c_str(), m_end_row.length()) >= 0) {
+          m_eos = true;
+          return;
+        }
+      }
+    }
+
+    /**
+     * Column family check
+     */
+    if (!key.load(m_cur_key)) {
+      HT_ERROR("Problem parsing key!");
+      break;
+    }
+    if (key.flag == FLAG_DELETE_ROW || m_scan_context_ptr->family_mask[key.column_family_code])
+      break;
+  }
+}
+
+
+
+/**
+ * Decodes the entry at m_block.ptr, rebuilding the full key from the
+ * shared prefix of the previous key, and advances m_block.ptr to the
+ * following entry.
+ *
+ * @return true if an entry was decoded, false at the end of the block
+ */
+bool CellStoreScannerV1::decode_entry() {
+  const uint8_t *ptr = m_block.ptr;
+  uint32_t shared, unshared;
+  size_t key_len;
+
+  if (ptr >= m_block.end)
+    return false;
+
+  shared = decode_vi32(&ptr);
+  unshared = decode_vi32(&ptr);
+
+  if (shared > m_key_len || ptr + unshared > m_block.end) {
+    HT_ERRORF("Corrupt key in cell store '%s' block at offset %u",
+              m_cell_store_ptr->get_filename().c_str(), m_block.offset);
+    m_block.ptr = m_block.end;
+    return false;
+  }
+
+  key_len = shared + unshared;
+
+  if (KEY_PREFIX_SPACE + key_len > m_key_buf_size) {
+    size_t new_size = (KEY_PREFIX_SPACE + key_len) * 3 / 2;
+    uint8_t *new_buf = new uint8_t [new_size];
+    memcpy(new_buf + KEY_PREFIX_SPACE, m_key_buf + KEY_PREFIX_SPACE, shared);
+    delete [] m_key_buf;
+    m_key_buf = new_buf;
+    m_key_buf_size = new_size;
+  }
+
+  memcpy(m_key_buf + KEY_PREFIX_SPACE + shared, ptr, unshared);
+  ptr += unshared;
+  m_key_len = key_len;
+
+  // write the ByteString length immediately in front of the key bytes
+  uint8_t *key_ptr = m_key_buf + KEY_PREFIX_SPACE - encoded_length_vi32(key_len);
+  m_cur_key.ptr = key_ptr;
+  encode_vi32(&key_ptr, key_len);
+
+  m_cur_value.ptr = ptr;
+  m_block.ptr = ptr + m_cur_value.length();
+
+  return true;
+}
+
+
+
+/**
+ * Returns the row of the key at the given restart point.  Keys at restart
+ * points are stored in full, so no decoding state is needed.
+ */
+const char *CellStoreScannerV1::restart_row(uint32_t i) {
+  const uint8_t *ptr = m_block.base + read_i32(m_block.restarts + (4 * i));
+  decode_vi32(&ptr);  // shared (zero)
+  decode_vi32(&ptr);  // unshared
+  return (const char *)ptr;
+}
+
+
+
+/**
+ * Positions the scanner at the first key whose row is not less than
+ * (inclusive) or greater than (exclusive) the given row.  A binary search
+ * over the restart points of the current block finds where to start
+ * decoding, after which at most restart_interval entries are examined.
+ *
+ * @return true if positioned on a key, false if the store has no such key
+ */
+bool CellStoreScannerV1::seek_row(const char *row, bool inclusive) {
+  uint32_t lo = 0, hi = m_block.num_restarts, mid;
+  size_t row_len = strlen(row);
+  int cmp;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    cmp = strcmp(restart_row(mid), row);
+    if (cmp < 0 || (!inclusive && cmp == 0))
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo > 0)
+    m_block.ptr = m_block.base + read_i32(m_block.restarts + (4 * (lo - 1)));
+  m_key_len = 0;
+
+  while (true) {
+    if (!decode_entry()) {
+      if (m_readahead) {
+        if (!fetch_next_block_readahead())
+          return false;
+      }
+      else if (!fetch_next_block())
+        return false;
+      continue;
+    }
+    cmp = compare_row(m_cur_key, row, row_len);
+    if (cmp > 0 || (inclusive && cmp == 0))
+      return true;
+  }
+}
+
+
+
+/**
+ * Sets up m_block for a freshly inflated (or checked out) block, locating
+ * the restart point array at the end of the block.
+ */
+bool CellStoreScannerV1::load_block(const uint8_t *base, uint32_t len) {
+  uint32_t num_restarts;
+
+  if (len < 4 || 4 + 4 * (size_t)(num_restarts = read_i32(base + len - 4)) > len) {
+    HT_ERRORF("Bad restart array in cell store '%s' block at offset %u",
+              m_cell_store_ptr->get_filename().c_str(), m_block.offset);
+    m_block.ptr = m_block.end = base;
+    return false;
+  }
+
+  m_block.num_restarts = num_restarts;
+  m_block.restarts = base + len - 4 - (4 * num_restarts);
+  m_block.ptr = base;
+  m_block.end = m_block.restarts;
+  m_key_len = 0;
+
+  m_check_for_range_end = m_block.offset >= m_end_check_offset;
+
+  return true;
+}
+
+
+
+/**
+ * Fetches the block referenced by m_ref, either from the readahead stream
+ * or from the block cache (reading and inflating it on a cache miss).
+ */
+bool CellStoreScannerV1::fetch_block() {
+  DynamicBuffer expand_buf(0);
+  uint32_t len;
+
+  m_block.offset = m_ref.offset;
+  m_block.zlength = m_ref.zlength;
+
+  if (m_readahead) {
+    uint32_t nread;
+
+    assert(m_block.offset == m_start_offset);
+
+    try {
+      DynamicBuffer buf(m_block.zlength);
+      /** Read compressed block **/
+      nread = m_cell_store_v1->m_filesys->read(m_fd, buf.ptr, m_block.zlength);
+      buf.ptr += m_block.zlength;
+
+      /**
+       * Use the cached copy if there is one, but don't promote it; a
+       * readahead scan touches each block once
+       */
+      if (Global::block_cache->checkout(m_file_id, m_block.offset,
+                                        (uint8_t **)&m_block.base, &len, false))
+        m_block.cached = true;
+      else {
+        /** inflate compressed block **/
+        BlockCompressionHeader header;
+
+        m_zcodec->inflate(buf, expand_buf, header);
+
+        if (!header.check_magic(CellStoreV1::DATA_BLOCK_MAGIC))
+          HT_THROW(Error::BLOCK_COMPRESSOR_BAD_MAGIC,
+                   "Error inflating cell store block - magic string mismatch");
+      }
+    }
+    catch (Exception &e) {
+      HT_ERROR_OUT <<"Error reading cell store ("
+                   << m_cell_store_ptr->get_filename() <<") block: "
+                   << e << HT_END;
+      return false;
+    }
+    // Errors should've been caught by checksum/decompression
+    HT_EXPECT(nread == m_block.zlength, Error::UNPOSSIBLE);
+    m_start_offset += nread;
+
+    if (!m_block.cached) {
+      /** take ownership of inflate buffer **/
+      size_t fill;
+      m_block.base = expand_buf.release(&fill);
+      len = fill;
+
+      /** Hand block to the cache at the cold end of the in queue **/
+      if (Global::block_cache->insert_and_checkout(m_file_id, m_block.offset,
+                                   (uint8_t *)m_block.base, len, false))
+        m_block.cached = true;
+    }
+  }
+  else if (Global::block_cache->checkout(m_file_id, m_block.offset,
+                                         (uint8_t **)&m_block.base, &len))
+    m_block.cached = true;
+  else {
+    try {
+      DynamicBuffer buf(m_block.zlength);
+      /** Read compressed block **/
+      m_cell_store_v1->m_filesys->pread(m_cell_store_v1->m_fd, buf.ptr,
+                                        m_block.zlength, m_block.offset);
+      buf.ptr += m_block.zlength;
+      /** inflate compressed block **/
+      BlockCompressionHeader header;
+
+      m_zcodec->inflate(buf, expand_buf, header);
+
+      if (!header.check_magic(CellStoreV1::DATA_BLOCK_MAGIC))
+        HT_THROW(Error::BLOCK_COMPRESSOR_BAD_MAGIC,
+                 "Error inflating cell store block - magic string mismatch");
+    }
+    catch (Exception &e) {
+      HT_ERROR_OUT <<"Error reading cell store ("
+                   << m_cell_store_ptr->get_filename() <<") block: "
+                   << e << HT_END;
+      return false;
+    }
+
+    /** take ownership of inflate buffer **/
+    size_t fill;
+    m_block.base = expand_buf.release(&fill);
+    len = fill;
+
+    /**
+     * Insert block into cache.  If another scanner inserted it first, use
+     * the cached copy.  A block too large to be cached stays with the
+     * scanner and is freed when it is done with it.
+     */
+    if (Global::block_cache->insert_and_checkout(m_file_id, m_block.offset,
+                                       (uint8_t *)m_block.base, len))
+      m_block.cached = true;
+    else {
+      uint8_t *block;
+      uint32_t block_len;
+
+      if (Global::block_cache->checkout(m_file_id, m_block.offset, &block,
+                                        &block_len)) {
+        delete [] m_block.base;
+        m_block.base = block;
+        len = block_len;
+        m_block.cached = true;
+      }
+    }
+  }
+
+  return load_block(m_block.base, len);
+}
+
+
+
+/**
+ * Releases the current block (back to the block cache) and fetches the
+ * next one, unless the current block is the last one in the scan range.
+ *
+ * @return true if next block successfully fetched, false if no next block
+ */
+bool CellStoreScannerV1::fetch_next_block() {
+  if (m_block.base != 0) {
+    if (m_block.cached)
+      Global::block_cache->checkin(m_file_id, m_block.offset);
+    else
+      delete [] m_block.base;
+    memset(&m_block, 0, sizeof(m_block));
+  }
+
+  if (!m_cell_store_v1->next_block(m_ref, m_zcodec) ||
+      m_ref.offset >= m_end_offset)
+    return false;
+
+  return fetch_block();
+}
+
+
+
+/**
+ * Frees the current block and reads the next one from the readahead
+ * stream, unless the current block is the last one in the scan range.
+ *
+ * @return true if next block successfully fetched, false if no next block
+ */
+bool CellStoreScannerV1::fetch_next_block_readahead() {
+  if (m_block.cached)
+    Global::block_cache->checkin(m_file_id, m_block.offset);
+  else
+    delete [] m_block.base;
+  memset(&m_block, 0, sizeof(m_block));
+
+  if (!m_cell_store_v1->next_block(m_ref, m_zcodec) ||
+      m_ref.offset >= m_end_offset)
+    return false;
+
+  return fetch_block();
+}
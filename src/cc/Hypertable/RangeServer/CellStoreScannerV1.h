@@ -0,0 +1,93 @@
+/** -*- c++ -*-
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef HYPERTABLE_CELLSTORESCANNERV1_H
+#define HYPERTABLE_CELLSTORESCANNERV1_H
+
+#include "CellStoreV1.h"
+#include "CellListScanner.h"
+
+namespace Hypertable {
+
+  class BlockCompressionCodec;
+  class CellStore;
+
+  /**
+   * Scanner for version 1 cell stores.  Keys are stored prefix compressed,
+   * so the current key is reconstructed into a scanner-owned buffer; the
+   * key returned by #get is only valid until the next call to #forward.
+   */
+  class CellStoreScannerV1 : public CellListScanner {
+  public:
+    CellStoreScannerV1(CellStorePtr &cellstore, ScanContextPtr &scan_ctx);
+    virtual ~CellStoreScannerV1();
+    virtual void forward();
+    virtual bool get(ByteString &key, ByteString &value);
+
+  private:
+
+    struct BlockInfo {
+      uint32_t offset;
+      uint32_t zlength;
+      const uint8_t *base;
+      const uint8_t *ptr;
+      const uint8_t *end;
+      const uint8_t *restarts;
+      uint32_t num_restarts;
+      bool cached;
+    };
+
+    bool fetch_next_block();
+    bool fetch_next_block_readahead();
+    bool fetch_block();
+    bool load_block(const uint8_t *base, uint32_t len);
+    bool decode_entry();
+    bool seek_row(const char *row, bool inclusive);
+    const char *restart_row(uint32_t i);
+
+    CellStorePtr            m_cell_store_ptr;
+    CellStoreV1            *m_cell_store_v1;
+    CellStoreV1::BlockRef   m_ref;
+    bool                    m_eos;
+
+    BlockInfo             m_block;
+    uint8_t              *m_key_buf;
+    size_t                m_key_buf_size;
+    size_t                m_key_len;
+    ByteString            m_cur_key;
+    ByteString            m_cur_value;
+    BlockCompressionCodec *m_zcodec;
+    bool                  m_check_for_range_end;
+    bool                  m_end_inclusive;
+    int                   m_file_id;
+    std::string           m_start_row;
+    std::string           m_end_row;
+    bool                  m_readahead;
+    int32_t               m_fd;
+    uint32_t              m_start_offset;
+    uint32_t              m_end_offset;
+    uint32_t              m_end_check_offset;
+    uint32_t              m_returned;
+  };
+
+}
+
+#endif // HYPERTABLE_CELLSTORESCANNERV1_H
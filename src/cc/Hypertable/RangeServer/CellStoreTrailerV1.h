@@ -0,0 +1,64 @@
+/** -*- c++ -*-
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef HYPERTABLE_CELLSTORETRAILERV1_H
+#define HYPERTABLE_CELLSTORETRAILERV1_H
+
+#include "CellStoreTrailer.h"
+#include "Timestamp.h"
+
+namespace Hypertable {
+
+  /**
+   * Trailer for version 1 cell stores.  Like the version 0 trailer, the
+   * last two bytes hold the version number so that the version of a
+   * cell store can be determined before its trailer size is known.
+   */
+  class CellStoreTrailerV1 : public CellStoreTrailer {
+  public:
+    CellStoreTrailerV1();
+    virtual ~CellStoreTrailerV1() { return; }
+    virtual void clear();
+    virtual size_t size() { return 56; }
+    virtual void serialize(uint8_t *buf);
+    virtual void deserialize(const uint8_t *buf);
+    virtual void display(std::ostream &os);
+
+    uint32_t  leaf_index_offset;
+    uint32_t  root_index_offset;
+    uint32_t  filter_offset;
+    uint32_t  index_entries;
+    uint32_t  leaf_index_entries;
+    uint32_t  total_entries;
+    uint32_t  blocksize;
+    uint32_t  restart_interval;
+    Timestamp timestamp;
+    union {
+      float compression_ratio;
+      uint32_t compression_ratio_i32;
+    };
+    uint16_t  compression_type;
+    uint16_t  version;
+  };
+
+}
+
+#endif // HYPERTABLE_CELLSTORETRAILERV1_H
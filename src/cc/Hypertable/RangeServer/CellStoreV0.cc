@@ -83,10 +83,13 @@ void CellStoreV0::get_timestamp(Timestamp &timestamp) {
 }
 
 
-const char *CellStoreV0::get_split_row() {
-  if (m_split_row != "")
-    return m_split_row.c_str();
-  return 0;
+/**
+ * The whole block index is held in memory, so every block provides a
+ * sample (the row of its last key).
+ */
+void CellStoreV0::get_index_rows(std::vector<String> &rows) {
+  for (IndexMap::const_iterator iter = m_index.begin(); iter != m_index.end(); ++iter)
+    rows.push_back((*iter).first.str());
 }
 
 
@@ -96,7 +99,8 @@ CellListScanner *CellStoreV0::create_scanner(ScanContextPtr &scan_ctx) {
 }
 
 
-int CellStoreV0::create(const char *fname, uint32_t blocksize, const std::string &compressor) {
+int CellStoreV0::create(const char *fname, uint32_t blocksize, const std::string &compressor,
+                        const std::string &bloom_filter) {
   m_buffer.reserve(blocksize*4);
 
   m_fd = -1;
@@ -128,6 +132,14 @@ int CellStoreV0::create(const char *fname, uint32_t blocksize, const std::string
       (BlockCompressionCodec::Type)m_trailer.compression_type,
       m_compressor_args);
 
+  if (!Schema::parse_bloom_filter_spec(bloom_filter, m_bloom_filter_mode,
+                                       m_bloom_filter_false_positive)) {
+    HT_ERRORF("Invalid bloom filter specification '%s' for cellstore '%s'",
+              bloom_filter.c_str(), fname);
+    return Error::BAD_SCHEMA;
+  }
+  m_bloom_filter_hashes.clear();
+
   try { m_fd = m_filesys->create(m_filename, true, -1, -1, -1); }
   catch (Exception &e) {
     HT_ERRORF("Error creating cellstore: %s", e.what());
@@ -185,6 +197,9 @@ int CellStoreV0::add(const ByteString key, const ByteString value, uint64_t real
   m_last_key.ptr = m_buffer.add_unchecked(key.ptr, key_len);
   m_buffer.add_unchecked(value.ptr, value_len);
 
+  if (m_bloom_filter_mode != Schema::BLOOM_FILTER_DISABLED)
+    add_bloom_filter_entry(key);
+
   m_trailer.total_entries++;
 
   return 0;
@@ -299,9 +314,16 @@ int CellStoreV0::finalize(Timestamp &timestamp) {
   // deallocate fix index data
   delete [] m_fix_index_buffer.release();
 
-  // write filter_offset (empty for now)
+  // write filter_offset and bloom filter (if any)
   m_trailer.filter_offset = m_offset + zbuf.fill();
 
+  if (m_bloom_filter_mode != Schema::BLOOM_FILTER_DISABLED) {
+    create_bloom_filter();
+    zbuf.ensure(1 + m_bloom_filter->encoded_length() + m_trailer.size());
+    *zbuf.ptr++ = (uint8_t)m_bloom_filter_mode;
+    m_bloom_filter->encode(&zbuf.ptr);
+  }
+
   //
   m_trailer.serialize(zbuf.ptr);
   zbuf.ptr += m_trailer.size();
@@ -455,10 +477,16 @@ int CellStoreV0::load_index() {
   uint32_t len;
   BlockCompressionHeader header;
   ByteString key;
+  uint32_t filter_end = (uint32_t)(m_file_length - m_trailer.size());
+  uint32_t filter_offset = m_trailer.filter_offset;
 
   m_compressor = create_block_compression_codec();
 
-  amount = (m_file_length-m_trailer.size()) - m_trailer.fix_index_offset;
+  // stores written before bloom filters have an empty filter section
+  if (filter_offset < m_trailer.var_index_offset || filter_offset > filter_end)
+    filter_offset = filter_end;
+
+  amount = filter_end - m_trailer.fix_index_offset;
 
   try {
     DynamicBuffer buf(amount);
@@ -478,7 +506,7 @@ int CellStoreV0::load_index() {
 
     /** inflate variable index **/
     DynamicBuffer vbuf(0, false);
-    amount = (m_file_length-m_trailer.size()) - m_trailer.var_index_offset;
+    amount = filter_offset - m_trailer.var_index_offset;
     vbuf.base = buf.ptr;
     vbuf.ptr = buf.ptr + amount;
 
@@ -486,6 +514,11 @@ int CellStoreV0::load_index() {
 
     if (!header.check_magic(INDEX_VARIABLE_BLOCK_MAGIC))
       HT_THROW(Error::BLOCK_COMPRESSOR_BAD_MAGIC, "");
+
+    /** load bloom filter **/
+    if (filter_offset < filter_end)
+      load_bloom_filter(buf.base + (filter_offset - m_trailer.fix_index_offset),
+                        filter_end - filter_offset);
   }
   catch (Exception &e) {
     HT_ERROR_OUT <<"Error reading trailer for cellstore '"<< m_filename
@@ -590,11 +623,3 @@ void CellStoreV0::display_block_info() {
 
 
 
-void CellStoreV0::record_split_row(const ByteString key) {
-  const uint8_t *ptr;
-  key.decode_length(&ptr);
-  std::string split_row = (const char *)ptr;
-  if (split_row > m_start_row && split_row < m_end_row)
-    m_split_row = split_row;
-  //cout << "record_split_row = " << m_split_row << endl;
-}
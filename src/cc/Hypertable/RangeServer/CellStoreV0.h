@@ -31,6 +31,7 @@
 
 #include "Hypertable/Lib/BlockCompressionCodec.h"
 #include "Hypertable/Lib/Filesystem.h"
+#include "Hypertable/Lib/Schema.h"
 
 #include "CellStore.h"
 #include "CellStoreTrailerV0.h"
@@ -54,7 +55,8 @@ namespace Hypertable {
     CellStoreV0(Filesystem *filesys);
     virtual ~CellStoreV0();
 
-    virtual int create(const char *fname, uint32_t blocksize, const std::string &compressor);
+    virtual int create(const char *fname, uint32_t blocksize, const std::string &compressor,
+                       const std::string &bloom_filter);
     virtual int add(const ByteString key, const ByteString value, uint64_t real_timestamp);
     virtual int finalize(Timestamp &timestamp);
     virtual int open(const char *fname, const char *start_row, const char *end_row);
@@ -63,7 +65,7 @@ namespace Hypertable {
     virtual void get_timestamp(Timestamp &timestamp);
     virtual uint64_t disk_usage() { return m_disk_usage; }
     virtual float compression_ratio() { return m_trailer.compression_ratio; }
-    virtual const char *get_split_row();
+    virtual void get_index_rows(std::vector<String> &rows);
     virtual std::string &get_filename() { return m_filename; }
     virtual CellListScanner *create_scanner(ScanContextPtr &scan_ctx);
 
@@ -72,7 +74,7 @@ namespace Hypertable {
     /**
      * Displays block map information to stdout
      */
-    void display_block_info();
+    virtual void display_block_info();
 
     friend class CellStoreScannerV0;
 
@@ -81,7 +83,6 @@ namespace Hypertable {
   protected:
 
     void add_index_entry(const ByteString key, uint32_t offset);
-    void record_split_row(const ByteString key);
 
     static const char DATA_BLOCK_MAGIC[10];
     static const char INDEX_FIXED_BLOCK_MAGIC[10];
@@ -104,7 +105,6 @@ namespace Hypertable {
     ByteString             m_last_key;
     uint64_t               m_file_length;
     uint32_t               m_disk_usage;
-    std::string            m_split_row;
     int                    m_file_id;
     float                  m_uncompressed_data;
     float                  m_compressed_data;
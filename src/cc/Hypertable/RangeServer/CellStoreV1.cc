@@ -0,0 +1,1152 @@
+/** -*- c++ -*-
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "Common/Compat.h"
+#include <algorithm>
+#include <cassert>
+
+#include "Common/Error.h"
+#include "Common/Logger.h"
+#include "Common/System.h"
+
+#include "AsyncComm/Protocol.h"
+
+#include "Hypertable/Lib/BlockCompressionHeader.h"
+#include "Hypertable/Lib/CompressorFactory.h"
+#include "Hypertable/Lib/Key.h"
+
+#include "CellStoreScannerV1.h"
+#include "CellStoreV1.h"
+#include "FileBlockCache.h"
+#include "Global.h"
+
+using namespace std;
+using namespace Hypertable;
+using namespace Serialization;
+
+const char CellStoreV1::DATA_BLOCK_MAGIC[10]       = { 'D','a','t','a','V','1','-','-','-','-' };
+const char CellStoreV1::INDEX_LEAF_BLOCK_MAGIC[10] = { 'I','d','x','L','e','a','f','-','-','-' };
+const char CellStoreV1::INDEX_ROOT_BLOCK_MAGIC[10] = { 'I','d','x','R','o','o','t','-','-','-' };
+
+namespace {
+  const uint32_t MAX_APPENDS_OUTSTANDING = 3;
+  const uint32_t MAX_BLOCKS_PENDING_PER_THREAD = 2;
+
+  inline uint32_t read_i32(const uint8_t *ptr) {
+    size_t remaining = 4;
+    return decode_i32(&ptr, &remaining);
+  }
+}
+
+
+/**
+ * Compression threads shared by all CellStores being written.  Each entry
+ * of the queue stands for one pending block of the CellStore; the threads
+ * run for the life of the process.
+ */
+class CellStoreV1::CompressionPool {
+public:
+  CompressionPool(size_t threads) : m_size(threads) {
+    for (size_t i=0; i<threads; i++)
+      m_threads.create_thread(Worker(this));
+  }
+
+  void enqueue(CellStoreV1 *cellstore) {
+    boost::mutex::scoped_lock lock(m_mutex);
+    m_queue.push_back(cellstore);
+    m_cond.notify_one();
+  }
+
+  size_t size() { return m_size; }
+
+private:
+  class Worker {
+  public:
+    Worker(CompressionPool *pool) : m_pool(pool) { }
+    void operator()() { m_pool->run(); }
+  private:
+    CompressionPool *m_pool;
+  };
+
+  void run() {
+    CellStoreV1 *cellstore;
+
+    while (true) {
+      {
+        boost::mutex::scoped_lock lock(m_mutex);
+        while (m_queue.empty())
+          m_cond.wait(lock);
+        cellstore = m_queue.front();
+        m_queue.pop_front();
+      }
+      cellstore->compress_block();
+    }
+  }
+
+  boost::mutex              m_mutex;
+  boost::condition          m_cond;
+  std::deque<CellStoreV1 *> m_queue;
+  boost::thread_group       m_threads;
+  size_t                    m_size;
+};
+
+CellStoreV1::CompressionPool *CellStoreV1::ms_compression_pool = 0;
+boost::mutex CellStoreV1::ms_compression_pool_mutex;
+
+
+void CellStoreV1::LeafPage::load(const uint8_t *base, uint32_t len) {
+  if (len < 4)
+    HT_THROW(Error::BLOCK_COMPRESSOR_TRUNCATED, "Truncated leaf index page");
+  m_base = base;
+  m_count = read_i32(base + len - 4);
+  if (4 + 4 * (size_t)m_count > len)
+    HT_THROW(Error::BLOCK_COMPRESSOR_TRUNCATED, "Bad leaf index page entry count");
+  m_offsets = base + len - 4 - (4 * m_count);
+}
+
+
+ByteString CellStoreV1::LeafPage::key(uint32_t i) const {
+  return ByteString(m_base + read_i32(m_offsets + (4 * i)));
+}
+
+
+void CellStoreV1::LeafPage::get_block(uint32_t i, uint32_t *offsetp, uint32_t *zlengthp) const {
+  ByteString key(m_base + read_i32(m_offsets + (4 * i)));
+  const uint8_t *ptr = key.ptr + key.length();
+  *offsetp = read_i32(ptr);
+  *zlengthp = read_i32(ptr + 4);
+}
+
+
+
+CellStoreV1::CellStoreV1(Filesystem *filesys) : m_filesys(filesys), m_filename(), m_fd(-1),
+  m_root_buffer(0), m_compressor(0), m_buffer(0), m_block_entries(0), m_last_key(0),
+  m_leaf_buffer(0), m_leaf_block_offset(0), m_leaf_pages(0),
+  m_outstanding_appends(0), m_offset(0), m_file_length(0), m_disk_usage(0), m_file_id(0), m_uncompressed_blocksize(0),
+  m_next_to_compress(0), m_compress_jobs(0), m_compress_thread_count(0) {
+  m_file_id = FileBlockCache::get_next_file_id();
+  assert(sizeof(float) == 4);
+}
+
+
+
+CellStoreV1::~CellStoreV1() {
+  try {
+    stop_compression_pipeline();
+    delete m_compressor;
+
+    if (m_fd != -1)
+      m_filesys->close(m_fd);
+  }
+  catch (Exception &e) {
+    HT_ERROR_OUT << "Error closing DFS client: "<< e << HT_END;
+  }
+}
+
+
+BlockCompressionCodec *CellStoreV1::create_block_compression_codec() {
+  return CompressorFactory::create_block_codec(
+      (BlockCompressionCodec::Type)m_trailer.compression_type);
+}
+
+
+
+void CellStoreV1::get_timestamp(Timestamp &timestamp) {
+  timestamp = m_trailer.timestamp;
+}
+
+
+/**
+ * The last key of each leaf index page provides one sample per leaf page.
+ */
+void CellStoreV1::get_index_rows(std::vector<String> &rows) {
+  for (size_t i=0; i<m_root_index.size(); i++)
+    rows.push_back(m_root_index[i].last_key.str());
+}
+
+
+CellListScanner *CellStoreV1::create_scanner(ScanContextPtr &scan_ctx) {
+  CellStorePtr cellstore(this);
+  return new CellStoreScannerV1(cellstore, scan_ctx);
+}
+
+
+int CellStoreV1::create(const char *fname, uint32_t blocksize, const std::string &compressor,
+                        const std::string &bloom_filter) {
+  m_buffer.reserve(blocksize*4);
+
+  m_fd = -1;
+  m_offset = 0;
+  m_block_entries = 0;
+  m_restarts.clear();
+  m_last_key.clear();
+  m_leaf_buffer.reserve(blocksize);
+  m_leaf_entries.clear();
+  m_leaf_pages.clear();
+  m_root_buffer.clear();
+  m_root_index.clear();
+
+  m_uncompressed_data = 0.0;
+  m_compressed_data = 0.0;
+
+  m_trailer.clear();
+  m_trailer.blocksize = blocksize;
+  m_trailer.restart_interval = RESTART_INTERVAL;
+  m_uncompressed_blocksize = blocksize;
+
+  m_filename = fname;
+
+  m_start_row = "";
+  m_end_row = Key::END_ROW_MARKER;
+
+  if (compressor.empty())
+    m_trailer.compression_type = CompressorFactory::parse_block_codec_spec(
+        "lzo", m_compressor_args);
+  else
+    m_trailer.compression_type = CompressorFactory::parse_block_codec_spec(
+        compressor, m_compressor_args);
+
+  m_compressor = CompressorFactory::create_block_codec(
+      (BlockCompressionCodec::Type)m_trailer.compression_type,
+      m_compressor_args);
+
+  if (!Schema::parse_bloom_filter_spec(bloom_filter, m_bloom_filter_mode,
+                                       m_bloom_filter_false_positive)) {
+    HT_ERRORF("Invalid bloom filter specification '%s' for cellstore '%s'",
+              bloom_filter.c_str(), fname);
+    return Error::BAD_SCHEMA;
+  }
+  m_bloom_filter_hashes.clear();
+
+  try { m_fd = m_filesys->create(m_filename, true, -1, -1, -1); }
+  catch (Exception &e) {
+    HT_ERRORF("Error creating cellstore: %s", e.what());
+    return e.code();
+  }
+
+  if (m_trailer.compression_type != BlockCompressionCodec::NONE)
+    start_compression_pipeline();
+
+  return Error::OK;
+}
+
+
+/**
+ * Appends a key/value pair to the current block.  Each entry is encoded
+ * as the length of the prefix shared with the previous key, the length of
+ * the remaining key suffix, the suffix bytes and then the value (as a
+ * ByteString).  Every RESTART_INTERVAL entries the shared length is forced
+ * to zero and the entry offset is recorded as a restart point.
+ */
+int CellStoreV1::add(const ByteString key, const ByteString value, uint64_t real_timestamp) {
+  const uint8_t *key_data;
+  size_t key_len;
+  size_t value_len;
+  size_t shared = 0;
+
+  (void)real_timestamp;
+
+  if (m_buffer.fill() > m_uncompressed_blocksize) {
+    if (write_block() != Error::OK)
+      return -1;
+  }
+
+  key_len = key.decode_length(&key_data);
+  value_len = value.length();
+
+  if ((m_block_entries % m_trailer.restart_interval) == 0)
+    m_restarts.push_back(m_buffer.fill());
+  else {
+    size_t max_shared = std::min(key_len, (size_t)m_last_key.fill());
+    while (shared < max_shared && m_last_key.base[shared] == key_data[shared])
+      shared++;
+  }
+
+  m_buffer.ensure(10 + (key_len - shared) + value_len);
+  encode_vi32(&m_buffer.ptr, shared);
+  encode_vi32(&m_buffer.ptr, key_len - shared);
+  m_buffer.add_unchecked(key_data + shared, key_len - shared);
+  m_buffer.add_unchecked(value.ptr, value_len);
+
+  m_last_key.clear();
+  m_last_key.add(key_data, key_len);
+  m_block_entries++;
+
+  if (m_bloom_filter_mode != Schema::BLOOM_FILTER_DISABLED)
+    add_bloom_filter_entry(key);
+
+  m_trailer.total_entries++;
+
+  return 0;
+}
+
+
+
+/**
+ * Appends the restart point array to the current block and either hands
+ * it to the compression pool or, if there is none, compresses and appends
+ * it inline.
+ */
+int CellStoreV1::write_block() {
+  m_buffer.ensure(4 * (m_restarts.size() + 1));
+  for (size_t i=0; i<m_restarts.size(); i++)
+    encode_i32(&m_buffer.ptr, m_restarts[i]);
+  encode_i32(&m_buffer.ptr, m_restarts.size());
+
+  m_uncompressed_data += (float)m_buffer.fill();
+  m_restarts.clear();
+  m_block_entries = 0;
+
+  if (m_compress_thread_count == 0) {
+    DynamicBuffer zbuf(0);
+    BlockCompressionHeader header(DATA_BLOCK_MAGIC);
+    m_compressor->deflate(m_buffer, zbuf, header);
+    m_buffer.clear();
+    return append_block(zbuf, m_last_key.base, m_last_key.fill());
+  }
+
+  PendingBlock *block = new PendingBlock();
+
+  block->data.base = m_buffer.base;
+  block->data.ptr = m_buffer.ptr;
+  block->data.size = m_buffer.size;
+  m_buffer.release();
+  m_buffer.reserve(m_trailer.blocksize*4);
+  block->last_key.set(m_last_key.base, m_last_key.fill());
+
+  {
+    boost::mutex::scoped_lock lock(m_compress_mutex);
+    m_pending_blocks.push_back(block);
+    m_compress_jobs++;
+  }
+  ms_compression_pool->enqueue(this);
+
+  return flush_compressed_blocks(false);
+}
+
+
+
+/**
+ * Appends a compressed data block to the file and adds it to the index.
+ */
+int CellStoreV1::append_block(DynamicBuffer &zbuf, const uint8_t *last_key, size_t last_key_len) {
+  EventPtr event_ptr;
+
+  m_compressed_data += (float)zbuf.fill();
+
+  uint64_t llval = ((uint64_t)m_trailer.blocksize * (uint64_t)m_uncompressed_data) / (uint64_t)m_compressed_data;
+  m_uncompressed_blocksize = (uint32_t)llval;
+
+  if (m_outstanding_appends >= MAX_APPENDS_OUTSTANDING) {
+    if (!m_sync_handler.wait_for_reply(event_ptr)) {
+      HT_ERRORF("Problem writing to DFS file '%s' : %s", m_filename.c_str(), Hypertable::Protocol::string_format_message(event_ptr).c_str());
+      return -1;
+    }
+    m_outstanding_appends--;
+  }
+
+  uint32_t zlen = zbuf.fill();
+  StaticBuffer send_buf(zbuf);
+
+  if (Global::maintenance_queue)
+    Global::maintenance_queue->throttle_write(zlen);
+
+  try { m_filesys->append(m_fd, send_buf, 0, &m_sync_handler); }
+  catch (Exception &e) {
+    HT_ERRORF("Problem writing to DFS file '%s' : %s",
+              m_filename.c_str(), e.what());
+    return -1;
+  }
+  m_outstanding_appends++;
+
+  add_index_entry(last_key, last_key_len, m_offset, zlen);
+
+  m_offset += zlen;
+
+  return Error::OK;
+}
+
+
+
+/**
+ * Appends the compressed blocks at the head of the pending queue.  Unless
+ * wait_all is set, only waits for a block to finish compressing if the
+ * queue has grown past MAX_BLOCKS_PENDING_PER_THREAD blocks per thread,
+ * which bounds the memory held by the pipeline.
+ */
+int CellStoreV1::flush_compressed_blocks(bool wait_all) {
+  size_t max_pending = wait_all ? 0 : MAX_BLOCKS_PENDING_PER_THREAD * m_compress_thread_count;
+  PendingBlock *block;
+  int error;
+
+  while (true) {
+    {
+      boost::mutex::scoped_lock lock(m_compress_mutex);
+
+      if (m_pending_blocks.empty())
+        return Error::OK;
+
+      block = m_pending_blocks.front();
+
+      if (!block->compressed) {
+        if (m_pending_blocks.size() <= max_pending)
+          return Error::OK;
+        while (!block->compressed)
+          m_compressed_cond.wait(lock);
+      }
+
+      m_pending_blocks.pop_front();
+      m_next_to_compress--;
+    }
+
+    if (block->failed)
+      error = -1;
+    else
+      error = append_block(block->zdata, block->last_key.base, block->last_key.fill());
+
+    delete block;
+
+    if (error != Error::OK)
+      return error;
+  }
+}
+
+
+
+/**
+ * Run by a pool thread for each block handed to the pool.  Deflates the
+ * next pending block in fill order, with a codec that no other thread
+ * is using at the time.  Codecs are kept for reuse until the pipeline
+ * stops.
+ */
+void CellStoreV1::compress_block() {
+  BlockCompressionCodec *codec = 0;
+  PendingBlock *block;
+  bool failed = false;
+
+  {
+    boost::mutex::scoped_lock lock(m_compress_mutex);
+    block = m_pending_blocks[m_next_to_compress++];
+    if (!m_compress_codecs.empty()) {
+      codec = m_compress_codecs.back();
+      m_compress_codecs.pop_back();
+    }
+  }
+
+  try {
+    if (codec == 0)
+      codec = CompressorFactory::create_block_codec(
+          (BlockCompressionCodec::Type)m_trailer.compression_type,
+          m_compressor_args);
+    BlockCompressionHeader header(DATA_BLOCK_MAGIC);
+    codec->deflate(block->data, block->zdata, header);
+  }
+  catch (Exception &e) {
+    HT_ERROR_OUT << "Problem compressing block for '" << m_filename
+                 << "': " << e << HT_END;
+    failed = true;
+  }
+  block->data.free();
+
+  {
+    boost::mutex::scoped_lock lock(m_compress_mutex);
+    if (codec)
+      m_compress_codecs.push_back(codec);
+    block->failed = failed;
+    block->compressed = true;
+    m_compress_jobs--;
+    m_compressed_cond.notify_all();
+  }
+}
+
+
+
+/**
+ * Sets up compression through the shared pool, which is created with
+ * Global::cell_store_compression_threads threads by the first CellStore
+ * that needs it.  With no threads configured, blocks are compressed
+ * inline.
+ */
+void CellStoreV1::start_compression_pipeline() {
+
+  if (Global::cell_store_compression_threads <= 0)
+    return;
+
+  {
+    boost::mutex::scoped_lock lock(ms_compression_pool_mutex);
+    if (ms_compression_pool == 0)
+      ms_compression_pool =
+          new CompressionPool(Global::cell_store_compression_threads);
+  }
+
+  m_compress_thread_count = ms_compression_pool->size();
+  m_next_to_compress = 0;
+}
+
+
+
+/**
+ * Waits for the pool to finish the blocks handed to it, then drops the
+ * blocks that were not appended and the codecs
+ */
+void CellStoreV1::stop_compression_pipeline() {
+
+  if (m_compress_thread_count == 0)
+    return;
+
+  {
+    boost::mutex::scoped_lock lock(m_compress_mutex);
+    while (m_compress_jobs > 0)
+      m_compressed_cond.wait(lock);
+  }
+
+  m_compress_thread_count = 0;
+
+  while (!m_pending_blocks.empty()) {
+    delete m_pending_blocks.front();
+    m_pending_blocks.pop_front();
+  }
+  m_next_to_compress = 0;
+
+  for (size_t i=0; i<m_compress_codecs.size(); i++)
+    delete m_compress_codecs[i];
+  m_compress_codecs.clear();
+}
+
+
+
+int CellStoreV1::finalize(Timestamp &timestamp) {
+  int error = -1;
+  size_t zlen;
+  DynamicBuffer zbuf(0);
+  StaticBuffer send_buf;
+
+  if (m_buffer.fill() > 0 && write_block() != Error::OK)
+    goto abort;
+
+  if (flush_compressed_blocks(true) != Error::OK)
+    goto abort;
+
+  stop_compression_pipeline();
+
+  if (!m_leaf_entries.empty())
+    write_leaf_page();
+
+  /**
+   * Write leaf index pages
+   */
+  m_trailer.leaf_index_offset = m_offset;
+
+  if (m_leaf_pages.fill() > 0) {
+    zlen = m_leaf_pages.fill();
+    send_buf = m_leaf_pages;
+
+    try { m_filesys->append(m_fd, send_buf, 0, &m_sync_handler); }
+    catch (Exception &e) {
+      HT_ERROR_OUT << e << HT_END;
+      goto abort;
+    }
+    m_outstanding_appends++;
+    m_offset += zlen;
+  }
+
+  m_trailer.timestamp = timestamp;
+  m_trailer.compression_ratio = m_compressed_data / m_uncompressed_data;
+  m_trailer.version = 1;
+
+  /**
+   * Leaf page offsets in the root index were recorded relative to the
+   * start of the leaf index, now that it's known make them absolute
+   */
+  {
+    uint8_t *ptr = m_root_buffer.base;
+    for (size_t i=0; i<m_trailer.leaf_index_entries; i++) {
+      ptr += ByteString(ptr).length();
+      uint8_t *offset_ptr = ptr;
+      encode_i32(&offset_ptr, read_i32(ptr) + m_trailer.leaf_index_offset);
+      ptr += 12;
+    }
+  }
+
+  /**
+   * Write root index + filter + trailer
+   */
+  {
+    BlockCompressionHeader header(INDEX_ROOT_BLOCK_MAGIC);
+    m_trailer.root_index_offset = m_offset;
+    m_compressor->deflate(m_root_buffer, zbuf, header, m_trailer.size());
+  }
+
+  m_trailer.filter_offset = m_offset + zbuf.fill();
+
+  if (m_bloom_filter_mode != Schema::BLOOM_FILTER_DISABLED) {
+    create_bloom_filter();
+    zbuf.ensure(1 + m_bloom_filter->encoded_length() + m_trailer.size());
+    *zbuf.ptr++ = (uint8_t)m_bloom_filter_mode;
+    m_bloom_filter->encode(&zbuf.ptr);
+  }
+
+  m_trailer.serialize(zbuf.ptr);
+  zbuf.ptr += m_trailer.size();
+
+  zlen = zbuf.fill();
+  send_buf = zbuf;
+
+  try { m_filesys->append(m_fd, send_buf); }
+  catch (Exception &e) {
+    HT_ERROR_OUT << e << HT_END;
+    goto abort;
+  }
+  m_outstanding_appends++;
+  m_offset += zlen;
+
+  /** close file for writing **/
+  try { m_filesys->close(m_fd); }
+  catch (Exception &e) {
+    HT_ERROR_OUT << e << HT_END;
+    goto abort;
+  }
+
+  /** Set file length **/
+  m_file_length = m_offset;
+
+  /** Re-open file for reading **/
+  try { m_fd = m_filesys->open(m_filename); }
+  catch (Exception &e) {
+    HT_ERROR_OUT << "Error reopening cellstore: "<<  e << HT_END;
+    goto abort;
+  }
+
+  /** Set up in-memory root index **/
+  try {
+    load_root_index();
+    compute_disk_usage(m_compressor);
+  }
+  catch (Exception &e) {
+    HT_ERROR_OUT << "Error loading index for cellstore '" << m_filename
+                 << "': " << e << HT_END;
+    goto abort;
+  }
+
+  m_disk_usage = (uint32_t)m_file_length;
+  error = 0;
+
+ abort:
+  stop_compression_pipeline();
+  delete m_compressor;
+  m_compressor = 0;
+  delete [] m_leaf_buffer.release();
+  delete [] m_leaf_pages.release();
+  delete [] m_buffer.release();
+
+  return error;
+}
+
+
+
+/**
+ * Adds an entry for a data block to the current leaf index page, writing
+ * out the page once it reaches the block size.
+ */
+void CellStoreV1::add_index_entry(const uint8_t *key, size_t key_len, uint32_t offset, uint32_t zlength) {
+
+  if (m_leaf_entries.empty())
+    m_leaf_block_offset = offset;
+
+  m_leaf_entries.push_back(m_leaf_buffer.fill());
+
+  m_leaf_buffer.ensure(5 + key_len + 8);
+  encode_vi32(&m_leaf_buffer.ptr, key_len);
+  m_leaf_buffer.add_unchecked(key, key_len);
+  encode_i32(&m_leaf_buffer.ptr, offset);
+  encode_i32(&m_leaf_buffer.ptr, zlength);
+
+  m_trailer.index_entries++;
+
+  if (m_leaf_buffer.fill() >= m_trailer.blocksize)
+    write_leaf_page();
+}
+
+
+
+/**
+ * Compresses the current leaf index page into the pending leaf page
+ * buffer and adds a root index entry for it.  Root entries are the last
+ * key of the page, the page offset (relative to the start of the leaf
+ * index until finalize), its compressed length, and the offset of the
+ * first data block that it covers.
+ */
+void CellStoreV1::write_leaf_page() {
+  DynamicBuffer zbuf(0);
+  BlockCompressionHeader header(INDEX_LEAF_BLOCK_MAGIC);
+  ByteString last_key(m_leaf_buffer.base + m_leaf_entries.back());
+  size_t last_key_len = last_key.length();
+
+  m_root_buffer.ensure(last_key_len + 12);
+  m_root_buffer.add_unchecked(last_key.ptr, last_key_len);
+  encode_i32(&m_root_buffer.ptr, m_leaf_pages.fill());
+
+  m_leaf_buffer.ensure(4 * (m_leaf_entries.size() + 1));
+  for (size_t i=0; i<m_leaf_entries.size(); i++)
+    encode_i32(&m_leaf_buffer.ptr, m_leaf_entries[i]);
+  encode_i32(&m_leaf_buffer.ptr, m_leaf_entries.size());
+
+  m_compressor->deflate(m_leaf_buffer, zbuf, header);
+
+  encode_i32(&m_root_buffer.ptr, zbuf.fill());
+  encode_i32(&m_root_buffer.ptr, m_leaf_block_offset);
+
+  m_leaf_pages.add(zbuf.base, zbuf.fill());
+
+  m_leaf_buffer.clear();
+  m_leaf_entries.clear();
+  m_trailer.leaf_index_entries++;
+}
+
+
+
+/**
+ * Builds m_root_index from the uncompressed root index in m_root_buffer
+ */
+void CellStoreV1::load_root_index() {
+  const uint8_t *ptr = m_root_buffer.base;
+  const uint8_t *end = m_root_buffer.ptr;
+  IndexRootEntry entry;
+
+  m_root_index.clear();
+  m_root_index.reserve(m_trailer.leaf_index_entries);
+
+  for (size_t i=0; i<m_trailer.leaf_index_entries; i++) {
+    entry.last_key.ptr = ptr;
+    ptr += entry.last_key.length();
+    if (ptr + 12 > end)
+      HT_THROW(Error::BLOCK_COMPRESSOR_TRUNCATED, "Truncated root index");
+    entry.leaf_offset = read_i32(ptr);
+    entry.leaf_zlength = read_i32(ptr + 4);
+    entry.block_offset = read_i32(ptr + 8);
+    ptr += 12;
+    m_root_index.push_back(entry);
+  }
+}
+
+
+
+/**
+ * Checks out the given leaf index page from the block cache, reading and
+ * inflating it first if it isn't already cached.  The page must be
+ * returned with #checkin_leaf.
+ */
+bool CellStoreV1::checkout_leaf(uint32_t leaf, LeafPage &page, BlockCompressionCodec *codec) {
+  const IndexRootEntry &entry = m_root_index[leaf];
+  uint8_t *base;
+  uint32_t len;
+
+  page.cached = false;
+
+  if (Global::block_cache->checkout(m_file_id, entry.leaf_offset, &base, &len))
+    page.cached = true;
+  else {
+    DynamicBuffer expand_buf(0);
+    try {
+      DynamicBuffer buf(entry.leaf_zlength);
+      m_filesys->pread(m_fd, buf.ptr, entry.leaf_zlength, entry.leaf_offset);
+      buf.ptr += entry.leaf_zlength;
+      BlockCompressionHeader header;
+      codec->inflate(buf, expand_buf, header);
+      if (!header.check_magic(INDEX_LEAF_BLOCK_MAGIC))
+        HT_THROW(Error::BLOCK_COMPRESSOR_BAD_MAGIC,
+                 "Error inflating leaf index page - magic string mismatch");
+    }
+    catch (Exception &e) {
+      HT_ERROR_OUT << "Error reading cell store (" << m_filename
+                   << ") leaf index page: " << e << HT_END;
+      return false;
+    }
+
+    size_t fill;
+    base = expand_buf.release(&fill);
+    len = fill;
+
+    /**
+     * Use the copy another reader cached first, if any.  A page too large
+     * to be cached is kept by the page and freed on checkin.
+     */
+    if (Global::block_cache->insert_and_checkout(m_file_id, entry.leaf_offset, base, len))
+      page.cached = true;
+    else {
+      uint8_t *block;
+      uint32_t block_len;
+
+      if (Global::block_cache->checkout(m_file_id, entry.leaf_offset, &block,
+                                        &block_len)) {
+        delete [] base;
+        base = block;
+        len = block_len;
+        page.cached = true;
+      }
+    }
+  }
+
+  page.block = base;
+
+  try { page.load(base, len); }
+  catch (Exception &e) {
+    HT_ERROR_OUT << "Bad leaf index page in cell store (" << m_filename
+                 << "): " << e << HT_END;
+    checkin_leaf(leaf, page);
+    return false;
+  }
+  return true;
+}
+
+
+void CellStoreV1::checkin_leaf(uint32_t leaf, LeafPage &page) {
+  if (page.cached)
+    Global::block_cache->checkin(m_file_id, m_root_index[leaf].leaf_offset);
+  else
+    delete [] page.block;
+  page.block = 0;
+}
+
+
+
+/**
+ * Locates the first block whose last key is greater than (upper == true)
+ * or not less than (upper == false) the target key.  This is the
+ * equivalent of upper_bound/lower_bound on the version 0 index map.
+ *
+ * @return true if such a block exists, false otherwise
+ */
+bool CellStoreV1::find_block(const ByteString target, bool upper, BlockRef &ref,
+                             BlockCompressionCodec *codec) {
+  LeafPage page;
+  uint32_t lo = 0, hi = m_root_index.size(), mid;
+
+  // binary search the root index
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (upper ? !(target < m_root_index[mid].last_key)
+              : m_root_index[mid].last_key < target)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo == m_root_index.size())
+    return false;
+
+  ref.leaf = lo;
+
+  if (!checkout_leaf(ref.leaf, page, codec))
+    return false;
+
+  // binary search the leaf page
+  lo = 0;
+  hi = page.size();
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (upper ? !(target < page.key(mid)) : page.key(mid) < target)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo == page.size()) {
+    // the root entry says this page has a match, so this is corruption
+    checkin_leaf(ref.leaf, page);
+    HT_ERRORF("Inconsistent block index in cell store '%s'", m_filename.c_str());
+    return false;
+  }
+
+  ref.entry = lo;
+  page.get_block(ref.entry, &ref.offset, &ref.zlength);
+
+  checkin_leaf(ref.leaf, page);
+  return true;
+}
+
+
+
+/**
+ * Advances the block reference to the next block in the file.
+ *
+ * @return true if there is a next block, false otherwise
+ */
+bool CellStoreV1::next_block(BlockRef &ref, BlockCompressionCodec *codec) {
+  LeafPage page;
+
+  if (!checkout_leaf(ref.leaf, page, codec))
+    return false;
+
+  if (ref.entry + 1 < page.size()) {
+    ref.entry++;
+    page.get_block(ref.entry, &ref.offset, &ref.zlength);
+    checkin_leaf(ref.leaf, page);
+    return true;
+  }
+
+  checkin_leaf(ref.leaf, page);
+
+  if (ref.leaf + 1 >= m_root_index.size())
+    return false;
+
+  if (!checkout_leaf(ref.leaf + 1, page, codec))
+    return false;
+
+  ref.leaf++;
+  ref.entry = 0;
+  page.get_block(ref.entry, &ref.offset, &ref.zlength);
+  checkin_leaf(ref.leaf, page);
+  return true;
+}
+
+
+
+/**
+ *
+ */
+int CellStoreV1::open(const char *fname, const char *start_row, const char *end_row) {
+  m_start_row = (start_row) ? start_row : "";
+  m_end_row = (end_row) ? end_row : Key::END_ROW_MARKER;
+
+  m_fd = -1;
+
+  m_filename = fname;
+
+  /** Get the file length **/
+  try { m_file_length = m_filesys->length(m_filename); }
+  catch (Exception &e) {
+    HT_ERROR_OUT << e << HT_END;
+    goto abort;
+  }
+
+  if (m_file_length < m_trailer.size()) {
+    HT_ERRORF("Bad length of CellStore file '%s' - %lld", m_filename.c_str(),
+              m_file_length);
+    goto abort;
+  }
+
+  /** Open the DFS file **/
+  try { m_fd =  m_filesys->open(m_filename); }
+  catch (Exception &e) {
+    HT_ERROR_OUT << e << HT_END;
+    goto abort;
+  }
+
+  /**
+   * Read and deserialize trailer
+   */
+  {
+    uint32_t len;
+    uint8_t *trailer_buf = new uint8_t [m_trailer.size()];
+
+    try {
+      len = m_filesys->pread(m_fd, trailer_buf, m_trailer.size(),
+                             m_file_length - m_trailer.size());
+    }
+    catch (Exception &e) {
+      HT_ERRORF("Problem reading trailer for CellStore '%s': %s",
+                m_filename.c_str(), e.what());
+      delete [] trailer_buf;
+      goto abort;
+    }
+
+    if (len != m_trailer.size()) {
+      HT_ERRORF("Problem reading trailer for CellStore file '%s' - only read "
+                "%d of %d bytes", m_filename.c_str(), len, m_trailer.size());
+      delete [] trailer_buf;
+      goto abort;
+    }
+
+    m_trailer.deserialize(trailer_buf);
+    delete [] trailer_buf;
+  }
+
+  /** Sanity check trailer **/
+  if (m_trailer.version != 1) {
+    HT_ERRORF("Unsupported CellStore version (%d) for file '%s'",
+              m_trailer.version, fname);
+    goto abort;
+  }
+  if (!(m_trailer.leaf_index_offset <= m_trailer.root_index_offset &&
+        m_trailer.root_index_offset < m_trailer.filter_offset &&
+        m_trailer.filter_offset <= m_file_length - m_trailer.size()) ||
+      m_trailer.restart_interval == 0) {
+    HT_ERRORF("Bad index offsets in CellStore trailer leaf=%u, root=%u, "
+              "filter=%u, length=%lld, file='%s'", m_trailer.leaf_index_offset,
+              m_trailer.root_index_offset, m_trailer.filter_offset,
+              m_file_length, fname);
+    goto abort;
+  }
+
+  return Error::OK;
+
+ abort:
+  return Error::LOCAL_IO_ERROR;
+}
+
+
+/**
+ * Reads the root index and bloom filter.  Leaf index pages are not read
+ * here, they are brought into the block cache as they are needed.
+ */
+int CellStoreV1::load_index() {
+  int error = -1;
+  uint32_t amount;
+  uint32_t len;
+  BlockCompressionHeader header;
+  uint32_t filter_end = (uint32_t)(m_file_length - m_trailer.size());
+
+  m_compressor = create_block_compression_codec();
+
+  amount = filter_end - m_trailer.root_index_offset;
+
+  try {
+    DynamicBuffer buf(amount);
+    /** Read root index and filter **/
+    len = m_filesys->pread(m_fd, buf.ptr, amount, m_trailer.root_index_offset);
+
+    if (len != amount)
+      HT_THROWF(Error::DFSBROKER_IO_ERROR, "Error loading index for "
+                "CellStore '%s' : tried to read %d but only got %d",
+                m_filename.c_str(), amount, len);
+
+    /** inflate root index **/
+    buf.ptr += (m_trailer.filter_offset - m_trailer.root_index_offset);
+    m_compressor->inflate(buf, m_root_buffer, header);
+
+    if (!header.check_magic(INDEX_ROOT_BLOCK_MAGIC))
+      HT_THROW(Error::BLOCK_COMPRESSOR_BAD_MAGIC, "");
+
+    /** load bloom filter **/
+    if (m_trailer.filter_offset < filter_end)
+      load_bloom_filter(buf.base + (m_trailer.filter_offset - m_trailer.root_index_offset),
+                        filter_end - m_trailer.filter_offset);
+
+    load_root_index();
+
+    compute_disk_usage(m_compressor);
+  }
+  catch (Exception &e) {
+    HT_ERROR_OUT <<"Error reading index for cellstore '"<< m_filename
+                 <<"': "<<  e << HT_END;
+    goto abort;
+  }
+
+  error = 0;
+
+ abort:
+  delete m_compressor;
+  m_compressor = 0;
+  return error;
+}
+
+
+
+/**
+ * Computes the disk usage and split row for the (possibly restricted)
+ * view of this store.  When the view spans at least three leaf index
+ * pages the split row is taken from the root index, otherwise the leaf
+ * pages (at most two) are walked to find the middle block.
+ */
+void CellStoreV1::compute_disk_usage(BlockCompressionCodec *codec) {
+  uint32_t start = 0;
+  uint32_t end = m_trailer.leaf_index_offset;
+  size_t start_row_length = m_start_row.length() + 1;
+  size_t end_row_length = m_end_row.length() + 1;
+  DynamicBuffer dbuf(7 + std::max(start_row_length, end_row_length));
+  ByteString bs;
+  BlockRef start_ref, end_ref, ref;
+  bool got_end;
+
+  m_disk_usage = 0;
+
+  dbuf.clear();
+  append_as_byte_string(dbuf, m_start_row.c_str(), start_row_length);
+  bs.ptr = dbuf.base;
+  if (!find_block(bs, true, start_ref, codec))
+    return;
+  start = start_ref.offset;
+
+  dbuf.clear();
+  append_as_byte_string(dbuf, m_end_row.c_str(), end_row_length);
+  bs.ptr = dbuf.base;
+  if ((got_end = find_block(bs, false, end_ref, codec)))
+    end = end_ref.offset;
+
+  if (end > start)
+    m_disk_usage = end - start;
+
+  uint32_t end_leaf = got_end ? end_ref.leaf + 1 : m_root_index.size();
+
+  if (end_leaf - start_ref.leaf >= 3) {
+    record_split_row(m_root_index[start_ref.leaf + (end_leaf - start_ref.leaf)/2].last_key);
+    return;
+  }
+
+  // count blocks in the view, then walk to the middle one
+  size_t count = 0;
+  ref = start_ref;
+  do {
+    count++;
+  } while (ref.offset < end && next_block(ref, codec) && ref.offset < end);
+
+  ref = start_ref;
+  for (size_t i=0; i<count/2; i++) {
+    if (!next_block(ref, codec))
+      return;
+  }
+
+  LeafPage page;
+  if (checkout_leaf(ref.leaf, page, codec)) {
+    record_split_row(page.key(ref.entry));
+    checkin_leaf(ref.leaf, page);
+  }
+}
+
+
+/**
+ *
+ */
+void CellStoreV1::display_block_info() {
+  BlockCompressionCodec *codec = create_block_compression_codec();
+  LeafPage page;
+  uint32_t offset, zlength;
+  size_t i=0;
+
+  for (uint32_t leaf=0; leaf<m_root_index.size(); leaf++) {
+    if (!checkout_leaf(leaf, page, codec))
+      break;
+    cout << "leaf " << leaf << ": offset=" << m_root_index[leaf].leaf_offset
+         << " size=" << m_root_index[leaf].leaf_zlength << " entries="
+         << page.size() << endl;
+    for (uint32_t j=0; j<page.size(); j++, i++) {
+      page.get_block(j, &offset, &zlength);
+      cout << i << ": offset=" << offset << " size=" << zlength << " row="
+           << page.key(j).str() << endl;
+    }
+    checkin_leaf(leaf, page);
+  }
+  delete codec;
+}
+
+
+
@@ -0,0 +1,224 @@
+/** -*- c++ -*-
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef HYPERTABLE_CELLSTOREV1_H
+#define HYPERTABLE_CELLSTOREV1_H
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <boost/thread/condition.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "AsyncComm/DispatchHandlerSynchronizer.h"
+#include "Common/DynamicBuffer.h"
+
+#include "Hypertable/Lib/BlockCompressionCodec.h"
+#include "Hypertable/Lib/Filesystem.h"
+#include "Hypertable/Lib/Schema.h"
+
+#include "CellStore.h"
+#include "CellStoreTrailerV1.h"
+
+
+namespace Hypertable {
+
+  /**
+   * Version 1 cell store.  Differs from version 0 in two ways:
+   *
+   * 1. Keys within a data block are prefix compressed against the previous
+   *    key.  Every restart_interval entries the full key is stored (a
+   *    "restart point") and the offsets of the restart points are stored
+   *    at the end of the block, so a seek within a block is a binary search
+   *    over the restart points followed by a short linear scan.
+   *
+   * 2. The block index is two-level.  The per-block index entries are
+   *    grouped into leaf index pages that are stored in the file after the
+   *    data blocks.  Only the root index, which has one entry per leaf page,
+   *    is kept in memory; leaf pages are read on demand and held in the
+   *    block cache like data blocks.
+   *
+   * When writing, full data blocks are handed to a pool of compression
+   * threads (Hypertable.RangeServer.CellStore.CompressionThreads) shared by
+   * all CellStores being written, so that deflating a block overlaps with
+   * filling the next one.  Blocks are appended and indexed in the order
+   * they were filled.
+   *
+   * File layout:
+   *<pre>
+   * [data blocks] [leaf index pages] [root index] [bloom filter] [trailer]
+   *</pre>
+   */
+  class CellStoreV1 : public CellStore {
+
+  public:
+
+    CellStoreV1(Filesystem *filesys);
+    virtual ~CellStoreV1();
+
+    virtual int create(const char *fname, uint32_t blocksize, const std::string &compressor,
+                       const std::string &bloom_filter);
+    virtual int add(const ByteString key, const ByteString value, uint64_t real_timestamp);
+    virtual int finalize(Timestamp &timestamp);
+    virtual int open(const char *fname, const char *start_row, const char *end_row);
+    virtual int load_index();
+    virtual uint32_t get_blocksize() { return m_trailer.blocksize; }
+    virtual void get_timestamp(Timestamp &timestamp);
+    virtual uint64_t disk_usage() { return m_disk_usage; }
+    virtual float compression_ratio() { return m_trailer.compression_ratio; }
+    virtual void get_index_rows(std::vector<String> &rows);
+    virtual std::string &get_filename() { return m_filename; }
+    virtual CellListScanner *create_scanner(ScanContextPtr &scan_ctx);
+    virtual void display_block_info();
+
+    BlockCompressionCodec *create_block_compression_codec();
+
+    friend class CellStoreScannerV1;
+
+    virtual CellStoreTrailer *get_trailer() { return &m_trailer; }
+
+    enum { RESTART_INTERVAL = 16 };
+
+  protected:
+
+    /**
+     * Location of a data block: its position in the two-level index
+     * along with its file offset and compressed length
+     */
+    struct BlockRef {
+      uint32_t leaf;
+      uint32_t entry;
+      uint32_t offset;
+      uint32_t zlength;
+    };
+
+    /**
+     * In-memory root index entry, one per leaf index page
+     */
+    struct IndexRootEntry {
+      ByteString last_key;
+      uint32_t leaf_offset;
+      uint32_t leaf_zlength;
+      uint32_t block_offset;
+    };
+
+    /**
+     * Read-only view of an uncompressed leaf index page.  Each entry is
+     * the last key of a block followed by the block's offset and compressed
+     * length.  The page ends with the offsets of the entries followed by
+     * the entry count.
+     */
+    class LeafPage {
+    public:
+      LeafPage() : block(0), cached(false), m_base(0), m_offsets(0),
+                   m_count(0) { }
+      void load(const uint8_t *base, uint32_t len);
+      uint32_t size() const { return m_count; }
+      ByteString key(uint32_t i) const;
+      void get_block(uint32_t i, uint32_t *offsetp, uint32_t *zlengthp) const;
+      uint8_t *block;  // checked out page, owned by the page if not cached
+      bool cached;
+    private:
+      const uint8_t *m_base;
+      const uint8_t *m_offsets;
+      uint32_t m_count;
+    };
+
+    /**
+     * Full data block waiting to be compressed and appended
+     */
+    struct PendingBlock {
+      PendingBlock() : data(0), zdata(0), last_key(0), compressed(false),
+                       failed(false) { }
+      DynamicBuffer data;
+      DynamicBuffer zdata;
+      DynamicBuffer last_key;
+      bool compressed;
+      bool failed;
+    };
+
+    class CompressionPool;
+    friend class CompressionPool;
+
+    int write_block();
+    int append_block(DynamicBuffer &zbuf, const uint8_t *last_key, size_t last_key_len);
+    int flush_compressed_blocks(bool wait_all);
+    void compress_block();
+    void start_compression_pipeline();
+    void stop_compression_pipeline();
+    void add_index_entry(const uint8_t *key, size_t key_len, uint32_t offset, uint32_t zlength);
+    void write_leaf_page();
+    void load_root_index();
+    bool checkout_leaf(uint32_t leaf, LeafPage &page, BlockCompressionCodec *codec);
+    void checkin_leaf(uint32_t leaf, LeafPage &page);
+    bool find_block(const ByteString target, bool upper, BlockRef &ref, BlockCompressionCodec *codec);
+    bool next_block(BlockRef &ref, BlockCompressionCodec *codec);
+    void compute_disk_usage(BlockCompressionCodec *codec);
+
+    static const char DATA_BLOCK_MAGIC[10];
+    static const char INDEX_LEAF_BLOCK_MAGIC[10];
+    static const char INDEX_ROOT_BLOCK_MAGIC[10];
+
+    static CompressionPool *ms_compression_pool;
+    static boost::mutex     ms_compression_pool_mutex;
+
+    typedef std::vector<IndexRootEntry> RootIndex;
+
+    Filesystem            *m_filesys;
+    std::string            m_filename;
+    int32_t                m_fd;
+    RootIndex              m_root_index;
+    DynamicBuffer          m_root_buffer;
+    CellStoreTrailerV1     m_trailer;
+    BlockCompressionCodec *m_compressor;
+    DynamicBuffer          m_buffer;
+    std::vector<uint32_t>  m_restarts;
+    uint32_t               m_block_entries;
+    DynamicBuffer          m_last_key;
+    DynamicBuffer          m_leaf_buffer;
+    std::vector<uint32_t>  m_leaf_entries;
+    uint32_t               m_leaf_block_offset;
+    DynamicBuffer          m_leaf_pages;
+    DispatchHandlerSynchronizer  m_sync_handler;
+    uint32_t               m_outstanding_appends;
+    uint32_t               m_offset;
+    uint64_t               m_file_length;
+    uint32_t               m_disk_usage;
+    int                    m_file_id;
+    float                  m_uncompressed_data;
+    float                  m_compressed_data;
+    uint32_t               m_uncompressed_blocksize;
+    BlockCompressionCodec::Args m_compressor_args;
+    boost::mutex           m_compress_mutex;
+    boost::condition       m_compressed_cond;
+    std::deque<PendingBlock *> m_pending_blocks;
+    size_t                 m_next_to_compress;
+    size_t                 m_compress_jobs;
+    size_t                 m_compress_thread_count;
+    std::vector<BlockCompressionCodec *> m_compress_codecs;
+  };
+  typedef boost::intrusive_ptr<CellStoreV1> CellStoreV1Ptr;
+
+}
+
+#endif // HYPERTABLE_CELLSTOREV1_H
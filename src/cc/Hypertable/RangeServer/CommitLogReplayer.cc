@@ -0,0 +1,491 @@
+/** -*- c++ -*-
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "Common/Compat.h"
+#include <cstring>
+
+#include <boost/thread/thread.hpp>
+
+#include "Common/Error.h"
+#include "Common/HashMap.h"
+#include "Common/Logger.h"
+#include "Common/Serialization.h"
+
+#include "Hypertable/Lib/BlockCompressionHeaderCommitLog.h"
+#include "Hypertable/Lib/CommitLog.h"
+#include "Hypertable/Lib/CommitLogBlockStream.h"
+#include "Hypertable/Lib/CommitLogReader.h"
+#include "Hypertable/Lib/CompressorFactory.h"
+
+#include "CommitLogReplayer.h"
+#include "Global.h"
+
+using namespace Hypertable;
+using namespace Serialization;
+
+
+CommitLogReplayer::CommitLogReplayer(Filesystem *fs,
+    TableInfoMapPtr &replay_map_ptr, uint32_t reader_threads,
+    uint32_t apply_threads)
+  : m_fs(fs), m_replay_map_ptr(replay_map_ptr),
+    m_reader_count(reader_threads ? reader_threads : 1), m_next_fragment(0),
+    m_next_route(0), m_queues(apply_threads ? apply_threads : 1),
+    m_queued_bytes(0), m_routing_done(false), m_error(Error::OK) {
+  boost::xtime_get(&m_start_time, boost::TIME_UTC);
+}
+
+
+CommitLogReplayer::~CommitLogReplayer() {
+  for (size_t i=0; i<m_fragments.size(); i++)
+    delete m_fragments[i];
+  for (size_t i=0; i<m_queues.size(); i++)
+    for (size_t j=0; j<m_queues[i].size(); j++)
+      delete m_queues[i][j];
+}
+
+
+/**
+ */
+void CommitLogReplayer::replay(const String &log_dir) {
+  CommitLogReaderPtr reader_ptr = new CommitLogReader(m_fs, log_dir);
+  std::vector<CommitLogFileInfo> fragments;
+  boost::thread_group readers;
+  boost::thread_group appliers;
+
+  reader_ptr->get_fragments(fragments);
+
+  {
+    boost::mutex::scoped_lock lock(m_mutex);
+    for (size_t i=0; i<fragments.size(); i++)
+      m_fragments.push_back(new Fragment(fragments[i]));
+    m_stats.fragments = fragments.size();
+    boost::xtime_get(&m_start_time, boost::TIME_UTC);
+  }
+
+  HT_INFOF("Replaying %u commit log fragments from '%s' with %u reader and "
+           "%u apply threads", (unsigned)fragments.size(), log_dir.c_str(),
+           (unsigned)m_reader_count, (unsigned)m_queues.size());
+
+  for (uint32_t i=0; i<m_reader_count; i++)
+    readers.create_thread(ReaderWorker(this));
+  for (size_t i=0; i<m_queues.size(); i++)
+    appliers.create_thread(ApplyWorker(this, i));
+
+  try {
+    route();
+  }
+  catch (Exception &e) {
+    set_error(e.code(), e.what());
+  }
+
+  {
+    boost::mutex::scoped_lock lock(m_mutex);
+    m_routing_done = true;
+    m_cond.notify_all();
+    m_apply_cond.notify_all();
+  }
+
+  readers.join_all();
+  appliers.join_all();
+
+  {
+    boost::mutex::scoped_lock lock(m_mutex);
+    m_stats.elapsed_millis = elapsed_millis();
+    m_stats.done = true;
+  }
+
+  if (m_error != Error::OK)
+    HT_THROW(m_error, m_error_msg);
+
+  HT_INFOF("Commit log replay complete: %u fragments, %llu blocks, %llu "
+           "bytes, %llu cells (%llu skipped) in %llu ms",
+           (unsigned)m_stats.fragments, (Llu)m_stats.blocks,
+           (Llu)m_stats.bytes, (Llu)m_stats.cells,
+           (Llu)m_stats.cells_skipped, (Llu)m_stats.elapsed_millis);
+}
+
+
+void CommitLogReplayer::get_statistics(Statistics &stats) {
+  boost::mutex::scoped_lock lock(m_mutex);
+  stats = m_stats;
+  if (!stats.done)
+    stats.elapsed_millis = elapsed_millis();
+}
+
+
+/**
+ * Reader thread.  Claims the next unread fragment, as long as it is not too
+ * far ahead of the router, and reads and inflates all of its blocks.
+ */
+void CommitLogReplayer::read_fragments() {
+  Fragment *fragment;
+
+  while (true) {
+
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      while (!m_routing_done && m_next_fragment < m_fragments.size() &&
+             m_next_fragment >= m_next_route + 2*m_reader_count)
+        m_cond.wait(lock);
+      if (m_routing_done || m_next_fragment >= m_fragments.size())
+        return;
+      fragment = m_fragments[m_next_fragment++];
+    }
+
+    try {
+      load_fragment(fragment);
+    }
+    catch (Exception &e) {
+      HT_ERRORF("Problem reading commit log fragment %s%u - %s",
+                fragment->info.log_dir.c_str(), fragment->info.num,
+                Error::get_text(e.code()));
+      set_error(e.code(), e.what());
+    }
+
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      fragment->loaded = true;
+      m_cond.notify_all();
+    }
+  }
+}
+
+
+void CommitLogReplayer::load_fragment(Fragment *fragment) {
+  typedef hash_map<uint16_t, BlockCompressionCodecPtr> CompressorMap;
+  CommitLogBlockStream stream(m_fs, fragment->info.log_dir,
+                              format("%u", fragment->info.num));
+  CompressorMap compressor_map;
+  BlockCompressionCodecPtr compressor_ptr;
+  BlockCompressionHeaderCommitLog header;
+  CommitLogBlockInfo binfo;
+  uint64_t blocks = 0, bytes = 0;
+  uint16_t ztype;
+
+  while (stream.next(&binfo, &header)) {
+
+    if (binfo.error != Error::OK) {
+      HT_ERRORF("Corruption detected in CommitLog fragment %s starting at "
+                "position %llu for %llu bytes - %s",
+                stream.get_fname().c_str(), (Llu)binfo.start_offset,
+                (Llu)(binfo.end_offset - binfo.start_offset),
+                Error::get_text(binfo.error));
+      continue;
+    }
+
+    if (!header.check_magic(CommitLog::MAGIC_DATA)) {
+      HT_WARNF("Skipping non-data block in CommitLog fragment %s at "
+               "position %llu", stream.get_fname().c_str(),
+               (Llu)binfo.start_offset);
+      continue;
+    }
+
+    ztype = header.get_compression_type();
+    if (ztype >= BlockCompressionCodec::COMPRESSION_TYPE_LIMIT)
+      HT_THROWF(Error::BLOCK_COMPRESSOR_UNSUPPORTED_TYPE,
+                "Invalid compression type - %d", (int)ztype);
+    if (!(compressor_ptr = compressor_map[ztype])) {
+      compressor_ptr = CompressorFactory::create_block_codec((BlockCompressionCodec::Type)ztype);
+      compressor_map[ztype] = compressor_ptr;
+    }
+
+    Block *block = new Block();
+    DynamicBuffer zblock;
+
+    zblock.base = binfo.block_ptr;
+    zblock.ptr = binfo.block_ptr + binfo.block_len;
+
+    try {
+      compressor_ptr->inflate(zblock, block->data, header);
+    }
+    catch (Exception &e) {
+      HT_ERRORF("Inflate error in CommitLog fragment %s starting at "
+                "position %llu (block len = %llu) - %s",
+                stream.get_fname().c_str(), (Llu)binfo.start_offset,
+                (Llu)(binfo.end_offset - binfo.start_offset),
+                Error::get_text(e.code()));
+      zblock.release();
+      delete block;
+      continue;
+    }
+    zblock.release();
+
+    block->timestamp = header.get_timestamp();
+    fragment->blocks.push_back(block);
+    blocks++;
+    bytes += block->data.fill();
+  }
+
+  boost::mutex::scoped_lock lock(m_mutex);
+  m_stats.blocks += blocks;
+  m_stats.bytes += bytes;
+}
+
+
+/**
+ * Routes the key/value pairs of each fragment, in log order, into per-range
+ * batches.  Runs on the thread that called #replay.
+ */
+void CommitLogReplayer::route() {
+  std::map<Range *, Batch *> batches;
+  Fragment *fragment;
+  Statistics stats;
+
+  try {
+
+    for (size_t i=0; i<m_fragments.size(); i++) {
+      fragment = m_fragments[i];
+
+      {
+        boost::mutex::scoped_lock lock(m_mutex);
+        while (!fragment->loaded)
+          m_cond.wait(lock);
+        if (m_error != Error::OK)
+          break;
+      }
+
+      for (size_t j=0; j<fragment->blocks.size(); j++)
+        route_block(fragment->blocks[j], batches);
+
+      {
+        boost::mutex::scoped_lock lock(m_mutex);
+        delete fragment;
+        m_fragments[i] = 0;
+        m_next_route++;
+        m_stats.fragments_replayed++;
+        m_cond.notify_all();
+      }
+
+      get_statistics(stats);
+      HT_INFOF("Commit log replay: %u/%u fragments, %llu cells, %.2f MB/s",
+               (unsigned)stats.fragments_replayed, (unsigned)stats.fragments,
+               (Llu)stats.cells, stats.elapsed_millis ?
+               ((double)stats.bytes / 1048576.0) /
+               ((double)stats.elapsed_millis / 1000.0) : 0.0);
+    }
+  }
+  catch (...) {
+    for (std::map<Range *, Batch *>::iterator iter = batches.begin();
+         iter != batches.end(); ++iter)
+      delete (*iter).second;
+    throw;
+  }
+
+  for (std::map<Range *, Batch *>::iterator iter = batches.begin();
+       iter != batches.end(); ++iter)
+    dispatch((*iter).second);
+}
+
+
+void CommitLogReplayer::route_block(Block *block, std::map<Range *, Batch *> &batches) {
+  const uint8_t *ptr = block->data.base;
+  const uint8_t *end = block->data.base + block->data.fill();
+  const uint8_t *run_start;
+  size_t remaining = block->data.fill();
+  TableIdentifier table_id;
+  TableInfoPtr table_info_ptr;
+  RangePtr range_ptr;
+  ByteString key, value;
+  const char *row;
+  String start_row, end_row;
+  Batch *batch;
+  uint64_t cells = 0, skipped = 0;
+
+  table_id.decode(&ptr, &remaining);
+
+  // tables that are not being replayed are skipped
+  if (!m_replay_map_ptr->get(table_id.id, table_info_ptr))
+    return;
+
+  while (ptr < end) {
+
+    row = ByteString(ptr).str();
+
+    if (!table_info_ptr->find_containing_range(row, range_ptr)) {
+      key.ptr = ptr;
+      ptr += key.length();
+      value.ptr = ptr;
+      ptr += value.length();
+      if (ptr > end)
+        HT_THROW(Error::REQUEST_TRUNCATED, "Problem decoding key/value");
+      skipped++;
+      continue;
+    }
+
+    // extend the run while the rows stay within the range, in either
+    // direction, since the pairs of a block need not be sorted
+    start_row = range_ptr->start_row();
+    end_row = range_ptr->end_row();
+    run_start = ptr;
+
+    while (ptr < end && strcmp(row, start_row.c_str()) > 0 &&
+           (end_row == "" || strcmp(row, end_row.c_str()) <= 0)) {
+      key.ptr = ptr;
+      ptr += key.length();
+      if (ptr > end)
+        HT_THROW(Error::REQUEST_TRUNCATED, "Problem decoding key");
+      value.ptr = ptr;
+      ptr += value.length();
+      if (ptr > end)
+        HT_THROW(Error::REQUEST_TRUNCATED, "Problem decoding value");
+      cells++;
+      if (ptr < end)
+        row = ByteString(ptr).str();
+    }
+
+    Batch *&batch_ref = batches[range_ptr.get()];
+    if (batch_ref == 0)
+      batch_ref = new Batch(range_ptr);
+    batch = batch_ref;
+
+    batch->data.ensure(12 + (ptr - run_start));
+    encode_i64(&batch->data.ptr, block->timestamp);
+    encode_i32(&batch->data.ptr, ptr - run_start);
+    memcpy(batch->data.ptr, run_start, ptr - run_start);
+    batch->data.ptr += ptr - run_start;
+
+    if (batch->data.fill() >= BATCH_SIZE) {
+      batches.erase(range_ptr.get());
+      dispatch(batch);
+    }
+  }
+
+  boost::mutex::scoped_lock lock(m_mutex);
+  m_stats.cells += cells;
+  m_stats.cells_skipped += skipped;
+}
+
+
+/**
+ * Hands a batch to the apply thread that owns its range, waiting if too
+ * much data is already queued.
+ */
+void CommitLogReplayer::dispatch(Batch *batch) {
+  size_t queue = ((size_t)batch->range_ptr.get() >> 4) % m_queues.size();
+  boost::mutex::scoped_lock lock(m_mutex);
+
+  while (m_queued_bytes > MAX_QUEUED_BYTES && m_error == Error::OK)
+    m_cond.wait(lock);
+
+  if (m_error != Error::OK) {
+    delete batch;
+    return;
+  }
+
+  m_queues[queue].push_back(batch);
+  m_queued_bytes += batch->data.fill();
+  m_apply_cond.notify_all();
+}
+
+
+/**
+ * Apply thread.  Adds the batches of its queue to their ranges in the
+ * order they were routed.
+ */
+void CommitLogReplayer::apply_batches(size_t queue) {
+  Batch *batch;
+
+  while (true) {
+
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      while (m_queues[queue].empty() && !m_routing_done)
+        m_apply_cond.wait(lock);
+      if (m_queues[queue].empty())
+        return;
+      batch = m_queues[queue].front();
+      m_queues[queue].pop_front();
+    }
+
+    try {
+      if (m_error == Error::OK)
+        apply_batch(batch);
+    }
+    catch (Exception &e) {
+      set_error(e.code(), e.what());
+    }
+
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      m_queued_bytes -= batch->data.fill();
+      m_cond.notify_all();
+    }
+
+    delete batch;
+  }
+}
+
+
+void CommitLogReplayer::apply_batch(Batch *batch) {
+  const uint8_t *ptr = batch->data.base;
+  const uint8_t *end = batch->data.base + batch->data.fill();
+  const uint8_t *run_end;
+  size_t remaining = batch->data.fill();
+  uint64_t timestamp;
+  uint32_t run_len;
+  ByteString key, value;
+  uint32_t count;
+  uint64_t memory_added = 0;
+  uint64_t items_added = 0;
+
+  while (ptr < end) {
+    timestamp = decode_i64(&ptr, &remaining);
+    run_len = decode_i32(&ptr, &remaining);
+    run_end = ptr + run_len;
+    remaining -= run_len;
+
+    while (ptr < run_end) {
+      key.ptr = ptr;
+      ptr += key.length();
+      value.ptr = ptr;
+      ptr += value.length();
+
+      HT_EXPECT(batch->range_ptr->replay_add(key, value, timestamp, &count) == Error::OK, Error::FAILED_EXPECTATION);
+
+      if (count) {
+        items_added += count;
+        memory_added += count * (ptr - key.ptr);
+      }
+    }
+  }
+
+  Global::memory_tracker.add_memory(memory_added);
+  Global::memory_tracker.add_items(items_added);
+}
+
+
+void CommitLogReplayer::set_error(int error, const String &msg) {
+  boost::mutex::scoped_lock lock(m_mutex);
+  if (m_error == Error::OK) {
+    m_error = error;
+    m_error_msg = msg;
+  }
+  m_cond.notify_all();
+  m_apply_cond.notify_all();
+}
+
+
+uint64_t CommitLogReplayer::elapsed_millis() {
+  boost::xtime now;
+  boost::xtime_get(&now, boost::TIME_UTC);
+  return ((uint64_t)(now.sec - m_start_time.sec) * 1000LL)
+         + ((int64_t)now.nsec - (int64_t)m_start_time.nsec) / 1000000LL;
+}
@@ -0,0 +1,188 @@
+/** -*- c++ -*-
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef HYPERTABLE_COMMITLOGREPLAYER_H
+#define HYPERTABLE_COMMITLOGREPLAYER_H
+
+#include <deque>
+#include <map>
+#include <vector>
+
+#include <boost/thread/condition.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/xtime.hpp>
+
+#include "Common/DynamicBuffer.h"
+#include "Common/ReferenceCount.h"
+#include "Common/String.h"
+
+#include "Hypertable/Lib/CommitLogBase.h"
+#include "Hypertable/Lib/Filesystem.h"
+
+#include "Range.h"
+#include "TableInfoMap.h"
+
+namespace Hypertable {
+
+  /**
+   * Replays a commit log into the ranges of a TableInfoMap using three
+   * stages that run concurrently.  A pool of reader threads reads and
+   * inflates log fragments, staying at most a few fragments ahead of the
+   * router.  The calling thread routes the key/value pairs of each
+   * fragment, in log order, into per-range batches.  A pool of apply
+   * threads adds the batches to their ranges.  All batches for a range
+   * go to the same apply thread, so updates to a range are still applied
+   * in log order, while different ranges are replayed in parallel.
+   */
+  class CommitLogReplayer : public ReferenceCount {
+  public:
+
+    enum {
+      BATCH_SIZE = 256*1024,
+      MAX_QUEUED_BYTES = 64*1024*1024
+    };
+
+    class Statistics {
+    public:
+      Statistics() : fragments(0), fragments_replayed(0), blocks(0),
+                     bytes(0), cells(0), cells_skipped(0),
+                     elapsed_millis(0), done(false) { }
+      uint32_t fragments;
+      uint32_t fragments_replayed;
+      uint64_t blocks;
+      uint64_t bytes;
+      uint64_t cells;
+      uint64_t cells_skipped;
+      uint64_t elapsed_millis;
+      bool     done;
+    };
+
+    /**
+     * Constructor.
+     *
+     * @param fs filesystem holding the commit log
+     * @param replay_map_ptr map of the tables and ranges to replay into
+     * @param reader_threads number of fragment reader threads
+     * @param apply_threads number of threads adding updates to ranges
+     */
+    CommitLogReplayer(Filesystem *fs, TableInfoMapPtr &replay_map_ptr,
+                      uint32_t reader_threads, uint32_t apply_threads);
+    virtual ~CommitLogReplayer();
+
+    /**
+     * Replays the commit log in the given directory and returns once all
+     * of its updates have been added.  Throws an exception if a fragment
+     * is malformed or an update cannot be added.
+     *
+     * @param log_dir commit log directory
+     */
+    void replay(const String &log_dir);
+
+    /**
+     * Returns a snapshot of the replay progress.  Safe to call from
+     * another thread while #replay is running.
+     *
+     * @param stats reference to statistics object to fill in
+     */
+    void get_statistics(Statistics &stats);
+
+  private:
+
+    class Block {
+    public:
+      uint64_t      timestamp;
+      DynamicBuffer data;
+    };
+
+    class Fragment {
+    public:
+      Fragment(const CommitLogFileInfo &file_info)
+        : info(file_info), loaded(false) { }
+      ~Fragment() {
+        for (size_t i=0; i<blocks.size(); i++)
+          delete blocks[i];
+      }
+      CommitLogFileInfo     info;
+      std::vector<Block *>  blocks;
+      bool                  loaded;
+    };
+
+    /** Runs of key/value pairs bound for one range, each run prefixed
+     * with its commit timestamp and length */
+    class Batch {
+    public:
+      Batch(RangePtr &range) : range_ptr(range) { }
+      RangePtr      range_ptr;
+      DynamicBuffer data;
+    };
+
+    typedef std::deque<Batch *> BatchQueue;
+
+    class ReaderWorker {
+    public:
+      ReaderWorker(CommitLogReplayer *replayer) : m_replayer(replayer) { }
+      void operator()() { m_replayer->read_fragments(); }
+    private:
+      CommitLogReplayer *m_replayer;
+    };
+
+    class ApplyWorker {
+    public:
+      ApplyWorker(CommitLogReplayer *replayer, size_t queue)
+        : m_replayer(replayer), m_queue(queue) { }
+      void operator()() { m_replayer->apply_batches(m_queue); }
+    private:
+      CommitLogReplayer *m_replayer;
+      size_t m_queue;
+    };
+
+    void read_fragments();
+    void load_fragment(Fragment *fragment);
+    void route();
+    void route_block(Block *block, std::map<Range *, Batch *> &batches);
+    void dispatch(Batch *batch);
+    void apply_batches(size_t queue);
+    void apply_batch(Batch *batch);
+    void set_error(int error, const String &msg);
+    uint64_t elapsed_millis();
+
+    Filesystem              *m_fs;
+    TableInfoMapPtr          m_replay_map_ptr;
+    uint32_t                 m_reader_count;
+    boost::mutex             m_mutex;
+    boost::condition         m_cond;
+    boost::condition         m_apply_cond;
+    std::vector<Fragment *>  m_fragments;
+    size_t                   m_next_fragment;
+    size_t                   m_next_route;
+    std::vector<BatchQueue>  m_queues;
+    size_t                   m_queued_bytes;
+    bool                     m_routing_done;
+    int                      m_error;
+    String                   m_error_msg;
+    boost::xtime             m_start_time;
+    Statistics               m_stats;
+  };
+  typedef boost::intrusive_ptr<CommitLogReplayer> CommitLogReplayerPtr;
+
+}
+
+#endif // HYPERTABLE_COMMITLOGREPLAYER_H
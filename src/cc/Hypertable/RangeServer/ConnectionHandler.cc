@@ -41,6 +41,7 @@ extern "C" {
 #include "RequestHandlerDumpStats.h"
 #include "RequestHandlerLoadRange.h"
 #include "RequestHandlerUpdate.h"
+#include "RequestHandlerUpdateMulti.h"
 #include "RequestHandlerCreateScanner.h"
 #include "RequestHandlerFetchScanblock.h"
 #include "RequestHandlerDropTable.h"
@@ -107,6 +108,9 @@ void ConnectionHandler::handle(EventPtr &event) {
       case RangeServerProtocol::COMMAND_UPDATE:
         handler = new RequestHandlerUpdate(m_comm, m_range_server_ptr.get(), event);
         break;
+      case RangeServerProtocol::COMMAND_UPDATE_MULTI:
+        handler = new RequestHandlerUpdateMulti(m_comm, m_range_server_ptr.get(), event);
+        break;
       case RangeServerProtocol::COMMAND_CREATE_SCANNER:
         handler = new RequestHandlerCreateScanner(m_comm, m_range_server_ptr.get(), event);
         break;
@@ -30,96 +30,244 @@ using std::pair;
 
 atomic_t FileBlockCache::ms_next_file_id = ATOMIC_INIT(0);
 
+FileBlockCache::FileBlockCache(uint64_t max_memory, uint32_t shards)
+  : m_shard_mask(0) {
+  size_t count = 1;
+
+  if (shards == 0)
+    shards = DEFAULT_SHARDS;
+
+  while (count * 2 <= shards &&
+         max_memory / (count * 2) >= (uint64_t)MIN_SHARD_MEMORY)
+    count *= 2;
+
+  m_shards.reserve(count);
+  for (size_t i=0; i<count; i++)
+    m_shards.push_back(new Shard(max_memory / count));
+  // give any remainder to the first shard
+  m_shards[0]->max_memory += max_memory % count;
+  m_shard_mask = count - 1;
+}
+
+
 FileBlockCache::~FileBlockCache() {
-  for (BlockCache::const_iterator iter = m_cache.begin();
-       iter != m_cache.end(); ++iter)
+  for (size_t i=0; i<m_shards.size(); i++)
+    delete m_shards[i];
+}
+
+
+FileBlockCache::Shard::~Shard() {
+  for (BlockCache::const_iterator iter = in_queue.begin();
+       iter != in_queue.end(); ++iter)
     delete [] (*iter).block;
+  for (BlockCache::const_iterator iter = hot_queue.begin();
+       iter != hot_queue.end(); ++iter)
+    delete [] (*iter).block;
+}
+
+
+/**
+ * Frees enough unreferenced blocks to make room for a block of the given
+ * length.  Blocks are taken from the in queue while it is over its share
+ * of memory (or the hot queue is empty), otherwise from the cold end of
+ * the hot queue.
+ *
+ * @return false if not enough memory could be freed because the remaining
+ * blocks are all checked out
+ */
+bool FileBlockCache::Shard::make_room(uint32_t length) {
+  bool evicted;
+
+  while (in_memory + hot_memory + length > max_memory) {
+    if (in_memory > in_max_memory || hot_queue.empty())
+      evicted = evict_from(in_queue, in_memory, true)
+          || evict_from(hot_queue, hot_memory, false);
+    else
+      evicted = evict_from(hot_queue, hot_memory, false)
+          || evict_from(in_queue, in_memory, true);
+    if (!evicted)
+      return false;
+  }
+  return true;
+}
+
+
+bool FileBlockCache::Shard::evict_from(BlockCache &queue, uint64_t &memory,
+                                       bool ghost) {
+  for (BlockCache::iterator iter = queue.begin(); iter != queue.end(); ++iter) {
+    if ((*iter).ref_count == 0) {
+      memory -= (*iter).length;
+      if (ghost)
+        add_ghost((*iter).key(), (*iter).length);
+      delete [] (*iter).block;
+      queue.erase(iter);
+      stats.evictions++;
+      return true;
+    }
+  }
+  return false;
 }
 
+
+void FileBlockCache::Shard::add_ghost(uint64_t key, uint32_t length) {
+  if (!ghosts.push_back(GhostEntry(key, length)).second)
+    return;
+  ghost_memory += length;
+  while (ghost_memory > ghost_max_memory && !ghosts.empty()) {
+    ghost_memory -= ghosts.front().length;
+    ghosts.pop_front();
+  }
+}
+
+
 bool
 FileBlockCache::checkout(int file_id, uint32_t file_offset, uint8_t **blockp,
-                         uint32_t *lengthp) {
-  boost::mutex::scoped_lock lock(m_mutex);
-  HashIndex &hash_index = m_cache.get<1>();
-  HashIndex::iterator iter;
+                         uint32_t *lengthp, bool promote) {
   uint64_t key = ((uint64_t)file_id << 32) | file_offset;
+  Shard &shard = get_shard(key);
+  boost::mutex::scoped_lock lock(shard.mutex);
+  HashIndex &hot_index = shard.hot_queue.get<1>();
+  HashIndex &in_index = shard.in_queue.get<1>();
+  HashIndex::iterator iter;
 
-  if ((iter = hash_index.find(key)) == hash_index.end())
+  if ((iter = hot_index.find(key)) != hot_index.end()) {
+    hot_index.modify(iter, IncrementRefCount());
+    if (promote)
+      shard.hot_queue.relocate(shard.hot_queue.end(),
+                               shard.hot_queue.project<0>(iter));
+  }
+  else if ((iter = in_index.find(key)) != in_index.end()) {
+    if (promote) {
+      // second reference while on probation, move to the hot queue
+      BlockCacheEntry entry = *iter;
+      entry.ref_count++;
+      in_index.erase(iter);
+      shard.in_memory -= entry.length;
+      pair<Sequence::iterator, bool> insert_result =
+          shard.hot_queue.push_back(entry);
+      assert(insert_result.second);
+      shard.hot_memory += entry.length;
+      shard.stats.promotions++;
+      iter = shard.hot_queue.project<1>(insert_result.first);
+    }
+    else
+      in_index.modify(iter, IncrementRefCount());
+  }
+  else {
+    shard.stats.misses++;
     return false;
+  }
 
-  BlockCacheEntry entry = *iter;
-  entry.ref_count++;
-
-  hash_index.erase(iter);
-  
-  pair<Sequence::iterator, bool> insert_result = m_cache.push_back(entry);
-  assert(insert_result.second);
-
-  *blockp = (*insert_result.first).block;
-  *lengthp = (*insert_result.first).length;
+  *blockp = (*iter).block;
+  *lengthp = (*iter).length;
+  shard.stats.hits++;
 
   return true;
 }
 
 
 void FileBlockCache::checkin(int file_id, uint32_t file_offset) {
-  boost::mutex::scoped_lock lock(m_mutex);
-  HashIndex &hash_index = m_cache.get<1>();
-  HashIndex::iterator iter;
   uint64_t key = ((uint64_t)file_id << 32) | file_offset;
+  Shard &shard = get_shard(key);
+  boost::mutex::scoped_lock lock(shard.mutex);
+  HashIndex &hot_index = shard.hot_queue.get<1>();
+  HashIndex &in_index = shard.in_queue.get<1>();
+  HashIndex::iterator iter;
 
-  iter = hash_index.find(key);
+  if ((iter = hot_index.find(key)) != hot_index.end()) {
+    assert((*iter).ref_count > 0);
+    hot_index.modify(iter, DecrementRefCount());
+    return;
+  }
+
+  iter = in_index.find(key);
 
-  assert(iter != hash_index.end() && (*iter).ref_count > 0);
+  assert(iter != in_index.end() && (*iter).ref_count > 0);
 
-  hash_index.modify(iter, DecrementRefCount());
+  in_index.modify(iter, DecrementRefCount());
 }
 
 
 bool
 FileBlockCache::insert_and_checkout(int file_id, uint32_t file_offset,
-                                    uint8_t *block, uint32_t length) {
-  boost::mutex::scoped_lock lock(m_mutex);
-  HashIndex &hash_index = m_cache.get<1>();
+                                    uint8_t *block, uint32_t length,
+                                    bool promote) {
   uint64_t key = ((uint64_t)file_id << 32) | file_offset;
+  Shard &shard = get_shard(key);
+  boost::mutex::scoped_lock lock(shard.mutex);
+  HashIndex &hot_index = shard.hot_queue.get<1>();
+  HashIndex &in_index = shard.in_queue.get<1>();
+  GhostHashIndex &ghost_index = shard.ghosts.get<1>();
+  GhostHashIndex::iterator ghost_iter;
 
-  if (length > m_max_memory || hash_index.find(key) != hash_index.end())
+  if (length > shard.max_memory || hot_index.find(key) != hot_index.end()
+      || in_index.find(key) != in_index.end())
     return false;
 
-  // make room
-  if (m_avail_memory < length) {
-    BlockCache::iterator iter = m_cache.begin();
-    while (iter != m_cache.end()) {
-      if ((*iter).ref_count == 0) {
-	m_avail_memory += (*iter).length;
-	delete [] (*iter).block;
-	iter = m_cache.erase(iter);
-	if (m_avail_memory >= length)
-	  break;
-      }
-      else
-	++iter;
-    }
-  }
+  // if everything is checked out, go over budget rather than fail
+  shard.make_room(length);
 
   BlockCacheEntry entry(file_id, file_offset);
   entry.block = block;
   entry.length = length;
   entry.ref_count = 1;
 
-  pair<Sequence::iterator, bool> insert_result = m_cache.push_back(entry);
+  pair<Sequence::iterator, bool> insert_result;
+
+  if (promote && (ghost_iter = ghost_index.find(key)) != ghost_index.end()) {
+    // re-read shortly after falling off the in queue, it's hot
+    shard.ghost_memory -= (*ghost_iter).length;
+    ghost_index.erase(ghost_iter);
+    insert_result = shard.hot_queue.push_back(entry);
+    shard.hot_memory += length;
+    shard.stats.promotions++;
+  }
+  else {
+    if (promote)
+      insert_result = shard.in_queue.push_back(entry);
+    else
+      insert_result = shard.in_queue.push_front(entry);
+    shard.in_memory += length;
+  }
   assert(insert_result.second);
 
-  m_avail_memory -= length;
-  
+  shard.stats.inserts++;
+
   return true;
 }
 
 
 bool FileBlockCache::contains(int file_id, uint32_t file_offset) {
-  boost::mutex::scoped_lock lock(m_mutex);
-  HashIndex &hash_index = m_cache.get<1>();
   uint64_t key = ((uint64_t)file_id << 32) | file_offset;
+  Shard &shard = get_shard(key);
+  boost::mutex::scoped_lock lock(shard.mutex);
+  HashIndex &hot_index = shard.hot_queue.get<1>();
+  HashIndex &in_index = shard.in_queue.get<1>();
+
+  return hot_index.find(key) != hot_index.end()
+      || in_index.find(key) != in_index.end();
+}
 
-  return (hash_index.find(key) != hash_index.end());
+
+void FileBlockCache::get_stats(size_t shard_index, Statistics &stats) {
+  Shard &shard = *m_shards[shard_index];
+  boost::mutex::scoped_lock lock(shard.mutex);
+  stats = shard.stats;
+  stats.memory_used = shard.in_memory + shard.hot_memory;
+}
+
+
+void FileBlockCache::get_stats(Statistics &stats) {
+  Statistics shard_stats;
+
+  stats = Statistics();
+  for (size_t i=0; i<m_shards.size(); i++) {
+    get_stats(i, shard_stats);
+    stats.hits += shard_stats.hits;
+    stats.misses += shard_stats.misses;
+    stats.inserts += shard_stats.inserts;
+    stats.evictions += shard_stats.evictions;
+    stats.promotions += shard_stats.promotions;
+    stats.memory_used += shard_stats.memory_used;
+  }
 }
@@ -22,10 +22,14 @@
 #ifndef HYPERTABLE_FILEBLOCKCACHE_H
 #define HYPERTABLE_FILEBLOCKCACHE_H
 
+#include <vector>
+
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/hashed_index.hpp>
 #include <boost/multi_index/mem_fun.hpp>
+#include <boost/multi_index/member.hpp>
 #include <boost/multi_index/sequenced_index.hpp>
+#include <boost/noncopyable.hpp>
 #include <boost/thread/mutex.hpp>
 
 #include "Common/atomic.h"
@@ -33,22 +37,65 @@
 namespace Hypertable {
   using namespace boost::multi_index;
 
-  class FileBlockCache {
+  /**
+   * Cache of uncompressed CellStore blocks keyed by (file id, offset).
+   * The cache is split into a power-of-two number of shards, selected by
+   * hashing the key, each with its own lock and an equal share of the
+   * memory budget, so that scanner threads working on different blocks
+   * rarely contend.
+   *
+   * Each shard uses a 2Q replacement policy.  Newly inserted blocks go on
+   * a probationary FIFO (the "in" queue) which is limited to a quarter of
+   * the shard's memory.  A block is moved to the LRU "hot" queue when it
+   * is checked out again while on probation, or when it is re-inserted
+   * shortly after being evicted from probation (remembered in a list of
+   * ghost keys).  A long scan therefore only churns the in queue and
+   * leaves the hot working set alone.  Callers that know a block will not
+   * be reused (readahead scans) can pass promote=false, which keeps the
+   * block off the hot queue and puts it first in line for eviction.
+   */
+  class FileBlockCache : boost::noncopyable {
 
     static atomic_t ms_next_file_id;
 
   public:
-    FileBlockCache(uint64_t max_memory)
-        : m_max_memory(max_memory), m_avail_memory(max_memory) {  }
+
+    enum { DEFAULT_SHARDS = 16, MIN_SHARD_MEMORY = 4*1024*1024 };
+
+    struct Statistics {
+      Statistics() : hits(0), misses(0), inserts(0), evictions(0),
+                     promotions(0), memory_used(0) { }
+      uint64_t hits;
+      uint64_t misses;
+      uint64_t inserts;
+      uint64_t evictions;
+      uint64_t promotions;
+      uint64_t memory_used;
+    };
+
+    /**
+     * Constructor.  The number of shards is rounded down to a power of two
+     * and reduced if needed so that each shard gets at least
+     * MIN_SHARD_MEMORY bytes.
+     *
+     * @param max_memory total memory budget for cached blocks
+     * @param shards requested number of shards (0 for the default)
+     */
+    FileBlockCache(uint64_t max_memory, uint32_t shards=0);
     ~FileBlockCache();
 
     bool checkout(int file_id, uint32_t file_offset, uint8_t **blockp,
-                  uint32_t *lengthp);
+                  uint32_t *lengthp, bool promote=true);
     void checkin(int file_id, uint32_t file_offset);
     bool insert_and_checkout(int file_id, uint32_t file_offset,
-                             uint8_t *block, uint32_t length);
+                             uint8_t *block, uint32_t length,
+                             bool promote=true);
     bool contains(int file_id, uint32_t file_offset);
 
+    size_t get_shard_count() { return m_shards.size(); }
+    void get_stats(size_t shard, Statistics &stats);
+    void get_stats(Statistics &stats);
+
     static int get_next_file_id() {
       return atomic_inc_return(&ms_next_file_id);
     }
@@ -70,6 +117,12 @@ namespace Hypertable {
       uint64_t key() const { return ((uint64_t)file_id << 32) | file_offset; }
     };
 
+    struct IncrementRefCount {
+      void operator()(BlockCacheEntry &entry) {
+        entry.ref_count++;
+      }
+    };
+
     struct DecrementRefCount {
       void operator()(BlockCacheEntry &entry) {
         entry.ref_count--;
@@ -94,10 +147,56 @@ namespace Hypertable {
     typedef BlockCache::nth_index<0>::type Sequence;
     typedef BlockCache::nth_index<1>::type HashIndex;
 
-    boost::mutex  m_mutex;
-    BlockCache    m_cache;
-    uint64_t      m_max_memory;
-    uint64_t      m_avail_memory;
+    /** Key of a block recently evicted from the in queue */
+    class GhostEntry {
+    public:
+      GhostEntry(uint64_t k, uint32_t len) : key(k), length(len) { }
+      uint64_t key;
+      uint32_t length;
+    };
+
+    typedef boost::multi_index_container<
+      GhostEntry,
+      indexed_by<
+        sequenced<>,
+        hashed_unique<member<GhostEntry, uint64_t, &GhostEntry::key>, HashI64>
+      >
+    > GhostCache;
+
+    typedef GhostCache::nth_index<1>::type GhostHashIndex;
+
+    class Shard : boost::noncopyable {
+    public:
+      Shard(uint64_t max) : max_memory(max), in_max_memory(max / 4),
+          ghost_max_memory(max / 2), in_memory(0), hot_memory(0),
+          ghost_memory(0) { }
+      ~Shard();
+
+      bool make_room(uint32_t length);
+      bool evict_from(BlockCache &queue, uint64_t &memory, bool ghost);
+      void add_ghost(uint64_t key, uint32_t length);
+
+      boost::mutex mutex;
+      BlockCache   in_queue;
+      BlockCache   hot_queue;
+      GhostCache   ghosts;
+      uint64_t     max_memory;
+      uint64_t     in_max_memory;
+      uint64_t     ghost_max_memory;
+      uint64_t     in_memory;
+      uint64_t     hot_memory;
+      uint64_t     ghost_memory;
+      Statistics   stats;
+    };
+
+    Shard &get_shard(uint64_t key) {
+      // multiplicative hash so that consecutive offsets spread out
+      return *m_shards[(size_t)((key * 0x9E3779B97F4A7C15ULL) >> 40)
+                       & m_shard_mask];
+    }
+
+    std::vector<Shard *> m_shards;
+    size_t               m_shard_mask;
   };
 
 }
@@ -25,13 +25,13 @@
 
 namespace Hypertable {
 
-  bool FillScanBlock(CellListScannerPtr &scanner, DynamicBuffer &dbuf) {
+  bool FillScanBlock(CellListScannerPtr &scanner, DynamicBuffer &dbuf,
+                     size_t limit) {
     ByteString key;
     ByteString value;
     size_t key_len, value_len;
     bool more = true;
-    size_t limit = HYPERTABLE_DATA_TRANSFER_BLOCKSIZE;
-    size_t remaining = HYPERTABLE_DATA_TRANSFER_BLOCKSIZE;
+    size_t remaining = limit;
     uint8_t *ptr;
 
     assert(dbuf.base == 0);
@@ -24,11 +24,24 @@
 
 #include "Common/DynamicBuffer.h"
 
+#include "Hypertable/Lib/Defaults.h"
+
 #include "CellListScanner.h"
 
 namespace Hypertable {
 
-  bool FillScanBlock(CellListScannerPtr &scanner, DynamicBuffer &dbuf);
+  /**
+   * Fills a scan block with cells from a scanner.  The block is prefixed
+   * with its encoded length.
+   *
+   * @param scanner scanner to read cells from
+   * @param dbuf empty buffer to fill
+   * @param limit maximum number of bytes of cells to put in the block
+   *        (exceeded only if the first cell is larger)
+   * @return true if the scanner has more cells, false otherwise
+   */
+  bool FillScanBlock(CellListScannerPtr &scanner, DynamicBuffer &dbuf,
+                     size_t limit=HYPERTABLE_DATA_TRANSFER_BLOCKSIZE);
 
 }
 
@@ -43,11 +43,14 @@ namespace Hypertable {
   int32_t                Global::access_group_max_files = 0;
   int32_t                Global::access_group_merge_files = 0;
   int32_t                Global::access_group_max_mem = 0;
+  int32_t                Global::access_group_compaction_threads = 1;
+  int32_t                Global::cell_store_compression_threads = 2;
   ScannerMap             Global::scanner_map;
   FileBlockCache        *Global::block_cache = 0;
   TablePtr               Global::metadata_table_ptr = 0;
   uint64_t               Global::range_metadata_max_bytes = 0;
   MemoryTracker          Global::memory_tracker;
+  uint64_t               Global::cell_cache_max_memory = 0;
   uint64_t               Global::log_prune_threshold_min = 0;
   uint64_t               Global::log_prune_threshold_max = 0;
 
@@ -62,11 +62,14 @@ namespace Hypertable {
     static int32_t        access_group_max_files;
     static int32_t        access_group_merge_files;
     static int32_t        access_group_max_mem;
+    static int32_t        access_group_compaction_threads;
+    static int32_t        cell_store_compression_threads;
     static ScannerMap     scanner_map;
     static Hypertable::FileBlockCache *block_cache;
     static TablePtr       metadata_table_ptr;
     static uint64_t       range_metadata_max_bytes;
     static Hypertable::MemoryTracker memory_tracker;
+    static uint64_t       cell_cache_max_memory;
     static uint64_t       log_prune_threshold_min;
     static uint64_t       log_prune_threshold_max;
   };
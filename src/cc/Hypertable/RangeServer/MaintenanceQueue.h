@@ -23,30 +23,101 @@
 #define HYPERTABLE_MAINTENANCEQUEUE_H
 
 #include <cassert>
+#include <map>
+#include <queue>
+#include <set>
+#include <vector>
+
+#include <boost/thread/condition.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/xtime.hpp>
+
+#include "Common/Logger.h"
+#include "Common/ReferenceCount.h"
+#include "Common/String.h"
 
 #include "MaintenanceTask.h"
 
 namespace Hypertable {
 
   /**
+   * Queue of maintenance tasks (splits, compactions, log cleanup) carried
+   * out by a pool of worker threads.  Tasks whose start time has arrived
+   * run in order of decreasing priority (first come, first served among
+   * equals).  At most max_compactions compactions run at once; a worker
+   * passes over queued compactions while the limit is reached.  CellStore
+   * writers call #throttle_write so that maintenance does not use more
+   * than max_write_bandwidth bytes per second of DFS write bandwidth.
    */
   class MaintenanceQueue : public ReferenceCount {
 
+  public:
+
+    class TaskStatistics {
+    public:
+      TaskStatistics() : count(0), total_wait_millis(0), max_wait_millis(0),
+                         total_exec_millis(0), max_exec_millis(0) { }
+      uint64_t count;
+      uint64_t total_wait_millis;
+      uint64_t max_wait_millis;
+      uint64_t total_exec_millis;
+      uint64_t max_exec_millis;
+    };
+
+    class Statistics {
+    public:
+      Statistics() : queued(0), running(0), running_compactions(0) { }
+      size_t   queued;
+      uint32_t running;
+      uint32_t running_compactions;
+      std::map<String, TaskStatistics> tasks;
+    };
+
+  private:
+
     struct LtMaintenanceTask {
+      bool operator()(const MaintenanceTask *sm1, const MaintenanceTask *sm2) const {
+        if (sm1->priority != sm2->priority)
+          return sm1->priority > sm2->priority;
+        return sm1->sequence < sm2->sequence;
+      }
+    };
+
+    struct LtStartTime {
       bool operator()(const MaintenanceTask *sm1, const MaintenanceTask *sm2) const {
         return xtime_cmp(sm1->start_time, sm2->start_time) >= 0;
       }
     };
 
-    typedef std::priority_queue<MaintenanceTask *, std::vector<MaintenanceTask *>, LtMaintenanceTask> TaskQueue;
+    typedef std::set<MaintenanceTask *, LtMaintenanceTask> TaskQueue;
+    typedef std::priority_queue<MaintenanceTask *, std::vector<MaintenanceTask *>, LtStartTime> DelayedQueue;
+
+    static uint64_t millis_between(boost::xtime &start, boost::xtime &end) {
+      int64_t millis = ((int64_t)end.sec - (int64_t)start.sec) * 1000LL
+        + ((int64_t)end.nsec - (int64_t)start.nsec) / 1000000LL;
+      return (millis < 0) ? 0 : (uint64_t)millis;
+    }
 
     class MaintenanceQueueState {
     public:
-      MaintenanceQueueState() : shutdown(false) { return; }
+      MaintenanceQueueState() : shutdown(false), next_sequence(0),
+          max_compactions(1), running(0), running_compactions(0),
+          max_write_bandwidth(0), write_credit(0.0) { return; }
       TaskQueue          queue;
+      DelayedQueue       delayed;
       boost::mutex       mutex;
       boost::condition   cond;
       bool               shutdown;
+      uint64_t           next_sequence;
+      uint32_t           max_compactions;
+      uint32_t           running;
+      uint32_t           running_compactions;
+      std::map<String, TaskStatistics> task_stats;
+      boost::mutex       throttle_mutex;
+      uint64_t           max_write_bandwidth;
+      double             write_credit;
+      boost::xtime       write_credit_time;
     };
 
     class Worker {
@@ -56,34 +127,38 @@ namespace Hypertable {
       Worker(MaintenanceQueueState &state) : m_state(state) { return; }
 
       void operator()() {
-        boost::xtime now, next_work;
+        boost::xtime started, finished;
         MaintenanceTask *task = 0;
+        uint64_t wait_millis, exec_millis;
+        bool compaction;
 
         while (true) {
 
           {
             boost::mutex::scoped_lock lock(m_state.mutex);
 
-            boost::xtime_get(&now, boost::TIME_UTC);
-
-            while (m_state.queue.empty() || xtime_cmp((m_state.queue.top())->start_time, now) > 0) {
+            while ((task = next_task()) == 0) {
 
               if (m_state.shutdown)
                 return;
 
-              if (m_state.queue.empty())
+              if (m_state.delayed.empty())
                 m_state.cond.wait(lock);
               else {
-                next_work = (m_state.queue.top())->start_time;
+                boost::xtime next_work = (m_state.delayed.top())->start_time;
                 m_state.cond.timed_wait(lock, next_work);
               }
-              boost::xtime_get(&now, boost::TIME_UTC);
             }
 
-            task = m_state.queue.top();
-            m_state.queue.pop();
+            compaction = task->is_compaction();
+            m_state.running++;
+            if (compaction)
+              m_state.running_compactions++;
           }
 
+          boost::xtime_get(&started, boost::TIME_UTC);
+          wait_millis = millis_between(task->queue_time, started);
+
           try {
             task->execute();
           }
@@ -91,11 +166,60 @@ namespace Hypertable {
             HT_ERRORF("%s (%s)", Error::get_text(e.code()), e.what());
           }
 
+          boost::xtime_get(&finished, boost::TIME_UTC);
+          exec_millis = millis_between(started, finished);
+
+          {
+            boost::mutex::scoped_lock lock(m_state.mutex);
+            TaskStatistics &stats = m_state.task_stats[task->name()];
+            stats.count++;
+            stats.total_wait_millis += wait_millis;
+            if (wait_millis > stats.max_wait_millis)
+              stats.max_wait_millis = wait_millis;
+            stats.total_exec_millis += exec_millis;
+            if (exec_millis > stats.max_exec_millis)
+              stats.max_exec_millis = exec_millis;
+            m_state.running--;
+            if (compaction) {
+              m_state.running_compactions--;
+              m_state.cond.notify_all();
+            }
+          }
+
           delete task;
         }
       }
 
     private:
+
+      /**
+       * Moves delayed tasks that are due onto the queue and removes the
+       * highest priority task that may run now.  Called with the state
+       * mutex held.
+       */
+      MaintenanceTask *next_task() {
+        boost::xtime now;
+        MaintenanceTask *task;
+
+        boost::xtime_get(&now, boost::TIME_UTC);
+        while (!m_state.delayed.empty() &&
+               xtime_cmp((m_state.delayed.top())->start_time, now) <= 0) {
+          m_state.queue.insert(m_state.delayed.top());
+          m_state.delayed.pop();
+        }
+
+        for (TaskQueue::iterator iter = m_state.queue.begin();
+             iter != m_state.queue.end(); ++iter) {
+          task = *iter;
+          if (task->is_compaction() &&
+              m_state.running_compactions >= m_state.max_compactions)
+            continue;
+          m_state.queue.erase(iter);
+          return task;
+        }
+        return 0;
+      }
+
       MaintenanceQueueState &m_state;
     };
 
@@ -106,32 +230,42 @@ namespace Hypertable {
   public:
 
     /**
-     * Constructor to set up the application queue.  It creates a number
+     * Constructor to set up the maintenance queue.  It creates a number
      * of worker threads specified by the worker_count argument.
      *
      * @param worker_count number of worker threads to create
+     * @param max_compactions maximum number of concurrent compactions
+     *        (0 for one less than the number of workers, at least one)
+     * @param max_write_bandwidth maximum DFS write rate of maintenance
+     *        tasks in bytes per second (0 for unlimited)
      */
-    MaintenanceQueue(int worker_count) : joined(false) {
-      Worker Worker(m_state);
+    MaintenanceQueue(int worker_count, uint32_t max_compactions=0,
+                     uint64_t max_write_bandwidth=0) : joined(false) {
       assert (worker_count > 0);
+      if (max_compactions == 0)
+        max_compactions = (worker_count > 1) ? worker_count - 1 : 1;
+      m_state.max_compactions = max_compactions;
+      m_state.max_write_bandwidth = max_write_bandwidth;
+      boost::xtime_get(&m_state.write_credit_time, boost::TIME_UTC);
+      Worker Worker(m_state);
       for (int i=0; i<worker_count; ++i)
         m_threads.create_thread(Worker);
-      //threads
     }
 
     /**
-     * Shuts down the application queue.  All outstanding requests are carried
-     * out and then all threads exit.  #join can be called to wait for completion
-     * of the shutdown.
+     * Shuts down the maintenance queue.  All outstanding tasks that are
+     * due are carried out and then all threads exit.  #join can be called
+     * to wait for completion of the shutdown.
      */
     void shutdown() {
+      boost::mutex::scoped_lock lock(m_state.mutex);
       m_state.shutdown = true;
       m_state.cond.notify_all();
     }
 
     /**
-     * Waits for a shutdown to complete.  This method returns when all application
-     * queue threads exit.
+     * Waits for a shutdown to complete.  This method returns when all
+     * maintenance queue threads exit.
      */
     void join() {
       if (!joined) {
@@ -141,16 +275,73 @@ namespace Hypertable {
     }
 
     /**
-     * Adds a request (application handler) to the request queue.  The request queue
-     * is designed to support the serialization of related requests.  Requests are
-     * related by the thread group ID value in the ApplicationHandler.  This thread
-     * group ID is constructed in the Event object
+     * Adds a task to the queue.  The task runs once its start time has
+     * arrived and no task of higher priority is waiting.
+     *
+     * @param task task to add (the queue takes ownership)
      */
     void add(MaintenanceTask *task) {
       boost::mutex::scoped_lock lock(m_state.mutex);
-      m_state.queue.push(task);
+      boost::xtime_get(&task->queue_time, boost::TIME_UTC);
+      task->sequence = m_state.next_sequence++;
+      if (xtime_cmp(task->start_time, task->queue_time) > 0)
+        m_state.delayed.push(task);
+      else
+        m_state.queue.insert(task);
       m_state.cond.notify_one();
     }
+
+    /**
+     * Accounts for amount bytes about to be written to the DFS by a
+     * maintenance task, sleeping as needed to stay within the write
+     * bandwidth limit.  Up to one second's worth of unused bandwidth can
+     * be saved up for a burst.
+     *
+     * @param amount number of bytes about to be written
+     */
+    void throttle_write(size_t amount) {
+      boost::xtime now;
+      double delay = 0.0;
+
+      if (m_state.max_write_bandwidth == 0)
+        return;
+
+      {
+        boost::mutex::scoped_lock lock(m_state.throttle_mutex);
+        double bandwidth = (double)m_state.max_write_bandwidth;
+        boost::xtime_get(&now, boost::TIME_UTC);
+        m_state.write_credit += bandwidth *
+          ((double)((int64_t)now.sec - (int64_t)m_state.write_credit_time.sec)
+           + ((double)now.nsec - (double)m_state.write_credit_time.nsec) / 1000000000.0);
+        m_state.write_credit_time = now;
+        if (m_state.write_credit > bandwidth)
+          m_state.write_credit = bandwidth;
+        m_state.write_credit -= (double)amount;
+        if (m_state.write_credit < 0.0)
+          delay = -m_state.write_credit / bandwidth;
+      }
+
+      if (delay > 0.0) {
+        uint64_t nsec = (uint64_t)now.nsec + (uint64_t)(delay * 1000000000.0);
+        now.sec += nsec / 1000000000LL;
+        now.nsec = nsec % 1000000000LL;
+        boost::thread::sleep(now);
+      }
+    }
+
+    /**
+     * Returns the queue depth, the number of running tasks and per-task
+     * counts, queue wait and execution times
+     *
+     * @param stats reference to statistics object to fill in
+     */
+    void get_statistics(Statistics &stats) {
+      boost::mutex::scoped_lock lock(m_state.mutex);
+      stats.queued = m_state.queue.size() + m_state.delayed.size();
+      stats.running = m_state.running;
+      stats.running_compactions = m_state.running_compactions;
+      stats.tasks = m_state.task_stats;
+    }
   };
   typedef boost::intrusive_ptr<MaintenanceQueue> MaintenanceQueuePtr;
 
@@ -26,15 +26,37 @@
 
 namespace Hypertable {
 
+  /**
+   * Base class for work done by the MaintenanceQueue.  Tasks that are
+   * ready to run are executed in order of decreasing priority.
+   */
   class MaintenanceTask {
   public:
-    MaintenanceTask(boost::xtime start_time_) : start_time(start_time_), m_retry(false) { return; }
-    MaintenanceTask(boost::xtime start_time_, time_t retry_delay_seconds) : start_time(start_time_), m_retry(true), m_retry_delay_seconds(retry_delay_seconds) { return; }
-    MaintenanceTask() : m_retry(false) { boost::xtime_get(&start_time, boost::TIME_UTC); return; }
-    MaintenanceTask(time_t retry_delay_seconds) : m_retry(true), m_retry_delay_seconds(retry_delay_seconds) { boost::xtime_get(&start_time, boost::TIME_UTC); return; }
+
+    /** Priorities of tasks that are not scored by cost and benefit */
+    enum {
+      PRIORITY_LOG_CLEANUP = 1000000,
+      PRIORITY_MANUAL      = 100000,
+      PRIORITY_SPLIT       = 10000
+    };
+
+    MaintenanceTask(boost::xtime start_time_) : start_time(start_time_), priority(0.0), sequence(0), m_retry(false) { return; }
+    MaintenanceTask(boost::xtime start_time_, time_t retry_delay_seconds) : start_time(start_time_), priority(0.0), sequence(0), m_retry(true), m_retry_delay_seconds(retry_delay_seconds) { return; }
+    MaintenanceTask() : priority(0.0), sequence(0), m_retry(false) { boost::xtime_get(&start_time, boost::TIME_UTC); return; }
+    MaintenanceTask(time_t retry_delay_seconds) : priority(0.0), sequence(0), m_retry(true), m_retry_delay_seconds(retry_delay_seconds) { boost::xtime_get(&start_time, boost::TIME_UTC); return; }
     virtual ~MaintenanceTask() { return; }
     virtual void execute() = 0;
+
+    /** Name used to report per-task statistics */
+    virtual const char *name() = 0;
+
+    /** Compactions are subject to the queue's concurrency limit */
+    virtual bool is_compaction() { return false; }
+
     boost::xtime start_time;
+    boost::xtime queue_time;
+    double priority;
+    uint64_t sequence;
   private:
     bool m_retry;
     time_t m_retry_delay_seconds;
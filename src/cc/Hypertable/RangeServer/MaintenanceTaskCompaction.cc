@@ -20,6 +20,7 @@
  */
 
 #include "Common/Compat.h"
+#include "Global.h"
 #include "MaintenanceTaskCompaction.h"
 
 using namespace Hypertable;
@@ -27,7 +28,8 @@ using namespace Hypertable;
 /**
  *
  */
-MaintenanceTaskCompaction::MaintenanceTaskCompaction(RangePtr &range_ptr, bool major) : MaintenanceTask(), m_range_ptr(range_ptr), m_major(major) {
+MaintenanceTaskCompaction::MaintenanceTaskCompaction(RangePtr &range_ptr, bool major, double priority_) : MaintenanceTask(), m_range_ptr(range_ptr), m_major(major) {
+  priority = priority_;
 }
 
 
@@ -37,3 +39,22 @@ MaintenanceTaskCompaction::MaintenanceTaskCompaction(RangePtr &range_ptr, bool m
 void MaintenanceTaskCompaction::execute() {
   m_range_ptr->compact(m_major);
 }
+
+
+/**
+ *
+ */
+double MaintenanceTaskCompaction::compute_priority(const AccessGroup::CompactionPriorityData &pd) {
+  const double mb = 1048576.0;
+  double benefit, cost;
+
+  benefit = (double)pd.log_space_pinned / mb + (double)pd.mem_used / mb;
+  if (pd.cell_stores > 1)
+    benefit += (double)(pd.cell_stores - 1);
+
+  cost = (double)pd.mem_used / mb;
+  if (pd.cell_stores >= (uint32_t)Global::access_group_max_files)
+    cost += (double)pd.disk_used / mb;
+
+  return benefit / (1.0 + cost);
+}
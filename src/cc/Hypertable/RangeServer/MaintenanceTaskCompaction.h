@@ -22,6 +22,7 @@
 #ifndef HYPERTABLE_MAINTENANCETASKCOMPACTION_H
 #define HYPERTABLE_MAINTENANCETASKCOMPACTION_H
 
+#include "AccessGroup.h"
 #include "Range.h"
 #include "MaintenanceTask.h"
 
@@ -29,8 +30,23 @@ namespace Hypertable {
 
   class MaintenanceTaskCompaction : public MaintenanceTask {
   public:
-    MaintenanceTaskCompaction(RangePtr &range_ptr, bool major);
+    MaintenanceTaskCompaction(RangePtr &range_ptr, bool major, double priority);
     virtual void execute();
+    virtual const char *name() { return "compaction"; }
+    virtual bool is_compaction() { return true; }
+
+    /**
+     * Scores the compaction of an access group as benefit over cost.  The
+     * benefit is the commit log space it unpins, the memory it frees and
+     * the read amplification it removes (one point per extra CellStore).
+     * The cost is the number of bytes the compaction has to write, which
+     * includes the existing CellStores once a merge is due.
+     *
+     * @param pd compaction priority data of the access group
+     * @return priority of the compaction
+     */
+    static double compute_priority(const AccessGroup::CompactionPriorityData &pd);
+
   private:
     RangePtr m_range_ptr;
     bool     m_major;
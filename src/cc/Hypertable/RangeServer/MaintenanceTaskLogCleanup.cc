@@ -30,6 +30,7 @@ using namespace Hypertable;
  *
  */
 MaintenanceTaskLogCleanup::MaintenanceTaskLogCleanup(RangeServer *range_server) : MaintenanceTask(), m_range_server(range_server) {
+  priority = PRIORITY_LOG_CLEANUP;
 }
 
 
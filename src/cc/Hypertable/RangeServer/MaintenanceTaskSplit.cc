@@ -29,6 +29,7 @@ using namespace Hypertable;
  *
  */
 MaintenanceTaskSplit::MaintenanceTaskSplit(RangePtr &range_ptr) : MaintenanceTask(), m_range_ptr(range_ptr) {
+  priority = PRIORITY_SPLIT;
 }
 
 
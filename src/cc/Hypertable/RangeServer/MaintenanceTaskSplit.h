@@ -31,6 +31,7 @@ namespace Hypertable {
   public:
     MaintenanceTaskSplit(RangePtr &range_ptr);
     virtual void execute();
+    virtual const char *name() { return "split"; }
   private:
     RangePtr m_range_ptr;
   };
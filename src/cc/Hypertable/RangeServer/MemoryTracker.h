@@ -22,48 +22,109 @@
 #ifndef HYPERTABLE_MEMORYTRACKER_H
 #define HYPERTABLE_MEMORYTRACKER_H
 
+#include <boost/thread/condition.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/xtime.hpp>
 
 namespace Hypertable {
 
+  /**
+   * Tracks the memory and the number of cells held in the server's cell
+   * caches.  The counters are updated with atomic instructions, so the
+   * update path never takes a lock.  Update threads that are throttled
+   * because the cell caches are over budget sleep in #wait_for_total; the
+   * lock is only taken to wake them when memory is released while someone
+   * is waiting.
+   */
   class MemoryTracker {
   public:
-    MemoryTracker() : m_memory_used(0), m_item_count(0) { return; }
+    MemoryTracker() : m_memory_used(0), m_item_count(0), m_item_overhead(0),
+                      m_waiters(0) { return; }
 
     void add_memory(uint64_t amount) {
-      boost::mutex::scoped_lock lock(m_mutex);
-      m_memory_used += amount;
+      __sync_add_and_fetch(&m_memory_used, amount);
     }
 
     void remove_memory(uint64_t amount) {
-      boost::mutex::scoped_lock lock(m_mutex);
-      m_memory_used -= amount;
+      __sync_sub_and_fetch(&m_memory_used, amount);
+      wake_waiters();
     }
 
-    uint64_t get_memory() {
-      boost::mutex::scoped_lock lock(m_mutex);
-      return m_memory_used;
-    }
+    uint64_t get_memory() { return m_memory_used; }
 
     void add_items(uint64_t count) {
-      boost::mutex::scoped_lock lock(m_mutex);
-      m_item_count += count;
+      __sync_add_and_fetch(&m_item_count, count);
     }
 
     void remove_items(uint64_t count) {
-      boost::mutex::scoped_lock lock(m_mutex);
-      m_item_count -= count;
+      __sync_sub_and_fetch(&m_item_count, count);
+      wake_waiters();
     }
 
-    uint64_t get_items() {
+    uint64_t get_items() { return m_item_count; }
+
+    /**
+     * Sets the per-cell overhead of the cell map, used by #get_total
+     */
+    void set_item_overhead(uint64_t overhead) { m_item_overhead = overhead; }
+
+    /**
+     * Returns an estimate of the total memory held by the cell caches,
+     * including the overhead of the cell maps.
+     */
+    uint64_t get_total() {
+      return m_memory_used + (m_item_count * m_item_overhead);
+    }
+
+    /**
+     * Waits until #get_total drops to the given limit, or until the
+     * timeout expires.
+     *
+     * @param limit memory limit
+     * @param max_wait_millis maximum number of milliseconds to wait
+     * @return true if memory is within the limit, false on timeout
+     */
+    bool wait_for_total(uint64_t limit, uint32_t max_wait_millis) {
       boost::mutex::scoped_lock lock(m_mutex);
-      return m_item_count;
+      boost::xtime deadline;
+      bool within_limit = true;
+
+      boost::xtime_get(&deadline, boost::TIME_UTC);
+      deadline.sec += max_wait_millis / 1000;
+      deadline.nsec += (max_wait_millis % 1000) * 1000000;
+      if (deadline.nsec >= 1000000000) {
+        deadline.sec++;
+        deadline.nsec -= 1000000000;
+      }
+
+      // m_waiters is raised before the check so a concurrent release
+      // either is seen by the check or takes the lock to notify us
+      __sync_add_and_fetch(&m_waiters, 1);
+      while (get_total() > limit) {
+        if (!m_cond.timed_wait(lock, deadline)) {
+          within_limit = get_total() <= limit;
+          break;
+        }
+      }
+      __sync_sub_and_fetch(&m_waiters, 1);
+      return within_limit;
     }
 
   private:
-    boost::mutex m_mutex;
-    uint64_t m_memory_used;
-    uint64_t m_item_count;
+
+    void wake_waiters() {
+      if (m_waiters) {
+        boost::mutex::scoped_lock lock(m_mutex);
+        m_cond.notify_all();
+      }
+    }
+
+    volatile uint64_t m_memory_used;
+    volatile uint64_t m_item_count;
+    uint64_t          m_item_overhead;
+    volatile int      m_waiters;
+    boost::mutex      m_mutex;
+    boost::condition  m_cond;
   };
 
 }
@@ -20,7 +20,9 @@
  */
 
 #include "Common/Compat.h"
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 
 #include "Common/Logger.h"
 
@@ -30,12 +32,52 @@
 
 using namespace Hypertable;
 
+namespace {
+
+  /**
+   * Records a delete covering the given key prefix, or raises the
+   * timestamp of the recorded delete if it is for the same prefix.
+   */
+  inline void record_delete(DynamicBuffer &deleted, uint64_t &deleted_timestamp,
+                            const uint8_t *prefix, size_t len,
+                            uint64_t timestamp) {
+    if (deleted.fill() == len && !key_memcmp(deleted.base, prefix, len)) {
+      if (deleted_timestamp < timestamp)
+        deleted_timestamp = timestamp;
+    }
+    else {
+      deleted.set(prefix, len);
+      deleted_timestamp = timestamp;
+    }
+  }
+
+  /**
+   * Returns true if the recorded delete hides a cell with the given key
+   * prefix and timestamp.  Cells arrive in sorted order, so once a cell
+   * with a different prefix shows up the delete can't match again and is
+   * dropped.
+   */
+  inline bool check_delete(DynamicBuffer &deleted, uint64_t deleted_timestamp,
+                           const uint8_t *prefix, size_t len,
+                           uint64_t timestamp) {
+    if (deleted.fill() == 0)
+      return false;
+    if (deleted.fill() == len && !key_memcmp(deleted.base, prefix, len))
+      return timestamp <= deleted_timestamp;
+    deleted.clear();
+    return false;
+  }
+
+}
+
 /**
  *
  */
-MergeScanner::MergeScanner(ScanContextPtr &scan_ctx, bool return_dels) : CellListScanner(scan_ctx), m_done(false), m_initialized(false), m_scanners(), m_queue(), m_delete_present(false), m_deleted_row(0), m_deleted_column_family(0), m_deleted_cell(0), m_return_deletes(return_dels), m_row_count(0), m_row_limit(0), m_cell_count(0), m_cell_limit(0), m_cell_cutoff(0), m_prev_key(0) {
+MergeScanner::MergeScanner(ScanContextPtr &scan_ctx, bool return_dels) : CellListScanner(scan_ctx), m_done(false), m_initialized(false), m_scanners(), m_delete_present(false), m_deleted_row(0), m_deleted_column_family(0), m_deleted_cell(0), m_return_deletes(return_dels), m_row_count(0), m_row_limit(0), m_cell_count(0), m_cell_limit(0), m_prev_key(0), m_prev_row_len(0), m_predicate_filter(0), m_gc_stats(0) {
   if (scan_ctx->spec != 0)
     m_row_limit = scan_ctx->spec->row_limit;
+  if (!scan_ctx->predicate_filter.empty())
+    m_predicate_filter = &scan_ctx->predicate_filter;
   m_start_timestamp = scan_ctx->interval.first;
   m_end_timestamp = scan_ctx->interval.second;
 }
@@ -58,272 +100,263 @@ MergeScanner::~MergeScanner() {
 
 
 void MergeScanner::forward() {
-  ScannerState sstate;
-  Key key;
-  size_t len;
 
-  if (m_queue.empty())
+  if (m_tree.empty() || !m_states[m_tree[0]].valid)
     return;
 
-  sstate = m_queue.top();
+  advance();
+  select();
+}
 
-  /**
-   * Pop the top element, forward it, re-insert it back into the queue;
-   */
 
-  while (true) {
 
-    while (true) {
+bool MergeScanner::get(ByteString &key, ByteString &value) {
 
-      m_queue.pop();
-      sstate.scanner->forward();
-      if (sstate.scanner->get(sstate.key, sstate.value))
-        m_queue.push(sstate);
+  if (!m_initialized)
+    initialize();
 
-      if (m_queue.empty())
-        return;
+  if (!m_tree.empty() && m_states[m_tree[0]].valid && !m_done) {
+    const ScannerState &sstate = m_states[m_tree[0]];
+    key = sstate.key;
+    value = sstate.value;
+    return true;
+  }
+  return false;
+}
 
-      sstate = m_queue.top();
 
-      if (!key.load(sstate.key)) {
-        HT_ERROR("Problem decoding key!");
-      }
-      else if (key.timestamp < m_start_timestamp) {
-        continue;
-      }
-      else if (key.flag == FLAG_DELETE_ROW) {
-        len = strlen(key.row) + 1;
-        if (m_delete_present && m_deleted_row.fill() == len && !memcmp(m_deleted_row.base, key.row, len)) {
-          if (m_deleted_row_timestamp < key.timestamp)
-            m_deleted_row_timestamp = key.timestamp;
-        }
-        else {
-          m_deleted_row.clear();
-          m_deleted_row.ensure(len);
-          memcpy(m_deleted_row.base, key.row, len);
-          m_deleted_row.ptr = m_deleted_row.base + len;
-          m_deleted_row_timestamp = key.timestamp;
-          m_delete_present = true;
-        }
-        if (m_return_deletes)
-          break;
-      }
-      else if (key.flag == FLAG_DELETE_COLUMN_FAMILY) {
-        len = key.column_qualifier - key.row;
-        if (m_delete_present && m_deleted_column_family.fill() == len && !memcmp(m_deleted_column_family.base, key.row, len)) {
-          if (m_deleted_column_family_timestamp < key.timestamp)
-            m_deleted_column_family_timestamp = key.timestamp;
-        }
-        else {
-          m_deleted_column_family.clear();
-          m_deleted_column_family.ensure(len);
-          memcpy(m_deleted_column_family.base, key.row, len);
-          m_deleted_column_family.ptr = m_deleted_column_family.base + len;
-          m_deleted_column_family_timestamp = key.timestamp;
-          m_delete_present = true;
-        }
-        if (m_return_deletes)
-          break;
-      }
-      else if (key.flag == FLAG_DELETE_CELL) {
-        len = (key.column_qualifier - key.row) + strlen(key.column_qualifier) + 1;
-        if (m_delete_present && m_deleted_cell.fill() == len && !memcmp(m_deleted_cell.base, key.row, len)) {
-          if (m_deleted_cell_timestamp < key.timestamp)
-            m_deleted_cell_timestamp = key.timestamp;
-        }
-        else {
-          m_deleted_cell.clear();
-          m_deleted_cell.ensure(len);
-          memcpy(m_deleted_cell.base, key.row, len);
-          m_deleted_cell.ptr = m_deleted_cell.base + len;
-          m_deleted_cell_timestamp = key.timestamp;
-          m_delete_present = true;
-        }
-        if (m_return_deletes)
-          break;
-      }
-      else {
-        if (key.timestamp >= m_end_timestamp)
-          continue;
-        if (!m_return_deletes && m_delete_present) {
-          if (m_deleted_cell.fill() > 0) {
-            len = (key.column_qualifier - key.row) + strlen(key.column_qualifier) + 1;
-            if (m_deleted_cell.fill() == len && !memcmp(m_deleted_cell.base, key.row, len)) {
-              if (key.timestamp <= m_deleted_cell_timestamp)
-                continue;
-              break;
-            }
-            m_deleted_cell.clear();
-          }
-          if (m_deleted_column_family.fill() > 0) {
-            len = key.column_qualifier - key.row;
-            if (m_deleted_column_family.fill() == len && !memcmp(m_deleted_column_family.base, key.row, len)) {
-              if (key.timestamp <= m_deleted_column_family_timestamp)
-                continue;
-              break;
-            }
-            m_deleted_column_family.clear();
-          }
-          if (m_deleted_row.fill() > 0) {
-            len = strlen(key.row) + 1;
-            if (m_deleted_row.fill() == len && !memcmp(m_deleted_row.base, key.row, len)) {
-              if (key.timestamp <= m_deleted_row_timestamp)
-                continue;
-              break;
-            }
-            m_deleted_row.clear();
-          }
-          m_delete_present = false;
-        }
-        break;
-      }
+
+void MergeScanner::initialize() {
+  m_states.resize(m_scanners.size());
+  for (size_t i=0; i<m_scanners.size(); i++) {
+    m_states[i].scanner = m_scanners[i];
+    fetch(m_states[i]);
+  }
+  build_tree();
+  select();
+  m_initialized = true;
+}
+
+
+
+/**
+ * Loads the scanner's current cell into the state and decodes its key.
+ * Cells with undecodable keys are logged and skipped.
+ *
+ * @return false if the scanner is exhausted
+ */
+bool MergeScanner::fetch(ScannerState &sstate) {
+  while (sstate.scanner->get(sstate.key, sstate.value)) {
+    if (sstate.decoded.load(sstate.key)) {
+      sstate.len = sstate.key.decode_length(&sstate.data);
+      sstate.column_len = sstate.decoded.column_qualifier - sstate.decoded.row;
+      sstate.row_len = sstate.column_len - 1;
+      sstate.cell_len = sstate.len - 9;
+      sstate.valid = true;
+      return true;
     }
+    HT_ERROR("Problem decoding key!");
+    sstate.scanner->forward();
+  }
+  sstate.valid = false;
+  return false;
+}
 
-    const uint8_t *prev_key;
-    size_t prev_key_len = sstate.key.decode_length(&prev_key);
 
-    if (m_prev_key.fill() != 0) {
 
-      if (m_row_limit) {
-        if (strcmp(key.row, (const char *)m_prev_key.base)) {
-          m_row_count++;
-          if (m_row_count >= m_row_limit) {
-            m_done = true;
-            return;
-          }
-          m_prev_key.set(prev_key, prev_key_len);
-          m_cell_limit = m_scan_context_ptr->family_info[key.column_family_code].max_versions;
-          m_cell_cutoff = m_scan_context_ptr->family_info[key.column_family_code].cutoff_time;
-          m_cell_count = 0;
-          return;
-        }
-      }
+/**
+ * Builds the loser tree.  The scanners are the leaves (leaf i is node
+ * n + i); each internal node holds the loser of the match between the
+ * winners of its two subtrees and m_tree[0] holds the overall winner.
+ */
+void MergeScanner::build_tree() {
+  size_t n = m_states.size();
+  std::vector<size_t> winners(2 * n);
 
-      if (prev_key_len == m_prev_key.fill() && prev_key_len > 9 && !memcmp(prev_key, m_prev_key.base, prev_key_len-9)) {
-        if (m_cell_limit) {
-          m_cell_count++;
-          m_prev_key.set(prev_key, prev_key_len);
-          if (m_cell_count >= m_cell_limit)
-            continue;
-        }
-      }
-      else {
-        m_prev_key.set(prev_key, prev_key_len);
-        m_cell_limit = m_scan_context_ptr->family_info[key.column_family_code].max_versions;
-        m_cell_cutoff = m_scan_context_ptr->family_info[key.column_family_code].cutoff_time;
-        m_cell_count = 0;
-      }
+  m_tree.resize(n);
+  if (n == 0)
+    return;
 
+  for (size_t i=0; i<n; i++)
+    winners[n + i] = i;
+
+  for (size_t node = n - 1; node > 0; node--) {
+    size_t left = winners[2 * node];
+    size_t right = winners[2 * node + 1];
+    if (less(right, left)) {
+      winners[node] = right;
+      m_tree[node] = left;
     }
     else {
-      m_prev_key.set(prev_key, prev_key_len);
-      m_cell_limit = m_scan_context_ptr->family_info[key.column_family_code].max_versions;
-      m_cell_cutoff = m_scan_context_ptr->family_info[key.column_family_code].cutoff_time;
-      m_cell_count = 0;
+      winners[node] = left;
+      m_tree[node] = right;
     }
-
-    break;
   }
-
-
+  m_tree[0] = (n == 1) ? 0 : winners[1];
 }
 
 
 
-bool MergeScanner::get(ByteString &key, ByteString &value) {
+/**
+ * Advances the winning scanner and replays its matches on the path from
+ * its leaf to the root.
+ */
+void MergeScanner::advance() {
+  size_t winner = m_tree[0];
 
-  if (!m_initialized)
-    initialize();
+  m_states[winner].scanner->forward();
+  fetch(m_states[winner]);
 
-  if (!m_queue.empty() && !m_done) {
-    const ScannerState &sstate = m_queue.top();
-    // check for row or cell limit
-    key = sstate.key;
-    value = sstate.value;
-    return true;
+  for (size_t node = (winner + m_tree.size()) / 2; node > 0; node /= 2) {
+    if (less(m_tree[node], winner))
+      std::swap(m_tree[node], winner);
   }
-  return false;
+  m_tree[0] = winner;
 }
 
 
 
-void MergeScanner::initialize() {
-  ScannerState sstate;
-  while (!m_queue.empty())
-    m_queue.pop();
-  for (size_t i=0; i<m_scanners.size(); i++) {
-    if (m_scanners[i]->get(sstate.key, sstate.value)) {
-      sstate.scanner = m_scanners[i];
-      m_queue.push(sstate);
-    }
-  }
-  while (!m_queue.empty()) {
-    sstate = m_queue.top();
-    Key key;
-    if (!key.load(sstate.key)) {
-      assert(!"MergeScanner::initialize() - Problem decoding key!");
-    }
+/**
+ * Starting at the current winner, skips over cells that are outside the
+ * scan interval, expired, deleted, rejected by the scan predicates, or
+ * beyond the version limit and records any deletes encountered along the way.  Stops
+ * at the first cell to return.  Predicates are applied before the row and
+ * version limits, so the limits count matching cells only.
+ */
+void MergeScanner::select() {
+
+  while (!m_tree.empty() && m_states[m_tree[0]].valid) {
+    const ScannerState &sstate = m_states[m_tree[0]];
+    const Key &key = sstate.decoded;
 
     if (key.timestamp < m_start_timestamp) {
-      m_queue.pop();
-      sstate.scanner->forward();
-      if (sstate.scanner->get(sstate.key, sstate.value))
-        m_queue.push(sstate);
+      advance();
       continue;
     }
 
     if (key.flag == FLAG_DELETE_ROW) {
-      size_t len = strlen(key.row) + 1;
-      m_deleted_row.clear();
-      m_deleted_row.ensure(len);
-      memcpy(m_deleted_row.base, key.row, len);
-      m_deleted_row.ptr = m_deleted_row.base + len;
-      m_deleted_row_timestamp = key.timestamp;
+      record_delete(m_deleted_row, m_deleted_row_timestamp, sstate.data,
+                    sstate.row_len, key.timestamp);
       m_delete_present = true;
-      if (!m_return_deletes)
-        forward();
+      if (!m_return_deletes) {
+        collect(sstate);
+        advance();
+        continue;
+      }
     }
     else if (key.flag == FLAG_DELETE_COLUMN_FAMILY) {
-      size_t len = (key.column_qualifier - key.row) + strlen(key.column_qualifier) + 1;
-      m_deleted_column_family.clear();
-      m_deleted_column_family.ensure(len);
-      memcpy(m_deleted_column_family.base, key.row, len);
-      m_deleted_column_family.ptr = m_deleted_column_family.base + len;
-      m_deleted_column_family_timestamp = key.timestamp;
+      if (expired(key)) {
+        collect(sstate);
+        advance();
+        continue;
+      }
+      record_delete(m_deleted_column_family, m_deleted_column_family_timestamp,
+                    sstate.data, sstate.column_len, key.timestamp);
       m_delete_present = true;
-      if (!m_return_deletes)
-        forward();
+      if (!m_return_deletes) {
+        collect(sstate);
+        advance();
+        continue;
+      }
     }
     else if (key.flag == FLAG_DELETE_CELL) {
-      size_t len = (key.column_qualifier - key.row) + strlen(key.column_qualifier) + 1;
-      m_deleted_cell.clear();
-      m_deleted_cell.ensure(len);
-      memcpy(m_deleted_cell.base, key.row, len);
-      m_deleted_cell.ptr = m_deleted_cell.base + len;
-      m_deleted_cell_timestamp = key.timestamp;
+      if (expired(key)) {
+        collect(sstate);
+        advance();
+        continue;
+      }
+      record_delete(m_deleted_cell, m_deleted_cell_timestamp, sstate.data,
+                    sstate.cell_len, key.timestamp);
       m_delete_present = true;
-      if (!m_return_deletes)
-        forward();
+      if (!m_return_deletes) {
+        collect(sstate);
+        advance();
+        continue;
+      }
     }
     else {
       if (key.timestamp >= m_end_timestamp) {
-        m_queue.pop();
-        sstate.scanner->forward();
-        if (sstate.scanner->get(sstate.key, sstate.value))
-          m_queue.push(sstate);
+        advance();
+        continue;
+      }
+      if (expired(key)) {
+        collect(sstate);
+        advance();
+        continue;
+      }
+      if (!m_return_deletes && m_delete_present) {
+        if (check_delete(m_deleted_cell, m_deleted_cell_timestamp,
+                         sstate.data, sstate.cell_len, key.timestamp) ||
+            check_delete(m_deleted_column_family,
+                         m_deleted_column_family_timestamp, sstate.data,
+                         sstate.column_len, key.timestamp) ||
+            check_delete(m_deleted_row, m_deleted_row_timestamp,
+                         sstate.data, sstate.row_len, key.timestamp)) {
+          collect(sstate);
+          advance();
+          continue;
+        }
+        if (m_deleted_cell.fill() == 0 && m_deleted_column_family.fill() == 0
+            && m_deleted_row.fill() == 0)
+          m_delete_present = false;
+      }
+      if (m_predicate_filter && !matches_predicates(sstate)) {
+        advance();
         continue;
       }
-      m_delete_present = false;
-      const uint8_t *ptr;
-      size_t len = sstate.key.decode_length(&ptr);
-      m_prev_key.set(ptr, len);
-      m_cell_limit = m_scan_context_ptr->family_info[key.column_family_code].max_versions;
-      m_cell_cutoff = m_scan_context_ptr->family_info[key.column_family_code].cutoff_time;
-      m_cell_count = 0;
     }
-    break;
+
+    if (m_prev_key.fill() != 0) {
+
+      if (m_row_limit) {
+        if (sstate.row_len != m_prev_row_len ||
+            key_memcmp(sstate.data, m_prev_key.base, sstate.row_len)) {
+          m_row_count++;
+          if (m_row_count >= m_row_limit) {
+            m_done = true;
+            return;
+          }
+          set_prev_key(sstate);
+          return;
+        }
+      }
+
+      if (sstate.len == m_prev_key.fill() && sstate.len > 9 &&
+          !key_memcmp(sstate.data, m_prev_key.base, sstate.cell_len)) {
+        if (m_cell_limit) {
+          m_cell_count++;
+          m_prev_key.set(sstate.data, sstate.len);
+          if (m_cell_count >= m_cell_limit) {
+            collect(sstate);
+            advance();
+            continue;
+          }
+        }
+        return;
+      }
+    }
+
+    set_prev_key(sstate);
+    return;
   }
+}
 
-  m_initialized = true;
+
+
+bool MergeScanner::matches_predicates(const ScannerState &sstate) {
+  const uint8_t *value = 0;
+  size_t value_len = sstate.value ? sstate.value.decode_length(&value) : 0;
+  return m_predicate_filter->matches(
+      (const char *)sstate.data + sstate.column_len,
+      sstate.cell_len - sstate.column_len - 1, value, value_len);
 }
 
+
+
+void MergeScanner::set_prev_key(const ScannerState &sstate) {
+  uint8_t family = sstate.decoded.column_family_code;
+  m_prev_key.set(sstate.data, sstate.len);
+  m_prev_row_len = sstate.row_len;
+  m_cell_limit = m_scan_context_ptr->family_info[family].max_versions;
+  m_cell_count = 0;
+}
@@ -22,12 +22,15 @@
 #ifndef HYPERTABLE_MERGESCANNER_H
 #define HYPERTABLE_MERGESCANNER_H
 
-#include <queue>
+#include <cstring>
 #include <string>
 #include <vector>
 
 #include "Common/ByteString.h"
 #include "Common/DynamicBuffer.h"
+#include "Common/KeyCompare.h"
+
+#include "Hypertable/Lib/Key.h"
 
 #include "CellListScanner.h"
 #include "CellStoreReleaseCallback.h"
@@ -35,19 +38,51 @@
 
 namespace Hypertable {
 
+  /**
+   * Merges the output of a set of cell list scanners, applying deletes,
+   * the scan time interval and the row and version limits.  The merge is
+   * done with a loser tree, so advancing the merge costs one comparison
+   * per level of the tree instead of a heap pop and push.
+   *
+   * Cells older than their column family's TTL cutoff are dropped, as are
+   * cell and column family deletes older than the cutoff since everything
+   * they cover has expired too.  When used for a compaction, a
+   * GcStatistics object can be installed to tally the cells that were
+   * dropped for good (expired, beyond the version limit, deleted or
+   * deletes) by column family.
+   */
   class MergeScanner : public CellListScanner {
   public:
 
+    /**
+     * Current cell of one of the merged scanners.  The key is decoded once
+     * when the scanner is advanced and the lengths of its row, column
+     * family and cell prefixes are kept alongside so that delete and
+     * version checks are plain memcmp()s.
+     */
     struct ScannerState {
       CellListScanner *scanner;
       ByteString key;
       ByteString value;
+      Key decoded;
+      const uint8_t *data;  // key contents
+      size_t len;           // length of key contents
+      size_t row_len;       // row + NUL
+      size_t column_len;    // row + NUL + column family
+      size_t cell_len;      // everything but the flag and timestamp
+      bool valid;           // false once the scanner is exhausted
     };
 
-    struct LtScannerState {
-      bool operator()(const ScannerState &ss1, const ScannerState &ss2) const {
-        return !(ss1.key < ss2.key);
+    /**
+     * Cells and bytes dropped per column family
+     */
+    struct GcStatistics {
+      GcStatistics() {
+        memset(cells, 0, sizeof(cells));
+        memset(bytes, 0, sizeof(bytes));
       }
+      uint64_t cells[256];
+      uint64_t bytes[256];
     };
 
     MergeScanner(ScanContextPtr &scan_ctx, bool return_dels=true);
@@ -60,14 +95,54 @@ namespace Hypertable {
       m_release_callback = cb;
     }
 
+    void set_gc_statistics(GcStatistics *stats) { m_gc_stats = stats; }
+
   private:
 
     void initialize();
+    bool fetch(ScannerState &sstate);
+    void build_tree();
+    void advance();
+    void select();
+    void set_prev_key(const ScannerState &sstate);
+    bool matches_predicates(const ScannerState &sstate);
+
+    bool expired(const Key &key) const {
+      return m_scan_context_ptr->family_mask[key.column_family_code] &&
+          key.timestamp <
+          m_scan_context_ptr->family_info[key.column_family_code].cutoff_time;
+    }
+
+    void collect(const ScannerState &sstate) {
+      if (m_gc_stats) {
+        m_gc_stats->cells[sstate.decoded.column_family_code]++;
+        m_gc_stats->bytes[sstate.decoded.column_family_code] +=
+            sstate.key.length() + sstate.value.length();
+      }
+    }
+
+    /**
+     * Loser tree ordering: exhausted scanners sort last and equal keys are
+     * ordered by scanner index so the merge is deterministic.
+     */
+    bool less(size_t i, size_t j) const {
+      const ScannerState &ss1 = m_states[i];
+      const ScannerState &ss2 = m_states[j];
+      if (!ss1.valid)
+        return false;
+      if (!ss2.valid)
+        return true;
+      int cmp = key_memcmp(ss1.data, ss2.data, (ss1.len < ss2.len) ? ss1.len : ss2.len);
+      if (cmp == 0)
+        return (ss1.len == ss2.len) ? i < j : ss1.len < ss2.len;
+      return cmp < 0;
+    }
 
     bool          m_done;
     bool          m_initialized;
     std::vector<CellListScanner *>  m_scanners;
-    std::priority_queue<ScannerState, std::vector<ScannerState>, LtScannerState> m_queue;
+    std::vector<ScannerState> m_states;
+    std::vector<size_t> m_tree;  // [0] is the winner, [1..n-1] the losers
     bool          m_delete_present;
     DynamicBuffer m_deleted_row;
     uint64_t      m_deleted_row_timestamp;
@@ -80,13 +155,14 @@ namespace Hypertable {
     uint32_t      m_row_limit;
     uint32_t      m_cell_count;
     uint32_t      m_cell_limit;
-    uint64_t      m_cell_cutoff;
     uint64_t      m_start_timestamp;
     uint64_t      m_end_timestamp;
     DynamicBuffer m_prev_key;
+    size_t        m_prev_row_len;
+    CellPredicateFilter *m_predicate_filter;
     CellStoreReleaseCallback m_release_callback;
+    GcStatistics *m_gc_stats;
   };
 }
 
 #endif // HYPERTABLE_MERGESCANNER_H
-
@@ -39,7 +39,7 @@ extern "C" {
 #include "Hypertable/Lib/CommitLogReader.h"
 
 
-#include "CellStoreV0.h"
+#include "CellStoreFactory.h"
 #include "Global.h"
 #include "MergeScanner.h"
 #include "MetadataNormal.h"
@@ -156,22 +156,15 @@ void Range::load_cell_stores(Metadata *metadata) {
 
       HT_INFOF("Loading CellStore %s", csvec[i].c_str());
 
-      cellstore = new CellStoreV0(Global::dfs);
-
       if (!extract_csid_from_path(csvec[i], &csid)) {
         HT_ERRORF("Unable to extract cell store ID from path '%s'", csvec[i].c_str());
         continue;
       }
-      if ((error = cellstore->open(csvec[i].c_str(), m_start_row.c_str(), m_end_row.c_str())) != Error::OK) {
+      if ((error = CellStoreFactory::open(Global::dfs, csvec[i].c_str(), m_start_row.c_str(), m_end_row.c_str(), cellstore)) != Error::OK) {
         // this should throw an exception
         HT_ERRORF("Problem opening cell store '%s', skipping...", csvec[i].c_str());
         continue;
       }
-      if ((error = cellstore->load_index()) != Error::OK) {
-        // this should throw an exception
-        HT_ERRORF("Problem loading index of cell store '%s', skipping...", csvec[i].c_str());
-        continue;
-      }
 
       ag->add_cell_store(cellstore, csid);
     }
@@ -610,9 +603,11 @@ void Range::dump_stats() {
   std::string range_str = (std::string)m_identifier.name + "[" + m_start_row + ".." + m_end_row + "]";
   uint64_t collisions = 0;
   uint64_t cached = 0;
+  uint64_t cache_allocated = 0;
   for (size_t i=0; i<m_access_group_vector.size(); i++) {
     collisions += m_access_group_vector[i]->get_collision_count();
     cached += m_access_group_vector[i]->get_cached_count();
+    cache_allocated += m_access_group_vector[i]->get_cached_memory_allocated();
   }
   cout << "STAT\t" << range_str << "\tadded inserts\t" << m_added_inserts << endl;
   cout << "STAT\t" << range_str << "\tadded row deletes\t" << m_added_deletes[0] << endl;
@@ -621,6 +616,7 @@ void Range::dump_stats() {
   cout << "STAT\t" << range_str << "\tadded total\t" << (m_added_inserts + m_added_deletes[0] + m_added_deletes[1] + m_added_deletes[2]) << endl;
   cout << "STAT\t" << range_str << "\tcollisions\t" << collisions << endl;
   cout << "STAT\t" << range_str << "\tcached\t" << cached << endl;
+  cout << "STAT\t" << range_str << "\tcache allocated\t" << cache_allocated << endl;
   cout << flush;
 }
 
@@ -122,6 +122,13 @@ namespace Hypertable {
       m_scanner_timestamp_controller.remove_update_timestamp(ts);
     }
 
+    /**
+     * Returns the mutex that serializes the application of updates to
+     * this range.  The update path holds it from timestamp assignment
+     * until the updates are in the cell caches.
+     */
+    boost::mutex &get_update_mutex() { return m_update_mutex; }
+
     bool get_split_info(String &split_row, CommitLogPtr &split_log_ptr) {
       boost::mutex::scoped_lock lock(m_mutex);
       split_row = m_split_row;
@@ -167,6 +174,7 @@ namespace Hypertable {
     void split_notify_master(String &old_start_row);
 
     boost::mutex        m_mutex;
+    boost::mutex        m_update_mutex;
     MasterClientPtr     m_master_client_ptr;
     TableIdentifierManaged m_identifier;
     SchemaPtr           m_schema;
@@ -20,6 +20,7 @@
  */
 
 #include "Common/Compat.h"
+#include <algorithm>
 #include <cassert>
 #include <string>
 
@@ -31,6 +32,7 @@ extern "C" {
 #include <sys/resource.h>
 }
 
+#include "Common/BufferPool.h"
 #include "Common/FileUtils.h"
 #include "Common/md5.h"
 #include "Common/StringExt.h"
@@ -42,6 +44,7 @@ extern "C" {
 
 #include "DfsBroker/Lib/Client.h"
 
+#include "CellCache.h"
 #include "FillScanBlock.h"
 #include "Global.h"
 #include "HandlerFactory.h"
@@ -64,7 +67,7 @@ namespace {
 /**
  * Constructor
  */
-RangeServer::RangeServer(PropertiesPtr &props_ptr, ConnectionManagerPtr &conn_manager_ptr, ApplicationQueuePtr &app_queue_ptr, Hyperspace::SessionPtr &hyperspace_ptr) : m_props_ptr(props_ptr), m_verbose(false), m_conn_manager_ptr(conn_manager_ptr), m_app_queue_ptr(app_queue_ptr), m_hyperspace_ptr(hyperspace_ptr), m_last_commit_log_clean(0), m_bytes_loaded(0) {
+RangeServer::RangeServer(PropertiesPtr &props_ptr, ConnectionManagerPtr &conn_manager_ptr, ApplicationQueuePtr &app_queue_ptr, Hyperspace::SessionPtr &hyperspace_ptr) : m_props_ptr(props_ptr), m_verbose(false), m_conn_manager_ptr(conn_manager_ptr), m_app_queue_ptr(app_queue_ptr), m_hyperspace_ptr(hyperspace_ptr), m_last_commit_log_clean(0), m_bytes_loaded(0), m_last_memory_compaction(0) {
   int error;
   uint16_t port;
   uint32_t maintenance_threads = 1;
@@ -74,6 +77,9 @@ RangeServer::RangeServer(PropertiesPtr &props_ptr, ConnectionManagerPtr &conn_ma
   Global::access_group_max_files   = props_ptr->get_int("Hypertable.RangeServer.AccessGroup.MaxFiles", 10);
   Global::access_group_merge_files = props_ptr->get_int("Hypertable.RangeServer.AccessGroup.MergeFiles", 4);
   Global::access_group_max_mem  = props_ptr->get_int("Hypertable.RangeServer.AccessGroup.MaxMemory", 50000000);
+  Global::access_group_compaction_threads = props_ptr->get_int("Hypertable.RangeServer.AccessGroup.CompactionThreads", 1);
+  Global::cell_store_compression_threads = props_ptr->get_int("Hypertable.RangeServer.CellStore.CompressionThreads", 2);
+  Global::cell_cache_max_memory = props_ptr->get_int64("Hypertable.RangeServer.CellCache.MaxMemory", 0);
   maintenance_threads             = props_ptr->get_int("Hypertable.RangeServer.MaintenanceThreads", 1);
   port                            = props_ptr->get_int("Hypertable.RangeServer.Port", DEFAULT_PORT);
   m_scanner_ttl                   = (time_t)props_ptr->get_int("Hypertable.RangeServer.Scanner.Ttl", 120);
@@ -89,8 +95,11 @@ RangeServer::RangeServer(PropertiesPtr &props_ptr, ConnectionManagerPtr &conn_ma
     m_scanner_ttl = (time_t)10;
   }
 
+  Global::memory_tracker.set_item_overhead(CellCache::cell_overhead());
+
   uint64_t block_cacheMemory = props_ptr->get_int64("Hypertable.RangeServer.BlockCache.MaxMemory", 200000000LL);
-  Global::block_cache = new FileBlockCache(block_cacheMemory);
+  uint32_t block_cache_shards = (uint32_t)props_ptr->get_int("Hypertable.RangeServer.BlockCache.Shards", FileBlockCache::DEFAULT_SHARDS);
+  Global::block_cache = new FileBlockCache(block_cacheMemory, block_cache_shards);
 
   assert(Global::access_group_merge_files <= Global::access_group_max_files);
 
@@ -99,8 +108,12 @@ RangeServer::RangeServer(PropertiesPtr &props_ptr, ConnectionManagerPtr &conn_ma
   if (Global::verbose) {
     cout << "Hypertable.RangeServer.AccessGroup.MaxFiles=" << Global::access_group_max_files << endl;
     cout << "Hypertable.RangeServer.AccessGroup.MaxMemory=" << Global::access_group_max_mem << endl;
+    cout << "Hypertable.RangeServer.AccessGroup.CompactionThreads=" << Global::access_group_compaction_threads << endl;
     cout << "Hypertable.RangeServer.AccessGroup.MergeFiles=" << Global::access_group_merge_files << endl;
     cout << "Hypertable.RangeServer.BlockCache.MaxMemory=" << block_cacheMemory << endl;
+    cout << "Hypertable.RangeServer.CellCache.MaxMemory=" << Global::cell_cache_max_memory << endl;
+    cout << "Hypertable.RangeServer.CellStore.CompressionThreads=" << Global::cell_store_compression_threads << endl;
+    cout << "Hypertable.RangeServer.BlockCache.Shards=" << Global::block_cache->get_shard_count() << endl;
     cout << "Hypertable.RangeServer.Range.MaxBytes=" << Global::range_max_bytes << endl;
     cout << "Hypertable.RangeServer.MaintenanceThreads=" << maintenance_threads << endl;
     cout << "Hypertable.RangeServer.Port=" << port << endl;
@@ -166,7 +179,9 @@ RangeServer::RangeServer(PropertiesPtr &props_ptr, ConnectionManagerPtr &conn_ma
     exit(1);
 
   // Create the maintenance queue
-  Global::maintenance_queue = new MaintenanceQueue(maintenance_threads);
+  Global::maintenance_queue = new MaintenanceQueue(maintenance_threads,
+      props_ptr->get_int("Hypertable.RangeServer.Maintenance.MaxCompactions", 0),
+      props_ptr->get_int64("Hypertable.RangeServer.Maintenance.MaxWriteBandwidth", 0));
 
   // Create table info maps
   m_live_map_ptr = new TableInfoMap();
@@ -460,7 +475,7 @@ void RangeServer::compact(ResponseCallback *cb, TableIdentifier *table, RangeSpe
 
   // schedule the compaction
   if (!range_ptr->test_and_set_maintenance())
-    Global::maintenance_queue->add(new MaintenanceTaskCompaction(range_ptr, major));
+    Global::maintenance_queue->add(new MaintenanceTaskCompaction(range_ptr, major, MaintenanceTask::PRIORITY_MANUAL));
 
   if ((error = cb->response_ok()) != Error::OK) {
     HT_ERRORF("Problem sending OK response - %s", Error::get_text(error));
@@ -572,13 +587,14 @@ void RangeServer::fetch_scanblock(ResponseCallbackFetchScanblock *cb, uint32_t s
   RangePtr range_ptr;
   bool more = true;
   DynamicBuffer rbuf;
+  uint32_t block_size;
 
   if (Global::verbose) {
     cout << "RangeServer::fetch_scanblock" << endl;
     cout << "Scanner ID = " << scanner_id << endl;
   }
 
-  if (!Global::scanner_map.get(scanner_id, scanner_ptr, range_ptr)) {
+  if (!Global::scanner_map.get(scanner_id, scanner_ptr, range_ptr, &block_size)) {
     error = Error::RANGESERVER_INVALID_SCANNER_ID;
     char tbuf[32];
     sprintf(tbuf, "%d", scanner_id);
@@ -586,7 +602,7 @@ void RangeServer::fetch_scanblock(ResponseCallbackFetchScanblock *cb, uint32_t s
     goto abort;
   }
 
-  more = FillScanBlock(scanner_ptr, rbuf);
+  more = FillScanBlock(scanner_ptr, rbuf, block_size);
 
   if (!more)
     Global::scanner_map.remove(scanner_id);
@@ -812,12 +828,6 @@ namespace {
     size_t len;
   };
 
-  struct SendBackRec {
-    int error;
-    uint32_t offset;
-    uint32_t len;
-  };
-
   struct MinTimestampRec {
     RangePtr range_ptr;
     Timestamp timestamp;
@@ -830,15 +840,125 @@ namespace {
  * Update
  */
 void RangeServer::update(ResponseCallbackUpdate *cb, TableIdentifier *table, StaticBuffer &buffer) {
+  TableUpdate table_update;
+  std::vector<TableUpdate *> table_updates;
+  int error;
+
+  if (Global::verbose) {
+    cout << "RangeServer::update" << endl;
+    cout << *table;
+  }
+
+  table_update.id = *table;
+  table_update.base = buffer.base;
+  table_update.size = buffer.size;
+  table_updates.push_back(&table_update);
+
+  apply_updates(table_updates);
+
+  if (table_update.error == Error::OK) {
+    /**
+     * Send back response
+     */
+    if (!table_update.send_back.empty()) {
+      StaticBuffer ext(new uint8_t [table_update.send_back.size() * 12], table_update.send_back.size() * 12);
+      uint8_t *ptr = ext.base;
+      for (size_t i=0; i<table_update.send_back.size(); i++) {
+        encode_i32(&ptr, table_update.send_back[i].error);
+        encode_i32(&ptr, table_update.send_back[i].offset);
+        encode_i32(&ptr, table_update.send_back[i].len);
+      }
+      if ((error = cb->response(ext)) != Error::OK) {
+        HT_ERRORF("Problem sending OK response - %s", Error::get_text(error));
+      }
+    }
+    else {
+      if ((error = cb->response_ok()) != Error::OK) {
+        HT_ERRORF("Problem sending OK response - %s", Error::get_text(error));
+      }
+    }
+  }
+  else {
+    HT_ERRORF("%s '%s'", Error::get_text(table_update.error), table_update.errmsg.c_str());
+    if ((error = cb->error(table_update.error, table_update.errmsg)) != Error::OK) {
+      HT_ERRORF("Problem sending error response - %s", Error::get_text(error));
+    }
+  }
+}
+
+
+
+/**
+ * Update multi
+ */
+void RangeServer::update_multi(ResponseCallbackUpdate *cb, std::vector<TableUpdate *> &table_updates) {
+  TableUpdate *tu;
+  size_t len = 0;
+  int error;
+
+  if (Global::verbose) {
+    cout << "RangeServer::update_multi" << endl;
+    for (size_t i=0; i<table_updates.size(); i++)
+      cout << table_updates[i]->id;
+  }
+
+  apply_updates(table_updates);
+
+  /**
+   * Send back response, one section of (error, offset, length) triples
+   * per table.  A table that failed as a whole gets a single triple
+   * covering all of its updates.
+   */
+  for (size_t i=0; i<table_updates.size(); i++) {
+    tu = table_updates[i];
+    len += 4 + ((tu->error == Error::OK) ? tu->send_back.size() * 12 : 12);
+  }
+
+  StaticBuffer ext(new uint8_t [len], len);
+  uint8_t *ptr = ext.base;
+
+  for (size_t i=0; i<table_updates.size(); i++) {
+    tu = table_updates[i];
+    if (tu->error != Error::OK) {
+      HT_ERRORF("%s '%s'", Error::get_text(tu->error), tu->errmsg.c_str());
+      encode_i32(&ptr, 1);
+      encode_i32(&ptr, tu->error);
+      encode_i32(&ptr, 0);
+      encode_i32(&ptr, tu->size);
+    }
+    else {
+      encode_i32(&ptr, tu->send_back.size());
+      for (size_t j=0; j<tu->send_back.size(); j++) {
+        encode_i32(&ptr, tu->send_back[j].error);
+        encode_i32(&ptr, tu->send_back[j].offset);
+        encode_i32(&ptr, tu->send_back[j].len);
+      }
+    }
+  }
+
+  if ((error = cb->response(ext)) != Error::OK) {
+    HT_ERRORF("Problem sending OK response - %s", Error::get_text(error));
+  }
+}
+
+
+
+/**
+ * Applies the updates of each table and then commits the valid ones for
+ * all of the tables with a single commit log write.  A failure affecting
+ * a whole table is recorded in that table's TableUpdate and does not stop
+ * the other tables from being applied.
+ */
+void RangeServer::apply_updates(std::vector<TableUpdate *> &table_updates) {
+  TableUpdate *tu;
+  TableIdentifier *table;
   uint8_t *mod_ptr;
   const uint8_t *mod_end;
   const uint8_t *add_base_ptr;
   const uint8_t *add_end_ptr;
   uint8_t *ts_ptr;
   const uint8_t auto_ts[8] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
-  string errmsg;
-  int error = Error::OK;
-  TableInfoPtr table_info_ptr;
+  int error;
   uint64_t update_timestamp = 0;
   uint64_t min_timestamp = 0;
   const char *row;
@@ -858,311 +978,334 @@ void RangeServer::update(ResponseCallbackUpdate *cb, TableIdentifier *table, Sta
   uint64_t items_added = 0;
   bool split_pending;
   ByteString key, value;
-  bool a_locked = false;
-  bool b_locked = false;
-  vector<SendBackRec> send_back_vector;
   const uint8_t *send_back_ptr = 0;
   uint32_t misses = 0;
+  std::vector<DynamicBuffer *> commit_blocks;
+  std::vector<TableUpdate *> committed;
+  uint64_t bytes_loaded = 0;
 
   min_ts_vector.reserve(50);
 
-  if (Global::verbose) {
-    cout << "RangeServer::update" << endl;
-    cout << *table;
+  // TODO: Sanity check mod data (checksum validation)
+
+  /**
+   * If the cell caches are over budget, schedule compactions to bring them
+   * back under and, past the throttle point, hold this update back for a
+   * while to give the compactions a chance to catch up
+   */
+  if (Global::cell_cache_max_memory) {
+    uint64_t memory_used = Global::memory_tracker.get_total();
+    if (memory_used > Global::cell_cache_max_memory) {
+      schedule_memory_compactions(memory_used);
+      uint64_t throttle_limit = Global::cell_cache_max_memory + Global::cell_cache_max_memory / 4;
+      if (memory_used > throttle_limit) {
+        HT_WARNF("Throttling updates, cell cache memory %llu exceeds %llu",
+                 (Llu)memory_used, (Llu)throttle_limit);
+        Global::memory_tracker.wait_for_total(throttle_limit, 1000);
+      }
+    }
   }
 
-  // TODO: Sanity check mod data (checksum validation)
+  for (size_t i=0; i<table_updates.size(); i++) {
 
-  try {
+    tu = table_updates[i];
+    table = &tu->id;
 
-    // Fetch table info
-    if (!m_live_map_ptr->get(table->id, table_info_ptr)) {
-      StaticBuffer ext(new uint8_t [12], 12);
-      uint8_t *ptr = ext.base;
-      encode_i32(&ptr, Error::RANGESERVER_TABLE_NOT_FOUND);
-      encode_i32(&ptr, 0);
-      encode_i32(&ptr, buffer.size);
-      HT_ERRORF("Unable to find table info for table '%s'", table->name);
-      if ((error = cb->response(ext)) != Error::OK)
-        HT_ERRORF("Problem sending OK response - %s", Error::get_text(error));
-      return;
-    }
+    try {
 
-    // verify schema
-    if ((error = verify_schema(table_info_ptr, table->generation, errmsg)) != Error::OK) {
-      HT_ERRORF("%s", errmsg.c_str());
-      cb->error(error, errmsg);
-      return;
-    }
+      // Fetch table info
+      if (!m_live_map_ptr->get(table->id, tu->table_info)) {
+        HT_ERRORF("Unable to find table info for table '%s'", table->name);
+        tu->add_send_back(Error::RANGESERVER_TABLE_NOT_FOUND, 0, tu->size);
+        goto next_table;
+      }
 
-    mod_end = buffer.base + buffer.size;
-    mod_ptr = buffer.base;
+      // verify schema
+      if ((tu->error = verify_schema(tu->table_info, table->generation, tu->errmsg)) != Error::OK) {
+        HT_ERRORF("%s", tu->errmsg.c_str());
+        goto next_table;
+      }
 
-    gomods.clear();
+      mod_end = tu->base + tu->size;
+      mod_ptr = tu->base;
 
-    m_update_mutex_a.lock();
-    a_locked = true;
+      gomods.clear();
+      gosz = 0;
 
-    send_back_ptr = 0;
+      send_back_ptr = 0;
 
-    while (mod_ptr < mod_end) {
+      while (mod_ptr < mod_end) {
 
-      key.ptr = mod_ptr;
+        key.ptr = mod_ptr;
 
-      row = key.str();
+        row = key.str();
 
-      // Look for containing range, add to stop mods if not found
-      if (!table_info_ptr->find_containing_range(row, min_ts_rec.range_ptr)) {
-        if (send_back_ptr == 0)
-          send_back_ptr = mod_ptr;
-        key.next(); // skip key
-        key.next(); // skip value;
-        mod_ptr = (uint8_t *)key.ptr;
-        misses++;
-        continue;
-      }
+        // Look for containing range, add to stop mods if not found
+        if (!tu->table_info->find_containing_range(row, min_ts_rec.range_ptr)) {
+          if (send_back_ptr == 0)
+            send_back_ptr = mod_ptr;
+          key.next(); // skip key
+          key.next(); // skip value;
+          mod_ptr = (uint8_t *)key.ptr;
+          misses++;
+          continue;
+        }
 
-      if (send_back_ptr) {
-        SendBackRec send_back;
-        send_back.error = Error::RANGESERVER_OUT_OF_RANGE;
-        send_back.offset = send_back_ptr - buffer.base;
-        send_back.len = mod_ptr - send_back_ptr;
-        send_back_vector.push_back(send_back);
-        send_back_ptr = 0;
-      }
+        if (send_back_ptr) {
+          tu->add_send_back(Error::RANGESERVER_OUT_OF_RANGE, send_back_ptr - tu->base, mod_ptr - send_back_ptr);
+          send_back_ptr = 0;
+        }
 
-      add_base_ptr = mod_ptr;
+        add_base_ptr = mod_ptr;
 
-      /** Increment update count (block if maintenance in progress) **/
-      min_ts_rec.range_ptr->increment_update_counter();
+        /** Increment update count (block if maintenance in progress) **/
+        min_ts_rec.range_ptr->increment_update_counter();
 
-      // Make sure range didn't just shrink
-      if (strcmp(row, (min_ts_rec.range_ptr->start_row()).c_str()) <= 0) {
-        min_ts_rec.range_ptr->decrement_update_counter();
-        continue;
-      }
+        // Make sure range didn't just shrink.  If it did, the lookup
+        // snapshot is stale, so rebuild it before looking the row up again
+        if (strcmp(row, (min_ts_rec.range_ptr->start_row()).c_str()) <= 0) {
+          min_ts_rec.range_ptr->decrement_update_counter();
+          tu->table_info->refresh_ranges();
+          continue;
+        }
 
-      /** Obtain the most recently seen timestamp **/
-      min_timestamp = min_ts_rec.range_ptr->get_latest_timestamp();
+        /**
+         * Updates to the same range are serialized from here until they
+         * are in the cell caches, so that timestamps are assigned and
+         * applied in order.  Updates to other ranges proceed in parallel.
+         */
+        boost::mutex::scoped_lock range_lock(min_ts_rec.range_ptr->get_update_mutex());
+
+        /** Obtain the most recently seen timestamp **/
+        min_timestamp = min_ts_rec.range_ptr->get_latest_timestamp();
 
-      /** Obtain "update timestamp" **/
-      update_timestamp = Global::log->get_timestamp();
+        /** Obtain "update timestamp" **/
+        update_timestamp = Global::log->get_timestamp();
 
-      end_row = min_ts_rec.range_ptr->end_row();
+        end_row = min_ts_rec.range_ptr->end_row();
 
-      /** Fetch range split information **/
-      split_pending = min_ts_rec.range_ptr->get_split_info(split_row, splitlog);
+        /** Fetch range split information **/
+        split_pending = min_ts_rec.range_ptr->get_split_info(split_row, splitlog);
 
-      splitmods.clear();
-      splitsz = 0;
+        splitmods.clear();
+        splitsz = 0;
 
-      next_timestamp = 0;
-      min_ts_rec.timestamp.logical = 0;
-      min_ts_rec.timestamp.real = update_timestamp;
+        next_timestamp = 0;
+        min_ts_rec.timestamp.logical = 0;
+        min_ts_rec.timestamp.real = update_timestamp;
 
-      while (mod_ptr < mod_end && (end_row == "" || (strcmp(row, end_row.c_str()) <= 0))) {
+        while (mod_ptr < mod_end && (end_row == "" || (strcmp(row, end_row.c_str()) <= 0))) {
 
-        // If timestamp value is set to AUTO (zero one's compliment), then assign a timestamp
-        ts_ptr = mod_ptr + key.length() - 8;
-        if (!memcmp(ts_ptr, auto_ts, 8)) {
-          if (next_timestamp == 0) {
-            boost::xtime now;
-            boost::xtime_get(&now, boost::TIME_UTC);
-            next_timestamp = ((uint64_t)now.sec * 1000000000LL) + (uint64_t)now.nsec;
+          // If timestamp value is set to AUTO (zero one's compliment), then assign a timestamp
+          ts_ptr = mod_ptr + key.length() - 8;
+          if (!memcmp(ts_ptr, auto_ts, 8)) {
+            if (next_timestamp == 0) {
+              boost::xtime now;
+              boost::xtime_get(&now, boost::TIME_UTC);
+              next_timestamp = ((uint64_t)now.sec * 1000000000LL) + (uint64_t)now.nsec;
+            }
+            temp_timestamp = ++next_timestamp;
+            if (min_ts_rec.timestamp.logical == 0 || temp_timestamp < min_ts_rec.timestamp.logical)
+              min_ts_rec.timestamp.logical = temp_timestamp;
+            Key::encode_ts64(&ts_ptr, temp_timestamp);
           }
-          temp_timestamp = ++next_timestamp;
-          if (min_ts_rec.timestamp.logical == 0 || temp_timestamp < min_ts_rec.timestamp.logical)
-            min_ts_rec.timestamp.logical = temp_timestamp;
-          Key::encode_ts64(&ts_ptr, temp_timestamp);
-        }
-        else {
-          uint8_t flag = *(ts_ptr-1);
-          temp_timestamp = Key::decode_ts64((const uint8_t **)&ts_ptr);
-          if (flag > FLAG_DELETE_CELL && temp_timestamp <= min_timestamp) {
-            error = Error::RANGESERVER_TIMESTAMP_ORDER_ERROR;
-            errmsg = (string)"Update timestamp " + temp_timestamp + " is <= previously seen timestamp of " + min_timestamp;
-            min_ts_rec.range_ptr->decrement_update_counter();
-            m_update_mutex_a.unlock();
-            goto abort;
+          else {
+            uint8_t flag = *(ts_ptr-1);
+            temp_timestamp = Key::decode_ts64((const uint8_t **)&ts_ptr);
+            if (flag > FLAG_DELETE_CELL && temp_timestamp <= min_timestamp) {
+              tu->error = Error::RANGESERVER_TIMESTAMP_ORDER_ERROR;
+              tu->errmsg = (string)"Update timestamp " + temp_timestamp + " is <= previously seen timestamp of " + min_timestamp;
+              min_ts_rec.range_ptr->decrement_update_counter();
+              goto next_table;
+            }
+            if (min_ts_rec.timestamp.logical == 0 || temp_timestamp < min_ts_rec.timestamp.logical)
+              min_ts_rec.timestamp.logical = temp_timestamp;
           }
-          if (min_ts_rec.timestamp.logical == 0 || temp_timestamp < min_ts_rec.timestamp.logical)
-            min_ts_rec.timestamp.logical = temp_timestamp;
-        }
 
-        update.base = mod_ptr;
-        key.next(); // skip key
-        key.next(); // skip value
-        mod_ptr = (uint8_t *)key.ptr;
-        update.len = mod_ptr - update.base;
-        if (split_pending && strcmp(row, split_row.c_str()) <= 0) {
-          splitmods.push_back(update);
-          splitsz += update.len;
-        }
-        else {
-          gomods.push_back(update);
-          gosz += update.len;
+          update.base = mod_ptr;
+          key.next(); // skip key
+          key.next(); // skip value
+          mod_ptr = (uint8_t *)key.ptr;
+          update.len = mod_ptr - update.base;
+          if (split_pending && strcmp(row, split_row.c_str()) <= 0) {
+            splitmods.push_back(update);
+            splitsz += update.len;
+          }
+          else {
+            gomods.push_back(update);
+            gosz += update.len;
+          }
+          if (mod_ptr < mod_end)
+            row = key.str();
         }
-        if (mod_ptr < mod_end)
-          row = key.str();
-      }
 
-      add_end_ptr = mod_ptr;
+        add_end_ptr = mod_ptr;
 
-      // force scans to only see updates before the earliest time in this range
-      min_ts_rec.timestamp.logical--;
-      min_ts_rec.range_ptr->add_update_timestamp(min_ts_rec.timestamp);
-      min_ts_vector.push_back(min_ts_rec);
+        // force scans to only see updates before the earliest time in this range
+        min_ts_rec.timestamp.logical--;
+        min_ts_rec.range_ptr->add_update_timestamp(min_ts_rec.timestamp);
+        min_ts_vector.push_back(min_ts_rec);
 
-      if (splitsz > 0) {
-        DynamicBuffer dbuf(splitsz + table->encoded_length());
+        if (splitsz > 0) {
+          DynamicBuffer dbuf(splitsz + table->encoded_length());
 
-        table->encode(&dbuf.ptr);
+          table->encode(&dbuf.ptr);
 
-        items_added += splitmods.size();
-        memory_added += splitsz;
+          items_added += splitmods.size();
+          memory_added += splitsz;
 
-        for (size_t i=0; i<splitmods.size(); i++) {
-          memcpy(dbuf.ptr, splitmods[i].base, splitmods[i].len);
-          dbuf.ptr += splitmods[i].len;
-        }
+          for (size_t j=0; j<splitmods.size(); j++) {
+            memcpy(dbuf.ptr, splitmods[j].base, splitmods[j].len);
+            dbuf.ptr += splitmods[j].len;
+          }
 
-        HT_EXPECT(dbuf.fill() <= (splitsz + table->encoded_length()), Error::FAILED_EXPECTATION);
+          HT_EXPECT(dbuf.fill() <= (splitsz + table->encoded_length()), Error::FAILED_EXPECTATION);
 
-        if ((error = splitlog->write(dbuf, update_timestamp)) != Error::OK) {
-          errmsg = (string)"Problem writing " + (int)dbuf.fill() + " bytes to split log";
-          m_update_mutex_a.unlock();
-          goto abort;
+          if ((error = splitlog->write(dbuf, update_timestamp)) != Error::OK) {
+            tu->error = error;
+            tu->errmsg = (string)"Problem writing " + (int)dbuf.fill() + " bytes to split log";
+            goto next_table;
+          }
         }
-      }
 
-      /**
-       * Apply the modifications
-       */
-      min_ts_rec.range_ptr->lock();
-      {
-        uint8_t *ptr = (uint8_t *)add_base_ptr;
-        while (ptr < add_end_ptr) {
-          key.ptr = ptr;
-          ptr += key.length();
-          value.ptr = ptr;
-          ptr += value.length();
-          if ((error = min_ts_rec.range_ptr->add(key, value, update_timestamp)) != Error::OK) {
-            SendBackRec send_back;
-            send_back.error = error;
-            send_back.offset = key.ptr - buffer.base;
-            send_back.len = add_end_ptr - key.ptr;
-            send_back_vector.push_back(send_back);
-            break;
+        /**
+         * Apply the modifications
+         */
+        min_ts_rec.range_ptr->lock();
+        {
+          uint8_t *ptr = (uint8_t *)add_base_ptr;
+          while (ptr < add_end_ptr) {
+            key.ptr = ptr;
+            ptr += key.length();
+            value.ptr = ptr;
+            ptr += value.length();
+            if ((error = min_ts_rec.range_ptr->add(key, value, update_timestamp)) != Error::OK) {
+              tu->add_send_back(error, key.ptr - tu->base, add_end_ptr - key.ptr);
+              break;
+            }
           }
         }
-      }
-      min_ts_rec.range_ptr->unlock(update_timestamp);
+        min_ts_rec.range_ptr->unlock(update_timestamp);
+        range_lock.unlock();
 
-      /**
-       * Split and Compaction processing
-       */
-      if (!min_ts_rec.range_ptr->maintenance_in_progress()) {
-        std::vector<AccessGroup::CompactionPriorityData> priority_data_vec;
-        std::vector<AccessGroup *> compactions;
-        uint64_t disk_usage = 0;
-
-        min_ts_rec.range_ptr->get_compaction_priority_data(priority_data_vec);
-        for (size_t i=0; i<priority_data_vec.size(); i++) {
-          disk_usage += priority_data_vec[i].disk_used;
-          if (!priority_data_vec[i].in_memory && priority_data_vec[i].mem_used >= (uint32_t)Global::access_group_max_mem)
-            compactions.push_back(priority_data_vec[i].ag);
-        }
+        /**
+         * Split and Compaction processing
+         */
+        if (!min_ts_rec.range_ptr->maintenance_in_progress()) {
+          std::vector<AccessGroup::CompactionPriorityData> priority_data_vec;
+          std::vector<AccessGroup *> compactions;
+          uint64_t disk_usage = 0;
+          double priority = 0.0;
+
+          min_ts_rec.range_ptr->get_compaction_priority_data(priority_data_vec);
+          for (size_t j=0; j<priority_data_vec.size(); j++) {
+            disk_usage += priority_data_vec[j].disk_used;
+            if (!priority_data_vec[j].in_memory && priority_data_vec[j].mem_used >= (uint32_t)Global::access_group_max_mem) {
+              compactions.push_back(priority_data_vec[j].ag);
+              priority = std::max(priority, MaintenanceTaskCompaction::compute_priority(priority_data_vec[j]));
+            }
+          }
 
-        if (!min_ts_rec.range_ptr->is_root() &&
-            (disk_usage > min_ts_rec.range_ptr->get_size_limit() ||
-             (Global::range_metadata_max_bytes && table->id == 0 && disk_usage > Global::range_metadata_max_bytes))) {
-          if (!min_ts_rec.range_ptr->test_and_set_maintenance())
-            Global::maintenance_queue->add(new MaintenanceTaskSplit(min_ts_rec.range_ptr));
-        }
-        else if (!compactions.empty()) {
-          if (!min_ts_rec.range_ptr->test_and_set_maintenance()) {
-            for (size_t i=0; i<compactions.size(); i++)
-              compactions[i]->set_compaction_bit();
-            Global::maintenance_queue->add(new MaintenanceTaskCompaction(min_ts_rec.range_ptr, false));
+          if (!min_ts_rec.range_ptr->is_root() &&
+              (disk_usage > min_ts_rec.range_ptr->get_size_limit() ||
+               (Global::range_metadata_max_bytes && table->id == 0 && disk_usage > Global::range_metadata_max_bytes))) {
+            if (!min_ts_rec.range_ptr->test_and_set_maintenance())
+              Global::maintenance_queue->add(new MaintenanceTaskSplit(min_ts_rec.range_ptr));
+          }
+          else if (!compactions.empty()) {
+            if (!min_ts_rec.range_ptr->test_and_set_maintenance()) {
+              for (size_t j=0; j<compactions.size(); j++)
+                compactions[j]->set_compaction_bit();
+              Global::maintenance_queue->add(new MaintenanceTaskCompaction(min_ts_rec.range_ptr, false, priority));
+            }
           }
         }
-      }
 
-      if (Global::verbose) {
-        HT_INFOF("Added %d (%d split off) updates to '%s'", gomods.size()+splitmods.size(), splitmods.size(), table->name);
+        if (Global::verbose) {
+          HT_INFOF("Added %d (%d split off) updates to '%s'", gomods.size()+splitmods.size(), splitmods.size(), table->name);
+        }
       }
-    }
 
-    if (send_back_ptr) {
-      SendBackRec send_back;
-      send_back.error = Error::RANGESERVER_OUT_OF_RANGE;
-      send_back.offset = send_back_ptr - buffer.base;
-      send_back.len = mod_ptr - send_back_ptr;
-      send_back_vector.push_back(send_back);
-      send_back_ptr = 0;
-    }
+      if (send_back_ptr) {
+        tu->add_send_back(Error::RANGESERVER_OUT_OF_RANGE, send_back_ptr - tu->base, mod_ptr - send_back_ptr);
+        send_back_ptr = 0;
+      }
 
-    m_update_mutex_b.lock();
-    m_update_mutex_a.unlock();
-    b_locked = true;
+      /**
+       * Build the commit block holding this table's valid (go) mutations
+       */
+      if (gosz > 0) {
+        tu->go_buf.ensure(gosz + table->encoded_length());
 
-    /**
-     * Commit valid (go) mutations
-     */
-    if (gosz > 0) {
-      DynamicBuffer dbuf(gosz + table->encoded_length());
+        table->encode(&tu->go_buf.ptr);
 
-      table->encode(&dbuf.ptr);
+        items_added += gomods.size();
+        memory_added += gosz;
 
-      items_added += gomods.size();
-      memory_added += gosz;
+        for (size_t j=0; j<gomods.size(); j++) {
+          memcpy(tu->go_buf.ptr, gomods[j].base, gomods[j].len);
+          tu->go_buf.ptr += gomods[j].len;
+        }
 
-      for (size_t i=0; i<gomods.size(); i++) {
-        memcpy(dbuf.ptr, gomods[i].base, gomods[i].len);
-        dbuf.ptr += gomods[i].len;
+        HT_EXPECT(tu->go_buf.fill() <= (gosz + table->encoded_length()), Error::FAILED_EXPECTATION);
       }
 
-      HT_EXPECT(dbuf.fill() <= (gosz + table->encoded_length()), Error::FAILED_EXPECTATION);
-
-      if ((error = Global::log->write(dbuf, update_timestamp)) != Error::OK) {
-        errmsg = (string)"Problem writing " + (int)dbuf.fill() + " bytes to commit log";
-        m_update_mutex_b.unlock();
-        goto abort;
-      }
     }
-
-    m_update_mutex_b.unlock();
-
-    if (Global::verbose && misses) {
-      HT_INFOF("Sent back %d updates because out-of-range", misses);
+    catch (Exception &e) {
+      HT_ERRORF("Exception caught: %s", Error::get_text(e.code()));
+      tu->error = e.code();
+      tu->errmsg = e.what();
     }
 
-    error = Error::OK;
+  next_table:
+    bytes_loaded += tu->size;
   }
-  catch (Exception &e) {
-    HT_ERRORF("Exception caught: %s", Error::get_text(e.code()));
-    error = e.code();
-    errmsg = e.what();
-    if (b_locked)
-      m_update_mutex_b.unlock();
-    else if (a_locked)
-      m_update_mutex_a.unlock();
+
+  {
+    boost::mutex::scoped_lock lock(m_mutex);
+    m_bytes_loaded += bytes_loaded;
   }
 
-  m_bytes_loaded += buffer.size;
+  /**
+   * Commit valid (go) mutations of all tables with a single commit log
+   * write, stamped with the update timestamp of the last range, which is
+   * the latest one handed out to this request.  The range locks have been
+   * released by now, so the blocks of concurrent requests may reach the
+   * log out of timestamp order, even for the same range.  That is safe:
+   *
+   *   - replay adds each cell with the timestamp of its block, and a cell
+   *     cache orders its cells by key, so the order of the blocks does
+   *     not matter
+   *   - a block timestamp is never older than the update timestamp its
+   *     cells were added with, so a cell that is not yet in a cell store
+   *     is never dropped on replay as already compacted
+   *   - a fragment is purged by the newest block timestamp it holds, so
+   *     it is not removed while any of its blocks is still needed
+   */
+  for (size_t i=0; i<table_updates.size(); i++) {
+    tu = table_updates[i];
+    if (tu->error == Error::OK && tu->go_buf.fill() > 0) {
+      commit_blocks.push_back(&tu->go_buf);
+      committed.push_back(tu);
+    }
+  }
 
- abort:
+  if (!commit_blocks.empty()) {
+    if ((error = Global::log->write(commit_blocks, update_timestamp)) != Error::OK) {
+      for (size_t i=0; i<committed.size(); i++) {
+        committed[i]->error = error;
+        committed[i]->errmsg = (string)"Problem writing " + (int)committed[i]->go_buf.fill() + " bytes to commit log";
+      }
+    }
+  }
+
+  if (Global::verbose && misses) {
+    HT_INFOF("Sent back %d updates because out-of-range", misses);
+  }
 
   Global::memory_tracker.add_memory(memory_added);
   Global::memory_tracker.add_items(items_added);
 
-  {
-    uint64_t mt_memory = Global::memory_tracker.get_memory();
-    uint64_t mt_items = Global::memory_tracker.get_items();
-    uint64_t vm_estimate = mt_memory + (mt_items*120);
-    HT_INFOF("drj mem=%lld items=%lld vm-est%lld", mt_memory, mt_items, vm_estimate);
-  }
-
   splitlog = 0;
 
   // unblock scanner timestamp and decrement update counter
@@ -1170,39 +1313,9 @@ void RangeServer::update(ResponseCallbackUpdate *cb, TableIdentifier *table, Sta
     min_ts_vector[i].range_ptr->remove_update_timestamp(min_ts_vector[i].timestamp);
     min_ts_vector[i].range_ptr->decrement_update_counter();
   }
-
-  if (error == Error::OK) {
-    /**
-     * Send back response
-     */
-    if (!send_back_vector.empty()) {
-      StaticBuffer ext(new uint8_t [send_back_vector.size() * 12], send_back_vector.size() * 12);
-      uint8_t *ptr = ext.base;
-      for (size_t i=0; i<send_back_vector.size(); i++) {
-        encode_i32(&ptr, send_back_vector[i].error);
-        encode_i32(&ptr, send_back_vector[i].offset);
-        encode_i32(&ptr, send_back_vector[i].len);
-      }
-      if ((error = cb->response(ext)) != Error::OK) {
-        HT_ERRORF("Problem sending OK response - %s", Error::get_text(error));
-      }
-    }
-    else {
-      if ((error = cb->response_ok()) != Error::OK) {
-        HT_ERRORF("Problem sending OK response - %s", Error::get_text(error));
-      }
-    }
-  }
-  else {
-    HT_ERRORF("%s '%s'", Error::get_text(error), errmsg.c_str());
-    if ((error = cb->error(error, errmsg)) != Error::OK) {
-      HT_ERRORF("Problem sending error response - %s", Error::get_text(error));
-    }
-  }
 }
 
 
-
 void RangeServer::drop_table(ResponseCallback *cb, TableIdentifier *table) {
   TableInfoPtr table_info_ptr;
   std::vector<RangePtr> range_vector;
@@ -1265,6 +1378,54 @@ void RangeServer::dump_stats(ResponseCallback *cb) {
 
   HT_INFO("dump_stats");
 
+  {
+    MaintenanceQueue::Statistics stats;
+    Global::maintenance_queue->get_statistics(stats);
+    HT_INFOF("Maintenance queue: %u queued, %u running (%u compactions)",
+             (unsigned)stats.queued, (unsigned)stats.running,
+             (unsigned)stats.running_compactions);
+    for (std::map<String, MaintenanceQueue::TaskStatistics>::iterator iter = stats.tasks.begin();
+         iter != stats.tasks.end(); ++iter) {
+      MaintenanceQueue::TaskStatistics &ts = (*iter).second;
+      HT_INFOF("  %s: count=%llu avg-wait=%llums max-wait=%llums "
+               "avg-exec=%llums max-exec=%llums", (*iter).first.c_str(),
+               (Llu)ts.count, (Llu)(ts.total_wait_millis / ts.count),
+               (Llu)ts.max_wait_millis, (Llu)(ts.total_exec_millis / ts.count),
+               (Llu)ts.max_exec_millis);
+    }
+  }
+
+  {
+    BufferPool::Statistics stats;
+    BufferPool::get_statistics(stats);
+    HT_INFOF("Buffer pool: %llu allocations, %.1f%% hits, %llu oversized, "
+             "%llu releases (%llu discarded), %llu bytes in depot",
+             (Llu)stats.allocations, stats.allocations ?
+             100.0 * stats.hits / stats.allocations : 0.0,
+             (Llu)stats.oversized, (Llu)stats.releases, (Llu)stats.discards,
+             (Llu)stats.depot_bytes);
+  }
+
+  if (m_app_queue_ptr) {
+    ApplicationQueue::StatisticsMap stats;
+    m_app_queue_ptr->get_statistics(stats);
+    HT_INFO("Application queue (depth, wait usec, service usec):");
+    for (ApplicationQueue::StatisticsMap::iterator iter = stats.begin();
+         iter != stats.end(); ++iter) {
+      ApplicationQueue::RequestStatistics &rs = (*iter).second;
+      HT_INFOF("  %s: count=%llu depth=%llu/%llu/%llu wait=%llu/%llu/%llu "
+               "service=%llu/%llu/%llu (mean/p99/max)",
+               (*iter).first == ApplicationHandler::REQUEST_TYPE_NONE ? "other"
+               : Global::protocol->command_text((*iter).first),
+               (Llu)rs.service_micros.count, (Llu)rs.queue_depth.mean(),
+               (Llu)rs.queue_depth.percentile(99), (Llu)rs.queue_depth.max,
+               (Llu)rs.wait_micros.mean(), (Llu)rs.wait_micros.percentile(99),
+               (Llu)rs.wait_micros.max, (Llu)rs.service_micros.mean(),
+               (Llu)rs.service_micros.percentile(99),
+               (Llu)rs.service_micros.max);
+    }
+  }
+
   m_live_map_ptr->get_all(table_vec);
 
   for (size_t i=0; i<table_vec.size(); i++) {
@@ -1524,6 +1685,15 @@ void RangeServer::do_maintenance() {
     Global::maintenance_queue->add(new MaintenanceTaskLogCleanup(this));
     m_last_commit_log_clean = tval.tv_sec;
   }
+
+  /**
+   * Schedule compactions if the cell caches are over budget
+   */
+  if (Global::cell_cache_max_memory) {
+    uint64_t memory_used = Global::memory_tracker.get_total();
+    if (memory_used > Global::cell_cache_max_memory)
+      schedule_memory_compactions(memory_used);
+  }
 }
 
 namespace {
@@ -1534,6 +1704,12 @@ namespace {
     }
   };
 
+  struct GtMemUsed {
+    bool operator()(const AccessGroup::CompactionPriorityData &pd1, const AccessGroup::CompactionPriorityData &pd2) const {
+      return pd1.mem_used > pd2.mem_used;
+    }
+  };
+
 
 }
 
@@ -1596,12 +1772,14 @@ void RangeServer::log_cleanup() {
     if (map_iter == log_frag_map.end())
       continue;
 
+    priority_data_vec[i].log_space_pinned = (*map_iter).second.cumulative_size;
+
     if ((*map_iter).second.cumulative_size > prune_threshold) {
       if (priority_data_vec[i].mem_used > 0)
         priority_data_vec[i].ag->set_compaction_bit();
       size_t rangei = (size_t)priority_data_vec[i].user_data;
       if (!range_vec[rangei]->test_and_set_maintenance()) {
-        Global::maintenance_queue->add(new MaintenanceTaskCompaction(range_vec[rangei], false));
+        Global::maintenance_queue->add(new MaintenanceTaskCompaction(range_vec[rangei], false, MaintenanceTaskCompaction::compute_priority(priority_data_vec[i])));
       }
     }
   }
@@ -1617,6 +1795,71 @@ void RangeServer::log_cleanup() {
 
 
 
+/**
+ * Schedules compactions of the access groups with the largest cell caches
+ * until enough memory is being freed to bring the cell caches down to 3/4
+ * of Hypertable.RangeServer.CellCache.MaxMemory.  Memory held by ranges
+ * that already have maintenance in progress is counted as being freed.
+ * Runs at most once a second.
+ */
+void RangeServer::schedule_memory_compactions(uint64_t memory_used) {
+  std::vector<TableInfoPtr> table_vec;
+  std::vector<RangePtr> range_vec;
+  std::vector<AccessGroup::CompactionPriorityData> priority_data_vec;
+  uint64_t low_watermark = (Global::cell_cache_max_memory / 4) * 3;
+  uint64_t memory_freed = 0;
+  size_t scheduled = 0;
+
+  {
+    boost::mutex::scoped_lock lock(m_mutex);
+    time_t now = time(0);
+    if (now == m_last_memory_compaction)
+      return;
+    m_last_memory_compaction = now;
+  }
+
+  m_live_map_ptr->get_all(table_vec);
+  for (size_t i=0; i<table_vec.size(); i++)
+    table_vec[i]->get_range_vector(range_vec);
+
+  /**
+   * Memory of access groups whose compaction is already scheduled or
+   * running will be freed, but not that of the other access groups of
+   * their ranges
+   */
+  for (size_t i=0; i<range_vec.size(); i++) {
+    size_t start = priority_data_vec.size();
+    range_vec[i]->get_compaction_priority_data(priority_data_vec);
+    for (size_t j=start; j<priority_data_vec.size(); j++) {
+      priority_data_vec[j].user_data = (void *)i;
+      if (priority_data_vec[j].ag->needs_compaction())
+        memory_freed += priority_data_vec[j].mem_used;
+    }
+  }
+
+  std::sort(priority_data_vec.begin(), priority_data_vec.end(), GtMemUsed());
+
+  for (size_t i=0; i<priority_data_vec.size(); i++) {
+    if (memory_used - std::min(memory_used, memory_freed) <= low_watermark)
+      break;
+    if (priority_data_vec[i].in_memory || priority_data_vec[i].mem_used == 0)
+      continue;
+    RangePtr &range_ptr = range_vec[(size_t)priority_data_vec[i].user_data];
+    if (range_ptr->test_and_set_maintenance())
+      continue;
+    priority_data_vec[i].ag->set_compaction_bit();
+    Global::maintenance_queue->add(new MaintenanceTaskCompaction(range_ptr, false, MaintenanceTaskCompaction::compute_priority(priority_data_vec[i])));
+    memory_freed += priority_data_vec[i].mem_used;
+    scheduled++;
+  }
+
+  HT_INFOF("Cell cache memory %llu exceeds %llu, scheduled %u compactions",
+           (Llu)memory_used, (Llu)Global::cell_cache_max_memory,
+           (unsigned)scheduled);
+}
+
+
+
 /**
  */
 uint64_t RangeServer::get_timer_interval() {
@@ -22,6 +22,8 @@
 #ifndef HYPERTABLE_RANGESERVER_H
 #define HYPERTABLE_RANGESERVER_H
 
+#include "Common/DynamicBuffer.h"
+#include "Common/Error.h"
 #include "Common/Properties.h"
 #include "Common/ReferenceCount.h"
 #include "Common/HashMap.h"
@@ -49,6 +51,40 @@ namespace Hypertable {
 
   class ConnectionHandler;
 
+  /**
+   * Updates for one table carried by an "update" or "update multi" request,
+   * along with the outcome of applying them.  If error is set none of the
+   * table's updates were committed, otherwise send_back describes the
+   * regions (offsets relative to base) that were not applied.
+   */
+  class TableUpdate {
+  public:
+    struct SendBackRec {
+      int error;
+      uint32_t offset;
+      uint32_t len;
+    };
+
+    TableUpdate() : base(0), size(0), error(Error::OK) { return; }
+
+    void add_send_back(int err, uint32_t offset, uint32_t len) {
+      SendBackRec rec;
+      rec.error = err;
+      rec.offset = offset;
+      rec.len = len;
+      send_back.push_back(rec);
+    }
+
+    TableIdentifier id;
+    uint8_t *base;
+    size_t size;
+    TableInfoPtr table_info;
+    DynamicBuffer go_buf;
+    std::vector<SendBackRec> send_back;
+    int error;
+    String errmsg;
+  };
+
   class RangeServer : public ReferenceCount {
   public:
     RangeServer(PropertiesPtr &, ConnectionManagerPtr &, ApplicationQueuePtr &,
@@ -65,6 +101,7 @@ namespace Hypertable {
     void load_range(ResponseCallback *, TableIdentifier *, RangeSpec *,
                     const char *transfer_log_dir, RangeState *, uint16_t flags);
     void update(ResponseCallbackUpdate *, TableIdentifier *, StaticBuffer &);
+    void update_multi(ResponseCallbackUpdate *, std::vector<TableUpdate *> &);
     void drop_table(ResponseCallback *, TableIdentifier *);
     void dump_stats(ResponseCallback *);
 
@@ -77,6 +114,7 @@ namespace Hypertable {
     // Other methods
     void do_maintenance();
     void log_cleanup();
+    void schedule_memory_compactions(uint64_t memory_used);
 
     uint64_t get_timer_interval();
 
@@ -89,14 +127,13 @@ namespace Hypertable {
   private:
     int initialize(PropertiesPtr &);
     void fast_recover();
+    void apply_updates(std::vector<TableUpdate *> &);
     void reload_range(TableIdentifier *, RangeSpec *, uint64_t soft_limit,
                       const String &split_log);
 
     int verify_schema(TableInfoPtr &, int generation, std::string &errmsg);
 
     Mutex                  m_mutex;
-    Mutex                  m_update_mutex_a;
-    Mutex                  m_update_mutex_b;
     PropertiesPtr          m_props_ptr;
     bool                   m_verbose;
     Comm                  *m_comm;
@@ -115,6 +152,7 @@ namespace Hypertable {
     long                   m_last_commit_log_clean;
     uint64_t               m_timer_interval;
     uint64_t               m_bytes_loaded;
+    time_t                 m_last_memory_compaction;
   };
 
   typedef intrusive_ptr<RangeServer> RangeServerPtr;
@@ -0,0 +1,72 @@
+/** -*- c++ -*-
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "Common/Compat.h"
+#include "Common/Error.h"
+#include "Common/Logger.h"
+
+#include "AsyncComm/ResponseCallback.h"
+#include "Common/Serialization.h"
+
+#include "Hypertable/Lib/Types.h"
+
+#include "RangeServer.h"
+#include "RequestHandlerUpdateMulti.h"
+
+using namespace Hypertable;
+using namespace Serialization;
+
+/**
+ *
+ */
+void RequestHandlerUpdateMulti::run() {
+  ResponseCallbackUpdate cb(m_comm, m_event_ptr);
+  size_t remaining = m_event_ptr->message_len - 2;
+  const uint8_t *p = m_event_ptr->message + 2;
+  std::vector<TableUpdate *> table_updates;
+  TableUpdate *table_update;
+  uint32_t count, len;
+
+  try {
+    count = decode_i32(&p, &remaining);
+
+    for (uint32_t i=0; i<count; i++) {
+      table_update = new TableUpdate();
+      table_updates.push_back(table_update);
+      table_update->id.decode(&p, &remaining);
+      len = decode_i32(&p, &remaining);
+      HT_DECODE_NEED(remaining, len);
+      table_update->base = (uint8_t *)p;
+      table_update->size = len;
+      p += len;
+      remaining -= len;
+    }
+
+    m_range_server->update_multi(&cb, table_updates);
+  }
+  catch (Exception &e) {
+    HT_ERROR_OUT << e << HT_END;
+    cb.error(Error::PROTOCOL_ERROR, "Error handling Update Multi message");
+  }
+
+  for (size_t i=0; i<table_updates.size(); i++)
+    delete table_updates[i];
+}
@@ -75,7 +75,7 @@ void ScanContext::initialize(uint64_t ts, ScanSpec *ss, RangeSpec *range_, Schem
           throw Hypertable::Exception(Error::RANGESERVER_INVALID_COLUMNFAMILY, *iter);
 
         family_mask[cf->id] = true;
-        if (cf->ttl == 0)
+        if (cf->ttl == 0 || ts <= (uint64_t)cf->ttl * 1000000000LL)
           family_info[cf->id].cutoff_time = 0;
         else
           family_info[cf->id].cutoff_time = ts - ((uint64_t)cf->ttl * 1000000000LL);
@@ -98,7 +98,7 @@ void ScanContext::initialize(uint64_t ts, ScanSpec *ss, RangeSpec *range_, Schem
           if ((*cf_it)->id == 0)
             throw Hypertable::Exception(Error::RANGESERVER_SCHEMA_INVALID_CFID, (std::string)"Bad ID for Column Family '" + (*cf_it)->name + "'");
           family_mask[(*cf_it)->id] = true;
-          if ((*cf_it)->ttl == 0)
+          if ((*cf_it)->ttl == 0 || ts <= (uint64_t)(*cf_it)->ttl * 1000000000LL)
             family_info[(*cf_it)->id].cutoff_time = 0;
           else
             family_info[(*cf_it)->id].cutoff_time = ts - ((uint64_t)(*cf_it)->ttl * 1000000000LL);
@@ -119,8 +119,16 @@ void ScanContext::initialize(uint64_t ts, ScanSpec *ss, RangeSpec *range_, Schem
   /**
    * Create Start Key and End Key
    */
+  single_row = false;
+
   if (spec) {
 
+    for (size_t i=0; i<spec->predicates.size(); i++)
+      predicate_filter.add(spec->predicates[i]);
+
+    single_row = spec->start_row_inclusive && spec->end_row_inclusive &&
+        *spec->start_row != 0 && !strcmp(spec->start_row, spec->end_row);
+
     // start row
     start_row = spec->start_row;
     if (!spec->start_row_inclusive)
@@ -33,6 +33,8 @@
 #include "Hypertable/Lib/Schema.h"
 #include "Hypertable/Lib/Types.h"
 
+#include "CellPredicateFilter.h"
+
 namespace Hypertable {
 
   struct CellFilterInfo {
@@ -51,9 +53,11 @@ namespace Hypertable {
     RangeSpec *range;
     std::string start_row;
     std::string end_row;
+    bool single_row;
     std::pair<uint64_t, uint64_t> interval;
     bool family_mask[256];
     CellFilterInfo family_info[256];
+    CellPredicateFilter predicate_filter;
 
     /**
      * Constructor.
@@ -95,7 +99,9 @@ namespace Hypertable {
      * up family_info entries for the column families that are included in the scan
      * which contains cell garbage collection info for each family (e.g. cutoff
      * timestamp and number of copies to keep).  Also sets up end_row to be the
-     * last possible key in spec->end_row.
+     * last possible key in spec->end_row and sets single_row if the scan is
+     * restricted to exactly one row.  Compiles the scan predicates into
+     * predicate_filter, since spec is not valid for the life of the scan.
      *
      * @param ts scan timestamp (point in time when scan began)
      * @param ss scan specification
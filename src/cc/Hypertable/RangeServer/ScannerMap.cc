@@ -20,6 +20,9 @@
  */
 
 #include "Common/Compat.h"
+
+#include "Hypertable/Lib/Defaults.h"
+
 #include "ScannerMap.h"
 
 using namespace Hypertable;
@@ -35,6 +38,8 @@ uint32_t ScannerMap::put(CellListScannerPtr &scanner_ptr, RangePtr &range_ptr) {
   scaninfo.scanner_ptr = scanner_ptr;
   scaninfo.range_ptr = range_ptr;
   scaninfo.last_access = get_timestamp();
+  scaninfo.last_fetch_millis = get_timestamp_millis();
+  scaninfo.block_size = HYPERTABLE_DATA_TRANSFER_BLOCKSIZE;
   uint32_t id = atomic_inc_return(&ms_next_id);
   m_scanner_map[id] = scaninfo;
   return id;
@@ -45,14 +50,35 @@ uint32_t ScannerMap::put(CellListScannerPtr &scanner_ptr, RangePtr &range_ptr) {
 /**
  *
  */
-bool ScannerMap::get(uint32_t id, CellListScannerPtr &scanner_ptr, RangePtr &range_ptr) {
+bool ScannerMap::get(uint32_t id, CellListScannerPtr &scanner_ptr, RangePtr &range_ptr,
+                     uint32_t *block_sizep) {
   boost::mutex::scoped_lock lock(m_mutex);
   CellListScannerMap::iterator iter = m_scanner_map.find(id);
   if (iter == m_scanner_map.end())
     return false;
-  (*iter).second.last_access = get_timestamp();
-  scanner_ptr = (*iter).second.scanner_ptr;
-  range_ptr = (*iter).second.range_ptr;
+  ScanInfo &scaninfo = (*iter).second;
+  scaninfo.last_access = get_timestamp();
+  scanner_ptr = scaninfo.scanner_ptr;
+  range_ptr = scaninfo.range_ptr;
+
+  if (block_sizep) {
+    int64_t now = get_timestamp_millis();
+    int64_t interval = now - scaninfo.last_fetch_millis;
+    scaninfo.last_fetch_millis = now;
+    if (interval < STREAMING_FETCH_INTERVAL_MS) {
+      if (scaninfo.block_size < MAX_BLOCK_SIZE / 2)
+        scaninfo.block_size *= 2;
+      else
+        scaninfo.block_size = MAX_BLOCK_SIZE;
+    }
+    else if (interval > INTERACTIVE_FETCH_INTERVAL_MS) {
+      if (scaninfo.block_size > MIN_BLOCK_SIZE * 2)
+        scaninfo.block_size /= 2;
+      else
+        scaninfo.block_size = MIN_BLOCK_SIZE;
+    }
+    *block_sizep = scaninfo.block_size;
+  }
   return true;
 }
 
@@ -92,3 +118,10 @@ time_t ScannerMap::get_timestamp() {
   boost::xtime_get(&now, boost::TIME_UTC);
   return (time_t)now.sec;
 }
+
+
+int64_t ScannerMap::get_timestamp_millis() {
+  boost::xtime now;
+  boost::xtime_get(&now, boost::TIME_UTC);
+  return (int64_t)now.sec * 1000LL + now.nsec / 1000000;
+}
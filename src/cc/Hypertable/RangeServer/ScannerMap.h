@@ -36,18 +36,49 @@ extern "C" {
 
 namespace Hypertable {
 
+  /**
+   * Map of open scanners.  Also tracks how quickly the client of each
+   * scanner comes back for the next block and adapts the size of the
+   * blocks it is sent: clients that fetch back-to-back (sequential scans)
+   * get progressively larger blocks, up to MAX_BLOCK_SIZE, which cuts the
+   * number of round trips, while clients that pause between fetches
+   * (interactive scans) get progressively smaller ones, down to
+   * MIN_BLOCK_SIZE, so that the server does not read and buffer cells
+   * that may never be asked for.
+   */
   class ScannerMap {
 
   public:
+
+    enum {
+      MIN_BLOCK_SIZE = 8 * 1024,
+      MAX_BLOCK_SIZE = 1024 * 1024,
+      STREAMING_FETCH_INTERVAL_MS = 100,
+      INTERACTIVE_FETCH_INTERVAL_MS = 1000
+    };
+
     ScannerMap() : m_mutex() { return; }
     uint32_t put(CellListScannerPtr &scanner_ptr, RangePtr &range_ptr);
-    bool get(uint32_t id, CellListScannerPtr &scanner_ptr, RangePtr &range_ptr);
+
+    /**
+     * Looks up a scanner.
+     *
+     * @param id scanner ID
+     * @param scanner_ptr reference to scanner smart pointer (output)
+     * @param range_ptr reference to range smart pointer (output)
+     * @param block_sizep address of variable to hold the size of the next
+     *        block to send, adapted to the client's fetch rate (optional)
+     * @return true if the scanner was found, false otherwise
+     */
+    bool get(uint32_t id, CellListScannerPtr &scanner_ptr, RangePtr &range_ptr,
+             uint32_t *block_sizep=0);
     bool remove(uint32_t id);
     void purge_expired(time_t expire_time);
 
   private:
 
     time_t get_timestamp();
+    int64_t get_timestamp_millis();
 
     static atomic_t ms_next_id;
 
@@ -57,6 +88,8 @@ namespace Hypertable {
       CellListScannerPtr scanner_ptr;
       RangePtr range_ptr;
       time_t last_access;
+      int64_t last_fetch_millis;
+      uint32_t block_size;
     };
     typedef hash_map<uint32_t, ScanInfo> CellListScannerMap;
 
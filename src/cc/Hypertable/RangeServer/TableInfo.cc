@@ -20,6 +20,9 @@
  */
 
 #include "Common/Compat.h"
+
+#include <boost/thread/thread.hpp>
+
 #include "Common/Logger.h"
 
 #include "TableInfo.h"
@@ -33,7 +36,15 @@ using namespace Hypertable;
 TableInfo::TableInfo(MasterClientPtr &master_client_ptr,
                      TableIdentifier *identifier, SchemaPtr &schema_ptr)
     : m_mutex(), m_master_client_ptr(master_client_ptr),
-      m_identifier(*identifier), m_schema(schema_ptr) {
+      m_identifier(*identifier), m_schema(schema_ptr),
+      m_snapshot(new RangeSnapshot()), m_epoch(0) {
+  atomic_set(&m_readers[0], 0);
+  atomic_set(&m_readers[1], 0);
+}
+
+
+TableInfo::~TableInfo() {
+  delete m_snapshot;
 }
 
 
@@ -48,19 +59,20 @@ void TableInfo::dump_range_table() {
  *
  */
 bool TableInfo::get_range(RangeSpec *range, RangePtr &range_ptr) {
-  boost::mutex::scoped_lock lock(m_mutex);
-  string end_row = range->end_row;
-
-  RangeMap::iterator iter = m_range_map.find(end_row);
-
-  if (iter == m_range_map.end())
-    return false;
-
-  range_ptr = (*iter).second;
-
-  string start_row = range_ptr->start_row();
+  const RangeEntry *entry;
+  bool found = false;
+  uint32_t epoch = enter_lookup();
+
+  entry = lookup(m_snapshot, range->end_row);
+  if (entry && entry->end_row == range->end_row) {
+    range_ptr = entry->range_ptr;
+    found = true;
+  }
+  leave_lookup(epoch);
 
-  if (strcmp(start_row.c_str(), range->start_row))
+  // the start row is checked against the range itself since it
+  // changes when the range splits
+  if (!found || strcmp(range_ptr->start_row().c_str(), range->start_row))
     return false;
 
   return true;
@@ -88,6 +100,8 @@ bool TableInfo::remove_range(RangeSpec *range, RangePtr &range_ptr) {
 
   m_range_map.erase(iter);
 
+  publish_snapshot();
+
   return true;
 }
 
@@ -101,26 +115,32 @@ void TableInfo::add_range(RangePtr &range_ptr) {
   RangeMap::iterator iter = m_range_map.find(range_ptr->end_row());
   assert(iter == m_range_map.end());
   m_range_map[range_ptr->end_row()] = range_ptr;
+  publish_snapshot();
 }
 
 
 /**
  *
  */
-bool TableInfo::find_containing_range(std::string row, RangePtr &range_ptr) {
-  boost::mutex::scoped_lock lock(m_mutex);
-
-  RangeMap::iterator iter = m_range_map.lower_bound(row);
-
-  if (iter == m_range_map.end())
-    return false;
+bool TableInfo::find_containing_range(const char *row, RangePtr &range_ptr) {
+  const RangeEntry *entry;
+  bool found = false;
+  uint32_t epoch = enter_lookup();
+
+  entry = lookup(m_snapshot, row);
+  if (entry && strcmp(row, entry->start_row.c_str()) > 0) {
+    range_ptr = entry->range_ptr;
+    found = true;
+  }
+  leave_lookup(epoch);
 
-  if (row <= (*iter).second->start_row())
-    return false;
+  return found;
+}
 
-  range_ptr = (*iter).second;
 
-  return true;
+void TableInfo::refresh_ranges() {
+  boost::mutex::scoped_lock lock(m_mutex);
+  publish_snapshot();
 }
 
 
@@ -134,6 +154,7 @@ void TableInfo::get_range_vector(std::vector<RangePtr> &range_vec) {
 void TableInfo::clear() {
   boost::mutex::scoped_lock lock(m_mutex);
   m_range_map.clear();
+  publish_snapshot();
 }
 
 
@@ -144,3 +165,75 @@ TableInfo *TableInfo::create_shallow_copy() {
   boost::mutex::scoped_lock lock(m_mutex);
   return new TableInfo(m_master_client_ptr, &m_identifier, m_schema);
 }
+
+
+/**
+ * Returns the first entry whose end row is not less than row
+ */
+const TableInfo::RangeEntry *
+TableInfo::lookup(const RangeSnapshot *snapshot, const char *row) {
+  size_t lo = 0, hi = snapshot->entries.size(), mid;
+
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (strcmp(snapshot->entries[mid].end_row.c_str(), row) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return (lo < snapshot->entries.size()) ? &snapshot->entries[lo] : 0;
+}
+
+
+/**
+ * Counts the caller as a reader of the current epoch and returns the
+ * epoch.  The epoch is checked again after the count has been
+ * incremented, so a reader that raced with a writer switching epochs
+ * moves on to the new epoch instead of holding up the writer.
+ */
+uint32_t TableInfo::enter_lookup() {
+  uint32_t epoch;
+
+  while (true) {
+    epoch = m_epoch;
+    atomic_inc(&m_readers[epoch]);
+    if (epoch == m_epoch)
+      return epoch;
+    atomic_dec(&m_readers[epoch]);
+  }
+}
+
+
+/**
+ * Builds a new snapshot from the range map and swaps it in.  Called with
+ * m_mutex held.  The new snapshot is published before the epoch switches,
+ * so readers that enter the new epoch only ever see the new snapshot.
+ * Once the readers of the previous epoch have left, no one can still be
+ * using the replaced snapshot and it is freed.  Those readers are in the
+ * middle of a single lookup, so the wait is short.
+ */
+void TableInfo::publish_snapshot() {
+  RangeSnapshot *snapshot = new RangeSnapshot();
+  RangeSnapshot *old_snapshot = (RangeSnapshot *)m_snapshot;
+  uint32_t old_epoch = m_epoch;
+  RangeEntry entry;
+
+  snapshot->entries.reserve(m_range_map.size());
+  for (RangeMap::iterator iter = m_range_map.begin(); iter != m_range_map.end(); iter++) {
+    entry.end_row = (*iter).first;
+    entry.start_row = (*iter).second->start_row();
+    entry.range_ptr = (*iter).second;
+    snapshot->entries.push_back(entry);
+  }
+
+  m_snapshot = snapshot;
+  __sync_synchronize();
+  m_epoch = old_epoch ^ 1;
+  __sync_synchronize();
+
+  while (atomic_read(&m_readers[old_epoch]) != 0)
+    boost::thread::yield();
+
+  delete old_snapshot;
+}
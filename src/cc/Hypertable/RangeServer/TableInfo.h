@@ -24,9 +24,11 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 #include <boost/thread/mutex.hpp>
 
+#include "Common/atomic.h"
 #include "Common/StringExt.h"
 #include "Common/ReferenceCount.h"
 
@@ -39,10 +41,22 @@ namespace Hypertable {
 
   class Schema;
 
+  /**
+   * Holds the schema and the ranges of a table that are loaded into this
+   * server.  Range lookups (#find_containing_range, #get_range) are served
+   * from an immutable snapshot, a sorted array of range end rows, that is
+   * swapped in atomically whenever a range is added or removed, or when a
+   * range has shrunk because of a split.  Readers neither take the table
+   * lock nor allocate; they only count themselves in the current epoch.
+   * A writer that replaces the snapshot moves to the other epoch and
+   * waits for the readers of the previous one to leave, which takes no
+   * longer than a lookup, before freeing the replaced snapshot.
+   */
   class TableInfo : public ReferenceCount {
 
   public:
     TableInfo(MasterClientPtr &master_client_ptr, TableIdentifier *identifier, SchemaPtr &schema_ptr);
+    virtual ~TableInfo();
     const char *get_name() { return m_identifier.name; }
     uint32_t get_id() { return m_identifier.id; }
     SchemaPtr &get_schema() {
@@ -56,7 +70,24 @@ namespace Hypertable {
     bool get_range(RangeSpec *range, RangePtr &range_ptr);
     bool remove_range(RangeSpec *range, RangePtr &range_ptr);
     void add_range(RangePtr &range_ptr);
-    bool find_containing_range(std::string row, RangePtr &range_ptr);
+
+    /**
+     * Looks up the range that contains the given row.
+     *
+     * @param row row key
+     * @param range_ptr reference to range pointer to fill in
+     * @return true if found, false otherwise
+     */
+    bool find_containing_range(const char *row, RangePtr &range_ptr);
+    bool find_containing_range(const std::string &row, RangePtr &range_ptr) {
+      return find_containing_range(row.c_str(), range_ptr);
+    }
+
+    /**
+     * Rebuilds the range lookup snapshot.  Must be called after a range
+     * has shrunk so that its new start row is seen by lookups.
+     */
+    void refresh_ranges();
 
     void dump_range_table();
 
@@ -70,11 +101,32 @@ namespace Hypertable {
 
     typedef std::map<std::string, RangePtr> RangeMap;
 
+    class RangeEntry {
+    public:
+      String   end_row;
+      String   start_row;
+      RangePtr range_ptr;
+    };
+
+    /** Immutable array of ranges sorted by end row */
+    class RangeSnapshot {
+    public:
+      std::vector<RangeEntry> entries;
+    };
+
+    const RangeEntry *lookup(const RangeSnapshot *snapshot, const char *row);
+    uint32_t enter_lookup();
+    void leave_lookup(uint32_t epoch) { atomic_dec(&m_readers[epoch]); }
+    void publish_snapshot();
+
     boost::mutex         m_mutex;
     MasterClientPtr      m_master_client_ptr;
     TableIdentifierManaged m_identifier;
     SchemaPtr            m_schema;
     RangeMap             m_range_map;
+    RangeSnapshot *volatile m_snapshot;
+    volatile uint32_t    m_epoch;
+    atomic_t             m_readers[2];
   };
 
   typedef boost::intrusive_ptr<TableInfo> TableInfoPtr;
@@ -33,8 +33,7 @@
 #include "Hypertable/Lib/Key.h"
 #include "Hypertable/Lib/KeySpec.h"
 
-#include "CellStoreV0.h"
-#include "CellStoreScannerV0.h"
+#include "CellStoreFactory.h"
 #include "CellStoreTrailer.h"
 #include "Global.h"
 
@@ -83,7 +82,7 @@ int main(int argc, char **argv) {
   bool hit_start = false;
   PropertiesPtr props_ptr;
   string config_file = "";
-  CellStoreV0Ptr cell_store_ptr;
+  CellStorePtr cell_store_ptr;
   ScanContextPtr scan_context_ptr(new ScanContext(END_OF_TIME));
   ByteString key;
   ByteString value;
@@ -135,13 +134,9 @@ int main(int argc, char **argv) {
     /**
      * Open cellStore
      */
-    cell_store_ptr = new CellStoreV0(client);
     CellListScanner *scanner = 0;
 
-    if (cell_store_ptr->open(file_vector[i].file.c_str(), 0, 0) != 0)
-      return 1;
-
-    if (cell_store_ptr->load_index() != 0)
+    if (CellStoreFactory::open(client, file_vector[i].file.c_str(), 0, 0, cell_store_ptr) != Error::OK)
       return 1;
 
     hit_start = (file_vector[i].start_row == "") ? true : false;
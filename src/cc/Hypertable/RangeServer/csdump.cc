@@ -40,8 +40,7 @@
 
 #include "Hypertable/Lib/Key.h"
 
-#include "CellStoreV0.h"
-#include "CellStoreScannerV0.h"
+#include "CellStoreFactory.h"
 #include "CellStoreTrailer.h"
 #include "Global.h"
 
@@ -75,7 +74,7 @@ int main(int argc, char **argv) {
   std::string fname = "";
   ByteString key, value;
   bool dump_all = false;
-  CellStoreV0Ptr cellstore;
+  CellStorePtr cellstore;
   bool count_keys = false;
   uint64_t key_count = 0;
   std::string start_key, end_key;
@@ -135,13 +134,9 @@ int main(int argc, char **argv) {
   /**
    * Open cellStore
    */
-  cellstore = new CellStoreV0(client);
   CellListScanner *scanner = 0;
 
-  if (cellstore->open(fname.c_str(), 0, 0) != 0)
-    return 1;
-
-  if (cellstore->load_index() != 0)
+  if (CellStoreFactory::open(client, fname.c_str(), 0, 0, cellstore) != Error::OK)
     return 1;
 
 
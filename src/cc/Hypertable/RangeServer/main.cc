@@ -82,7 +82,7 @@ int main(int argc, char **argv) {
     CommPtr comm_ptr;
     string cfgfile = "";
     string pidfile = "";
-    int reactor_count;
+    int reactor_count, reactor_flags;
     char *logbroker = 0;
     PropertiesPtr props_ptr;
     int worker_count;
@@ -130,7 +130,12 @@ int main(int argc, char **argv) {
     }
 
     reactor_count = props_ptr->get_int("Hypertable.RangeServer.Reactors", System::get_processor_count());
-    ReactorFactory::initialize(reactor_count);
+    reactor_flags = 0;
+    if (props_ptr->get_bool("Hypertable.RangeServer.Reactor.EdgeTriggered", false))
+      reactor_flags |= ReactorFactory::EDGE_TRIGGERED;
+    if (props_ptr->get_bool("Hypertable.RangeServer.Reactor.PinThreads", false))
+      reactor_flags |= ReactorFactory::PIN_THREADS;
+    ReactorFactory::initialize(reactor_count, reactor_flags);
     comm_ptr = new Comm();
 
     worker_count = props_ptr->get_int("Hypertable.RangeServer.Workers", DEFAULT_WORKERS);
@@ -0,0 +1,268 @@
+/** -*- c++ -*-
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "Common/Compat.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+#include <boost/thread/thread.hpp>
+
+#include "Common/DynamicBuffer.h"
+#include "Common/Error.h"
+#include "Common/Logger.h"
+#include "Common/Mutex.h"
+#include "Common/String.h"
+#include "Common/Usage.h"
+
+#include "Hypertable/Lib/Key.h"
+#include "Hypertable/Lib/Schema.h"
+#include "Hypertable/Lib/Types.h"
+
+#include "Hypertable/RangeServer/CellCache.h"
+#include "Hypertable/RangeServer/ScanContext.h"
+
+using namespace Hypertable;
+using namespace std;
+
+namespace {
+
+  const char *usage[] = {
+    "usage: CellCache_test [--seed=<n>] [--cells=<n>] [--readers=<n>]",
+    "",
+    "Inserts cells into a CellCache in random order from one thread while",
+    "several threads scan it.  Every scan must return its cells in key",
+    "order, with the right values, and must include every cell whose",
+    "insert completed before the scan started.",
+    "",
+    0
+  };
+
+  const char *schema_str =
+    "<Schema>\n"
+    "  <AccessGroup name=\"default\">\n"
+    "    <ColumnFamily>\n"
+    "      <Name>a</Name>\n"
+    "    </ColumnFamily>\n"
+    "  </AccessGroup>\n"
+    "</Schema>";
+
+  String row_name(size_t i) {
+    return format("row-%07d", (int)i);
+  }
+
+  String value_of(size_t i) {
+    return format("value-%d", (int)(i * 7919));
+  }
+
+  /**
+   * State shared by the writer and the scanning threads
+   */
+  class TestState {
+  public:
+    TestState(size_t count) : cache(new CellCache()), inserted(0),
+                              done(false), errors(0), scans(0) {
+      schema_ptr = Schema::new_instance(schema_str, strlen(schema_str));
+      HT_EXPECT(schema_ptr->is_valid(), Error::FAILED_EXPECTATION);
+      schema_ptr->assign_ids();
+      for (size_t i=0; i<count; i++)
+        order.push_back(i);
+      random_shuffle(order.begin(), order.end());
+    }
+
+    void error(const String &msg) {
+      ScopedLock lock(mutex);
+      if (errors++ < 10)
+        cout << msg << endl;
+    }
+
+    CellCachePtr   cache;
+    SchemaPtr      schema_ptr;
+    vector<size_t> order;
+    Mutex          mutex;
+    size_t         inserted;
+    bool           done;
+    size_t         errors;
+    size_t         scans;
+  };
+
+  /**
+   * Inserts the cells in the shuffled order, publishing the number of
+   * completed inserts after each one
+   */
+  class Writer {
+  public:
+    Writer(TestState &state) : m_state(state) { }
+
+    void operator()() {
+      DynamicBuffer key_buf(0), value_buf(0);
+
+      for (size_t i=0; i<m_state.order.size(); i++) {
+        size_t n = m_state.order[i];
+        key_buf.clear();
+        create_key_and_append(key_buf, FLAG_INSERT, row_name(n).c_str(), 1,
+                              "", 1000 + n);
+        value_buf.clear();
+        append_as_byte_string(value_buf, value_of(n).c_str());
+
+        m_state.cache->lock();
+        m_state.cache->add(ByteString(key_buf.base),
+                           ByteString(value_buf.base), 0);
+        m_state.cache->unlock();
+
+        ScopedLock lock(m_state.mutex);
+        m_state.inserted = i + 1;
+      }
+
+      ScopedLock lock(m_state.mutex);
+      m_state.done = true;
+    }
+
+  private:
+    TestState &m_state;
+  };
+
+  /**
+   * Scans the whole cache and checks order and values, and that the cells
+   * of the first <i>expected</i> inserts are all present.  Returns the
+   * number of cells scanned.
+   */
+  size_t scan(TestState &state, size_t expected) {
+    ScanContextPtr scan_ctx = new ScanContext(END_OF_TIME, state.schema_ptr);
+    CellListScannerPtr scanner = state.cache->create_scanner(scan_ctx);
+    vector<bool> seen(state.order.size(), false);
+    ByteString key, value;
+    String last_row;
+    const uint8_t *vptr;
+    size_t vlen, count = 0;
+
+    while (scanner->get(key, value)) {
+      Key key_comps(key);
+      String row = key_comps.row;
+      if (count > 0 && row <= last_row) {
+        state.error(format("scan returned %s after %s", row.c_str(),
+                           last_row.c_str()));
+        return count;
+      }
+      size_t n = atoi(row.c_str() + 4);
+      vlen = value.decode_length(&vptr);
+      if (n >= seen.size() || row != row_name(n) ||
+          String((const char *)vptr, vlen) != value_of(n)) {
+        state.error(format("scan returned bad cell %s", row.c_str()));
+        return count;
+      }
+      seen[n] = true;
+      last_row = row;
+      count++;
+      scanner->forward();
+    }
+
+    for (size_t i=0; i<expected; i++) {
+      if (!seen[state.order[i]]) {
+        state.error(format("scan missed %s, inserted before the scan began "
+                           "(%d of %d inserts done)",
+                           row_name(state.order[i]).c_str(), (int)i,
+                           (int)expected));
+        break;
+      }
+    }
+    return count;
+  }
+
+  class Reader {
+  public:
+    Reader(TestState &state) : m_state(state) { }
+
+    void operator()() {
+      while (true) {
+        bool done;
+        size_t expected;
+        {
+          ScopedLock lock(m_state.mutex);
+          done = m_state.done;
+          expected = m_state.inserted;
+          if (m_state.errors)
+            return;
+          m_state.scans++;
+        }
+        size_t count = scan(m_state, expected);
+        if (count < expected)
+          return;
+        if (done)
+          break;
+      }
+    }
+
+  private:
+    TestState &m_state;
+  };
+
+}
+
+
+int main(int argc, char **argv) {
+  unsigned seed = 1;
+  size_t cells = 100000;
+  size_t readers = 3;
+
+  for (int i=1; i<argc; i++) {
+    if (!strncmp(argv[i], "--seed=", 7))
+      seed = atoi(&argv[i][7]);
+    else if (!strncmp(argv[i], "--cells=", 8))
+      cells = atoi(&argv[i][8]);
+    else if (!strncmp(argv[i], "--readers=", 10))
+      readers = atoi(&argv[i][10]);
+    else
+      Usage::dump_and_exit(usage);
+  }
+
+  cout << "CellCache_test SEED = " << seed << endl;
+  srandom(seed);
+  srand(seed);
+
+  TestState state(cells);
+  boost::thread_group threads;
+
+  for (size_t i=0; i<readers; i++)
+    threads.create_thread(Reader(state));
+  threads.create_thread(Writer(state));
+  threads.join_all();
+
+  if (state.errors)
+    return 1;
+
+  // once the writer is done, a scan returns every cell
+  if (scan(state, cells) != cells || state.errors) {
+    cout << "final scan did not return all " << cells << " cells" << endl;
+    return 1;
+  }
+
+  if (state.cache->size() != cells) {
+    cout << "cache holds " << state.cache->size() << " cells, expected "
+         << cells << endl;
+    return 1;
+  }
+
+  cout << state.scans << " concurrent scans" << endl;
+  return 0;
+}
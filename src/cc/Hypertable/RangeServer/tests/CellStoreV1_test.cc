@@ -0,0 +1,325 @@
+/** -*- c++ -*-
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "Common/Compat.h"
+#include <cstdlib>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+#include "AsyncComm/Comm.h"
+#include "AsyncComm/ConnectionManager.h"
+#include "AsyncComm/ReactorFactory.h"
+
+#include "Common/DynamicBuffer.h"
+#include "Common/Error.h"
+#include "Common/InetAddr.h"
+#include "Common/Logger.h"
+#include "Common/String.h"
+#include "Common/System.h"
+#include "Common/Usage.h"
+
+#include "DfsBroker/Lib/Client.h"
+
+#include "Hypertable/Lib/Defaults.h"
+#include "Hypertable/Lib/Key.h"
+#include "Hypertable/Lib/Types.h"
+
+#include "Hypertable/RangeServer/CellStoreV1.h"
+#include "Hypertable/RangeServer/FileBlockCache.h"
+#include "Hypertable/RangeServer/Global.h"
+#include "Hypertable/RangeServer/ScanContext.h"
+
+using namespace Hypertable;
+using namespace std;
+
+namespace {
+
+  const char *usage[] = {
+    "usage: CellStoreV1_test",
+    "",
+    "Writes CellStoreV1 files through the DFS broker and checks that",
+    "scans of different row ranges read back exactly the cells written.",
+    "",
+    0
+  };
+
+  const uint32_t BLOCKSIZE = 4096;
+
+  const char *schema_str =
+    "<Schema>\n"
+    "  <AccessGroup name=\"default\">\n"
+    "    <ColumnFamily>\n"
+    "      <Name>a</Name>\n"
+    "    </ColumnFamily>\n"
+    "    <ColumnFamily>\n"
+    "      <Name>b</Name>\n"
+    "    </ColumnFamily>\n"
+    "  </AccessGroup>\n"
+    "</Schema>";
+
+  /** Row whose cells fill several blocks */
+  const char *SPAN_ROW = "row-0050";
+
+  class TestCell {
+  public:
+    String   row;
+    uint8_t  family;
+    String   qualifier;
+    uint64_t timestamp;
+    String   value;
+  };
+
+  /**
+   * Makes the cells of 100 rows in key order.  SPAN_ROW gets 150 cells
+   * with 200 byte values, about seven blocks worth.
+   */
+  void make_cells(vector<TestCell> &cells) {
+    char buf[32];
+    TestCell cell;
+
+    for (int r=0; r<100; r++) {
+      sprintf(buf, "row-%04d", r);
+      cell.row = buf;
+      size_t count = (cell.row == SPAN_ROW) ? 150 : 3;
+      for (size_t i=0; i<count; i++) {
+        sprintf(buf, "q%04d", (int)i);
+        cell.family = 1 + i % 2;
+        cell.qualifier = buf;
+        cell.timestamp = 1000 + i;
+        cell.value = format("%s:%s:", cell.row.c_str(), buf);
+        cell.value.append((cell.row == SPAN_ROW) ? 200 : 20, 'v');
+        cells.push_back(cell);
+      }
+    }
+
+    // order within a row is by family, then qualifier
+    for (size_t i=0; i<cells.size(); ) {
+      size_t j = i;
+      while (j < cells.size() && cells[j].row == cells[i].row)
+        j++;
+      vector<TestCell> family1, family2;
+      for (size_t k=i; k<j; k++)
+        (cells[k].family == 1 ? family1 : family2).push_back(cells[k]);
+      copy(family1.begin(), family1.end(), cells.begin() + i);
+      copy(family2.begin(), family2.end(), cells.begin() + i + family1.size());
+      i = j;
+    }
+  }
+
+  void write_store(Filesystem *fs, const String &fname, const char *compressor,
+                   const vector<TestCell> &cells) {
+    CellStorePtr cs = new CellStoreV1(fs);
+    DynamicBuffer key_buf(0), value_buf(0);
+    Timestamp timestamp(2000, 2000);
+
+    HT_EXPECT(cs->create(fname.c_str(), BLOCKSIZE, compressor, "rows") == Error::OK,
+              Error::FAILED_EXPECTATION);
+
+    for (size_t i=0; i<cells.size(); i++) {
+      key_buf.clear();
+      create_key_and_append(key_buf, FLAG_INSERT, cells[i].row.c_str(),
+                            cells[i].family, cells[i].qualifier.c_str(),
+                            cells[i].timestamp);
+      value_buf.clear();
+      append_as_byte_string(value_buf, cells[i].value.c_str());
+      HT_EXPECT(cs->add(ByteString(key_buf.base), ByteString(value_buf.base),
+                        cells[i].timestamp) == Error::OK,
+                Error::FAILED_EXPECTATION);
+    }
+
+    HT_EXPECT(cs->finalize(timestamp) == Error::OK, Error::FAILED_EXPECTATION);
+  }
+
+  /**
+   * Opens the store as the range (start_row, end_row], scans it with the
+   * given spec (or the whole range) and checks that the cells that come
+   * back are the cells with row in (first_row, last_row], in order
+   */
+  bool check_scan(const char *what, Filesystem *fs, const String &fname,
+                  const char *start_row, const char *end_row, ScanSpec *spec,
+                  SchemaPtr &schema_ptr, const vector<TestCell> &cells,
+                  const String &first_row, const String &last_row) {
+    CellStorePtr cs = new CellStoreV1(fs);
+    ScanContextPtr scan_ctx;
+    ByteString key, value;
+    const uint8_t *vptr;
+    size_t vlen, expected = 0, returned = 0;
+
+    HT_EXPECT(cs->open(fname.c_str(), start_row, end_row) == Error::OK,
+              Error::FAILED_EXPECTATION);
+    HT_EXPECT(cs->load_index() == Error::OK, Error::FAILED_EXPECTATION);
+
+    scan_ctx = new ScanContext(END_OF_TIME, spec, 0, schema_ptr);
+
+    while (expected < cells.size() && cells[expected].row <= first_row)
+      expected++;
+
+    CellListScannerPtr scanner = cs->create_scanner(scan_ctx);
+
+    while (scanner->get(key, value)) {
+      Key key_comps(key);
+      if (expected == cells.size() || cells[expected].row > last_row) {
+        cout << what << ": unexpected cell " << key_comps << endl;
+        return false;
+      }
+      const TestCell &cell = cells[expected];
+      vlen = value.decode_length(&vptr);
+      if (cell.row != key_comps.row || cell.family != key_comps.column_family_code ||
+          cell.qualifier != key_comps.column_qualifier ||
+          cell.timestamp != key_comps.timestamp ||
+          cell.value != String((const char *)vptr, vlen)) {
+        cout << what << ": expected " << cell.row << " " << (int)cell.family
+             << ":" << cell.qualifier << " @ " << cell.timestamp << ", got "
+             << key_comps << endl;
+        return false;
+      }
+      expected++;
+      returned++;
+      scanner->forward();
+    }
+
+    if (expected < cells.size() && cells[expected].row <= last_row) {
+      cout << what << ": scan ended after " << returned << " cells, before "
+           << cells[expected].row << " " << (int)cells[expected].family << ":"
+           << cells[expected].qualifier << endl;
+      return false;
+    }
+
+    cout << what << ": " << returned << " cells" << endl;
+    return true;
+  }
+
+  bool test_store(Filesystem *fs, const String &fname, const char *compressor) {
+    vector<TestCell> cells;
+    ScanSpec spec;
+    SchemaPtr schema_ptr = Schema::new_instance(schema_str, strlen(schema_str));
+
+    HT_EXPECT(schema_ptr->is_valid(), Error::FAILED_EXPECTATION);
+    schema_ptr->assign_ids();
+
+    make_cells(cells);
+    write_store(fs, fname, compressor, cells);
+
+    cout << "compressor '" << compressor << "'" << endl;
+
+    if (!check_scan("full range", fs, fname, "", Key::END_ROW_MARKER, 0,
+                    schema_ptr, cells, "", Key::END_ROW_MARKER))
+      return false;
+
+    // the range ends at the row that spans blocks
+    if (!check_scan("range ending at spanning row", fs, fname, "", SPAN_ROW,
+                    0, schema_ptr, cells, "", SPAN_ROW))
+      return false;
+
+    if (!check_scan("range starting after spanning row", fs, fname, SPAN_ROW,
+                    Key::END_ROW_MARKER, 0, schema_ptr, cells, SPAN_ROW,
+                    Key::END_ROW_MARKER))
+      return false;
+
+    if (!check_scan("range ending at row before spanning row", fs, fname, "",
+                    "row-0049", 0, schema_ptr, cells, "", "row-0049"))
+      return false;
+
+    spec.start_row = SPAN_ROW;
+    spec.start_row_inclusive = true;
+    spec.end_row = SPAN_ROW;
+    spec.end_row_inclusive = true;
+    if (!check_scan("single spanning row", fs, fname, "", SPAN_ROW, &spec,
+                    schema_ptr, cells, "row-0049", SPAN_ROW))
+      return false;
+
+    spec.start_row = "row-0040";
+    spec.start_row_inclusive = false;
+    spec.end_row = SPAN_ROW;
+    spec.end_row_inclusive = true;
+    if (!check_scan("scan ending at spanning row", fs, fname, "",
+                    Key::END_ROW_MARKER, &spec, schema_ptr, cells, "row-0040",
+                    SPAN_ROW))
+      return false;
+
+    spec.end_row_inclusive = false;
+    if (!check_scan("scan ending before spanning row", fs, fname, "",
+                    Key::END_ROW_MARKER, &spec, schema_ptr, cells, "row-0040",
+                    "row-0049"))
+      return false;
+
+    fs->remove(fname);
+    return true;
+  }
+
+}
+
+
+int main(int argc, char **argv) {
+  CommPtr comm_ptr;
+  ConnectionManagerPtr conn_manager_ptr;
+  DfsBroker::Client *dfs_client;
+  String test_dir = "/hypertable/test_cellstore";
+
+  if (argc == 2 && !strcmp(argv[1], "--help"))
+    Usage::dump_and_exit(usage);
+
+  try {
+    System::initialize(argv[0]);
+    ReactorFactory::initialize(System::get_processor_count());
+
+    comm_ptr = new Comm();
+    conn_manager_ptr = new ConnectionManager(comm_ptr.get());
+
+    struct sockaddr_in addr;
+    InetAddr::initialize(&addr, "localhost",
+                         HYPERTABLE_RANGESERVER_COMMITLOG_DFSBROKER_PORT);
+    dfs_client = new DfsBroker::Client(conn_manager_ptr, addr, 60);
+    if (!dfs_client->wait_for_connection(10)) {
+      HT_ERROR("Unable to connect to DFS Broker, exiting...");
+      exit(1);
+    }
+
+    Global::block_cache = new FileBlockCache(16 * 1024 * 1024);
+
+    dfs_client->mkdirs(test_dir);
+
+    Global::cell_store_compression_threads = 0;
+    if (!test_store(dfs_client, test_dir + "/cs-none", "none"))
+      return 1;
+
+    Global::cell_store_compression_threads = 2;
+    if (!test_store(dfs_client, test_dir + "/cs-zlib", "zlib"))
+      return 1;
+
+    // blocks and index pages too large for the cache are read uncached
+    delete Global::block_cache;
+    Global::block_cache = new FileBlockCache(256);
+    if (!test_store(dfs_client, test_dir + "/cs-uncached", "none"))
+      return 1;
+
+    dfs_client->rmdir(test_dir);
+  }
+  catch (Exception &e) {
+    HT_ERRORF("%s - %s", e.what(), Error::get_text(e.code()));
+    ReactorFactory::destroy();
+    return 1;
+  }
+
+  ReactorFactory::destroy();
+  return 0;
+}
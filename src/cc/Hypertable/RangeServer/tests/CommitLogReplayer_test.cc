@@ -0,0 +1,316 @@
+/** -*- c++ -*-
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "Common/Compat.h"
+#include <cstdlib>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include "AsyncComm/Comm.h"
+#include "AsyncComm/ConnectionManager.h"
+
+#include "Common/DynamicBuffer.h"
+#include "Common/Error.h"
+#include "Common/InetAddr.h"
+#include "Common/Logger.h"
+#include "Common/Properties.h"
+#include "Common/String.h"
+#include "Common/Usage.h"
+
+#include "DfsBroker/Lib/Client.h"
+
+#include "Hypertable/Lib/Client.h"
+#include "Hypertable/Lib/CommitLog.h"
+#include "Hypertable/Lib/Defaults.h"
+#include "Hypertable/Lib/Key.h"
+#include "Hypertable/Lib/Schema.h"
+#include "Hypertable/Lib/Types.h"
+
+#include "Hypertable/RangeServer/CommitLogReplayer.h"
+#include "Hypertable/RangeServer/Global.h"
+#include "Hypertable/RangeServer/ScanContext.h"
+
+using namespace Hypertable;
+using namespace std;
+
+namespace {
+
+  const char *usage[] = {
+    "usage: CommitLogReplayer_test [<seed>]",
+    "",
+    "Writes a commit log whose blocks hold cells of a table in random row",
+    "order, and replays it into three ranges of the table that leave a gap",
+    "of rows uncovered.  Each range must end up with exactly the cells of",
+    "its rows, the cells of the gap and of another table must be skipped.",
+    "Needs a running system: the ranges look up their cell stores in",
+    "METADATA, and the log is written through the DFS broker.",
+    0
+  };
+
+  const char *schema_str =
+    "<Schema>\n"
+    "  <AccessGroup name=\"default\">\n"
+    "    <ColumnFamily>\n"
+    "      <Name>a</Name>\n"
+    "    </ColumnFamily>\n"
+    "  </AccessGroup>\n"
+    "  <AccessGroup name=\"second\">\n"
+    "    <ColumnFamily>\n"
+    "      <Name>b</Name>\n"
+    "    </ColumnFamily>\n"
+    "  </AccessGroup>\n"
+    "</Schema>";
+
+  /** Table id that no table of the system uses, so METADATA has no cell
+   * stores for its ranges */
+  const uint32_t TABLE_ID = 0x7ffffff0;
+
+  const size_t ROWS = 1000;
+  const size_t BLOCKS = 400;
+  const size_t CELLS_PER_BLOCK = 40;
+
+  /** Ranges loaded for the replay; rows row-0500 (exclusive) through
+   * row-0750 (inclusive) are not covered */
+  const char *range_rows[][2] = {
+    { "", "row-0250" },
+    { "row-0250", "row-0500" },
+    { "row-0750", Key::END_ROW_MARKER }
+  };
+  const size_t RANGES = 3;
+
+  typedef map<String, String> CellMap;
+
+  String row_name(size_t i) {
+    return format("row-%04d", (int)i);
+  }
+
+  /** Returns the index of the range holding the row, or RANGES */
+  size_t range_of(const String &row) {
+    for (size_t i=0; i<RANGES; i++)
+      if (row > range_rows[i][0] && row <= range_rows[i][1])
+        return i;
+    return RANGES;
+  }
+
+  /**
+   * Writes the log.  Each block holds cells of random rows, so consecutive
+   * pairs of a block go back and forth between ranges.  Every tenth block
+   * belongs to another table.
+   */
+  void write_log(Filesystem *fs, const String &log_dir,
+                 CellMap expected[RANGES], uint64_t *cellsp,
+                 uint64_t *skippedp) {
+    PropertiesPtr props_ptr = new Properties();
+    CommitLogPtr log_ptr;
+    TableIdentifier table_id;
+    DynamicBuffer dbuf(0);
+    uint64_t timestamp = 1;
+    int error;
+
+    props_ptr->set("Hypertable.RangeServer.CommitLog.RollLimit", "20000");
+    log_ptr = new CommitLog(fs, log_dir, props_ptr);
+
+    table_id.name = "ReplayTest";
+    table_id.generation = 1;
+
+    for (size_t i=0; i<BLOCKS; i++) {
+      table_id.id = (i % 10 == 9) ? TABLE_ID + 1 : TABLE_ID;
+      dbuf.clear();
+      dbuf.ensure(table_id.encoded_length());
+      table_id.encode(&dbuf.ptr);
+
+      for (size_t j=0; j<CELLS_PER_BLOCK; j++) {
+        String row = row_name(random() % ROWS);
+        String qualifier = format("q%llu", (Llu)timestamp);
+        String value = format("v%u", (unsigned)random());
+        uint8_t family = 1 + (random() % 2);
+
+        create_key_and_append(dbuf, FLAG_INSERT, row.c_str(), family,
+                              qualifier.c_str(), timestamp++);
+        append_as_byte_string(dbuf, value.c_str());
+
+        if (table_id.id != TABLE_ID)
+          continue;
+        size_t range = range_of(row);
+        if (range == RANGES)
+          (*skippedp)++;
+        else {
+          expected[range][format("%s:%d:%s", row.c_str(), (int)family,
+                                 qualifier.c_str())] = value;
+          (*cellsp)++;
+        }
+      }
+
+      if ((error = log_ptr->write(dbuf, log_ptr->get_timestamp())) != Error::OK)
+        HT_THROW(error, "Problem writing commit log");
+    }
+
+    log_ptr->close();
+  }
+
+  bool check_range(RangePtr &range_ptr, SchemaPtr &schema_ptr,
+                   CellMap &expected) {
+    ScanContextPtr scan_ctx = new ScanContext(END_OF_TIME, schema_ptr);
+    CellListScannerPtr scanner_ptr = range_ptr->create_scanner(scan_ctx);
+    CellMap::iterator iter;
+    ByteString key, value;
+    const uint8_t *vptr;
+    size_t vlen, found = 0;
+
+    while (scanner_ptr->get(key, value)) {
+      Key key_comps(key);
+      String cell_key = format("%s:%d:%s", key_comps.row,
+                               (int)key_comps.column_family_code,
+                               key_comps.column_qualifier);
+      vlen = value.decode_length(&vptr);
+      if ((iter = expected.find(cell_key)) == expected.end()) {
+        cout << range_ptr->get_name() << ": unexpected cell " << cell_key
+             << endl;
+        return false;
+      }
+      if ((*iter).second != String((const char *)vptr, vlen)) {
+        cout << range_ptr->get_name() << ": wrong value for " << cell_key
+             << endl;
+        return false;
+      }
+      found++;
+      scanner_ptr->forward();
+    }
+
+    if (found != expected.size()) {
+      cout << range_ptr->get_name() << ": replayed " << found << " of "
+           << expected.size() << " cells" << endl;
+      return false;
+    }
+    return true;
+  }
+
+  bool test_replay(Filesystem *fs, const String &log_dir) {
+    SchemaPtr schema_ptr = Schema::new_instance(schema_str, strlen(schema_str));
+    MasterClientPtr master_client_ptr;
+    TableInfoMapPtr replay_map_ptr = new TableInfoMap();
+    TableInfoPtr table_info_ptr;
+    CommitLogReplayerPtr replayer_ptr;
+    CommitLogReplayer::Statistics stats;
+    TableIdentifier table_id;
+    RangePtr ranges[RANGES];
+    CellMap expected[RANGES];
+    uint64_t cells = 0, skipped = 0;
+
+    HT_EXPECT(schema_ptr->is_valid(), Error::FAILED_EXPECTATION);
+    schema_ptr->assign_ids();
+
+    write_log(fs, log_dir, expected, &cells, &skipped);
+
+    table_id.name = "ReplayTest";
+    table_id.id = TABLE_ID;
+    table_id.generation = 1;
+
+    table_info_ptr = new TableInfo(master_client_ptr, &table_id, schema_ptr);
+    for (size_t i=0; i<RANGES; i++) {
+      RangeSpec range(range_rows[i][0], range_rows[i][1]);
+      RangeState range_state;
+      ranges[i] = new Range(master_client_ptr, &table_id, schema_ptr, &range,
+                            &range_state);
+      table_info_ptr->add_range(ranges[i]);
+    }
+    replay_map_ptr->set(TABLE_ID, table_info_ptr);
+
+    replayer_ptr = new CommitLogReplayer(fs, replay_map_ptr, 2, 2);
+    replayer_ptr->replay(log_dir);
+    replayer_ptr->get_statistics(stats);
+
+    if (stats.fragments < 2 || stats.fragments_replayed != stats.fragments) {
+      cout << "replayed " << stats.fragments_replayed << " of "
+           << stats.fragments << " fragments, expected several" << endl;
+      return false;
+    }
+
+    if (stats.cells != cells || stats.cells_skipped != skipped) {
+      cout << "replayed " << stats.cells << " cells and skipped "
+           << stats.cells_skipped << ", expected " << cells << " and "
+           << skipped << endl;
+      return false;
+    }
+
+    for (size_t i=0; i<RANGES; i++)
+      if (!check_range(ranges[i], schema_ptr, expected[i]))
+        return false;
+
+    return true;
+  }
+
+}
+
+
+int main(int argc, char **argv) {
+  Client *hypertable;
+  CommPtr comm_ptr;
+  ConnectionManagerPtr conn_manager_ptr;
+  DfsBroker::Client *dfs_client;
+  String log_dir = "/hypertable/test_replay";
+  unsigned long seed = 1234;
+
+  if (argc > 2 ||
+      (argc == 2 && (!strcmp(argv[1], "--help") || !strcmp(argv[1], "-?"))))
+    Usage::dump_and_exit(usage);
+
+  if (argc == 2)
+    seed = atoi(argv[1]);
+
+  cout << "SEED: " << seed << endl;
+
+  srandom(seed);
+
+  hypertable = new Client(argv[0], "./hypertable.cfg");
+
+  try {
+    Global::metadata_table_ptr = hypertable->open_table("METADATA");
+
+    comm_ptr = new Comm();
+    conn_manager_ptr = new ConnectionManager(comm_ptr.get());
+
+    struct sockaddr_in addr;
+    InetAddr::initialize(&addr, "localhost",
+                         HYPERTABLE_RANGESERVER_COMMITLOG_DFSBROKER_PORT);
+    dfs_client = new DfsBroker::Client(conn_manager_ptr, addr, 60);
+    if (!dfs_client->wait_for_connection(10)) {
+      HT_ERROR("Unable to connect to DFS Broker, exiting...");
+      return 1;
+    }
+
+    dfs_client->rmdir(log_dir);
+    dfs_client->mkdirs(log_dir);
+
+    if (!test_replay(dfs_client, log_dir))
+      return 1;
+
+    dfs_client->rmdir(log_dir);
+  }
+  catch (Exception &e) {
+    HT_ERROR_OUT << e << HT_END;
+    return 1;
+  }
+
+  return 0;
+}
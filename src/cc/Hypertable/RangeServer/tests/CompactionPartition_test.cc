@@ -0,0 +1,333 @@
+/** -*- c++ -*-
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "Common/Compat.h"
+#include <cstdlib>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+#include "AsyncComm/Comm.h"
+#include "AsyncComm/ConnectionManager.h"
+#include "AsyncComm/ReactorFactory.h"
+
+#include "Common/DynamicBuffer.h"
+#include "Common/Error.h"
+#include "Common/InetAddr.h"
+#include "Common/Logger.h"
+#include "Common/String.h"
+#include "Common/System.h"
+#include "Common/Usage.h"
+
+#include "DfsBroker/Lib/Client.h"
+
+#include "Hypertable/Lib/Defaults.h"
+#include "Hypertable/Lib/Key.h"
+#include "Hypertable/Lib/Types.h"
+
+#include "Hypertable/RangeServer/AccessGroup.h"
+#include "Hypertable/RangeServer/CellCache.h"
+#include "Hypertable/RangeServer/CellStoreV0.h"
+#include "Hypertable/RangeServer/CellStoreV1.h"
+#include "Hypertable/RangeServer/FileBlockCache.h"
+#include "Hypertable/RangeServer/Global.h"
+#include "Hypertable/RangeServer/MergeScanner.h"
+#include "Hypertable/RangeServer/ScanContext.h"
+
+using namespace Hypertable;
+using namespace std;
+
+namespace {
+
+  const char *usage[] = {
+    "usage: CompactionPartition_test",
+    "",
+    "Checks the choice of compaction partition rows and that merging a",
+    "CellCache, a CellStoreV0 and a CellStoreV1 partition by partition,",
+    "the way a partitioned compaction does, yields the same cells as a",
+    "single merge.",
+    "",
+    0
+  };
+
+  const uint32_t BLOCKSIZE = 1024;
+  const int ROWS = 400;
+  const size_t PARTITIONS = 4;
+
+  const char *schema_str =
+    "<Schema>\n"
+    "  <AccessGroup name=\"default\">\n"
+    "    <ColumnFamily>\n"
+    "      <Name>a</Name>\n"
+    "    </ColumnFamily>\n"
+    "  </AccessGroup>\n"
+    "</Schema>";
+
+  void add_row(DynamicBuffer &buf, int r, const char *qualifier) {
+    char row[16];
+    String value;
+
+    sprintf(row, "row-%04d", r);
+    value = format("%s:%s:", row, qualifier);
+    value.append(80, 'v');
+    create_key_and_append(buf, FLAG_INSERT, row, 1, qualifier, 1000 + r);
+    append_as_byte_string(buf, value.c_str());
+  }
+
+  /**
+   * Writes the rows r, r+step, ... into the given store
+   */
+  void write_store(CellStorePtr cs, const String &fname, int r, int step) {
+    DynamicBuffer buf(0);
+    Timestamp timestamp(2000, 2000);
+    ByteString key, value;
+
+    HT_EXPECT(cs->create(fname.c_str(), BLOCKSIZE, "none", "none") == Error::OK,
+              Error::FAILED_EXPECTATION);
+
+    for (; r<ROWS; r+=step)
+      add_row(buf, r, "q");
+
+    key.ptr = buf.base;
+    while (key.ptr < buf.ptr) {
+      value.ptr = key.ptr + key.length();
+      HT_EXPECT(cs->add(key, value, 2000) == Error::OK,
+                Error::FAILED_EXPECTATION);
+      key.ptr = value.ptr + value.length();
+    }
+
+    HT_EXPECT(cs->finalize(timestamp) == Error::OK, Error::FAILED_EXPECTATION);
+  }
+
+  CellStorePtr open_store(CellStorePtr cs, const String &fname) {
+    HT_EXPECT(cs->open(fname.c_str(), 0, Key::END_ROW_MARKER) == Error::OK,
+              Error::FAILED_EXPECTATION);
+    HT_EXPECT(cs->load_index() == Error::OK, Error::FAILED_EXPECTATION);
+    return cs;
+  }
+
+  bool check_select(const char *what, vector<String> rows, size_t partitions,
+                    const String &start_row, const String &end_row,
+                    const char *expected) {
+    vector<String> partition_rows;
+    String got;
+
+    AccessGroup::select_partition_rows(rows, partitions, start_row, end_row,
+                                       partition_rows);
+    for (size_t i=0; i<partition_rows.size(); i++)
+      got += (i == 0) ? partition_rows[i] : String(",") + partition_rows[i];
+
+    if (got != expected) {
+      cout << what << ": expected '" << expected << "', got '" << got << "'"
+           << endl;
+      return false;
+    }
+    return true;
+  }
+
+  bool test_select() {
+    vector<String> rows;
+
+    if (!check_select("no index rows", rows, PARTITIONS, "", "", ""))
+      return false;
+
+    rows.push_back("m");
+    rows.push_back("c");
+    rows.push_back("m");
+    if (!check_select("fewer rows than partitions", rows, PARTITIONS, "", "",
+                      ""))
+      return false;
+
+    rows.push_back("a");
+    rows.push_back("t");
+    rows.push_back("x");
+    if (!check_select("unsorted rows", rows, PARTITIONS, "", "", "c,m,t"))
+      return false;
+
+    if (!check_select("rows outside of range", rows, PARTITIONS, "c", "t",
+                      "m"))
+      return false;
+
+    if (!check_select("single partition", rows, 1, "", "", ""))
+      return false;
+
+    return true;
+  }
+
+  /**
+   * Merges the cache and stores over [start_row, end_row), the way
+   * AccessGroup::run_compaction sets up each partition, and appends the
+   * keys to the given vector
+   */
+  bool merge(SchemaPtr &schema_ptr, CellCachePtr &cache,
+             vector<CellStorePtr> &stores, const String &start_row,
+             const String &end_row, vector<String> &keys) {
+    ScanContextPtr scan_ctx = new ScanContext(END_OF_TIME, schema_ptr);
+    ByteString key, value;
+
+    scan_ctx->start_row = start_row;
+    scan_ctx->end_row = end_row;
+
+    MergeScanner *mscanner = new MergeScanner(scan_ctx, false);
+    CellListScannerPtr scanner = mscanner;
+    mscanner->add_scanner(cache->create_scanner(scan_ctx));
+    for (size_t i=0; i<stores.size(); i++)
+      mscanner->add_scanner(stores[i]->create_scanner(scan_ctx));
+
+    while (scanner->get(key, value)) {
+      Key key_comps(key);
+      if (String(key_comps.row) < start_row || String(key_comps.row) >= end_row) {
+        cout << "partition [" << start_row << ".." << end_row
+             << ") returned " << key_comps << endl;
+        return false;
+      }
+      keys.push_back(String((const char *)key.ptr, key.length()));
+      scanner->forward();
+    }
+    return true;
+  }
+
+  bool test_partitioned_merge(Filesystem *fs, const String &dir) {
+    SchemaPtr schema_ptr = Schema::new_instance(schema_str, strlen(schema_str));
+    CellCachePtr cache = new CellCache();
+    vector<CellStorePtr> stores;
+    vector<String> rows, partition_rows, all_keys, partitioned_keys;
+    DynamicBuffer buf(0);
+    ByteString key, value;
+    size_t v0_rows;
+
+    HT_EXPECT(schema_ptr->is_valid(), Error::FAILED_EXPECTATION);
+    schema_ptr->assign_ids();
+
+    write_store(new CellStoreV0(fs), dir + "/cs0", 0, 2);
+    write_store(new CellStoreV1(fs), dir + "/cs1", 1, 2);
+    stores.push_back(open_store(new CellStoreV0(fs), dir + "/cs0"));
+    stores.push_back(open_store(new CellStoreV1(fs), dir + "/cs1"));
+
+    for (int r=0; r<ROWS; r+=7)
+      add_row(buf, r, "cached");
+    key.ptr = buf.base;
+    while (key.ptr < buf.ptr) {
+      value.ptr = key.ptr + key.length();
+      cache->add(key, value, 3000);
+      key.ptr = value.ptr + value.length();
+    }
+
+    stores[0]->get_index_rows(rows);
+    v0_rows = rows.size();
+    if (v0_rows < PARTITIONS) {
+      cout << "CellStoreV0 returned " << v0_rows << " index rows" << endl;
+      return false;
+    }
+    stores[1]->get_index_rows(rows);
+    if (rows.size() == v0_rows) {
+      cout << "CellStoreV1 returned no index rows" << endl;
+      return false;
+    }
+
+    AccessGroup::select_partition_rows(rows, PARTITIONS, "",
+                                       Key::END_ROW_MARKER, partition_rows);
+    if (partition_rows.size() != PARTITIONS - 1) {
+      cout << "expected " << PARTITIONS - 1 << " partition rows, got "
+           << partition_rows.size() << endl;
+      return false;
+    }
+
+    if (!merge(schema_ptr, cache, stores, "", Key::END_ROW_MARKER, all_keys))
+      return false;
+
+    for (size_t p=0; p<=partition_rows.size(); p++) {
+      String start_row = (p > 0) ? partition_rows[p-1] : "";
+      String end_row = (p < partition_rows.size()) ? partition_rows[p]
+                                                   : Key::END_ROW_MARKER;
+      size_t before = partitioned_keys.size();
+      if (!merge(schema_ptr, cache, stores, start_row, end_row,
+                 partitioned_keys))
+        return false;
+      cout << "partition " << p << ": " << partitioned_keys.size() - before
+           << " cells" << endl;
+    }
+
+    if (all_keys.size() != (size_t)(ROWS + (ROWS + 6) / 7)) {
+      cout << "single merge returned " << all_keys.size() << " cells" << endl;
+      return false;
+    }
+
+    if (partitioned_keys != all_keys) {
+      cout << "partitioned merge returned " << partitioned_keys.size()
+           << " cells, single merge returned " << all_keys.size() << endl;
+      return false;
+    }
+
+    fs->remove(dir + "/cs0");
+    fs->remove(dir + "/cs1");
+    return true;
+  }
+
+}
+
+
+int main(int argc, char **argv) {
+  CommPtr comm_ptr;
+  ConnectionManagerPtr conn_manager_ptr;
+  DfsBroker::Client *dfs_client;
+  String test_dir = "/hypertable/test_compaction_partition";
+
+  if (argc == 2 && !strcmp(argv[1], "--help"))
+    Usage::dump_and_exit(usage);
+
+  if (!test_select())
+    return 1;
+
+  try {
+    System::initialize(argv[0]);
+    ReactorFactory::initialize(System::get_processor_count());
+
+    comm_ptr = new Comm();
+    conn_manager_ptr = new ConnectionManager(comm_ptr.get());
+
+    struct sockaddr_in addr;
+    InetAddr::initialize(&addr, "localhost",
+                         HYPERTABLE_RANGESERVER_COMMITLOG_DFSBROKER_PORT);
+    dfs_client = new DfsBroker::Client(conn_manager_ptr, addr, 60);
+    if (!dfs_client->wait_for_connection(10)) {
+      HT_ERROR("Unable to connect to DFS Broker, exiting...");
+      exit(1);
+    }
+
+    Global::block_cache = new FileBlockCache(16 * 1024 * 1024);
+
+    dfs_client->mkdirs(test_dir);
+
+    if (!test_partitioned_merge(dfs_client, test_dir))
+      return 1;
+
+    dfs_client->rmdir(test_dir);
+  }
+  catch (Exception &e) {
+    HT_ERRORF("%s - %s", e.what(), Error::get_text(e.code()));
+    ReactorFactory::destroy();
+    return 1;
+  }
+
+  ReactorFactory::destroy();
+  return 0;
+}
@@ -23,7 +23,6 @@
 #include <cstdlib>
 #include <cstdio>
 #include <iostream>
-#include <list>
 #include <vector>
 
 extern "C" {
@@ -35,7 +34,9 @@ extern "C" {
 
 #include "Common/Error.h"
 #include "Common/Logger.h"
+#include "Common/Stopwatch.h"
 #include "Common/System.h"
+#include "Common/Thread.h"
 
 #include "Hypertable/RangeServer/FileBlockCache.h"
 
@@ -43,45 +44,305 @@ using namespace Hypertable;
 using namespace std;
 
 namespace {
+
+  const uint64_t MAX_MEMORY = 50000000;
+  const uint64_t TOTAL_ALLOC_LIMIT = 100000000;
+  const uint32_t TARGET_BUFSIZE = 65536;
+  const int MAX_FILE_ID = 10;
+  const int MAX_FILE_OFFSET = 100;
+
   struct BufferRecord {
     int file_id;
     uint32_t file_offset;
     uint32_t length;
   };
-  struct LtBufferRecord {
-    bool operator()(const struct BufferRecord &br1,
-                    const struct BufferRecord &br2) const {
-      if (br1.file_id == br2.file_id) {
-	if (br1.file_offset == br2.file_offset)
-	  return br1.length < br2.length;
-	return br1.file_offset < br2.file_offset;
+
+  /**
+   * Inserts and immediately checks in a block of the given size
+   */
+  bool insert_block(FileBlockCache *cache, int file_id, uint32_t file_offset,
+                    uint32_t length, bool promote=true) {
+    if (!cache->insert_and_checkout(file_id, file_offset,
+                                    new uint8_t [length], length, promote))
+      return false;
+    cache->checkin(file_id, file_offset);
+    return true;
+  }
+
+  /**
+   * Touches a block the way a scanner would: checkout on a hit, insert on
+   * a miss, and then checkin
+   */
+  void touch_block(FileBlockCache *cache, int file_id, uint32_t file_offset,
+                   uint32_t length, bool promote=true) {
+    uint8_t *block;
+    uint32_t len;
+    if (cache->checkout(file_id, file_offset, &block, &len, promote))
+      cache->checkin(file_id, file_offset);
+    else
+      HT_EXPECT(insert_block(cache, file_id, file_offset, length, promote),
+                Error::FAILED_EXPECTATION);
+  }
+
+  /**
+   * Inserts enough blocks of a file that is never read again to cycle
+   * through the cache several times
+   */
+  void sequential_scan(FileBlockCache *cache, int file_id, uint64_t amount,
+                       bool promote) {
+    for (uint32_t offset=0; (uint64_t)offset*TARGET_BUFSIZE < amount; offset++)
+      touch_block(cache, file_id, offset, TARGET_BUFSIZE, promote);
+  }
+
+  /**
+   * Checks that a single long scan does not push out blocks that have
+   * been read more than once
+   */
+  bool test_scan_resistance(bool promote) {
+    FileBlockCache cache(MAX_MEMORY, 1);
+    uint32_t hot_blocks = (MAX_MEMORY / 2) / TARGET_BUFSIZE;
+
+    for (int pass=0; pass<2; pass++)
+      for (uint32_t i=0; i<hot_blocks; i++)
+        touch_block(&cache, 0, i, TARGET_BUFSIZE);
+
+    sequential_scan(&cache, 1, 3*MAX_MEMORY, promote);
+
+    for (uint32_t i=0; i<hot_blocks; i++) {
+      if (!cache.contains(0, i)) {
+        HT_ERRORF("Hot block (id=0, offset=%u) evicted by %s scan", i,
+                  promote ? "promoting" : "non-promoting");
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * Checks that a block which is re-read shortly after being evicted from
+   * the probationary queue is treated as hot
+   */
+  bool test_ghost_promotion() {
+    FileBlockCache cache(MAX_MEMORY, 1);
+    FileBlockCache::Statistics stats;
+    uint32_t offset = 0;
+
+    HT_EXPECT(insert_block(&cache, 0, 0, TARGET_BUFSIZE),
+              Error::FAILED_EXPECTATION);
+
+    while (cache.contains(0, 0))
+      HT_EXPECT(insert_block(&cache, 1, offset++, TARGET_BUFSIZE),
+                Error::FAILED_EXPECTATION);
+
+    HT_EXPECT(insert_block(&cache, 0, 0, TARGET_BUFSIZE),
+              Error::FAILED_EXPECTATION);
+    cache.get_stats(stats);
+    if (stats.promotions != 1) {
+      HT_ERRORF("Expected re-read block to be promoted (promotions=%llu)",
+                (Llu)stats.promotions);
+      return false;
+    }
+
+    sequential_scan(&cache, 2, 3*MAX_MEMORY, true);
+
+    if (!cache.contains(0, 0)) {
+      HT_ERROR("Promoted block evicted by sequential scan");
+      return false;
+    }
+    return true;
+  }
+
+  /**
+   * Checks that checked out blocks are never evicted
+   */
+  bool test_pinned() {
+    FileBlockCache cache(MAX_MEMORY, 1);
+    uint8_t *block;
+    uint32_t length;
+
+    HT_EXPECT(cache.insert_and_checkout(0, 0, new uint8_t [TARGET_BUFSIZE],
+                                        TARGET_BUFSIZE, false),
+              Error::FAILED_EXPECTATION);
+
+    sequential_scan(&cache, 1, 3*MAX_MEMORY, false);
+
+    if (!cache.checkout(0, 0, &block, &length)) {
+      HT_ERROR("Checked out block was evicted");
+      return false;
+    }
+    cache.checkin(0, 0);
+    cache.checkin(0, 0);
+    return true;
+  }
+
+  /**
+   * Checks that a block larger than a shard is turned away without
+   * disturbing the cache, so that the caller can keep it uncached
+   */
+  bool test_oversized() {
+    FileBlockCache cache(MAX_MEMORY, 4);
+    FileBlockCache::Statistics stats;
+    size_t shards = cache.get_shard_count();
+    uint32_t length = (MAX_MEMORY / shards) + (MAX_MEMORY % shards) + 1;
+    uint8_t *block = new uint8_t [length];
+    uint32_t len;
+
+    HT_EXPECT(insert_block(&cache, 0, 0, TARGET_BUFSIZE),
+              Error::FAILED_EXPECTATION);
+
+    if (cache.insert_and_checkout(0, 1, block, length)) {
+      HT_ERRORF("Block of %u bytes cached by a %u shard cache of %llu bytes",
+                length, (unsigned)shards, (Llu)MAX_MEMORY);
+      return false;
+    }
+    delete [] block;
+
+    if (cache.checkout(0, 1, &block, &len) || cache.contains(0, 1)) {
+      HT_ERROR("Oversized block found in cache");
+      return false;
+    }
+
+    cache.get_stats(stats);
+    if (!cache.contains(0, 0) || stats.memory_used != TARGET_BUFSIZE) {
+      HT_ERRORF("Oversized block disturbed the cache (memory_used=%llu)",
+                (Llu)stats.memory_used);
+      return false;
+    }
+    return true;
+  }
+
+  /**
+   * Worker for the multithreaded test.  Accesses are skewed so that 80%
+   * of them go to the first 20% of the blocks.
+   */
+  class Worker {
+  public:
+    Worker(FileBlockCache *cache, const vector<BufferRecord> &input,
+           uint32_t seed, size_t operations)
+      : m_cache(cache), m_input(input), m_random(seed ? seed : 1),
+        m_operations(operations), m_checkouts(0) { }
+
+    void operator()() {
+      uint8_t *block;
+      uint32_t length;
+      size_t hot = m_input.size() / 5;
+
+      for (size_t i=0; i<m_operations; i++) {
+        size_t index = next_random();
+        if (index % 5)
+          index = (index >> 3) % hot;
+        else
+          index = hot + (index >> 3) % (m_input.size() - hot);
+        const BufferRecord &rec = m_input[index];
+        m_checkouts++;
+        if (m_cache->checkout(rec.file_id, rec.file_offset, &block, &length)) {
+          HT_EXPECT(length == rec.length, Error::FAILED_EXPECTATION);
+          m_cache->checkin(rec.file_id, rec.file_offset);
+        }
+        else {
+          block = new uint8_t [rec.length];
+          if (m_cache->insert_and_checkout(rec.file_id, rec.file_offset,
+                                           block, rec.length))
+            m_cache->checkin(rec.file_id, rec.file_offset);
+          else
+            delete [] block;  // another thread beat us to it
+        }
       }
-      return br1.file_id < br2.file_id;
     }
+
+    uint64_t get_checkouts() { return m_checkouts; }
+
+  private:
+    uint32_t next_random() {
+      m_random ^= m_random << 13;
+      m_random ^= m_random >> 17;
+      m_random ^= m_random << 5;
+      return m_random;
+    }
+
+    FileBlockCache *m_cache;
+    const vector<BufferRecord> &m_input;
+    uint32_t m_random;
+    size_t m_operations;
+    uint64_t m_checkouts;
   };
-}
 
-#define MAX_MEMORY 50000000
-#define TOTAL_ALLOC_LIMIT 100000000
-#define TARGET_BUFSIZE 65536
-#define MAX_FILE_ID 10
-#define MAX_FILE_OFFSET 100
+  bool test_concurrent(const vector<BufferRecord> &input, uint32_t shards,
+                       int thread_count, size_t operations, uint32_t seed) {
+    FileBlockCache cache(MAX_MEMORY, shards);
+    FileBlockCache::Statistics stats;
+    vector<Worker *> workers;
+    ThreadGroup threads;
+    uint64_t checkouts = 0;
+
+    for (int i=0; i<thread_count; i++)
+      workers.push_back(new Worker(&cache, input, seed + i, operations));
+
+    Stopwatch stopwatch;
+    for (int i=0; i<thread_count; i++)
+      threads.create_thread(boost::ref(*workers[i]));
+    threads.join_all();
+    stopwatch.stop();
+
+    for (int i=0; i<thread_count; i++) {
+      checkouts += workers[i]->get_checkouts();
+      delete workers[i];
+    }
+
+    cache.get_stats(stats);
+
+    cout << "threads=" << thread_count << " shards="
+         << cache.get_shard_count() << " operations=" << checkouts
+         << " elapsed=" << stopwatch.elapsed() << "s ops/s="
+         << (uint64_t)((double)checkouts / stopwatch.elapsed()) << endl;
+    for (size_t i=0; i<cache.get_shard_count(); i++) {
+      FileBlockCache::Statistics shard_stats;
+      cache.get_stats(i, shard_stats);
+      cout << "  shard " << i << ": hits=" << shard_stats.hits << " misses="
+           << shard_stats.misses << " evictions=" << shard_stats.evictions
+           << " promotions=" << shard_stats.promotions << " memory="
+           << shard_stats.memory_used << endl;
+    }
+
+    if (stats.hits + stats.misses != checkouts) {
+      HT_ERRORF("Hits (%llu) + misses (%llu) != checkouts (%llu)",
+                (Llu)stats.hits, (Llu)stats.misses, (Llu)checkouts);
+      return false;
+    }
+    if (stats.memory_used > MAX_MEMORY) {
+      HT_ERRORF("Cache memory %llu exceeds limit %llu",
+                (Llu)stats.memory_used, (Llu)MAX_MEMORY);
+      return false;
+    }
+    return true;
+  }
+
+}
 
+/**
+ * Usage: FileBlockCache_test [--seed=<n>] [--total-memory=<n>]
+ *                            [--threads=<n>] [--shards=<n>]
+ *                            [--operations=<n>]
+ *
+ * Runs the functional checks followed by a multithreaded run that reports
+ * throughput and per-shard statistics.  Use a large --operations count and
+ * vary --threads and --shards to benchmark lock contention.
+ */
 int main(int argc, char **argv) {
   FileBlockCache *cache;
   vector<BufferRecord> input_data;
-  list<BufferRecord> history;
   BufferRecord rec;
   unsigned long seed = (unsigned long)getpid();
   uint64_t total_alloc = 0;
   uint64_t total_memory = TOTAL_ALLOC_LIMIT;
+  int thread_count = 4;
+  uint32_t shards = 0;
+  size_t operations = 50000;
   int file_id;
   uint32_t file_offset;
-  uint8_t *block;
-  uint32_t length;
   int index;
-  set<BufferRecord, LtBufferRecord> lru;
-  
+  FileBlockCache::Statistics stats;
+
   System::initialize(argv[0]);
 
   for (int i=1; i<argc; i++) {
@@ -89,10 +350,14 @@ int main(int argc, char **argv) {
       seed = atoi(&argv[i][7]);
     else if (!strncmp(argv[i], "--total-memory=", 15))
       total_memory = strtoll(&argv[i][15], 0, 0);
+    else if (!strncmp(argv[i], "--threads=", 10))
+      thread_count = atoi(&argv[i][10]);
+    else if (!strncmp(argv[i], "--shards=", 9))
+      shards = atoi(&argv[i][9]);
+    else if (!strncmp(argv[i], "--operations=", 13))
+      operations = strtoll(&argv[i][13], 0, 0);
   }
 
-  cache = new FileBlockCache(MAX_MEMORY);
-
   srandom(seed);
 
   input_data.reserve(MAX_FILE_ID*MAX_FILE_OFFSET);
@@ -107,6 +372,8 @@ int main(int argc, char **argv) {
 
   cout << "FileBlockCache_test SEED = " << seed << endl;
 
+  cache = new FileBlockCache(MAX_MEMORY);
+
   /**
    * Check to make sure cache rejects items that are too large
    */
@@ -115,66 +382,47 @@ int main(int argc, char **argv) {
     return 1;
   }
 
+  /**
+   * Random workload; the cache must stay within its memory limit and
+   * account for every lookup
+   */
+  uint64_t lookups = 0;
   while (total_alloc < total_memory) {
     index = (int)(random() % (MAX_FILE_ID*MAX_FILE_OFFSET));
     file_id = input_data[index].file_id;
     file_offset = input_data[index].file_offset;
-    if (cache->checkout(file_id, file_offset, &block, &length))
-      cache->checkin(file_id, file_offset);
-    else {
-      length = input_data[index].length;
-      block = new uint8_t [ length ];
-      HT_EXPECT(cache->insert_and_checkout(file_id, file_offset, block, length), Error::FAILED_EXPECTATION);
-      total_alloc += length;
-      cache->checkin(file_id, file_offset);
-    }
-    history.push_front(input_data[index]);
-  }
-
-  /**
-   * Now verify that our idea of LRU is actually in the cache
-   */
-  total_alloc = 0; 
-  list<BufferRecord>::iterator history_iter = history.begin();
-  while (total_alloc < MAX_MEMORY) {
-    rec.file_id = (*history_iter).file_id;
-    rec.file_offset = (*history_iter).file_offset;
-    rec.length = (*history_iter).length;
-    if (lru.find(rec) == lru.end()) {
-      if (total_alloc + (*history_iter).length > MAX_MEMORY)
-	break;
-      lru.insert(rec);
-      total_alloc += rec.length;
-      if (!cache->contains(rec.file_id, rec.file_offset)) {
-	HT_ERRORF("computed LRU does not match cache's (id=%d, offset=%u)", rec.file_id, rec.file_offset);
-	return 1;
-      }
+    lookups++;
+    touch_block(cache, file_id, file_offset, input_data[index].length);
+    if (!cache->contains(file_id, file_offset)) {
+      HT_ERRORF("Most recently used block (id=%d, offset=%u) not in cache",
+                file_id, file_offset);
+      return 1;
     }
-    history_iter++;
+    total_alloc += input_data[index].length;
   }
 
-  /**
-   * Now verify that all of the remaining items that
-   * should *not* be in our LRU are, indeed, not in the cache
-   */
-  if (cache->contains(rec.file_id, rec.file_offset)) {
-    HT_ERROR("computed LRU does not match cache's");
+  cache->get_stats(stats);
+  if (stats.memory_used > MAX_MEMORY) {
+    HT_ERRORF("Cache memory %llu exceeds limit %llu", (Llu)stats.memory_used,
+              (Llu)MAX_MEMORY);
     return 1;
   }
-  while (history_iter != history.end()) {
-    rec.file_id = (*history_iter).file_id;
-    rec.file_offset = (*history_iter).file_offset;
-    rec.length = (*history_iter).length;
-    if (lru.find(rec) == lru.end()) {
-      if (cache->contains(rec.file_id, rec.file_offset)) {
-	HT_ERROR("computed LRU does not match cache's");
-	return 1;
-      }
-    }
-    history_iter++;
+  if (stats.hits + stats.misses != lookups || stats.misses != stats.inserts) {
+    HT_ERRORF("Bad cache statistics hits=%llu misses=%llu inserts=%llu "
+              "lookups=%llu", (Llu)stats.hits, (Llu)stats.misses,
+              (Llu)stats.inserts, (Llu)lookups);
+    return 1;
   }
 
   delete cache;
 
+  if (!test_scan_resistance(true) || !test_scan_resistance(false) ||
+      !test_ghost_promotion() || !test_pinned() || !test_oversized())
+    return 1;
+
+  if (!test_concurrent(input_data, shards, thread_count, operations,
+                       (uint32_t)seed))
+    return 1;
+
   return 0;
 }
@@ -0,0 +1,277 @@
+/** -*- c++ -*-
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "Common/Compat.h"
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <boost/thread/condition.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/xtime.hpp>
+
+#include "Common/Usage.h"
+
+#include "Hypertable/RangeServer/MaintenanceQueue.h"
+
+using namespace Hypertable;
+using namespace std;
+
+namespace {
+
+  const char *usage[] = {
+    "usage: MaintenanceQueue_test",
+    "",
+    "Checks that the maintenance queue runs due tasks in order of",
+    "decreasing priority, first come first served among equals, that it",
+    "runs no more compactions at once than allowed, and that the write",
+    "throttle keeps to its bandwidth and saves up at most one second of",
+    "unused bandwidth.",
+    0
+  };
+
+  boost::xtime now_plus_millis(uint64_t millis) {
+    boost::xtime xt;
+    boost::xtime_get(&xt, boost::TIME_UTC);
+    uint64_t nsec = (uint64_t)xt.nsec + millis * 1000000LL;
+    xt.sec += nsec / 1000000000LL;
+    xt.nsec = nsec % 1000000000LL;
+    return xt;
+  }
+
+  double seconds_since(boost::xtime &start) {
+    boost::xtime now;
+    boost::xtime_get(&now, boost::TIME_UTC);
+    return (double)((int64_t)now.sec - (int64_t)start.sec) +
+           ((double)now.nsec - (double)start.nsec) / 1000000000.0;
+  }
+
+  /**
+   * State shared by the test and its tasks
+   */
+  class TestState {
+  public:
+    TestState() : gate_open(false), blocked(false), compactions(0),
+                  max_compactions(0) { }
+    boost::mutex     mutex;
+    boost::condition cond;
+    bool             gate_open;
+    bool             blocked;
+    vector<int>      order;
+    uint32_t         compactions;
+    uint32_t         max_compactions;
+  };
+
+  /**
+   * Records the order in which it runs and the number of compactions
+   * running at once.  A task with id -1 holds its worker until the gate
+   * opens.
+   */
+  class TestTask : public MaintenanceTask {
+  public:
+    TestTask(TestState &state, int id, double prio, bool compaction=false,
+             uint64_t millis=0)
+      : m_state(state), m_id(id), m_compaction(compaction),
+        m_millis(millis) {
+      priority = prio;
+    }
+
+    virtual void execute() {
+      {
+        boost::mutex::scoped_lock lock(m_state.mutex);
+        if (m_id == -1) {
+          m_state.blocked = true;
+          m_state.cond.notify_all();
+          while (!m_state.gate_open)
+            m_state.cond.wait(lock);
+          return;
+        }
+        m_state.order.push_back(m_id);
+        if (m_compaction && ++m_state.compactions > m_state.max_compactions)
+          m_state.max_compactions = m_state.compactions;
+      }
+      if (m_millis)
+        boost::thread::sleep(now_plus_millis(m_millis));
+      if (m_compaction) {
+        boost::mutex::scoped_lock lock(m_state.mutex);
+        m_state.compactions--;
+      }
+    }
+
+    virtual const char *name() { return "test"; }
+
+    virtual bool is_compaction() { return m_compaction; }
+
+  private:
+    TestState &m_state;
+    int        m_id;
+    bool       m_compaction;
+    uint64_t   m_millis;
+  };
+
+  /**
+   * Queues tasks of mixed priorities behind a task that holds the only
+   * worker, then lets them run
+   */
+  bool test_priority_order() {
+    MaintenanceQueuePtr queue_ptr = new MaintenanceQueue(1);
+    TestState state;
+    double priorities[] = { 5.0, 1.0, 10.0, 5.0,
+                            MaintenanceTask::PRIORITY_LOG_CLEANUP, 1.0,
+                            10.0 };
+    int expected[] = { 4, 2, 6, 0, 3, 1, 5 };
+
+    queue_ptr->add(new TestTask(state, -1, 0.0));
+    {
+      boost::mutex::scoped_lock lock(state.mutex);
+      while (!state.blocked)
+        state.cond.wait(lock);
+    }
+
+    for (int i=0; i<7; i++)
+      queue_ptr->add(new TestTask(state, i, priorities[i]));
+
+    {
+      boost::mutex::scoped_lock lock(state.mutex);
+      state.gate_open = true;
+      state.cond.notify_all();
+    }
+
+    queue_ptr->shutdown();
+    queue_ptr->join();
+
+    for (size_t i=0; i<7; i++) {
+      if (i >= state.order.size() || state.order[i] != expected[i]) {
+        cout << "task " << i << " to run was "
+             << (i < state.order.size() ? state.order[i] : -1)
+             << ", expected " << expected[i] << endl;
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * Runs long compactions and other tasks on three workers with at most
+   * one compaction at a time.  The other tasks must not wait behind the
+   * queued compactions, even though those have higher priority.
+   */
+  bool test_compaction_limit() {
+    MaintenanceQueuePtr queue_ptr = new MaintenanceQueue(3, 1);
+    TestState state;
+
+    for (int i=0; i<3; i++)
+      queue_ptr->add(new TestTask(state, i, 100.0, true, 200));
+    for (int i=3; i<6; i++)
+      queue_ptr->add(new TestTask(state, i, 1.0));
+
+    queue_ptr->shutdown();
+    queue_ptr->join();
+
+    if (state.order.size() != 6 || state.max_compactions != 1) {
+      cout << state.order.size() << " tasks ran, up to "
+           << state.max_compactions << " compactions at once" << endl;
+      return false;
+    }
+
+    // the other tasks run alongside the first compaction, so they all
+    // start before the queued compactions
+    for (size_t i=0; i<3; i++) {
+      if (state.order[i + 1] < 3) {
+        cout << "compaction " << state.order[i + 1]
+             << " started before the other tasks" << endl;
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * Writes through the throttle and checks the time it takes.  Only lower
+   * bounds are checked where the throttle has to wait, since a loaded
+   * machine may always take longer.
+   */
+  bool test_throttle() {
+    const uint64_t bandwidth = 4 * 1024 * 1024;
+    const size_t chunk = 64 * 1024;
+    MaintenanceQueuePtr queue_ptr = new MaintenanceQueue(1, 0, bandwidth);
+    boost::xtime start;
+    double elapsed;
+
+    // no credit saved up, 6 MB take at least 1.5 seconds
+    boost::xtime_get(&start, boost::TIME_UTC);
+    for (size_t written=0; written<6*1024*1024; written+=chunk)
+      queue_ptr->throttle_write(chunk);
+    elapsed = seconds_since(start);
+    if (elapsed < 1.4) {
+      cout << "6 MB at 4 MB/s written in " << elapsed << " seconds" << endl;
+      return false;
+    }
+
+    // after more than a second of idling, a second's worth is a burst
+    boost::thread::sleep(now_plus_millis(1500));
+    boost::xtime_get(&start, boost::TIME_UTC);
+    for (size_t written=0; written<bandwidth; written+=chunk)
+      queue_ptr->throttle_write(chunk);
+    elapsed = seconds_since(start);
+    if (elapsed > 0.5) {
+      cout << "burst of 4 MB after idling took " << elapsed << " seconds"
+           << endl;
+      return false;
+    }
+
+    // but no more than a second's worth is saved up
+    boost::thread::sleep(now_plus_millis(3000));
+    boost::xtime_get(&start, boost::TIME_UTC);
+    for (size_t written=0; written<3*bandwidth; written+=chunk)
+      queue_ptr->throttle_write(chunk);
+    elapsed = seconds_since(start);
+    if (elapsed < 1.9) {
+      cout << "12 MB at 4 MB/s after idling 3 seconds written in "
+           << elapsed << " seconds" << endl;
+      return false;
+    }
+
+    queue_ptr->shutdown();
+    queue_ptr->join();
+    return true;
+  }
+
+}
+
+
+int main(int argc, char **argv) {
+
+  if (argc > 1)
+    Usage::dump_and_exit(usage);
+
+  if (!test_priority_order())
+    return 1;
+
+  if (!test_compaction_limit())
+    return 1;
+
+  if (!test_throttle())
+    return 1;
+
+  return 0;
+}
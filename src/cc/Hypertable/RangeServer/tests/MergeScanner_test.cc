@@ -0,0 +1,373 @@
+/** -*- c++ -*-
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "Common/Compat.h"
+#include <cstdlib>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+extern "C" {
+#include <sys/types.h>
+#include <unistd.h>
+}
+
+#include "Common/DynamicBuffer.h"
+#include "Common/Error.h"
+#include "Common/Logger.h"
+#include "Common/Stopwatch.h"
+#include "Common/System.h"
+
+#include "Hypertable/Lib/Key.h"
+#include "Hypertable/Lib/Types.h"
+
+#include "Hypertable/RangeServer/MergeScanner.h"
+
+using namespace Hypertable;
+using namespace std;
+
+namespace {
+
+  /**
+   * Sorted, in-memory list of cells
+   */
+  class CellList {
+  public:
+    CellList() : m_buf(0) { }
+
+    void add(uint8_t flag, const char *row, uint8_t family,
+             const char *qualifier, uint64_t timestamp,
+             const char *value="value") {
+      m_offsets.push_back(m_buf.fill());
+      create_key_and_append(m_buf, flag, row, family, qualifier, timestamp);
+      append_as_byte_string(m_buf, value);
+    }
+
+    size_t size() const { return m_offsets.size(); }
+
+    ByteString key(size_t i) const {
+      return ByteString(m_buf.base + m_offsets[i]);
+    }
+
+  private:
+    DynamicBuffer  m_buf;
+    vector<size_t> m_offsets;
+  };
+
+  class CellListScannerStub : public CellListScanner {
+  public:
+    CellListScannerStub(ScanContextPtr &scan_ctx, const CellList &cells)
+      : CellListScanner(scan_ctx), m_cells(cells), m_index(0) { }
+
+    virtual void forward() {
+      if (m_index < m_cells.size())
+        m_index++;
+    }
+
+    virtual bool get(ByteString &key, ByteString &value) {
+      if (m_index == m_cells.size())
+        return false;
+      key = m_cells.key(m_index);
+      value.ptr = key.ptr + key.length();
+      return true;
+    }
+
+  private:
+    const CellList &m_cells;
+    size_t m_index;
+  };
+
+  /**
+   * Merges the given cell lists and returns the timestamps of the cells
+   * that come out of the merge scanner
+   */
+  vector<uint64_t> merge(ScanContextPtr &scan_ctx, vector<CellList> &lists,
+                         bool return_deletes,
+                         MergeScanner::GcStatistics *gc_stats=0) {
+    MergeScanner *mscanner = new MergeScanner(scan_ctx, return_deletes);
+    vector<uint64_t> timestamps;
+    ByteString key, value;
+
+    mscanner->set_gc_statistics(gc_stats);
+
+    for (size_t i=0; i<lists.size(); i++)
+      mscanner->add_scanner(new CellListScannerStub(scan_ctx, lists[i]));
+
+    while (mscanner->get(key, value)) {
+      timestamps.push_back(Key(key).timestamp);
+      mscanner->forward();
+    }
+    delete mscanner;
+    return timestamps;
+  }
+
+  bool check(const char *what, const vector<uint64_t> &got,
+             const uint64_t *expected, size_t count) {
+    if (got.size() == count && equal(got.begin(), got.end(), expected))
+      return true;
+    cout << what << ": expected";
+    for (size_t i=0; i<count; i++)
+      cout << " " << expected[i];
+    cout << ", got";
+    for (size_t i=0; i<got.size(); i++)
+      cout << " " << got[i];
+    cout << endl;
+    return false;
+  }
+
+  /**
+   * Checks delete and version handling with cells spread across scanners
+   */
+  bool test_deletes_and_versions() {
+    ScanContextPtr scan_ctx = new ScanContext(END_OF_TIME);
+    vector<CellList> lists(3);
+
+    // row delete at 20 hides older versions of every cell in row "a"
+    lists[0].add(FLAG_DELETE_ROW, "a", 0, "", 20);
+    lists[1].add(FLAG_INSERT, "a", 1, "x", 30);
+    lists[2].add(FLAG_INSERT, "a", 1, "x", 20);
+    lists[1].add(FLAG_INSERT, "a", 1, "x", 10);
+    lists[2].add(FLAG_INSERT, "a", 2, "y", 15);
+
+    // column family delete at 40 and a newer cell delete at 50
+    lists[0].add(FLAG_DELETE_COLUMN_FAMILY, "b", 1, "", 40);
+    lists[2].add(FLAG_DELETE_CELL, "b", 1, "x", 50);
+    lists[1].add(FLAG_INSERT, "b", 1, "x", 60);
+    lists[0].add(FLAG_INSERT, "b", 1, "x", 45);
+    lists[1].add(FLAG_INSERT, "b", 1, "y", 45);
+    lists[2].add(FLAG_INSERT, "b", 1, "y", 35);
+    lists[0].add(FLAG_INSERT, "b", 2, "x", 35);
+
+    // five versions of one cell
+    for (uint64_t ts=5; ts>0; ts--)
+      lists[ts % 3].add(FLAG_INSERT, "c", 1, "x", ts);
+
+    const uint64_t visible[] = { 30, 60, 45, 35, 5, 4, 3, 2, 1 };
+    if (!check("deletes", merge(scan_ctx, lists, false), visible,
+               sizeof(visible)/sizeof(uint64_t)))
+      return false;
+
+    const uint64_t all[] = { 20, 30, 20, 10, 15, 40, 50, 60, 45, 45, 35, 35,
+                             5, 4, 3, 2, 1 };
+    if (!check("return deletes", merge(scan_ctx, lists, true), all,
+               sizeof(all)/sizeof(uint64_t)))
+      return false;
+
+    scan_ctx->family_info[1].max_versions = 2;
+    const uint64_t limited[] = { 30, 60, 45, 35, 5, 4 };
+    if (!check("max versions", merge(scan_ctx, lists, false), limited,
+               sizeof(limited)/sizeof(uint64_t)))
+      return false;
+
+    // TTL cutoff of 40 for family 1 drops its older cells and deletes
+    MergeScanner::GcStatistics gc_stats;
+    scan_ctx->family_info[1].max_versions = 0;
+    scan_ctx->family_info[1].cutoff_time = 40;
+    const uint64_t unexpired[] = { 60, 45, 35 };
+    if (!check("ttl", merge(scan_ctx, lists, false, &gc_stats), unexpired,
+               sizeof(unexpired)/sizeof(uint64_t)))
+      return false;
+
+    if (gc_stats.cells[0] != 1 || gc_stats.cells[1] != 12 ||
+        gc_stats.cells[2] != 1) {
+      cout << "ttl: expected 1/12/1 cells collected, got " << gc_stats.cells[0]
+           << "/" << gc_stats.cells[1] << "/" << gc_stats.cells[2] << endl;
+      return false;
+    }
+
+    // the cutoff of a family outside of the scan is not applied
+    scan_ctx->family_mask[1] = false;
+    if (!check("ttl outside of scan", merge(scan_ctx, lists, false), visible,
+               sizeof(visible)/sizeof(uint64_t)))
+      return false;
+
+    return true;
+  }
+
+  /**
+   * Checks that qualifier and value predicates are applied, and applied
+   * before the row limit
+   */
+  bool test_predicates() {
+    SchemaPtr schema_ptr;
+    ScanSpec spec;
+    RangeSpec range("", Key::END_ROW_MARKER);
+    vector<CellList> lists(2);
+
+    spec.start_row = "";
+    spec.end_row = Key::END_ROW_MARKER;
+
+    lists[0].add(FLAG_INSERT, "a", 1, "apple", 1, "red");
+    lists[1].add(FLAG_INSERT, "a", 1, "apricot", 2, "orange");
+    lists[0].add(FLAG_INSERT, "a", 1, "banana", 3, "yellow");
+    lists[1].add(FLAG_DELETE_CELL, "b", 1, "apple", 5);
+    lists[0].add(FLAG_INSERT, "b", 1, "apple", 4, "green");
+    lists[1].add(FLAG_INSERT, "b", 2, "cherry", 6, "red");
+    lists[0].add(FLAG_INSERT, "c", 1, "apple", 7, "redder");
+
+    struct {
+      CellPredicate predicates[2];
+      size_t count;
+      uint32_t row_limit;
+      uint64_t expected[4];
+      size_t expected_count;
+    } cases[] = {
+      { { CellPredicate(CellPredicate::QUALIFIER, CellPredicate::PREFIX, "ap") },
+        1, 0, { 1, 2, 7 }, 3 },
+      { { CellPredicate(CellPredicate::QUALIFIER, CellPredicate::EXACT, "apple") },
+        1, 0, { 1, 7 }, 2 },
+      { { CellPredicate(CellPredicate::QUALIFIER, CellPredicate::REGEX, "^(banana|cherry)$") },
+        1, 0, { 3, 6 }, 2 },
+      { { CellPredicate(CellPredicate::VALUE, CellPredicate::EXACT, "red") },
+        1, 0, { 1, 6 }, 2 },
+      { { CellPredicate(CellPredicate::VALUE, CellPredicate::PREFIX, "red") },
+        1, 0, { 1, 6, 7 }, 3 },
+      { { CellPredicate(CellPredicate::QUALIFIER, CellPredicate::PREFIX, "a"),
+          CellPredicate(CellPredicate::VALUE, CellPredicate::REGEX, "e.$") },
+        2, 0, { 1, 7 }, 2 },
+      { { CellPredicate(CellPredicate::QUALIFIER, CellPredicate::EXACT, "cherry") },
+        1, 1, { 6 }, 1 },
+    };
+
+    for (size_t i=0; i<sizeof(cases)/sizeof(cases[0]); i++) {
+      spec.predicates.assign(cases[i].predicates,
+                             cases[i].predicates + cases[i].count);
+      spec.row_limit = cases[i].row_limit;
+      ScanContextPtr scan_ctx = new ScanContext(END_OF_TIME, &spec, &range,
+                                                schema_ptr);
+      String what = format("predicates case %d", (int)i);
+      if (!check(what.c_str(), merge(scan_ctx, lists, false),
+                 cases[i].expected, cases[i].expected_count))
+        return false;
+    }
+
+    spec.predicates.clear();
+    spec.predicates.push_back(CellPredicate(CellPredicate::VALUE,
+                                            CellPredicate::REGEX, "(unclosed"));
+    try {
+      ScanContextPtr scan_ctx = new ScanContext(END_OF_TIME, &spec, &range,
+                                                schema_ptr);
+      cout << "bad regex: expected RANGESERVER_BAD_SCAN_SPEC" << endl;
+      return false;
+    }
+    catch (Exception &e) {
+      if (e.code() != Error::RANGESERVER_BAD_SCAN_SPEC) {
+        cout << "bad regex: " << e << endl;
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+}
+
+
+/**
+ * Usage: MergeScanner_test [--seed=<n>] [--scanners=<n>] [--cells=<n>]
+ *                          [--iterations=<n>]
+ *
+ * Checks delete, version and predicate handling, then merges --scanners synthetic
+ * scanners holding --cells cells each (interleaved at random) and reports
+ * the merge rate.
+ */
+int main(int argc, char **argv) {
+  unsigned long seed = (unsigned long)getpid();
+  size_t scanner_count = 8;
+  size_t cells = 100000;
+  int iterations = 1;
+  char row[32], qualifier[32];
+
+  System::initialize(argv[0]);
+
+  for (int i=1; i<argc; i++) {
+    if (!strncmp(argv[i], "--seed=", 7))
+      seed = atoi(&argv[i][7]);
+    else if (!strncmp(argv[i], "--scanners=", 11))
+      scanner_count = atoi(&argv[i][11]);
+    else if (!strncmp(argv[i], "--cells=", 8))
+      cells = strtoll(&argv[i][8], 0, 0);
+    else if (!strncmp(argv[i], "--iterations=", 13))
+      iterations = atoi(&argv[i][13]);
+  }
+
+  cout << "MergeScanner_test SEED = " << seed << endl;
+  srandom(seed);
+
+  if (!test_deletes_and_versions() || !test_predicates())
+    return 1;
+
+  /**
+   * Generate cells in sorted order and deal them out to the scanners
+   */
+  vector<CellList> lists(scanner_count);
+  CellList expected;
+  size_t total = cells * scanner_count;
+
+  for (size_t i=0; expected.size() < total; i++) {
+    sprintf(row, "row%010u", (unsigned)i);
+    for (uint8_t family=1; family<=3 && expected.size() < total; family++) {
+      for (int q=0; q<4 && expected.size() < total; q++) {
+        sprintf(qualifier, "q%02d", q);
+        for (uint64_t ts=3; ts>0 && expected.size() < total; ts--) {
+          expected.add(FLAG_INSERT, row, family, qualifier, ts);
+          lists[random() % scanner_count].add(FLAG_INSERT, row, family,
+                                              qualifier, ts);
+        }
+      }
+    }
+  }
+
+  ScanContextPtr scan_ctx = new ScanContext(END_OF_TIME);
+  Stopwatch stopwatch(false);
+  ByteString key, value;
+  size_t count = 0;
+
+  for (int iteration=0; iteration<iterations; iteration++) {
+    MergeScanner *mscanner = new MergeScanner(scan_ctx, false);
+    for (size_t i=0; i<lists.size(); i++)
+      mscanner->add_scanner(new CellListScannerStub(scan_ctx, lists[i]));
+
+    stopwatch.start();
+    for (count=0; mscanner->get(key, value); count++) {
+      if (count < total && key != expected.key(count)) {
+        HT_ERRORF("Merged cell %lu out of order", (unsigned long)count);
+        return 1;
+      }
+      mscanner->forward();
+    }
+    stopwatch.stop();
+    delete mscanner;
+
+    if (count != total) {
+      HT_ERRORF("Merge returned %lu cells, expected %lu",
+                (unsigned long)count, (unsigned long)total);
+      return 1;
+    }
+  }
+
+  cout << "scanners=" << scanner_count << " cells=" << total
+       << " iterations=" << iterations << " elapsed=" << stopwatch.elapsed()
+       << "s cells/s="
+       << (uint64_t)((double)total * iterations / stopwatch.elapsed()) << endl;
+
+  return 0;
+}
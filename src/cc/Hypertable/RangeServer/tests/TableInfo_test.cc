@@ -0,0 +1,248 @@
+/** -*- c++ -*-
+ * Copyright (C) 2008 Doug Judd (Zvents, Inc.)
+ *
+ * This file is part of Hypertable.
+ *
+ * Hypertable is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of the
+ * License.
+ *
+ * Hypertable is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "Common/Compat.h"
+#include <cstdlib>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+#include <boost/thread/thread.hpp>
+
+#include "Common/Error.h"
+#include "Common/Logger.h"
+#include "Common/Mutex.h"
+#include "Common/String.h"
+#include "Common/Usage.h"
+
+#include "Hypertable/Lib/Client.h"
+#include "Hypertable/Lib/Key.h"
+#include "Hypertable/Lib/Schema.h"
+#include "Hypertable/Lib/Types.h"
+
+#include "Hypertable/RangeServer/Global.h"
+#include "Hypertable/RangeServer/TableInfo.h"
+
+using namespace Hypertable;
+using namespace std;
+
+namespace {
+
+  const char *usage[] = {
+    "usage: TableInfo_test [<seed>]",
+    "",
+    "Looks up rows in a TableInfo from several threads while another",
+    "thread keeps removing and adding every other range.  A lookup must",
+    "return the range holding the row, and must always find the ranges",
+    "that are never removed.  Needs a running system, since the ranges",
+    "look up their cell stores in METADATA.",
+    0
+  };
+
+  const char *schema_str =
+    "<Schema>\n"
+    "  <AccessGroup name=\"default\">\n"
+    "    <ColumnFamily>\n"
+    "      <Name>a</Name>\n"
+    "    </ColumnFamily>\n"
+    "  </AccessGroup>\n"
+    "</Schema>";
+
+  /** Table id that no table of the system uses */
+  const uint32_t TABLE_ID = 0x7ffffff1;
+
+  const size_t RANGES = 64;
+  const size_t ROWS_PER_RANGE = 16;
+  const size_t READERS = 4;
+  const size_t ROUNDS = 500;
+
+  String row_name(size_t i) {
+    return format("row-%04d", (int)i);
+  }
+
+  /**
+   * State shared by the writer and the lookup threads
+   */
+  class TestState {
+  public:
+    TestState() : done(false), errors(0), lookups(0) { }
+
+    void error(const String &msg) {
+      ScopedLock lock(mutex);
+      if (errors++ < 10)
+        cout << msg << endl;
+    }
+
+    TableInfoPtr     table_info_ptr;
+    vector<RangePtr> ranges;
+    vector<String>   start_rows;
+    vector<String>   end_rows;
+    Mutex            mutex;
+    volatile bool    done;
+    size_t           errors;
+    size_t           lookups;
+  };
+
+  /**
+   * Removes the odd ranges and adds them back, refreshing the ranges in
+   * between, until the rounds are done
+   */
+  class Writer {
+  public:
+    Writer(TestState &state) : m_state(state) { }
+
+    void operator()() {
+      RangePtr range_ptr;
+
+      for (size_t round=0; round<ROUNDS && !m_state.errors; round++) {
+        for (size_t i=1; i<RANGES; i+=2) {
+          RangeSpec range(m_state.start_rows[i].c_str(),
+                          m_state.end_rows[i].c_str());
+          if (!m_state.table_info_ptr->remove_range(&range, range_ptr) ||
+              range_ptr.get() != m_state.ranges[i].get())
+            m_state.error(format("unable to remove range %d", (int)i));
+        }
+        m_state.table_info_ptr->refresh_ranges();
+        for (size_t i=1; i<RANGES; i+=2)
+          m_state.table_info_ptr->add_range(m_state.ranges[i]);
+      }
+      m_state.done = true;
+    }
+
+  private:
+    TestState &m_state;
+  };
+
+  class Reader {
+  public:
+    Reader(TestState &state) : m_state(state) { }
+
+    void operator()() {
+      RangePtr range_ptr;
+      size_t lookups = 0;
+
+      while (!m_state.done && !m_state.errors) {
+        size_t n = random() % (RANGES * ROWS_PER_RANGE);
+        size_t expected = n / ROWS_PER_RANGE;
+        String row = row_name(n);
+
+        // the last row of a range is its end row
+        if (n % ROWS_PER_RANGE == 0 && n > 0)
+          expected--;
+
+        if (m_state.table_info_ptr->find_containing_range(row, range_ptr)) {
+          if (range_ptr.get() != m_state.ranges[expected].get())
+            m_state.error(format("row %s found in %s", row.c_str(),
+                                 range_ptr->get_name().c_str()));
+        }
+        else if (expected % 2 == 0)
+          m_state.error(format("row %s not found", row.c_str()));
+
+        RangeSpec range(m_state.start_rows[expected & ~1].c_str(),
+                        m_state.end_rows[expected & ~1].c_str());
+        if (!m_state.table_info_ptr->get_range(&range, range_ptr) ||
+            range_ptr.get() != m_state.ranges[expected & ~1].get())
+          m_state.error(format("range %d not found", (int)(expected & ~1)));
+
+        lookups++;
+      }
+
+      ScopedLock lock(m_state.mutex);
+      m_state.lookups += lookups;
+    }
+
+  private:
+    TestState &m_state;
+  };
+
+  bool test_concurrent_lookups() {
+    SchemaPtr schema_ptr = Schema::new_instance(schema_str, strlen(schema_str));
+    MasterClientPtr master_client_ptr;
+    TableIdentifier table_id;
+    TestState state;
+    boost::thread_group threads;
+
+    HT_EXPECT(schema_ptr->is_valid(), Error::FAILED_EXPECTATION);
+    schema_ptr->assign_ids();
+
+    table_id.name = "TableInfoTest";
+    table_id.id = TABLE_ID;
+    table_id.generation = 1;
+
+    state.table_info_ptr = new TableInfo(master_client_ptr, &table_id,
+                                         schema_ptr);
+
+    for (size_t i=0; i<RANGES; i++) {
+      state.start_rows.push_back(i ? row_name(i * ROWS_PER_RANGE) : "");
+      state.end_rows.push_back((i < RANGES - 1) ?
+          row_name((i + 1) * ROWS_PER_RANGE) : Key::END_ROW_MARKER);
+      RangeSpec range(state.start_rows[i].c_str(), state.end_rows[i].c_str());
+      RangeState range_state;
+      state.ranges.push_back(new Range(master_client_ptr, &table_id,
+                                       schema_ptr, &range, &range_state));
+      state.table_info_ptr->add_range(state.ranges[i]);
+    }
+
+    for (size_t i=0; i<READERS; i++)
+      threads.create_thread(Reader(state));
+    threads.create_thread(Writer(state));
+    threads.join_all();
+
+    if (state.errors)
+      return false;
+
+    cout << state.lookups << " concurrent lookups" << endl;
+    return true;
+  }
+
+}
+
+
+int main(int argc, char **argv) {
+  Client *hypertable;
+  unsigned long seed = 1234;
+
+  if (argc > 2 ||
+      (argc == 2 && (!strcmp(argv[1], "--help") || !strcmp(argv[1], "-?"))))
+    Usage::dump_and_exit(usage);
+
+  if (argc == 2)
+    seed = atoi(argv[1]);
+
+  cout << "SEED: " << seed << endl;
+
+  srandom(seed);
+
+  hypertable = new Client(argv[0], "./hypertable.cfg");
+
+  try {
+    Global::metadata_table_ptr = hypertable->open_table("METADATA");
+
+    if (!test_concurrent_lookups())
+      return 1;
+  }
+  catch (Exception &e) {
+    HT_ERROR_OUT << e << HT_END;
+    return 1;
+  }
+
+  return 0;
+}
@@ -61,6 +61,7 @@ public class Error {
     static public final int COMM_RECEIVE_ERROR       = 0x00010007;
     static public final int COMM_POLL_ERROR          = 0x00010008;
     static public final int COMM_CONFLICTING_ADDRESS = 0x00010009;
+    static public final int COMM_SOCKET_ERROR        = 0x0001000A;
 
     static public final int DFSBROKER_BAD_FILE_HANDLE   = 0x00020001;
     static public final int DFSBROKER_IO_ERROR          = 0x00020002;
@@ -109,6 +110,7 @@ public class Error {
     static public final int RANGESERVER_TIMESTAMP_ORDER_ERROR  = 0x00050010;
     static public final int RANGESERVER_ROW_OVERFLOW           = 0x00050011;
     static public final int RANGESERVER_TABLE_NOT_FOUND        = 0x00050012;
+    static public final int RANGESERVER_BAD_SCAN_SPEC          = 0x00050013;
 
     static public final int HQL_BAD_LOAD_FILE_FORMAT = 0x00060001;
 
@@ -196,6 +198,7 @@ public class Error {
         mTextMap.put(RANGESERVER_TIMESTAMP_ORDER_ERROR, "RANGE SERVER supplied timestamp is not strictly increasing");
         mTextMap.put(RANGESERVER_ROW_OVERFLOW,          "RANGE SERVER row overflow");
         mTextMap.put(RANGESERVER_TABLE_NOT_FOUND,       "RANGE SERVER table not found");
+        mTextMap.put(RANGESERVER_BAD_SCAN_SPEC,         "RANGE SERVER bad scan specification");
         mTextMap.put(HQL_BAD_LOAD_FILE_FORMAT,    "HQL bad load file format");
     }
 }